@@ -1,70 +1,190 @@
 #include "ArpaLanguageModel.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <QFile>
 #include "PhoneticService.h"
 #include "LangStat.h"
+#include "ParallelUtils.h"
 #include "assertImpl.h"
 #include <boost/format.hpp>
 
 namespace PticaGovorun
 {
-	const double LogProbMinusInf = -99; // Interpreted as log(0)
-
 	auto assertLeftBackOffImpossible = []() {};
 
-	auto NGramRow::partsCount() const -> int
+	// assume that processed text covers P portion of the whole language (0..1)
+	static const float TextStatisticCover = 0.8;
+	//static const float TextStatisticCover = 1;
+
+	size_t ArpaUnigramTable::size() const
 	{
-		return WordParts.ActualSize;
+		return WordParts.size();
 	}
 
-	auto NGramRow::part(int partInd) const -> const WordPart*
+	size_t ArpaBigramTable::size() const
 	{
-		return WordParts.Array[partInd];
+		return NextUnigramInd.size();
 	}
 
-	ArpaLanguageModel::ArpaLanguageModel(int gramMaxDimensions) : gramMaxDimensions_(gramMaxDimensions)
+	size_t ArpaBigramTable::historyBegin(size_t historyUnigramInd) const
+	{
+		return HistoryOffset[historyUnigramInd];
+	}
+
+	size_t ArpaBigramTable::historyEnd(size_t historyUnigramInd) const
 	{
+		return HistoryOffset[historyUnigramInd + 1];
 	}
 
-	void ArpaLanguageModel::buildBigramsWordPartsAware(const UkrainianPhoneticSplitter& phoneticSplitter)
+	void buildArpaBigramTable(size_t unigramsCount, const std::vector<ArpaBigramCount>& bigramCounts, int threadsCount, ArpaBigramTable& bigrams)
 	{
+		PG_Assert2(bigramCounts.size() <= std::numeric_limits<std::uint32_t>::max(), "Too many bigrams");
+
+		// counting sort by history
+		bigrams.HistoryOffset.assign(unigramsCount + 1, 0);
+		for (const ArpaBigramCount& count : bigramCounts)
+		{
+			PG_Assert(count.HistoryUnigramInd >= 0 && (size_t)count.HistoryUnigramInd < unigramsCount);
+			PG_Assert(count.NextUnigramInd >= 0 && (size_t)count.NextUnigramInd < unigramsCount);
+			bigrams.HistoryOffset[count.HistoryUnigramInd + 1] += 1;
+		}
+		for (size_t uniInd = 0; uniInd < unigramsCount; ++uniInd)
+			bigrams.HistoryOffset[uniInd + 1] += bigrams.HistoryOffset[uniInd];
+
+		bigrams.NextUnigramInd.resize(bigramCounts.size());
+		bigrams.UsageCounter.resize(bigramCounts.size());
+		bigrams.LogProb.assign(bigramCounts.size(), ArpaLogProbMinusInf);
+
+		std::vector<std::uint32_t> historyCursor(bigrams.HistoryOffset.begin(), bigrams.HistoryOffset.end() - 1);
+		for (const ArpaBigramCount& count : bigramCounts)
+		{
+			std::uint32_t bigramInd = historyCursor[count.HistoryUnigramInd]++;
+			bigrams.NextUnigramInd[bigramInd] = count.NextUnigramInd;
+			bigrams.UsageCounter[bigramInd] = count.UsageCounter;
+		}
+
 		// note, the order of bigrams must be the same as for unigrams
+		parallelFor(unigramsCount, threadsCount, [&bigrams](size_t uniInd, int threadInd)
+		{
+			size_t beg = bigrams.historyBegin(uniInd);
+			size_t end = bigrams.historyEnd(uniInd);
+			if (end - beg < 2)
+				return;
+
+			std::vector<std::pair<std::int32_t, std::int64_t>> history;
+			history.reserve(end - beg);
+			for (size_t i = beg; i < end; ++i)
+				history.push_back(std::make_pair(bigrams.NextUnigramInd[i], bigrams.UsageCounter[i]));
+			std::sort(history.begin(), history.end());
+
+			for (size_t i = beg; i < end; ++i)
+			{
+				PG_Assert2(i == beg || bigrams.NextUnigramInd[i - 1] != history[i - beg].first, "Bigrams must be unique");
+				bigrams.NextUnigramInd[i] = history[i - beg].first;
+				bigrams.UsageCounter[i] = history[i - beg].second;
+			}
+		});
+	}
+
+	void normalizeArpaBigrams(wv::slice<const double> historyLogScale, int threadsCount, ArpaUnigramTable& unigrams, ArpaBigramTable& bigrams)
+	{
+		PG_Assert(historyLogScale.size() == unigrams.size());
+		PG_Assert(bigrams.HistoryOffset.size() == unigrams.size() + 1);
+
+		unigrams.HistoryCounter.assign(unigrams.size(), 0);
+		bigrams.LogProb.resize(bigrams.size());
+
+		// each history writes only its own counter and its own range of bigrams
+		parallelFor(unigrams.size(), threadsCount, [&](size_t uniInd, int threadInd)
+		{
+			size_t beg = bigrams.historyBegin(uniInd);
+			size_t end = bigrams.historyEnd(uniInd);
+
+			std::int64_t historyCounter = 0;
+			for (size_t i = beg; i < end; ++i)
+				historyCounter += bigrams.UsageCounter[i];
+			unigrams.HistoryCounter[uniInd] = historyCounter;
+
+			// prob=usage/historyCounter*10^scale is computed as a difference of logarithms, to not lose small probabilities
+			double logNorm = historyCounter > 0 ? std::log10((double)historyCounter) - historyLogScale[uniInd] : 0;
+			for (size_t i = beg; i < end; ++i)
+			{
+				std::int64_t usage = bigrams.UsageCounter[i];
+				bigrams.LogProb[i] = usage > 0 ? std::log10((double)usage) - logNorm : ArpaLogProbMinusInf;
+			}
+		});
+	}
+
+	double log10SumPow10(wv::slice<const double> logProbs)
+	{
+		double maxLogProb = ArpaLogProbMinusInf;
+		for (double logProb : logProbs)
+			maxLogProb = std::max(maxLogProb, logProb);
+		if (maxLogProb <= ArpaLogProbMinusInf)
+			return ArpaLogProbMinusInf;
+
+		// the largest term is 1, hence there is no underflow of the sum
+		double sum = 0;
+		for (double logProb : logProbs)
+		{
+			if (logProb > ArpaLogProbMinusInf)
+				sum += std::pow(10.0, logProb - maxLogProb);
+		}
+		return maxLogProb + std::log10(sum);
+	}
+
+	ArpaLanguageModel::ArpaLanguageModel(int gramMaxDimensions) : gramMaxDimensions_(gramMaxDimensions)
+	{
+	}
 
+	void ArpaLanguageModel::buildBigramsWordPartsAware(const UkrainianPhoneticSplitter& phoneticSplitter, int threadsCount)
+	{
 		const WordsUsageInfo& wordUsage = phoneticSplitter.wordUsage();
-		bigrams_.reserve(unigrams_.size());
+		const WordPart* sentStart = phoneticSplitter.sentStartWordPart();
+		const WordPart* sentEnd = phoneticSplitter.sentEndWordPart();
+
+		size_t unigramsCount = unigrams_.size();
+		threadsCount = parallelThreadsCount(unigramsCount, threadsCount);
+		std::vector<std::vector<ArpaBigramCount>> threadBigrams(threadsCount);
 
-		size_t progressBigramStepSize = unigrams_.size() / 10;
-		for (size_t uniIndex1 = 0; uniIndex1 < unigrams_.size(); ++uniIndex1)
+		// histories are independent; the order of bigrams is restored by buildArpaBigramTable
+		parallelFor(unigramsCount, threadsCount, [&](size_t uniIndex1, int threadInd)
 		{
-			if (uniIndex1 % progressBigramStepSize == 0)
-				std::wcout << L"progress bigram uniIndex1=" << uniIndex1 / unigrams_.size() << std::endl;
+			std::vector<ArpaBigramCount>& bigramCounts = threadBigrams[threadInd];
+			const WordPart* part1 = unigrams_.WordParts[uniIndex1];
 
-			NGramRow& uni1 = *unigrams_[uniIndex1];
+			auto pushBigram = [&bigramCounts, uniIndex1](size_t uniIndex2, std::int64_t usage)
+			{
+				ArpaBigramCount count;
+				count.HistoryUnigramInd = (std::int32_t)uniIndex1;
+				count.NextUnigramInd = (std::int32_t)uniIndex2;
+				count.UsageCounter = usage;
+				bigramCounts.push_back(count);
+			};
+			auto seqUsage = [&wordUsage, part1](const WordPart* part2) -> std::int64_t
+			{
+				WordSeqKey seqKey({ part1->id(), part2->id() });
+				return wordUsage.getWordSequenceUsage(seqKey);
+			};
 
-			for (size_t uniIndex2 = 0; uniIndex2 < unigrams_.size(); ++uniIndex2)
+			for (size_t uniIndex2 = 0; uniIndex2 < unigramsCount; ++uniIndex2)
 			{
 				// assert: case uniIndex1 == uniIndex2 is allowed
 				// (word1,word1) combinations is necessary to exclude impossible combination of word parts, eg (~R,~R)
 
-				const NGramRow& uni2 = *unigrams_[uniIndex2];
+				const WordPart* part2 = unigrams_.WordParts[uniIndex2];
 
 				// bigram (<s>,~Right) is impossible; handled via back off
-				if (uni1.WordParts.Array[0] == phoneticSplitter.sentStartWordPart() &&
-					uni2.WordParts.Array[0]->partSide() == WordPartSide::RightPart)
+				// as <s> is ordinary word, all possible bigrams must be discarded by enumeration
+				if (part1 == sentStart && part2->partSide() == WordPartSide::RightPart)
 				{
-					// as <s> is ordinary word, all possible bigrams must be discarded by enumeration
-					NGramRow bigram;
-					bigram.LowOrderNGram = &uni1;
-					bigram.WordParts.ActualSize = 2;
-					bigram.WordParts.Array[0] = uni1.WordParts.Array[0];
-					bigram.WordParts.Array[1] = uni2.WordParts.Array[0];
-					bigram.LogProb = LogProbMinusInf;
-					bigrams_.push_back(bigram);
+					pushBigram(uniIndex2, 0);
 					continue;
 				}
 				// bigram (Left~,</s>) is impossible; handled via back off
-				if (uni1.WordParts.Array[0]->partSide() == WordPartSide::LeftPart &&
-					uni2.WordParts.Array[0] == phoneticSplitter.sentEndWordPart())
+				if (part1->partSide() == WordPartSide::LeftPart && part2 == sentEnd)
 				{
 					assertLeftBackOffImpossible();
 					continue;
@@ -72,153 +192,82 @@ namespace PticaGovorun
 
 				// specific case to discard (</s>,*)
 				// (</s>,<s>) is ok
-				if (uni1.WordParts.Array[0] == phoneticSplitter.sentEndWordPart())
+				if (part1 == sentEnd)
 				{
-					if (uni2.WordParts.Array[0] == phoneticSplitter.sentStartWordPart())
-					{
-						WordSeqKey seqKey({ uni1.WordParts.Array[0]->id(), uni2.WordParts.Array[0]->id() });
-						long seqUsage = wordUsage.getWordSequenceUsage(seqKey);
-
-						uni1.UsageCounter += seqUsage;
-
-						NGramRow bigram;
-						bigram.LowOrderNGram = &uni1;
-						bigram.WordParts.ActualSize = 2;
-						bigram.WordParts.Array[0] = uni1.WordParts.Array[0];
-						bigram.WordParts.Array[1] = uni2.WordParts.Array[0];
-						bigram.UsageCounter = seqUsage;
-						bigrams_.push_back(bigram);
-					}
+					if (part2 == sentStart)
+						pushBigram(uniIndex2, seqUsage(part2));
 
 					// bigram (</s>,*) is not possible
 					continue;
 				}
 
 				//
-				if (uni1.WordParts.Array[0]->partSide() == WordPartSide::LeftPart)
+				if (part1->partSide() == WordPartSide::LeftPart)
 				{
 					// 2nd: Left or Whole are handled via back off probability
-					if (uni2.WordParts.Array[0]->partSide() == WordPartSide::RightPart)
-					{
-						NGramRow bigram;
-						bigram.LowOrderNGram = &uni1;
-						bigram.WordParts.ActualSize = 2;
-						bigram.WordParts.Array[0] = uni1.WordParts.Array[0];
-						bigram.WordParts.Array[1] = uni2.WordParts.Array[0];
-
-						WordSeqKey seqKey({ uni1.WordParts.Array[0]->id(), uni2.WordParts.Array[0]->id() });
-						long seqUsage = wordUsage.getWordSequenceUsage(seqKey);
-						if (seqUsage > 0)
-						{
-							uni1.UsageCounter += seqUsage;
-							bigram.UsageCounter = seqUsage;
-						}
-						else
-						{
-							// prohibit impossible bigram (L~,~R) by enumeration
-							bigram.LogProb = LogProbMinusInf;
-						}
-						bigrams_.push_back(bigram);
-					}
+					// zero usage prohibits impossible bigram (L~,~R) by enumeration
+					if (part2->partSide() == WordPartSide::RightPart)
+						pushBigram(uniIndex2, seqUsage(part2));
 				}
-				else if (uni1.WordParts.Array[0]->partSide() == WordPartSide::RightPart ||
-					uni1.WordParts.Array[0]->partSide() == WordPartSide::WholeWord)
+				else if (part1->partSide() == WordPartSide::RightPart ||
+					part1->partSide() == WordPartSide::WholeWord)
 				{
-					if (uni2.WordParts.Array[0]->partSide() == WordPartSide::RightPart)
+					if (part2->partSide() == WordPartSide::RightPart)
 					{
 						// prohibit such case
-						NGramRow bigram;
-						bigram.LowOrderNGram = &uni1;
-						bigram.WordParts.ActualSize = 2;
-						bigram.WordParts.Array[0] = uni1.WordParts.Array[0];
-						bigram.WordParts.Array[1] = uni2.WordParts.Array[0];
-						bigram.LogProb = LogProbMinusInf;
-						bigrams_.push_back(bigram);
+						pushBigram(uniIndex2, 0);
 					}
-					else if (uni2.WordParts.Array[0]->partSide() == WordPartSide::LeftPart ||
-						uni2.WordParts.Array[0]->partSide() == WordPartSide::WholeWord)
+					else if (part2->partSide() == WordPartSide::LeftPart ||
+						part2->partSide() == WordPartSide::WholeWord)
 					{
-						WordSeqKey seqKey({ uni1.WordParts.Array[0]->id(), uni2.WordParts.Array[0]->id() });
-						long seqUsage = wordUsage.getWordSequenceUsage(seqKey);
-						if (seqUsage > 0)
-						{
-							uni1.UsageCounter += seqUsage;
-
-							NGramRow bigram;
-							bigram.LowOrderNGram = &uni1;
-							bigram.WordParts.ActualSize = 2;
-							bigram.WordParts.Array[0] = uni1.WordParts.Array[0];
-							bigram.WordParts.Array[1] = uni2.WordParts.Array[0];
-							bigram.UsageCounter = seqUsage;
-							bigrams_.push_back(bigram);
-						}
+						std::int64_t usage = seqUsage(part2);
+						if (usage > 0)
+							pushBigram(uniIndex2, usage);
 					}
 				}
 			}
-		}
+		});
+
+		std::vector<ArpaBigramCount> bigramCounts;
+		for (const std::vector<ArpaBigramCount>& counts : threadBigrams)
+			bigramCounts.insert(bigramCounts.end(), counts.begin(), counts.end());
+		buildArpaBigramTable(unigramsCount, bigramCounts, threadsCount, bigrams_);
 	}
 
-	void ArpaLanguageModel::buildBigramsWholeWordsOnly(const UkrainianPhoneticSplitter& phoneticSplitter)
+	void ArpaLanguageModel::buildBigramsWholeWordsOnly(const UkrainianPhoneticSplitter& phoneticSplitter, int threadsCount)
 	{
 		const WordsUsageInfo& wordUsage = phoneticSplitter.wordUsage();
-		bigrams_.reserve(wordUsage.wordSeqCount());
 
 		std::vector<const WordSeqUsage*> wordSeqUsages;
 		wordUsage.copyWordSeq(wordSeqUsages);
+
+		std::vector<ArpaBigramCount> bigramCounts;
+		bigramCounts.reserve(wordSeqUsages.size());
 		for (const WordSeqUsage* seqUsage : wordSeqUsages)
 		{
 			if (seqUsage->Key.PartCount != 2) // 2=bigram
 				continue;
 
-			int wordPart1Id = seqUsage->Key.PartIds[0];
-			int wordPart2Id = seqUsage->Key.PartIds[1];
-
 			// two word statistic must map to existent unigrams
-			NGramRow* pUni1 = getUnigramFromWordPartId(wordPart1Id);
-			if (pUni1 == nullptr)
+			int uniInd1 = unigramIndex(seqUsage->Key.PartIds[0]);
+			if (uniInd1 == -1)
 				continue;
-			NGramRow* pUni2 = getUnigramFromWordPartId(wordPart2Id);
-			if (pUni2 == nullptr)
+			int uniInd2 = unigramIndex(seqUsage->Key.PartIds[1]);
+			if (uniInd2 == -1)
 				continue;
 
-			pUni1->UsageCounter += seqUsage->UsedCount; // TODO: ???
-
-			const WordPart* wordPart1 = wordUsage.wordPartById(wordPart1Id);
-			PG_Assert(wordPart1 != nullptr);
-
-			const WordPart* wordPart2 = wordUsage.wordPartById(wordPart2Id);
-			PG_Assert(wordPart2 != nullptr);
-
-			NGramRow bigram;
-			bigram.LowOrderNGram = pUni1;
-			bigram.WordParts.ActualSize = 2;
-			bigram.WordParts.Array[0] = wordPart1;
-			bigram.WordParts.Array[1] = wordPart2;
-			bigram.UsageCounter = seqUsage->UsedCount;
-			bigrams_.push_back(bigram);
+			ArpaBigramCount count;
+			count.HistoryUnigramInd = uniInd1;
+			count.NextUnigramInd = uniInd2;
+			count.UsageCounter = seqUsage->UsedCount;
+			bigramCounts.push_back(count);
 		}
 
-		// note, the order of bigrams must be the same as for unigrams
-		std::sort(bigrams_.begin(), bigrams_.end(), [this](const NGramRow& a, const NGramRow& b)
-		{
-			if (a.LowOrderNGram->Order != b.LowOrderNGram->Order)
-				return a.LowOrderNGram->Order < b.LowOrderNGram->Order;
-
-			// compare by next word part
-			int wordPart1Id = a.WordParts.Array[1]->id();
-			int wordPart2Id = b.WordParts.Array[1]->id();
-
-			NGramRow* pUni1 = getUnigramFromWordPartId(wordPart1Id);
-			PG_Assert(pUni1 != nullptr);
-			NGramRow* pUni2 = getUnigramFromWordPartId(wordPart2Id);
-			PG_Assert(pUni2 != nullptr);
-
-			return pUni1->Order < pUni2->Order;
-		});
+		buildArpaBigramTable(unigrams_.size(), bigramCounts, threadsCount, bigrams_);
 	}
 
 	void ArpaLanguageModel::generate(const std::vector<PhoneticWord>& seedWords, const std::map<int, ptrdiff_t>& wordPartIdUsage, 
-		const UkrainianPhoneticSplitter& phoneticSplitter)
+		const UkrainianPhoneticSplitter& phoneticSplitter, int threadsCount)
 	{
 		// .arpa must have <s> and </s> words; to know how a sentence starts and ends
 		{
@@ -230,163 +279,125 @@ namespace PticaGovorun
 
 		const WordsUsageInfo& wordUsage = phoneticSplitter.wordUsage();
 
-		// calculate total usage of unigrams
-		ptrdiff_t unigramTotalUsageCounter = wordsTotalUsage(wordUsage, seedWords, &wordPartIdUsage);
-
-		// assume that processed text covers P portion of the whole language (0..1)
-		static const float TextStatisticCover = 0.8;
-		//static const float TextStatisticCover = 1;
-		static const float NewWordProb = 0.1;
-
 		// create unigrams
 
-		unigrams_.reserve(seedWords.size());
-		int unigramOrder = 0;
-		std::map<int, const WordPart*> q;
-		for (const PhoneticWord word : seedWords)
+		size_t unigramsCount = seedWords.size();
+		unigrams_ = ArpaUnigramTable();
+		unigrams_.WordParts.resize(unigramsCount);
+		unigrams_.UsageCounter.resize(unigramsCount);
+		unigrams_.LogProb.resize(unigramsCount);
+		parallelFor(unigramsCount, threadsCount, [&](size_t uniInd, int threadInd)
 		{
+			const PhoneticWord& word = seedWords[uniInd];
 			const WordPart* wordPart = wordUsage.wordPartByValue(toStdWString(word.Word), WordPartSide::WholeWord);
 			PG_Assert2(wordPart != nullptr, QString("word=%1").arg(toQString(word.Word)).toStdWString().c_str());
 
-			const WordPart* part = nullptr;
-			auto it = q.find(wordPart->id());
-			if (it != std::end(q))
-			{
-				part = it->second;
-			}
-			q[wordPart->id()] = wordPart;
+			unigrams_.WordParts[uniInd] = wordPart;
+			unigrams_.UsageCounter[uniInd] = wordUsageOneSource(wordPart->id(), wordUsage, &wordPartIdUsage);
+		});
 
-			auto seqUsage = wordUsageOneSource(wordPart->id(), wordUsage, &wordPartIdUsage);
+		// calculate total usage of unigrams
+		std::int64_t unigramTotalUsageCounter = 0;
+		wordPartIdToUnigramInd_.clear();
+		for (size_t uniInd = 0; uniInd < unigramsCount; ++uniInd)
+		{
+			unigramTotalUsageCounter += unigrams_.UsageCounter[uniInd];
+			wordPartIdToUnigramInd_.insert({ unigrams_.WordParts[uniInd]->id(), (int)uniInd });
+		}
 
-			double prob = seqUsage / (double)unigramTotalUsageCounter;
-			PG_Assert2(prob > 0 && prob <= 1, QString("word=%1").arg(toQString(word.Word)).toStdWString().c_str());
-			double logProb = std::log10(prob);
+		double logTotalUsage = std::log10((double)unigramTotalUsageCounter);
+		parallelFor(unigramsCount, threadsCount, [&](size_t uniInd, int threadInd)
+		{
+			std::int64_t usage = unigrams_.UsageCounter[uniInd];
+			PG_Assert2(usage > 0 && usage <= unigramTotalUsageCounter, QString("word=%1").arg(toQString(seedWords[uniInd].Word)).toStdWString().c_str());
 
 			// attempt to block isolated right parts
 			// bad, sentences become shorter even more
 			//if (wordPart->partSide() == WordPartSide::RightPart)
-			//	logProb = LogProbMinusInf; 
-
-			auto gram = std::make_unique<NGramRow>();
-			gram->Order = unigramOrder++;
-			gram->WordParts.ActualSize = 1;
-			gram->WordParts.Array[0] = wordPart;
-			gram->LogProb = logProb;
-			wordPartIdToUnigram_.insert({ wordPart->id(), gram.get() }); // assert gram != null
-			unigrams_.push_back(std::move(gram));
-		}
+			//	logProb = ArpaLogProbMinusInf; 
+
+			unigrams_.LogProb[uniInd] = std::log10((double)usage) - logTotalUsage;
+		});
 
+		bigrams_ = ArpaBigramTable();
 		if (gramMaxDimensions_ == 1)
+		{
+			checkTotalProbOne(threadsCount);
 			return;
+		}
 
 		// TODO: merge this two routines
-		//buildBigramsWordPartsAware(phoneticSplitter);
-		buildBigramsWholeWordsOnly(phoneticSplitter);
+		//buildBigramsWordPartsAware(phoneticSplitter, threadsCount);
+		buildBigramsWholeWordsOnly(phoneticSplitter, threadsCount);
 
-		// set backoff probabilities
-		for (std::unique_ptr<NGramRow>& uniPtr : unigrams_)
+		// set backoff probabilities and the portion of probability, which is given to bigrams of each history
+		unigrams_.BackOffLogProb.resize(unigramsCount);
+		std::vector<double> historyLogScale(unigramsCount);
+		parallelFor(unigramsCount, threadsCount, [&](size_t uniInd, int threadInd)
 		{
-			NGramRow& uni = *uniPtr;
-			PG_Assert(uni.WordParts.ActualSize == 1);
+			const WordPart* part = unigrams_.WordParts[uniInd];
 			// unigram (<s>)
-			if (uni.WordParts.Array[0] == phoneticSplitter.sentStartWordPart())
+			if (part == phoneticSplitter.sentStartWordPart())
 			{
-				//uni.LogProb = LogProbMinusInf; // start the new sentence the latest (the lowest priority)
-
 				//double backOff = 0; // the first word of a sentence may be any word, not just specified one
 				// double backOff = 1.4124; // from CMU LM for English
-				double backOff = std::log10(1 - TextStatisticCover);
-				uni.BackOffLogProb = backOff;
-				continue;
+				unigrams_.BackOffLogProb[uniInd] = std::log10(1.0 - TextStatisticCover);
+				historyLogScale[uniInd] = std::log10((double)TextStatisticCover);
+				return;
 			}
-			// unigram (</s>)
-			//if (uni.WordParts.Array[0] == phoneticSplitter.sentEndWordPart())
-			//{
-			//	// this back off value is ignored if there is no (</s>, *) bigram
-			//	uni.BackOffLogProb = 0; // all prob are in this case
-			//	//uni.BackOffLogProb = LogProbMinusInf; // all prob are described in bigrams
-			//	continue;
-			//}
-
-			if (uni.WordParts.Array[0]->partSide() == WordPartSide::LeftPart)
+
+			if (part->partSide() == WordPartSide::LeftPart)
 			{
 				// only right part can go after left part; other cases must be prohibited
 				assertLeftBackOffImpossible();
-				uni.BackOffLogProb = LogProbMinusInf;
+				unigrams_.BackOffLogProb[uniInd] = ArpaLogProbMinusInf;
+
+				// Everything is concentrated in the (L~,~R) pairs; backOff(L~)=-99
+				// This way we prohibit (L~,~R) words, which are not enumerated - which is bad.
+				// But we also prohibit (L~,L~) or (L~,W) - which is good.
+				// Do not change probability!
+				historyLogScale[uniInd] = 0;
 			}
-			else if (uni.WordParts.Array[0]->partSide() == WordPartSide::RightPart ||
-				uni.WordParts.Array[0]->partSide() == WordPartSide::WholeWord)
+			else if (part->partSide() == WordPartSide::RightPart ||
+				part->partSide() == WordPartSide::WholeWord)
 			{
 				// allow any word composition if text statistic is not available for some word sequence
 				//uni.BackOffLogProb = 0; // prob=100%
-				uni.BackOffLogProb = std::log10(1 - TextStatisticCover);
+				unigrams_.BackOffLogProb[uniInd] = std::log10(1.0 - TextStatisticCover);
+
+				// backOff(uni1)=log(1-TextStatisticCover), so here we should reduce max probability to TextStatisticCover
+				historyLogScale[uniInd] = std::log10((double)TextStatisticCover);
 			}
 			else
 			{
-				PG_Assert(false);
-				if (uni.BackOffLogProb != boost::none)
-				{
-					// back off > 0 means eg. L~ ~R which do not match
-					//PG_Assert(gram.BackOffCounter == 0);
-				}
-				else
-				{
-					PG_Assert(uni.BackOffCounter > 0); // TODO:
-					int unigramTotalBackOffCounter = 10;
-					double prob = uni.BackOffCounter / (double)unigramTotalBackOffCounter;
-					prob *= (1 - TextStatisticCover);
-					PG_Assert(prob > 0);
-					double logProb = std::log10(prob);
-					uni.BackOffLogProb = logProb;
-				}
+				PG_Assert2(false, "Middle word parts are not supported");
 			}
-		}
-		for (NGramRow& gram : bigrams_)
-		{
-			PG_Assert(gram.WordParts.ActualSize == 2);
-			if (gram.LogProb == boost::none)
-			{
-				PG_Assert(gram.LowOrderNGram != nullptr);
-				double prob = gram.UsageCounter / (double)gram.LowOrderNGram->UsageCounter;
-
-				if (gram.WordParts.Array[0]->partSide() == WordPartSide::LeftPart)
-				{
-					// Everything is concentrated in the (L~,~R) pairs; backOff(L~)=-99
-					// This way we prohibit (L~,~R) words, which are not enumerated - which is bad.
-					// But we also prohibit (L~,L~) or (L~,W) - which is good.
-					// Do not change probability!
-				}
-				else if (gram.WordParts.Array[0]->partSide() == WordPartSide::RightPart ||
-					gram.WordParts.Array[0]->partSide() == WordPartSide::WholeWord)
-				{
-					// backOff(uni1)=log(1-TextStatisticCover), so here we should reduce max probability to TextStatisticCover
-					prob *= TextStatisticCover;
-				}
-				else if (gram.WordParts.Array[0] == phoneticSplitter.sentEndWordPart() ||
-					gram.WordParts.Array[0] == phoneticSplitter.sentStartWordPart())
-				{
+		});
 
-				}
-				PG_Assert(prob >= 0 && prob <= 1);
-				double logProb = std::log10(prob);
-				gram.LogProb = logProb;
-			}
-		}
+		normalizeArpaBigrams(historyLogScale, threadsCount, unigrams_, bigrams_);
 
-		checkUnigramTotalProbOne();
+		checkTotalProbOne(threadsCount);
 	}
 
-	void ArpaLanguageModel::checkUnigramTotalProbOne() const
+	void ArpaLanguageModel::checkTotalProbOne(int threadsCount) const
 	{
-		double totalProb = 0;
-		for (const auto& pUnigram : unigrams_)
+		static const double delta = 0.01;
+
+		double totalProb = std::pow(10.0, log10SumPow10(unigrams_.LogProb));
+		PG_Assert(totalProb > 1 - delta && totalProb < 1 + delta);
+
+		if (bigrams_.HistoryOffset.empty())
+			return;
+		parallelFor(unigrams_.size(), threadsCount, [this](size_t uniInd, int threadInd)
 		{
-			PG_Assert(pUnigram->LogProb != boost::none);
-			double prob = std::pow(10, pUnigram->LogProb.value());
-			totalProb += prob;
-		}
-		static const float delta = 0.01;
-		PG_Assert(totalProb > 1 - delta && totalProb < 1+delta)
+			size_t beg = bigrams_.historyBegin(uniInd);
+			size_t end = bigrams_.historyEnd(uniInd);
+			if (beg == end)
+				return;
+			const double* logProbs = bigrams_.LogProb.data();
+			double historyProb = std::pow(10.0, log10SumPow10(wv::slice<const double>(logProbs + beg, logProbs + end)));
+			PG_Assert(historyProb < 1 + delta);
+		});
 	}
 
 	size_t ArpaLanguageModel::ngramCount(int ngramDim) const
@@ -399,12 +410,12 @@ namespace PticaGovorun
 		return 0;
 	}
 
-	NGramRow* ArpaLanguageModel::getUnigramFromWordPartId(int wordPartId)
+	int ArpaLanguageModel::unigramIndex(int wordPartId) const
 	{
-		auto gramIt = wordPartIdToUnigram_.find(wordPartId);
-		if (gramIt != wordPartIdToUnigram_.end())
+		auto gramIt = wordPartIdToUnigramInd_.find(wordPartId);
+		if (gramIt != wordPartIdToUnigramInd_.end())
 			return gramIt->second;
-		return nullptr;
+		return -1;
 	}
 
 	void ArpaLanguageModel::setGramMaxDimensions(int value)
@@ -412,12 +423,12 @@ namespace PticaGovorun
 		gramMaxDimensions_ = value;
 	}
 
-	const std::vector<std::unique_ptr<NGramRow>>& ArpaLanguageModel::unigrams() const
+	const ArpaUnigramTable& ArpaLanguageModel::unigrams() const
 	{
 		return unigrams_;
 	}
 
-	const std::vector<NGramRow>& ArpaLanguageModel::bigrams() const
+	const ArpaBigramTable& ArpaLanguageModel::bigrams() const
 	{
 		return bigrams_;
 	}
@@ -436,44 +447,47 @@ namespace PticaGovorun
 		dumpFileStream << "ngram 1=" << langModel.ngramCount(1) << "\n";
 		dumpFileStream << "ngram 2=" << langModel.ngramCount(2) << "\n"; // +2 for sentence start/end
 
-		std::wstring wstrBuf;
-
-		auto printNGram = [&dumpFileStream, &wstrBuf](const NGramRow& gram)
+		auto printLogProb = [&dumpFileStream](double logProb)
 		{
 			dumpFileStream.setFieldWidth(6);
-			dumpFileStream << gram.LogProb.get();
+			dumpFileStream << logProb;
 			dumpFileStream.setFieldWidth(0);
 			dumpFileStream << " ";
-
-			for (int partInd = 0; partInd < gram.partsCount(); ++partInd)
-			{
-				const WordPart* oneWordPart = gram.part(partInd);
-				boost::wstring_view dispName = oneWordPart->partText();
-
-				dumpFileStream << toQString(dispName);
-				dumpFileStream << " ";
-			}
-
-			if (gram.BackOffLogProb != boost::none)
-			{
-				dumpFileStream.setFieldWidth(6);
-				dumpFileStream << gram.BackOffLogProb.get();
-				dumpFileStream.setFieldWidth(0);
-				dumpFileStream << " ";
-			}
-
-			dumpFileStream << "\n";
 		};
+		auto printWordPart = [&dumpFileStream](const WordPart* wordPart)
+		{
+			boost::wstring_view dispName = wordPart->partText();
+			dumpFileStream << toQString(dispName);
+			dumpFileStream << " ";
+		};
+
+		const ArpaUnigramTable& unigrams = langModel.unigrams();
+		bool hasBackOff = !unigrams.BackOffLogProb.empty();
 
 		dumpFileStream << "\n"; // blank line
 		dumpFileStream << "\\1-grams:" << "\n";
-		for (const std::unique_ptr<NGramRow>& gram : langModel.unigrams())
-			printNGram(*gram);
+		for (size_t uniInd = 0; uniInd < unigrams.size(); ++uniInd)
+		{
+			printLogProb(unigrams.LogProb[uniInd]);
+			printWordPart(unigrams.WordParts[uniInd]);
+			if (hasBackOff)
+				printLogProb(unigrams.BackOffLogProb[uniInd]);
+			dumpFileStream << "\n";
+		}
 
+		const ArpaBigramTable& bigrams = langModel.bigrams();
 		dumpFileStream << "\n"; // blank line
 		dumpFileStream << "\\2-grams:" << "\n";
-		for (const NGramRow& gram : langModel.bigrams())
-			printNGram(gram);
+		for (size_t uniInd = 0; uniInd + 1 < bigrams.HistoryOffset.size(); ++uniInd)
+		{
+			for (size_t i = bigrams.historyBegin(uniInd); i < bigrams.historyEnd(uniInd); ++i)
+			{
+				printLogProb(bigrams.LogProb[i]);
+				printWordPart(unigrams.WordParts[uniInd]);
+				printWordPart(unigrams.WordParts[bigrams.NextUnigramInd[i]]);
+				dumpFileStream << "\n";
+			}
+		}
 
 		dumpFileStream << "\n"; // blank line
 		dumpFileStream << R"out(\end\)out" << "\n";
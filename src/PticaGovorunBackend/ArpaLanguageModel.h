@@ -1,43 +1,69 @@
 #pragma once
-#include <memory>
+#include <cstdint>
 #include <vector>
 #include <unordered_map>
-#include <boost/optional.hpp>
+#include "ClnUtils.h"
 #include "LangStat.h"
 #include "PhoneticService.h"
 
 namespace PticaGovorun
 {
-	template <typename T, size_t FixedSize>
-	struct ShortArray
+	/// Unigrams of ARPA model as columns; the i-th element of each column describes the i-th unigram.
+	/// The order of unigrams is the order of rows in the output file.
+	struct PG_EXPORTS ArpaUnigramTable
 	{
-		std::array<T, FixedSize> Array;
-		size_t ActualSize;
+		std::vector<const WordPart*> WordParts;
+		std::vector<std::int64_t> UsageCounter; // usage of the word in the text
+		std::vector<std::int64_t> HistoryCounter; // total usage of bigrams, which start with the word
+		std::vector<double> LogProb; // log10
+		std::vector<double> BackOffLogProb; // log10; empty for unigram model
+
+		size_t size() const;
+	};
+
+	/// Bigrams of ARPA model as columns, grouped by the first word (history).
+	struct PG_EXPORTS ArpaBigramTable
+	{
+		std::vector<std::uint32_t> HistoryOffset; // bigrams of i-th unigram history are [HistoryOffset[i]; HistoryOffset[i+1])
+		std::vector<std::int32_t> NextUnigramInd; // the second word; ascending inside one history
+		std::vector<std::int64_t> UsageCounter; // 0 for bigrams, which are prohibited by enumeration
+		std::vector<double> LogProb; // log10
+
+		size_t size() const;
+		size_t historyBegin(size_t historyUnigramInd) const;
+		size_t historyEnd(size_t historyUnigramInd) const;
 	};
 
-	// The row (unigram or bigram) of ARPA model file.
-	struct PG_EXPORTS NGramRow
+	/// The bigram as collected from the text, before it is put in the table.
+	struct ArpaBigramCount
 	{
-		int Order = -1; // order of n-gram in the output file; bigrams must be in the order of corresponding unigrams
-		ShortArray<const WordPart*, 2> WordParts;
-		long UsageCounter = 0;
-		boost::optional<float> LogProb;
-		long BackOffCounter = 0;
-		boost::optional<float> BackOffLogProb;
-		NGramRow* LowOrderNGram = nullptr; // pointer to the one part shorter n-gram
-
-		auto partsCount() const -> int;
-		auto part(int partInd) const -> const WordPart*;
+		std::int32_t HistoryUnigramInd;
+		std::int32_t NextUnigramInd;
+		std::int64_t UsageCounter;
 	};
 
+	/// Interpreted as log(0).
+	const double ArpaLogProbMinusInf = -99;
+
+	/// Puts bigrams in the table, grouping them by history. The order of bigrams is the same as in the output file:
+	/// by history, then by the next word. Bigrams of each history are sorted on threadsCount threads.
+	PG_EXPORTS void buildArpaBigramTable(size_t unigramsCount, const std::vector<ArpaBigramCount>& bigramCounts, int threadsCount, ArpaBigramTable& bigrams);
+
+	/// Computes the total usage of each history and the probability of each bigram, multiplied by 10^historyLogScale[history].
+	/// Histories are processed in parallel.
+	PG_EXPORTS void normalizeArpaBigrams(wv::slice<const double> historyLogScale, int threadsCount, ArpaUnigramTable& unigrams, ArpaBigramTable& bigrams);
+
+	/// Computes log10(sum(10^logProb)) without loss of precision on small probabilities.
+	/// Values <= ArpaLogProbMinusInf are treated as zero probabilities.
+	PG_EXPORTS double log10SumPow10(wv::slice<const double> logProbs);
+
 	// Represents ARPA language model.
-	// Note: This class can't be dllexport-ed as a whole because it contains std::unique_ptr members
 	class PG_EXPORTS ArpaLanguageModel
 	{
 		int gramMaxDimensions_; // 1=create unigram model, 2=bigram
-		std::unordered_map<int, NGramRow*> wordPartIdToUnigram_;
-		std::vector<std::unique_ptr<NGramRow>> unigrams_;
-		std::vector<NGramRow> bigrams_;
+		std::unordered_map<int, int> wordPartIdToUnigramInd_;
+		ArpaUnigramTable unigrams_;
+		ArpaBigramTable bigrams_;
 	public:
 		ArpaLanguageModel(int gramMaxDimensions);
 		ArpaLanguageModel(const ArpaLanguageModel&) = delete;
@@ -50,20 +76,24 @@ namespace PticaGovorun
 		// LM must contain <s>, otherwise Sphinx emits error on samples decoding
 		// ERROR: "ngram_search.c", line 1157 : Couldn't find <s> in first frame
 		/// @wordPartIdUsage usage statistics of wordParts not covered by text corpus
-		void generate(const std::vector<PhoneticWord>& seedUnigrams, const std::map<int, ptrdiff_t>& wordPartIdToRecoveredUsage, const UkrainianPhoneticSplitter& phoneticSplitter);
+		/// @threadsCount the number of threads to process unigrams and histories; <=0 uses all hardware threads
+		void generate(const std::vector<PhoneticWord>& seedUnigrams, const std::map<int, ptrdiff_t>& wordPartIdToRecoveredUsage, const UkrainianPhoneticSplitter& phoneticSplitter,
+			int threadsCount = -1);
 
 		size_t ngramCount(int ngramDim) const;
-		NGramRow* getUnigramFromWordPartId(int wordPartId);
+
+		/// Returns the index of the unigram or -1.
+		int unigramIndex(int wordPartId) const;
 
 		void setGramMaxDimensions(int value);
-		const std::vector<std::unique_ptr<NGramRow>>& unigrams() const;
-		const std::vector<NGramRow>& bigrams() const;
+		const ArpaUnigramTable& unigrams() const;
+		const ArpaBigramTable& bigrams() const;
 	private:
-		void buildBigramsWholeWordsOnly(const UkrainianPhoneticSplitter& phoneticSplitter);
-		void buildBigramsWordPartsAware(const UkrainianPhoneticSplitter& phoneticSplitter);
+		void buildBigramsWholeWordsOnly(const UkrainianPhoneticSplitter& phoneticSplitter, int threadsCount);
+		void buildBigramsWordPartsAware(const UkrainianPhoneticSplitter& phoneticSplitter, int threadsCount);
 		
-		/// Check total probability of all unigrams = 1
-		void checkUnigramTotalProbOne() const;
+		/// Check total probability of all unigrams = 1 and of bigrams of each history <= 1
+		void checkTotalProbOne(int threadsCount) const;
 	};
 
 	PG_EXPORTS bool writeArpaLanguageModel(const ArpaLanguageModel& langModel, const boost::filesystem::path& lmFilePath, ErrMsgList* errMsg);
@@ -0,0 +1,370 @@
+#include "ArpaLanguageModelQuery.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <QFile>
+#include <boost/format.hpp>
+#include "ArpaLanguageModel.h"
+#include "CoreUtils.h"
+#include "ParallelUtils.h"
+#include "PhoneticService.h"
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	namespace
+	{
+		// Splits the line into tokens, separated by spaces or tabs.
+		void splitTokens(boost::string_view line, std::vector<boost::string_view>& tokens)
+		{
+			tokens.clear();
+			size_t pos = 0;
+			while (pos < line.size())
+			{
+				while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t'))
+					++pos;
+				size_t start = pos;
+				while (pos < line.size() && line[pos] != ' ' && line[pos] != '\t')
+					++pos;
+				if (pos > start)
+					tokens.push_back(line.substr(start, pos - start));
+			}
+		}
+
+		// Parses the number in C locale, regardless of the current locale.
+		bool parseFloat(boost::string_view token, float& value)
+		{
+			bool ok = false;
+			value = QByteArray::fromRawData(token.data(), (int)token.size()).toFloat(&ok);
+			return ok;
+		}
+	}
+
+	bool ArpaLanguageModelQuery::load(const boost::filesystem::path& lmFilePath, ErrMsgList* errMsg)
+	{
+		*this = ArpaLanguageModelQuery();
+
+		QFile file(toQStringBfs(lmFilePath));
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't open file (%1%)") % lmFilePath.string()));
+			return false;
+		}
+		QByteArray bytes = file.readAll();
+		boost::string_view text(bytes.constData(), bytes.size());
+
+		struct BigramRow
+		{
+			std::int32_t HistoryWordId;
+			std::int32_t NextWordId;
+			float LogProb;
+		};
+		std::vector<BigramRow> bigrams;
+		std::map<int, size_t> declaredCounts;
+
+		int section = -1; // -1=before \data\, 0=\data\, N=\N-grams:
+		std::vector<boost::string_view> tokens;
+		std::wstring wordBuf;
+		size_t lineNum = 0;
+		size_t pos = 0;
+		bool hasEnd = false;
+		while (pos < text.size() && !hasEnd)
+		{
+			size_t lineEnd = text.find('\n', pos);
+			if (lineEnd == boost::string_view::npos)
+				lineEnd = text.size();
+			boost::string_view line = text.substr(pos, lineEnd - pos);
+			pos = lineEnd + 1;
+			lineNum += 1;
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+
+			splitTokens(line, tokens);
+			if (tokens.empty())
+				continue;
+
+			auto lineError = [&](const char* msg) -> bool
+			{
+				pushErrorMsg(errMsg, str(boost::format("%1% in line %2% of ARPA file (%3%)") % msg % lineNum % lmFilePath.string()));
+				return false;
+			};
+
+			boost::string_view first = tokens.front();
+			if (first == "\\data\\")
+			{
+				section = 0;
+				continue;
+			}
+			if (first == "\\end\\")
+			{
+				hasEnd = true;
+				continue;
+			}
+			if (section == -1)
+				continue; // skip the text before the header
+
+			int ngramOrder = 0;
+			if (first.size() == 9 && first.starts_with("\\") && first.ends_with("-grams:") && first[1] >= '1' && first[1] <= '9')
+			{
+				ngramOrder = first[1] - '0';
+				if (ngramOrder > 2)
+					return lineError("Only unigram and bigram models are supported");
+				section = ngramOrder;
+				order_ = std::max(order_, ngramOrder);
+				continue;
+			}
+
+			if (section == 0)
+			{
+				// ngram N=C
+				if (first != "ngram" || tokens.size() != 2)
+					return lineError("Expected 'ngram N=count'");
+				boost::string_view decl = tokens[1];
+				size_t eqPos = decl.find('=');
+				if (eqPos == boost::string_view::npos)
+					return lineError("Expected 'ngram N=count'");
+				int declOrder = std::atoi(std::string(decl.data(), eqPos).c_str());
+				size_t declCount = std::strtoull(std::string(decl.data() + eqPos + 1, decl.size() - eqPos - 1).c_str(), nullptr, 10);
+				declaredCounts[declOrder] = declCount;
+				continue;
+			}
+
+			// logProb word1 .. wordN [backOff]
+			if (tokens.size() != (size_t)section + 1 && tokens.size() != (size_t)section + 2)
+				return lineError("Wrong number of n-gram fields");
+			float logProb;
+			if (!parseFloat(tokens[0], logProb))
+				return lineError("Can't parse log probability");
+			float backOff = 0;
+			if (tokens.size() == (size_t)section + 2 && !parseFloat(tokens.back(), backOff))
+				return lineError("Can't parse back-off weight");
+
+			if (section == 1)
+			{
+				utf8s2ws(tokens[1], wordBuf);
+				std::int32_t newWordId = (std::int32_t)words_.size();
+				if (!wordToId_.insert({ wordBuf, newWordId }).second)
+					return lineError("Duplicate unigram");
+				words_.push_back(wordBuf);
+				uniLogProb_.push_back(logProb);
+				uniBackOffLogProb_.push_back(backOff);
+			}
+			else
+			{
+				BigramRow row;
+				row.LogProb = logProb;
+				utf8s2ws(tokens[1], wordBuf);
+				row.HistoryWordId = wordId(wordBuf);
+				utf8s2ws(tokens[2], wordBuf);
+				row.NextWordId = wordId(wordBuf);
+				if (row.HistoryWordId == -1 || row.NextWordId == -1)
+					return lineError("Bigram word is not in unigrams");
+				bigrams.push_back(row);
+			}
+		}
+
+		if (!hasEnd)
+		{
+			pushErrorMsg(errMsg, str(boost::format("ARPA file has no \\end\\ marker (%1%)") % lmFilePath.string()));
+			return false;
+		}
+		auto declaredCount = [&declaredCounts](int ngramOrder) -> size_t
+		{
+			auto it = declaredCounts.find(ngramOrder);
+			return it != declaredCounts.end() ? it->second : 0;
+		};
+		if (declaredCount(1) != words_.size() || declaredCount(2) != bigrams.size())
+		{
+			pushErrorMsg(errMsg, str(boost::format("The number of n-grams differs from the header of ARPA file (%1%)") % lmFilePath.string()));
+			return false;
+		}
+		if (bigrams.size() > std::numeric_limits<std::uint32_t>::max())
+		{
+			pushErrorMsg(errMsg, "Too many bigrams");
+			return false;
+		}
+
+		sentStartId_ = wordId(toStdWString(fillerStartSilence()));
+		sentEndId_ = wordId(toStdWString(fillerEndSilence()));
+		if (sentStartId_ == -1 || sentEndId_ == -1)
+		{
+			pushErrorMsg(errMsg, str(boost::format("Language model must contain <s> and </s> (%1%)") % lmFilePath.string()));
+			return false;
+		}
+
+		// group bigrams by history
+		std::sort(bigrams.begin(), bigrams.end(), [](const BigramRow& a, const BigramRow& b)
+		{
+			return std::tie(a.HistoryWordId, a.NextWordId) < std::tie(b.HistoryWordId, b.NextWordId);
+		});
+		historyOffset_.assign(words_.size() + 1, 0);
+		bigramNextWordId_.resize(bigrams.size());
+		bigramLogProb_.resize(bigrams.size());
+		for (size_t i = 0; i < bigrams.size(); ++i)
+		{
+			const BigramRow& row = bigrams[i];
+			if (i > 0 && row.HistoryWordId == bigrams[i - 1].HistoryWordId && row.NextWordId == bigrams[i - 1].NextWordId)
+			{
+				pushErrorMsg(errMsg, str(boost::format("Duplicate bigram in ARPA file (%1%)") % lmFilePath.string()));
+				return false;
+			}
+			historyOffset_[row.HistoryWordId + 1] += 1;
+			bigramNextWordId_[i] = row.NextWordId;
+			bigramLogProb_[i] = row.LogProb;
+		}
+		for (size_t wordInd = 0; wordInd < words_.size(); ++wordInd)
+			historyOffset_[wordInd + 1] += historyOffset_[wordInd];
+		return true;
+	}
+
+	int ArpaLanguageModelQuery::order() const
+	{
+		return order_;
+	}
+
+	size_t ArpaLanguageModelQuery::ngramCount(int ngramDim) const
+	{
+		PG_Assert(ngramDim == 1 || ngramDim == 2);
+		if (ngramDim == 1)
+			return words_.size();
+		return bigramNextWordId_.size();
+	}
+
+	std::int32_t ArpaLanguageModelQuery::wordId(const std::wstring& word) const
+	{
+		auto it = wordToId_.find(word);
+		if (it != wordToId_.end())
+			return it->second;
+		return -1;
+	}
+
+	const std::wstring& ArpaLanguageModelQuery::word(std::int32_t wordId) const
+	{
+		return words_[wordId];
+	}
+
+	std::int32_t ArpaLanguageModelQuery::sentStartId() const
+	{
+		return sentStartId_;
+	}
+
+	std::int32_t ArpaLanguageModelQuery::sentEndId() const
+	{
+		return sentEndId_;
+	}
+
+	double ArpaLanguageModelQuery::logProb(std::int32_t historyWordId, std::int32_t wordId) const
+	{
+		PG_DbgAssert(wordId >= 0 && (size_t)wordId < words_.size());
+		if (historyWordId == -1 || order_ < 2)
+			return uniLogProb_[wordId];
+
+		auto historyBegin = bigramNextWordId_.begin() + historyOffset_[historyWordId];
+		auto historyEnd = bigramNextWordId_.begin() + historyOffset_[historyWordId + 1];
+		auto it = std::lower_bound(historyBegin, historyEnd, wordId);
+		if (it != historyEnd && *it == wordId)
+			return bigramLogProb_[it - bigramNextWordId_.begin()];
+
+		// back off to the unigram
+		return (double)uniBackOffLogProb_[historyWordId] + uniLogProb_[wordId];
+	}
+
+	void PerplexityStat::add(const PerplexityStat& other)
+	{
+		SentCount += other.SentCount;
+		WordCount += other.WordCount;
+		OovCount += other.OovCount;
+		ZeroProbCount += other.ZeroProbCount;
+		LogProbSum += other.LogProbSum;
+	}
+
+	std::int64_t PerplexityStat::scoredCount() const
+	{
+		return WordCount - OovCount - ZeroProbCount + SentCount;
+	}
+
+	double PerplexityStat::perplexity() const
+	{
+		std::int64_t count = scoredCount();
+		if (count == 0)
+			return 0;
+		return std::pow(10.0, -LogProbSum / count);
+	}
+
+	double PerplexityStat::oovRate() const
+	{
+		if (WordCount == 0)
+			return 0;
+		return OovCount / (double)WordCount;
+	}
+
+	void scoreSentence(const ArpaLanguageModelQuery& langModel, wv::slice<const std::int32_t> wordIds, PerplexityStat& stat)
+	{
+		stat.SentCount += 1;
+		stat.WordCount += wordIds.size();
+
+		std::int32_t historyWordId = langModel.sentStartId();
+		auto scoreWord = [&](std::int32_t wordId)
+		{
+			double logProb = langModel.logProb(historyWordId, wordId);
+			if (logProb <= ArpaLogProbMinusInf)
+				stat.ZeroProbCount += 1;
+			else
+				stat.LogProbSum += logProb;
+		};
+		for (std::int32_t wordId : wordIds)
+		{
+			if (wordId == -1)
+			{
+				stat.OovCount += 1;
+				historyWordId = -1; // the next word is scored without history
+				continue;
+			}
+			scoreWord(wordId);
+			historyWordId = wordId;
+		}
+		scoreWord(langModel.sentEndId());
+	}
+
+	bool evaluateLangModelPerplexity(const ArpaLanguageModelQuery& langModel, const boost::filesystem::path& textFilesDir,
+		const boost::filesystem::path& numDictPath, int maxFileToProcess, int threadsCount, PerplexityStat& stat, ErrMsgList* errMsg)
+	{
+		// the number of files is not known in advance; it is the upper bound of the number of threads
+		int maxThreadsCount = parallelThreadsCount(std::numeric_limits<size_t>::max(), threadsCount);
+		std::vector<std::map<size_t, PerplexityStat>> threadFileStats(maxThreadsCount);
+		std::vector<std::vector<std::int32_t>> threadWordIds(maxThreadsCount);
+		std::vector<std::wstring> threadWordBufs(maxThreadsCount);
+
+		auto onSent = [&](size_t fileInd, int threadInd, const std::vector<RawTextLexeme>& sent)
+		{
+			std::vector<std::int32_t>& wordIds = threadWordIds[threadInd];
+			std::wstring& wordBuf = threadWordBufs[threadInd];
+			wordIds.clear();
+			for (const RawTextLexeme& lex : sent)
+			{
+				wordBuf.assign(lex.ValueStr.data(), lex.ValueStr.size());
+				wordIds.push_back(langModel.wordId(wordBuf));
+			}
+			scoreSentence(langModel, wordIds, threadFileStats[threadInd][fileInd]);
+		};
+
+		size_t filesCount = 0;
+		if (!parseLangModelSentencesParallel(textFilesDir, numDictPath, maxFileToProcess, maxThreadsCount, onSent, filesCount, errMsg))
+			return false;
+
+		// each file is processed by one thread; files are summed in order, so the sum doesn't depend on scheduling
+		std::vector<PerplexityStat> fileStats(filesCount);
+		for (const std::map<size_t, PerplexityStat>& fileToStat : threadFileStats)
+		{
+			for (const auto& fileStat : fileToStat)
+				fileStats[fileStat.first] = fileStat.second;
+		}
+		stat = PerplexityStat();
+		for (const PerplexityStat& fileStat : fileStats)
+			stat.add(fileStat);
+		return true;
+	}
+}
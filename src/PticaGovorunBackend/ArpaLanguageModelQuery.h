@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/filesystem/path.hpp>
+#include "PticaGovorunCore.h"
+#include "ComponentsInfrastructure.h"
+#include "ClnUtils.h"
+
+namespace PticaGovorun
+{
+	/// In-memory unigram or bigram back-off language model, loaded from ARPA file (see writeArpaLanguageModel).
+	/// Bigrams are kept in sorted arrays, grouped by history; a bigram is found by binary search inside its history.
+	class PG_EXPORTS ArpaLanguageModelQuery
+	{
+		int order_ = 0;
+		std::unordered_map<std::wstring, std::int32_t> wordToId_;
+		std::vector<std::wstring> words_;
+		std::vector<float> uniLogProb_; // log10
+		std::vector<float> uniBackOffLogProb_; // log10; 0 if absent
+		std::vector<std::uint32_t> historyOffset_; // bigrams of i-th word history are [historyOffset_[i]; historyOffset_[i+1])
+		std::vector<std::int32_t> bigramNextWordId_; // ascending inside one history
+		std::vector<float> bigramLogProb_; // log10
+		std::int32_t sentStartId_ = -1;
+		std::int32_t sentEndId_ = -1;
+	public:
+		bool load(const boost::filesystem::path& lmFilePath, ErrMsgList* errMsg);
+
+		/// The max length of n-grams (1 or 2).
+		int order() const;
+		size_t ngramCount(int ngramDim) const;
+
+		/// Returns the id of the word or -1 if the word is not in vocabulary.
+		std::int32_t wordId(const std::wstring& word) const;
+		const std::wstring& word(std::int32_t wordId) const;
+		std::int32_t sentStartId() const;
+		std::int32_t sentEndId() const;
+
+		/// Gets log10 P(word|history). If there is no such bigram, backs off to the unigram.
+		/// historyWordId=-1 queries the unigram.
+		double logProb(std::int32_t historyWordId, std::int32_t wordId) const;
+	};
+
+	/// Log probability of text, accumulated in the same way as SRILM's 'ngram -ppl' does.
+	/// Out of vocabulary words are not scored and the next word is scored without history.
+	struct PG_EXPORTS PerplexityStat
+	{
+		std::int64_t SentCount = 0;
+		std::int64_t WordCount = 0; // words of sentences, without <s> and </s>
+		std::int64_t OovCount = 0;
+		std::int64_t ZeroProbCount = 0; // in-vocabulary words with zero probability, which are not scored
+		double LogProbSum = 0; // log10 probability of all in-vocabulary words and </s>
+
+		void add(const PerplexityStat& other);
+
+		/// The number of scored words, including </s>.
+		std::int64_t scoredCount() const;
+		double perplexity() const;
+		double oovRate() const;
+	};
+
+	/// Scores one sentence. wordIds don't contain <s> and </s>; -1 denotes out of vocabulary word.
+	PG_EXPORTS void scoreSentence(const ArpaLanguageModelQuery& langModel, wv::slice<const std::int32_t> wordIds, PerplexityStat& stat);
+
+	/// Scores the sentences of the text corpus, which are prepared in the same way as when language model is built.
+	/// The files are scored in parallel; the result is the same for any number of threads.
+	PG_EXPORTS bool evaluateLangModelPerplexity(const ArpaLanguageModelQuery& langModel, const boost::filesystem::path& textFilesDir,
+		const boost::filesystem::path& numDictPath, int maxFileToProcess, int threadsCount, PerplexityStat& stat, ErrMsgList* errMsg);
+}
@@ -0,0 +1,644 @@
+#include "BatchPhoneAlignment.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <QFile>
+#include <boost/format.hpp>
+#include "CoreUtils.h"
+#include "FileHelpers.h"
+#include "KaldiFeatureArchive.h"
+#include "ParallelUtils.h"
+#include "PhoneAlignment.h"
+#include "SpeechProcessing.h"
+#include "WavUtils.h"
+#include "XmlAudioMarkup.h"
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	namespace
+	{
+		const double Log2Pi = std::log(2 * 3.14159265358979323846);
+
+		// the variance of a component is not less than this fraction of the variance of all frames
+		const double VarFloorRatio = 0.01;
+		const double MinVariance = 1e-4;
+		const double MinWeight = 1e-10;
+
+		// the features are computed as in computeMfccVelocityAccelFeatures
+		int mfccFrameSize(float sampleRate) { return (int)(sampleRate * 0.025f); }
+		int mfccFrameShift(float sampleRate) { return (int)(sampleRate * 0.010f); }
+
+		double componentLogProb(const DiagGaussianMixture& gmm, int compInd, const float* frame)
+		{
+			const float* mean = &gmm.Means[compInd * gmm.Dim];
+			const float* var = &gmm.Variances[compInd * gmm.Dim];
+			double dist = 0;
+			for (int i = 0; i < gmm.Dim; ++i)
+			{
+				double d = frame[i] - mean[i];
+				dist += d * d / var[i];
+			}
+			return gmm.LogConsts[compInd] - 0.5 * dist;
+		}
+
+		/// Gets the frames [begFrame; endFrame), which lie entirely inside the range [begSample; endSample) of samples.
+		void segmentFrameRange(long begSample, long endSample, int frameSize, int frameShift, size_t framesCount, size_t& begFrame, size_t& endFrame)
+		{
+			begFrame = (size_t)((begSample + frameShift - 1) / frameShift);
+			endFrame = endSample >= frameSize ? (size_t)((endSample - frameSize) / frameShift + 1) : 0;
+			endFrame = std::min(endFrame, framesCount);
+			begFrame = std::min(begFrame, endFrame);
+		}
+
+		// Collects the frames of features for each phone-level marker of the annotation.
+		bool collectPhoneFrames(const boost::filesystem::path& annotFilePath, int& featVecLen, std::map<std::string, std::vector<float>>& phoneFrames, ErrMsgList* errMsg)
+		{
+			SpeechAnnotation annot;
+			if (!loadAudioMarkupXml(annotFilePath, annot, errMsg))
+				return false;
+
+			const std::vector<TimePointMarker>& markers = annot.markers();
+			bool hasPhones = std::any_of(markers.begin(), markers.end(), [](const TimePointMarker& m) { return m.LevelOfDetail == MarkerLevelOfDetail::Phone; });
+			if (!hasPhones)
+				return true;
+
+			auto audioFilePath = annotFilePath.parent_path() / annot.audioFilePathRel();
+			std::vector<short> samples;
+			float sampleRate = -1;
+			if (!readAllSamplesFormatAware(audioFilePath, samples, &sampleRate, errMsg))
+				return false;
+
+			std::vector<float> features;
+			featVecLen = computeMfccVelocityAccelFeatures(samples, sampleRate, features);
+			size_t framesCount = features.size() / featVecLen;
+			int frameSize = mfccFrameSize(sampleRate);
+			int frameShift = mfccFrameShift(sampleRate);
+
+			for (size_t i = 0; i + 1 < markers.size(); ++i)
+			{
+				const TimePointMarker& marker = markers[i];
+				std::string phoneName;
+				if (marker.LevelOfDetail == MarkerLevelOfDetail::Phone && !marker.TranscripText.isEmpty())
+					phoneName = marker.TranscripText.toStdString();
+				else if (marker.LevelOfDetail == MarkerLevelOfDetail::Word && marker.TranscripText.isEmpty())
+					phoneName = PGPhoneSilence; // pause between words
+				else
+					continue;
+
+				size_t begFrame;
+				size_t endFrame;
+				segmentFrameRange(marker.SampleInd, markers[i + 1].SampleInd, frameSize, frameShift, framesCount, begFrame, endFrame);
+				std::vector<float>& frames = phoneFrames[phoneName];
+				frames.insert(frames.end(), features.begin() + begFrame * featVecLen, features.begin() + endFrame * featVecLen);
+			}
+			return true;
+		}
+	}
+
+	int DiagGaussianMixture::componentsCount() const
+	{
+		return (int)Weights.size();
+	}
+
+	void DiagGaussianMixture::updateLogConsts()
+	{
+		LogConsts.resize(Weights.size());
+		for (int c = 0; c < componentsCount(); ++c)
+		{
+			double logDet = 0;
+			for (int i = 0; i < Dim; ++i)
+				logDet += std::log(Variances[c * Dim + i]);
+			LogConsts[c] = std::log(std::max<double>(Weights[c], MinWeight)) - 0.5 * (Dim * Log2Pi + logDet);
+		}
+	}
+
+	double DiagGaussianMixture::logProb(const float* frame) const
+	{
+		// log-sum-exp over components
+		double maxLog = std::numeric_limits<double>::lowest();
+		for (int c = 0; c < componentsCount(); ++c)
+			maxLog = std::max(maxLog, componentLogProb(*this, c, frame));
+
+		double sum = 0;
+		for (int c = 0; c < componentsCount(); ++c)
+			sum += std::exp(componentLogProb(*this, c, frame) - maxLog);
+		return maxLog + std::log(sum);
+	}
+
+	void trainDiagGaussianMixture(gsl::span<const float> frames, int dim, int componentsCount, int iterCount, DiagGaussianMixture& gmm)
+	{
+		PG_Assert(dim > 0 && frames.size() % dim == 0);
+		size_t framesCount = frames.size() / dim;
+		PG_Assert2(framesCount > 0, "There must be frames to train GMM");
+		int compCount = (int)std::min<size_t>(componentsCount, framesCount);
+
+		std::vector<double> globalMean(dim, 0);
+		std::vector<double> globalVar(dim, 0);
+		for (size_t n = 0; n < framesCount; ++n)
+			for (int i = 0; i < dim; ++i)
+				globalMean[i] += frames[n * dim + i];
+		for (int i = 0; i < dim; ++i)
+			globalMean[i] /= framesCount;
+		for (size_t n = 0; n < framesCount; ++n)
+			for (int i = 0; i < dim; ++i)
+			{
+				double d = frames[n * dim + i] - globalMean[i];
+				globalVar[i] += d * d;
+			}
+		std::vector<double> varFloor(dim);
+		for (int i = 0; i < dim; ++i)
+		{
+			globalVar[i] /= framesCount;
+			varFloor[i] = std::max(MinVariance, VarFloorRatio * globalVar[i]);
+		}
+
+		// the initial means are the frames, evenly spread across the input
+		gmm.Dim = dim;
+		gmm.Weights.assign(compCount, 1.0f / compCount);
+		gmm.Means.resize(compCount * dim);
+		gmm.Variances.resize(compCount * dim);
+		for (int c = 0; c < compCount; ++c)
+		{
+			size_t frameInd = (c * framesCount + framesCount / 2) / compCount;
+			for (int i = 0; i < dim; ++i)
+			{
+				gmm.Means[c * dim + i] = frames[frameInd * dim + i];
+				gmm.Variances[c * dim + i] = (float)std::max(globalVar[i], varFloor[i]);
+			}
+		}
+		gmm.updateLogConsts();
+
+		std::vector<double> resp(compCount);
+		std::vector<double> sumResp(compCount);
+		std::vector<double> sumX(compCount * dim);
+		std::vector<double> sumXX(compCount * dim);
+		for (int iter = 0; iter < iterCount && compCount > 1; ++iter)
+		{
+			std::fill(sumResp.begin(), sumResp.end(), 0);
+			std::fill(sumX.begin(), sumX.end(), 0);
+			std::fill(sumXX.begin(), sumXX.end(), 0);
+
+			// E-step: responsibilities of components for each frame
+			for (size_t n = 0; n < framesCount; ++n)
+			{
+				const float* x = &frames[n * dim];
+				double maxLog = std::numeric_limits<double>::lowest();
+				for (int c = 0; c < compCount; ++c)
+				{
+					resp[c] = componentLogProb(gmm, c, x);
+					maxLog = std::max(maxLog, resp[c]);
+				}
+				double sum = 0;
+				for (int c = 0; c < compCount; ++c)
+				{
+					resp[c] = std::exp(resp[c] - maxLog);
+					sum += resp[c];
+				}
+				for (int c = 0; c < compCount; ++c)
+				{
+					double r = resp[c] / sum;
+					sumResp[c] += r;
+					for (int i = 0; i < dim; ++i)
+					{
+						sumX[c * dim + i] += r * x[i];
+						sumXX[c * dim + i] += r * x[i] * x[i];
+					}
+				}
+			}
+
+			// M-step
+			for (int c = 0; c < compCount; ++c)
+			{
+				gmm.Weights[c] = (float)(sumResp[c] / framesCount);
+				if (sumResp[c] < 1e-6) // the component lost all frames; keep its parameters
+					continue;
+				for (int i = 0; i < dim; ++i)
+				{
+					double mean = sumX[c * dim + i] / sumResp[c];
+					double var = sumXX[c * dim + i] / sumResp[c] - mean * mean;
+					gmm.Means[c * dim + i] = (float)mean;
+					gmm.Variances[c * dim + i] = (float)std::max(var, varFloor[i]);
+				}
+			}
+			gmm.updateLogConsts();
+		}
+	}
+
+	bool savePhoneGmmModel(const PhoneGmmModel& model, const boost::filesystem::path& arkFilePath, ErrMsgList* errMsg)
+	{
+		KaldiArchiveWriter arkWriter;
+		if (!arkWriter.open(arkFilePath, boost::filesystem::path(), errMsg))
+			return false;
+
+		std::vector<float> data;
+		for (const auto& pair : model.PhoneNameToGmm)
+		{
+			const DiagGaussianMixture& gmm = pair.second;
+			int cols = 1 + 2 * gmm.Dim;
+			data.clear();
+			for (int c = 0; c < gmm.componentsCount(); ++c)
+			{
+				data.push_back(gmm.Weights[c]);
+				data.insert(data.end(), gmm.Means.begin() + c * gmm.Dim, gmm.Means.begin() + (c + 1) * gmm.Dim);
+				data.insert(data.end(), gmm.Variances.begin() + c * gmm.Dim, gmm.Variances.begin() + (c + 1) * gmm.Dim);
+			}
+			if (!arkWriter.writeMatrix(pair.first, data, cols, errMsg))
+				return false;
+		}
+		return arkWriter.close(errMsg);
+	}
+
+	bool loadPhoneGmmModel(const boost::filesystem::path& arkFilePath, PhoneGmmModel& model, ErrMsgList* errMsg)
+	{
+		KaldiArchiveReader arkReader;
+		if (!arkReader.openArk(arkFilePath, errMsg))
+			return false;
+
+		model.FeatVecLen = 0;
+		model.PhoneNameToGmm.clear();
+		std::vector<float> data;
+		for (const std::string& phoneName : arkReader.keys())
+		{
+			int rows = -1;
+			int cols = -1;
+			if (!arkReader.readMatrix(phoneName, data, rows, cols, errMsg))
+				return false;
+			if (cols < 3 || cols % 2 == 0 || (model.FeatVecLen > 0 && cols != 1 + 2 * model.FeatVecLen))
+			{
+				pushErrorMsg(errMsg, str(boost::format("Wrong size of GMM of the phone (%1%)") % phoneName));
+				return false;
+			}
+
+			DiagGaussianMixture gmm;
+			gmm.Dim = (cols - 1) / 2;
+			for (int c = 0; c < rows; ++c)
+			{
+				const float* row = &data[c * cols];
+				gmm.Weights.push_back(row[0]);
+				gmm.Means.insert(gmm.Means.end(), row + 1, row + 1 + gmm.Dim);
+				gmm.Variances.insert(gmm.Variances.end(), row + 1 + gmm.Dim, row + cols);
+			}
+			gmm.updateLogConsts();
+			model.FeatVecLen = gmm.Dim;
+			model.PhoneNameToGmm[phoneName] = std::move(gmm);
+		}
+		return true;
+	}
+
+	bool trainPhoneGmmModel(const std::vector<boost::filesystem::path>& annotFilePaths, int componentsCount, int threadsCount, PhoneGmmModel& model, ErrMsgList* errMsg)
+	{
+		// each thread collects frames into its own map
+		int usedThreadsCount = parallelThreadsCount(annotFilePaths.size(), threadsCount);
+		std::vector<std::map<std::string, std::vector<float>>> threadPhoneFrames(usedThreadsCount);
+		std::vector<int> threadFeatVecLen(usedThreadsCount, 0);
+		std::vector<ErrMsgList> fileErrs(annotFilePaths.size());
+		std::vector<char> fileOk(annotFilePaths.size(), false);
+		parallelFor(annotFilePaths.size(), threadsCount, [&](size_t fileInd, int threadInd)
+		{
+			fileOk[fileInd] = collectPhoneFrames(annotFilePaths[fileInd], threadFeatVecLen[threadInd], threadPhoneFrames[threadInd], &fileErrs[fileInd]);
+		});
+		for (size_t fileInd = 0; fileInd < annotFilePaths.size(); ++fileInd)
+		{
+			if (!fileOk[fileInd])
+			{
+				pushErrorMsg(errMsg, str(fileErrs[fileInd]));
+				pushErrorMsg(errMsg, str(boost::format("Can't collect features of phones (%1%)") % annotFilePaths[fileInd].string()));
+				return false;
+			}
+		}
+
+		std::map<std::string, std::vector<float>> phoneFrames;
+		model.FeatVecLen = 0;
+		for (int threadInd = 0; threadInd < usedThreadsCount; ++threadInd)
+		{
+			if (threadFeatVecLen[threadInd] > 0)
+				model.FeatVecLen = threadFeatVecLen[threadInd];
+			for (auto& pair : threadPhoneFrames[threadInd])
+			{
+				std::vector<float>& frames = phoneFrames[pair.first];
+				frames.insert(frames.end(), pair.second.begin(), pair.second.end());
+			}
+		}
+
+		std::vector<std::pair<std::string, const std::vector<float>*>> phonesToTrain;
+		for (const auto& pair : phoneFrames)
+		{
+			if (!pair.second.empty())
+				phonesToTrain.push_back(std::make_pair(pair.first, &pair.second));
+		}
+		if (phonesToTrain.empty())
+		{
+			pushErrorMsg(errMsg, "There are no phone markers to train GMMs");
+			return false;
+		}
+
+		const int iterCount = 20;
+		std::vector<DiagGaussianMixture> gmms(phonesToTrain.size());
+		parallelFor(phonesToTrain.size(), threadsCount, [&](size_t phoneInd, int threadInd)
+		{
+			trainDiagGaussianMixture(*phonesToTrain[phoneInd].second, model.FeatVecLen, componentsCount, iterCount, gmms[phoneInd]);
+		});
+
+		model.PhoneNameToGmm.clear();
+		for (size_t phoneInd = 0; phoneInd < phonesToTrain.size(); ++phoneInd)
+			model.PhoneNameToGmm[phonesToTrain[phoneInd].first] = std::move(gmms[phoneInd]);
+		return true;
+	}
+
+	bool alignPhonesGmm(const PhoneGmmModel& model, gsl::span<const float> features, const std::vector<std::string>& phones,
+		std::vector<std::pair<size_t, size_t>>& phoneFrames, double& alignmentScore, ErrMsgList* errMsg)
+	{
+		PG_Assert(model.FeatVecLen > 0 && features.size() % model.FeatVecLen == 0);
+		size_t framesCount = features.size() / model.FeatVecLen;
+		if (phones.empty() || framesCount < phones.size())
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't align %1% phones to %2% frames") % phones.size() % framesCount));
+			return false;
+		}
+
+		// the same phone may occur many times in the utterance, its emission is computed once
+		std::unordered_map<const DiagGaussianMixture*, size_t> gmmToRow;
+		std::vector<size_t> phoneToRow(phones.size());
+		std::vector<const DiagGaussianMixture*> rowGmms;
+		for (size_t i = 0; i < phones.size(); ++i)
+		{
+			auto gmmIt = model.PhoneNameToGmm.find(phones[i]);
+			if (gmmIt == model.PhoneNameToGmm.end())
+			{
+				pushErrorMsg(errMsg, str(boost::format("There is no GMM for the phone (%1%)") % phones[i]));
+				return false;
+			}
+			auto rowIt = gmmToRow.insert(std::make_pair(&gmmIt->second, rowGmms.size())).first;
+			if (rowIt->second == rowGmms.size())
+				rowGmms.push_back(&gmmIt->second);
+			phoneToRow[i] = rowIt->second;
+		}
+
+		std::vector<double> emitLogProb(rowGmms.size() * framesCount);
+		for (size_t frameInd = 0; frameInd < framesCount; ++frameInd)
+		{
+			const float* frame = &features[frameInd * model.FeatVecLen];
+			for (size_t row = 0; row < rowGmms.size(); ++row)
+				emitLogProb[frameInd * rowGmms.size() + row] = rowGmms[row]->logProb(frame);
+		}
+
+		size_t rowsCount = rowGmms.size();
+		std::function<double(size_t, size_t)> emitFun = [&emitLogProb, &phoneToRow, rowsCount](size_t stateInd, size_t frameInd) -> double
+		{
+			return emitLogProb[frameInd * rowsCount + phoneToRow[stateInd]];
+		};
+
+		std::vector<std::tuple<size_t, size_t>> alignedStates;
+		PhoneAlignment phoneAligner(phones.size(), framesCount, emitFun);
+		phoneAligner.compute(alignedStates);
+		alignmentScore = phoneAligner.getAlignmentScore();
+
+		phoneFrames.resize(alignedStates.size());
+		for (size_t i = 0; i < alignedStates.size(); ++i)
+			phoneFrames[i] = std::make_pair(std::get<0>(alignedStates[i]), std::get<1>(alignedStates[i]));
+		return true;
+	}
+
+	double BatchPhoneAlignmentStats::segmentsPerSec() const
+	{
+		return ElapsedSec > 0 ? SegmentsAligned / ElapsedSec : 0;
+	}
+
+	BatchPhoneAligner::BatchPhoneAligner(const PhoneGmmModel& model, WordToPhoneListFun wordToPhoneListFun)
+		: model_(model),
+		wordToPhoneListFun_(wordToPhoneListFun)
+	{
+	}
+
+	void BatchPhoneAligner::setJournalFilePath(const boost::filesystem::path& journalFilePath)
+	{
+		journalFilePath_ = journalFilePath;
+	}
+
+	void BatchPhoneAligner::setThreadsCount(int threadsCount)
+	{
+		threadsCount_ = threadsCount;
+	}
+
+	void BatchPhoneAligner::setProgressFun(ProgressFun progressFun)
+	{
+		progressFun_ = progressFun;
+	}
+
+	bool BatchPhoneAligner::run(const std::vector<boost::filesystem::path>& annotFilePaths, BatchPhoneAlignmentStats& stats, ErrMsgList* errMsg)
+	{
+		typedef std::chrono::steady_clock Clock;
+		auto startTime = Clock::now();
+		auto elapsedSec = [startTime]() { return std::chrono::duration<double>(Clock::now() - startTime).count(); };
+
+		std::unordered_set<std::string> doneFiles;
+		if (!journalFilePath_.empty() && !readJournal(doneFiles, errMsg))
+			return false;
+
+		stats_ = BatchPhoneAlignmentStats();
+		std::vector<const boost::filesystem::path*> filesToAlign;
+		for (const boost::filesystem::path& annotFilePath : annotFilePaths)
+		{
+			if (doneFiles.find(toUtf8StdString(annotFilePath.wstring())) != doneFiles.end())
+				stats_.FilesSkipped++;
+			else
+				filesToAlign.push_back(&annotFilePath);
+		}
+
+		parallelFor(filesToAlign.size(), threadsCount_, [&](size_t fileInd, int threadInd)
+		{
+			const boost::filesystem::path& annotFilePath = *filesToAlign[fileInd];
+			int segsAligned = 0;
+			int segsFailed = 0;
+			ErrMsgList fileErr;
+			bool fileOk = alignFile(annotFilePath, segsAligned, segsFailed, &fileErr);
+
+			std::lock_guard<std::mutex> lk(progressMutex_);
+			if (fileOk && !journalFilePath_.empty())
+				fileOk = appendJournal(toUtf8StdString(annotFilePath.wstring()), segsAligned, &fileErr);
+
+			if (fileOk)
+				stats_.FilesDone++;
+			else
+				stats_.FilesFailed++;
+			stats_.SegmentsAligned += segsAligned;
+			stats_.SegmentsFailed += segsFailed;
+			stats_.ElapsedSec = elapsedSec();
+			if (progressFun_ != nullptr)
+				progressFun_(annotFilePath, fileOk ? nullptr : &fileErr, stats_);
+		});
+
+		stats_.ElapsedSec = elapsedSec();
+		stats = stats_;
+		return true;
+	}
+
+	bool BatchPhoneAligner::alignFile(const boost::filesystem::path& annotFilePath, int& segsAligned, int& segsFailed, ErrMsgList* errMsg) const
+	{
+		SpeechAnnotation annot;
+		if (!loadAudioMarkupXml(annotFilePath, annot, errMsg))
+			return false;
+
+		struct SegmentToAlign
+		{
+			long BegSample;
+			long EndSample;
+			std::wstring Text;
+			SpeechLanguage Language;
+		};
+		std::vector<SegmentToAlign> segsToAlign;
+		{
+			std::vector<std::pair<const TimePointMarker*, const TimePointMarker*>> wordSegs;
+			collectAnnotatedSegments(annot.markers(), wordSegs);
+			for (const auto& wordSeg : wordSegs)
+			{
+				if (!includeInTrainOrTest(*wordSeg.first))
+					continue;
+
+				// the markers are ordered, the segment with phone markers inside was aligned before (may be manually)
+				bool hasPhones = std::any_of(wordSeg.first + 1, wordSeg.second, [](const TimePointMarker& m) { return m.LevelOfDetail == MarkerLevelOfDetail::Phone; });
+				if (hasPhones)
+					continue;
+
+				// all words in phonetic dictionary are in lowercase
+				segsToAlign.push_back(SegmentToAlign{ wordSeg.first->SampleInd, wordSeg.second->SampleInd, wordSeg.first->TranscripText.toLower().toStdWString(), wordSeg.first->Language });
+			}
+		}
+		if (segsToAlign.empty())
+			return true;
+
+		auto audioFilePath = annotFilePath.parent_path() / annot.audioFilePathRel();
+		std::vector<short> samples;
+		float sampleRate = -1;
+		if (!readAllSamplesFormatAware(audioFilePath, samples, &sampleRate, errMsg))
+			return false;
+
+		std::vector<float> features;
+		int featVecLen = computeMfccVelocityAccelFeatures(samples, sampleRate, features);
+		if (featVecLen != model_.FeatVecLen)
+		{
+			pushErrorMsg(errMsg, "The features of the audio don't match the features of the acoustic model");
+			return false;
+		}
+		size_t framesCount = features.size() / featVecLen;
+		int frameSize = mfccFrameSize(sampleRate);
+		int frameShift = mfccFrameShift(sampleRate);
+
+		std::vector<TimePointMarker> phoneMarkers;
+		std::vector<std::string> phones;
+		std::vector<std::pair<size_t, size_t>> phoneFrames;
+		for (const SegmentToAlign& seg : segsToAlign)
+		{
+			phones.clear();
+			bool insertShortPause = false;
+			std::tuple<bool, std::wstring> convOp = convertTextToPhoneList(seg.Text, wordToPhoneListFun_, insertShortPause, phones);
+			if (!std::get<0>(convOp))
+			{
+				segsFailed++;
+				continue;
+			}
+
+			size_t begFrame;
+			size_t endFrame;
+			segmentFrameRange(seg.BegSample, seg.EndSample, frameSize, frameShift, framesCount, begFrame, endFrame);
+			gsl::span<const float> segFeatures = gsl::span<const float>(features).subspan(begFrame * featVecLen, (endFrame - begFrame) * featVecLen);
+
+			double alignmentScore = 0;
+			if (!alignPhonesGmm(model_, segFeatures, phones, phoneFrames, alignmentScore, nullptr))
+			{
+				segsFailed++;
+				continue;
+			}
+
+			// the segment is aligned only if all its phones fit inside it
+			size_t segMarkersStart = phoneMarkers.size();
+			bool phonesFit = true;
+			for (size_t i = 0; i < phoneFrames.size(); ++i)
+			{
+				long phoneBeg = -1;
+				long phoneEnd = -1;
+				frameRangeToSampleRange(begFrame + phoneFrames[i].first, begFrame + phoneFrames[i].second, FrameToSamplePicker, frameSize, frameShift, phoneBeg, phoneEnd);
+
+				// the phone marker must be strictly inside the word segment, next to word's marker
+				phoneBeg = std::max(phoneBeg, seg.BegSample + 1);
+				if (phoneBeg >= seg.EndSample)
+				{
+					phonesFit = false;
+					break;
+				}
+
+				TimePointMarker marker;
+				marker.SampleInd = phoneBeg;
+				marker.LevelOfDetail = MarkerLevelOfDetail::Phone;
+				marker.TranscripText = QString::fromStdString(phones[i]);
+				marker.Language = seg.Language;
+				marker.StopsPlayback = false;
+				marker.IsManual = false;
+				phoneMarkers.push_back(marker);
+			}
+			if (!phonesFit)
+			{
+				phoneMarkers.resize(segMarkersStart);
+				segsFailed++;
+				continue;
+			}
+			segsAligned++;
+		}
+
+		if (phoneMarkers.empty())
+			return true;
+		for (const TimePointMarker& marker : phoneMarkers)
+			annot.insertMarker(marker);
+
+		std::string xmlTextBuff;
+		return saveAudioMarkupXmlFast(annot, annotFilePath, xmlTextBuff, errMsg);
+	}
+
+	bool BatchPhoneAligner::readJournal(std::unordered_set<std::string>& doneFiles, ErrMsgList* errMsg) const
+	{
+		if (!boost::filesystem::exists(journalFilePath_))
+			return true;
+
+		std::vector<char> bytes;
+		if (!readAllBytes(journalFilePath_, bytes, errMsg))
+			return false;
+
+		// annotFilePath <tab> segmentsAligned
+		// the last line may be partially written when the previous run was interrupted, it is ignored
+		boost::string_view text(bytes.data(), bytes.size());
+		for (size_t eolInd = text.find('\n'); eolInd != boost::string_view::npos; eolInd = text.find('\n'))
+		{
+			boost::string_view line = text.substr(0, eolInd);
+			text.remove_prefix(eolInd + 1);
+
+			size_t tabInd = line.find('\t');
+			if (tabInd != boost::string_view::npos)
+				doneFiles.insert(line.substr(0, tabInd).to_string());
+		}
+		return true;
+	}
+
+	bool BatchPhoneAligner::appendJournal(const std::string& annotFilePathUtf8, int segsAligned, ErrMsgList* errMsg) const
+	{
+		QFile journalFile(toQStringBfs(journalFilePath_));
+		if (!journalFile.open(QIODevice::WriteOnly | QIODevice::Append))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't open file for writing (%1%)") % journalFilePath_.string()));
+			return false;
+		}
+
+		std::string line = annotFilePathUtf8;
+		line.push_back('\t');
+		line.append(std::to_string(segsAligned));
+		line.push_back('\n');
+		if (journalFile.write(line.data(), line.size()) != (qint64)line.size())
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't write into file (%1%)") % journalFilePath_.string()));
+			return false;
+		}
+		return true;
+	}
+}
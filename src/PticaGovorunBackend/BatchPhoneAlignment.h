@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <unordered_set>
+#include <boost/filesystem/path.hpp>
+#include <gsl/span>
+#include "PticaGovorunCore.h"
+#include "ComponentsInfrastructure.h"
+
+namespace PticaGovorun
+{
+	/// Gaussian mixture with diagonal covariance matrices.
+	struct PG_EXPORTS DiagGaussianMixture
+	{
+		int Dim = 0;
+		std::vector<float> Weights; // one per component
+		std::vector<float> Means; // Dim values per component
+		std::vector<float> Variances; // Dim values per component
+		std::vector<double> LogConsts; // log(weight)-0.5*log(det(2*pi*Cov)) per component, see updateLogConsts
+
+		int componentsCount() const;
+
+		/// Recomputes the constant part of the log-likelihood of each component. Must be called when parameters change.
+		void updateLogConsts();
+
+		/// The log-likelihood of the feature vector (of Dim values).
+		double logProb(const float* frame) const;
+	};
+
+	/// Trains the mixture on frames (dim values per frame) with expectation-maximization.
+	/// The number of components is limited by the number of frames.
+	PG_EXPORTS void trainDiagGaussianMixture(gsl::span<const float> frames, int dim, int componentsCount, int iterCount, DiagGaussianMixture& gmm);
+
+	/// Monophone acoustic model: one emitting state per phone, which emits MFCC features with the phone's GMM.
+	struct PG_EXPORTS PhoneGmmModel
+	{
+		int FeatVecLen = 0;
+		std::map<std::string, DiagGaussianMixture> PhoneNameToGmm;
+	};
+
+	/// Stores each phone's GMM as the matrix in Kaldi's binary archive; one row per component: weight, means, variances.
+	PG_EXPORTS bool savePhoneGmmModel(const PhoneGmmModel& model, const boost::filesystem::path& arkFilePath, ErrMsgList* errMsg);
+	PG_EXPORTS bool loadPhoneGmmModel(const boost::filesystem::path& arkFilePath, PhoneGmmModel& model, ErrMsgList* errMsg);
+
+	/// Trains phone GMMs on the phone-level markers of speech annotation. The frames of word-level segments without
+	/// transcription are used to train the silence phone.
+	PG_EXPORTS bool trainPhoneGmmModel(const std::vector<boost::filesystem::path>& annotFilePaths, int componentsCount, int threadsCount, PhoneGmmModel& model, ErrMsgList* errMsg);
+
+	/// Aligns the sequence of phones to the frames of features with Viterbi algorithm (see PhoneAlignment).
+	/// phoneFrames[i] is the range [begFrame; endFrame] (inclusive) of i-th phone.
+	PG_EXPORTS bool alignPhonesGmm(const PhoneGmmModel& model, gsl::span<const float> features, const std::vector<std::string>& phones,
+		std::vector<std::pair<size_t, size_t>>& phoneFrames, double& alignmentScore, ErrMsgList* errMsg);
+
+	struct BatchPhoneAlignmentStats
+	{
+		int FilesDone = 0; // aligned or without segments to align
+		int FilesSkipped = 0; // listed in the journal of previous runs
+		int FilesFailed = 0;
+		int SegmentsAligned = 0;
+		int SegmentsFailed = 0;
+		double ElapsedSec = 0;
+
+		double segmentsPerSec() const;
+	};
+
+	/// Aligns phones in word-level segments of speech annotation files and writes phone-level markers back into xml.
+	/// The segments which already have phone markers are left intact. Files are processed on a pool of threads;
+	/// each annotation file is replaced atomically.
+	/// The names of processed files are appended to the journal, so that the interrupted run can be resumed.
+	class PG_EXPORTS BatchPhoneAligner
+	{
+	public:
+		/// Converts the transcription of a segment into phones.
+		typedef std::function<auto (const std::wstring& word, std::vector<std::string>& wordPhones) -> bool> WordToPhoneListFun;
+
+		/// Called after each file, from the thread which processed the file.
+		typedef std::function<auto (const boost::filesystem::path& annotFilePath, const ErrMsgList* fileErr, const BatchPhoneAlignmentStats& stats) -> void> ProgressFun;
+	private:
+		const PhoneGmmModel& model_;
+		WordToPhoneListFun wordToPhoneListFun_;
+		ProgressFun progressFun_;
+		boost::filesystem::path journalFilePath_;
+		int threadsCount_ = -1;
+
+		std::mutex progressMutex_;
+		BatchPhoneAlignmentStats stats_;
+	public:
+		BatchPhoneAligner(const PhoneGmmModel& model, WordToPhoneListFun wordToPhoneListFun);
+
+		/// The file to log processed files into. Empty path disables resuming.
+		void setJournalFilePath(const boost::filesystem::path& journalFilePath);
+		void setThreadsCount(int threadsCount);
+		void setProgressFun(ProgressFun progressFun);
+
+		bool run(const std::vector<boost::filesystem::path>& annotFilePaths, BatchPhoneAlignmentStats& stats, ErrMsgList* errMsg);
+
+		/// Aligns all segments of one annotation file and saves it.
+		bool alignFile(const boost::filesystem::path& annotFilePath, int& segsAligned, int& segsFailed, ErrMsgList* errMsg) const;
+	private:
+		bool readJournal(std::unordered_set<std::string>& doneFiles, ErrMsgList* errMsg) const;
+		bool appendJournal(const std::string& annotFilePathUtf8, int segsAligned, ErrMsgList* errMsg) const;
+	};
+}
@@ -0,0 +1,420 @@
+#include "BuildPipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <QFile>
+#include <QTextStream>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include "CoreUtils.h"
+#include "FileHelpers.h"
+#include "ParallelUtils.h"
+
+namespace PticaGovorun
+{
+	namespace
+	{
+		const char* StageInfoFileName = "stage.txt";
+		const char* StageKeyName = "#key";
+		const std::uint64_t FnvOffset = 14695981039346656037ULL;
+
+		std::mutex stageLogMutex;
+
+		// the names of values come from data (eg speaker ids), hence '=' and line breaks are escaped with backslash
+		std::string escapeStageInfo(boost::string_view text)
+		{
+			std::string result;
+			result.reserve(text.size());
+			for (char ch : text)
+			{
+				switch (ch)
+				{
+				case '\\': result += "\\\\"; break;
+				case '=': result += "\\="; break;
+				case '\n': result += "\\n"; break;
+				case '\r': result += "\\r"; break;
+				default: result.push_back(ch);
+				}
+			}
+			return result;
+		}
+
+		/// Splits the line name=value on the first unescaped '=' and unescapes both parts.
+		bool parseStageInfoLine(boost::string_view line, std::string& name, std::string& value)
+		{
+			name.clear();
+			value.clear();
+			bool gotSep = false;
+			for (size_t i = 0; i < line.size(); ++i)
+			{
+				char ch = line[i];
+				if (ch == '=' && !gotSep)
+				{
+					gotSep = true;
+					continue;
+				}
+				if (ch == '\\' && i + 1 < line.size())
+				{
+					ch = line[++i];
+					if (ch == 'n') ch = '\n';
+					else if (ch == 'r') ch = '\r';
+				}
+				(gotSep ? value : name).push_back(ch);
+			}
+			return gotSep;
+		}
+	}
+
+	StageLogLine::StageLogLine(bool isError) : isError_(isError)
+	{
+	}
+
+	StageLogLine::~StageLogLine()
+	{
+		std::lock_guard<std::mutex> lk(stageLogMutex);
+		std::wostream& os = isError_ ? std::wcerr : std::wcout;
+		os << line_.str() << std::endl;
+	}
+
+	StageLogLine& StageLogLine::operator<<(const std::string& value)
+	{
+		line_ << utf8s2ws(value);
+		return *this;
+	}
+
+	StageKeyBuilder::StageKeyBuilder() : hash_(FnvOffset)
+	{
+	}
+
+	void StageKeyBuilder::addString(boost::string_view value)
+	{
+		// the size separates consecutive values, so that ("ab","c") and ("a","bc") differ
+		std::uint64_t size = value.size();
+		hash_ = hashFnv1a64(&size, sizeof(size), hash_);
+		hash_ = hashFnv1a64(value.data(), value.size(), hash_);
+	}
+
+	void StageKeyBuilder::addWString(boost::wstring_view value)
+	{
+		addString(toUtf8StdString(value));
+	}
+
+	void StageKeyBuilder::addConfig(boost::string_view name, boost::string_view value)
+	{
+		addString(name);
+		addString(value);
+	}
+
+	void StageKeyBuilder::addConfig(boost::string_view name, double value)
+	{
+		char buf[32];
+		int len = std::snprintf(buf, sizeof(buf), "%.17g", value);
+		addConfig(name, boost::string_view(buf, len));
+	}
+
+	bool StageKeyBuilder::addFileContent(const boost::filesystem::path& filePath, ErrMsgList* errMsg)
+	{
+		addWString(filePath.wstring());
+		if (!boost::filesystem::exists(filePath))
+		{
+			addString("<absent>");
+			return true;
+		}
+
+		std::vector<char> bytes;
+		if (!readAllBytes(filePath, bytes, errMsg))
+			return false;
+		addString(boost::string_view(bytes.data(), bytes.size()));
+		return true;
+	}
+
+	void StageKeyBuilder::addFileStamp(const boost::filesystem::path& filePath)
+	{
+		addWString(filePath.wstring());
+		boost::system::error_code ec;
+		std::int64_t stamp[2] = { -1, 0 };
+		auto fileSize = boost::filesystem::file_size(filePath, ec);
+		if (!ec)
+		{
+			stamp[0] = (std::int64_t)fileSize;
+			stamp[1] = (std::int64_t)boost::filesystem::last_write_time(filePath, ec);
+		}
+		hash_ = hashFnv1a64(stamp, sizeof(stamp), hash_);
+	}
+
+	bool StageKeyBuilder::addDir(const boost::filesystem::path& dirPath, bool hashContent, ErrMsgList* errMsg)
+	{
+		addWString(dirPath.wstring());
+		if (!boost::filesystem::is_directory(dirPath))
+		{
+			addString("<absent>");
+			return true;
+		}
+
+		// the order of directory iteration is unspecified
+		std::vector<boost::filesystem::path> filePaths;
+		for (boost::filesystem::recursive_directory_iterator it(dirPath), end; it != end; ++it)
+		{
+			if (boost::filesystem::is_regular_file(it->path()))
+				filePaths.push_back(it->path());
+		}
+		std::sort(filePaths.begin(), filePaths.end());
+
+		for (const boost::filesystem::path& filePath : filePaths)
+		{
+			if (!hashContent)
+				addFileStamp(filePath);
+			else if (!addFileContent(filePath, errMsg))
+				return false;
+		}
+		return true;
+	}
+
+	std::uint64_t StageKeyBuilder::key() const
+	{
+		return hash_;
+	}
+
+	BuildStageCache::BuildStageCache(const boost::filesystem::path& cacheDir)
+		: cacheDir_(cacheDir)
+	{
+	}
+
+	bool BuildStageCache::runCached(const std::string& stageName, std::uint64_t key,
+		const std::vector<boost::filesystem::path>& relOutPaths, const boost::filesystem::path& outDir,
+		std::map<std::string, std::string>& values,
+		std::function<auto (std::map<std::string, std::string>& values, ErrMsgList* errMsg) -> bool> buildFun,
+		ErrMsgList* errMsg)
+	{
+		if (cacheDir_.empty())
+			return buildFun(values, errMsg);
+
+		bool restored = false;
+		if (!restore(stageName, key, relOutPaths, outDir, values, restored, errMsg))
+			return false;
+		if (restored)
+		{
+			StageLogLine() << "Stage " << stageName << " is restored from cache";
+			return true;
+		}
+
+		values.clear();
+		if (!buildFun(values, errMsg))
+			return false;
+
+		// failure to cache the artifacts doesn't fail the build
+		ErrMsgList storeErrMsg;
+		if (!store(stageName, key, relOutPaths, outDir, values, &storeErrMsg))
+			StageLogLine(true) << "Can't cache stage " << stageName << ". " << str(storeErrMsg);
+		return true;
+	}
+
+	bool BuildStageCache::restore(const std::string& stageName, std::uint64_t key,
+		const std::vector<boost::filesystem::path>& relOutPaths, const boost::filesystem::path& outDir,
+		std::map<std::string, std::string>& values, bool& restored, ErrMsgList* errMsg) const
+	{
+		restored = false;
+		boost::filesystem::path stageDir = cacheDir_ / stageName;
+		boost::filesystem::path infoPath = stageDir / StageInfoFileName;
+		if (!boost::filesystem::exists(infoPath))
+			return true;
+
+		std::vector<char> bytes;
+		if (!readAllBytes(infoPath, bytes, errMsg))
+			return false;
+
+		// each line is name=value; the first line is the key, so that the data values can have any name
+		std::map<std::string, std::string> cachedValues;
+		std::string name;
+		std::string value;
+		bool isKeyLine = true;
+		boost::string_view text(bytes.data(), bytes.size());
+		while (!text.empty())
+		{
+			size_t eolInd = text.find('\n');
+			boost::string_view line = text.substr(0, eolInd);
+			text.remove_prefix(eolInd == boost::string_view::npos ? text.size() : eolInd + 1);
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+
+			bool hasValue = parseStageInfoLine(line, name, value);
+			if (isKeyLine)
+			{
+				if (!hasValue || name != StageKeyName || std::strtoull(value.c_str(), nullptr, 16) != key)
+					return true; // stale
+				isKeyLine = false;
+				continue;
+			}
+			if (hasValue)
+				cachedValues[name] = value;
+		}
+		if (isKeyLine)
+			return true; // empty
+
+		for (const boost::filesystem::path& relPath : relOutPaths)
+		{
+			if (!boost::filesystem::exists(stageDir / relPath))
+				return true; // the artifact was deleted from the cache
+		}
+
+		for (const boost::filesystem::path& relPath : relOutPaths)
+		{
+			if (!copyTree(stageDir / relPath, outDir / relPath, errMsg))
+			{
+				pushErrorMsg(errMsg, str(boost::format("Can't restore stage %1% from cache") % stageName));
+				return false;
+			}
+		}
+		values = std::move(cachedValues);
+		restored = true;
+		return true;
+	}
+
+	bool BuildStageCache::store(const std::string& stageName, std::uint64_t key,
+		const std::vector<boost::filesystem::path>& relOutPaths, const boost::filesystem::path& outDir,
+		const std::map<std::string, std::string>& values, ErrMsgList* errMsg) const
+	{
+		boost::filesystem::path stageDir = cacheDir_ / stageName;
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(stageDir, ec);
+		if (ec || !boost::filesystem::create_directories(stageDir, ec))
+		{
+			pushErrorMsg(errMsg, ec.message());
+			pushErrorMsg(errMsg, str(boost::format("Can't create cache directory (%1%)") % stageDir.string()));
+			return false;
+		}
+
+		for (const boost::filesystem::path& relPath : relOutPaths)
+		{
+			if (!copyTree(outDir / relPath, stageDir / relPath, errMsg))
+				return false;
+		}
+
+		// the info file is written last, so that the interrupted store leaves the stage invalid
+		QFile infoFile(toQStringBfs(stageDir / StageInfoFileName));
+		if (!infoFile.open(QIODevice::WriteOnly | QIODevice::Text))
+		{
+			pushErrorMsg(errMsg, "Can't write stage info file");
+			return false;
+		}
+		QTextStream infoStream(&infoFile);
+		infoStream.setCodec("UTF-8");
+		infoStream << StageKeyName << "=" << QString::number(key, 16) << "\n";
+		for (const auto& pair : values)
+			infoStream << QString::fromStdString(escapeStageInfo(pair.first)) << "=" << QString::fromStdString(escapeStageInfo(pair.second)) << "\n";
+		return true;
+	}
+
+	void BuildPipeline::addStage(const std::string& name, const std::vector<std::string>& dependsOn, std::function<auto (ErrMsgList* errMsg) -> bool> runFun)
+	{
+		for (const std::string& depName : dependsOn)
+		{
+			auto depIt = std::find_if(stages_.begin(), stages_.end(), [&depName](const Stage& s) { return s.Name == depName; });
+			PG_Assert2(depIt != stages_.end(), "The stage must be added after the stages it depends on");
+		}
+		stages_.push_back(Stage{ name, dependsOn, runFun });
+	}
+
+	bool BuildPipeline::run(int threadsCount, ErrMsgList* errMsg)
+	{
+		typedef std::chrono::steady_clock Clock;
+		std::vector<bool> isDone(stages_.size(), false);
+		size_t doneCount = 0;
+
+		auto stageInd = [this](const std::string& name) -> size_t
+		{
+			auto it = std::find_if(stages_.begin(), stages_.end(), [&name](const Stage& s) { return s.Name == name; });
+			return std::distance(stages_.begin(), it);
+		};
+
+		std::vector<size_t> readyStages;
+		while (doneCount < stages_.size())
+		{
+			// the stages which dependencies are built
+			readyStages.clear();
+			for (size_t i = 0; i < stages_.size(); ++i)
+			{
+				if (isDone[i])
+					continue;
+				const std::vector<std::string>& deps = stages_[i].DependsOn;
+				bool isReady = std::all_of(deps.begin(), deps.end(), [&](const std::string& dep) { return isDone[stageInd(dep)]; });
+				if (isReady)
+					readyStages.push_back(i);
+			}
+			PG_Assert2(!readyStages.empty(), "Stages dependencies can't be cyclic");
+
+			std::vector<ErrMsgList> stageErrs(readyStages.size());
+			std::vector<char> stageOk(readyStages.size(), false);
+			parallelFor(readyStages.size(), threadsCount, [&](size_t readyInd, int threadInd)
+			{
+				const Stage& stage = stages_[readyStages[readyInd]];
+				std::chrono::time_point<Clock> now1 = Clock::now();
+				stageOk[readyInd] = stage.RunFun(&stageErrs[readyInd]);
+				std::chrono::time_point<Clock> now2 = Clock::now();
+				auto elapsedSec = std::chrono::duration_cast<std::chrono::seconds>(now2 - now1).count();
+				StageLogLine() << "Stage " << stage.Name << " elapsedSec=" << elapsedSec << "s";
+			});
+
+			for (size_t readyInd = 0; readyInd < readyStages.size(); ++readyInd)
+			{
+				const Stage& stage = stages_[readyStages[readyInd]];
+				if (!stageOk[readyInd])
+				{
+					pushErrorMsg(errMsg, str(stageErrs[readyInd]));
+					pushErrorMsg(errMsg, str(boost::format("Stage %1% failed") % stage.Name));
+					return false;
+				}
+				isDone[readyStages[readyInd]] = true;
+				doneCount += 1;
+			}
+		}
+		return true;
+	}
+
+	bool copyTree(const boost::filesystem::path& srcPath, const boost::filesystem::path& dstPath, ErrMsgList* errMsg)
+	{
+		boost::system::error_code ec;
+		auto copyFile = [&ec](const boost::filesystem::path& src, const boost::filesystem::path& dst) -> bool
+		{
+			// the destination is removed rather than overwritten, because overwriting a hard link to the source truncates the source
+			boost::filesystem::remove(dst, ec);
+			if (ec)
+				return false;
+			boost::filesystem::copy_file(src, dst, ec);
+			return !ec;
+		};
+
+		if (boost::filesystem::is_regular_file(srcPath))
+		{
+			boost::filesystem::create_directories(dstPath.parent_path(), ec);
+			if (!copyFile(srcPath, dstPath))
+			{
+				pushErrorMsg(errMsg, ec.message());
+				pushErrorMsg(errMsg, str(boost::format("Can't copy file (%1%)") % srcPath.string()));
+				return false;
+			}
+			return true;
+		}
+
+		boost::filesystem::create_directories(dstPath, ec);
+		for (boost::filesystem::recursive_directory_iterator it(srcPath), end; it != end; ++it)
+		{
+			const boost::filesystem::path& src = it->path();
+			boost::filesystem::path relPath = boost::filesystem::relative(src, srcPath);
+			boost::filesystem::path dst = dstPath / relPath;
+			bool op = boost::filesystem::is_directory(src) ?
+				boost::filesystem::create_directories(dst, ec) || !ec :
+				copyFile(src, dst);
+			if (!op)
+			{
+				pushErrorMsg(errMsg, ec.message());
+				pushErrorMsg(errMsg, str(boost::format("Can't copy (%1%)") % src.string()));
+				return false;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem/path.hpp>
+#include <boost/utility/string_view.hpp>
+#include "PticaGovorunCore.h"
+#include "ComponentsInfrastructure.h"
+
+namespace PticaGovorun
+{
+	/// Accumulates the inputs of a build stage (config values, files) into a key.
+	/// Stages with equal keys produce equal artifacts.
+	class PG_EXPORTS StageKeyBuilder
+	{
+		std::uint64_t hash_;
+	public:
+		StageKeyBuilder();
+
+		void addString(boost::string_view value);
+		void addWString(boost::wstring_view value);
+		void addConfig(boost::string_view name, boost::string_view value);
+		void addConfig(boost::string_view name, double value);
+
+		/// Hashes the content of the file. The absent file is hashed as absent.
+		bool addFileContent(const boost::filesystem::path& filePath, ErrMsgList* errMsg);
+
+		/// Hashes the size and the last modification time of the file. Used for big files (audio, text corpus),
+		/// which are too expensive to read on each run.
+		void addFileStamp(const boost::filesystem::path& filePath);
+
+		/// Hashes content (or stamps if hashContent=false) of all files in the directory tree.
+		bool addDir(const boost::filesystem::path& dirPath, bool hashContent, ErrMsgList* errMsg);
+
+		std::uint64_t key() const;
+	};
+
+	/// Persists the artifacts of build stages between runs.
+	/// Each stage has a directory in the cache with the copy of stage's output files and a file with
+	/// the key of stage's inputs and the values the stage computed (eg statistics).
+	class PG_EXPORTS BuildStageCache
+	{
+		boost::filesystem::path cacheDir_;
+	public:
+		/// Empty cacheDir disables the cache, so each stage is always built.
+		explicit BuildStageCache(const boost::filesystem::path& cacheDir);
+
+		/// Restores the stage's artifacts into outDir if they were built with the same key. Otherwise calls buildFun, which
+		/// should write artifacts into outDir, and puts the artifacts into the cache.
+		/// relOutPaths = files or directories, relative to outDir, which the stage produces.
+		/// values = the values of the stage; are populated either by buildFun or from the cache.
+		bool runCached(const std::string& stageName, std::uint64_t key,
+			const std::vector<boost::filesystem::path>& relOutPaths, const boost::filesystem::path& outDir,
+			std::map<std::string, std::string>& values,
+			std::function<auto (std::map<std::string, std::string>& values, ErrMsgList* errMsg) -> bool> buildFun,
+			ErrMsgList* errMsg);
+	private:
+		bool restore(const std::string& stageName, std::uint64_t key,
+			const std::vector<boost::filesystem::path>& relOutPaths, const boost::filesystem::path& outDir,
+			std::map<std::string, std::string>& values, bool& restored, ErrMsgList* errMsg) const;
+		bool store(const std::string& stageName, std::uint64_t key,
+			const std::vector<boost::filesystem::path>& relOutPaths, const boost::filesystem::path& outDir,
+			const std::map<std::string, std::string>& values, ErrMsgList* errMsg) const;
+	};
+
+	/// One line of the build progress. The line is written to the console in the destructor.
+	/// Stages run concurrently; the whole line is written under the lock, so that the lines of stages don't interleave.
+	class PG_EXPORTS StageLogLine
+	{
+		std::wostringstream line_;
+		bool isError_;
+	public:
+		/// isError=true writes the line to the error stream.
+		explicit StageLogLine(bool isError = false);
+		~StageLogLine();
+
+		template <typename T>
+		StageLogLine& operator<<(const T& value)
+		{
+			line_ << value;
+			return *this;
+		}
+
+		/// The string is in UTF8.
+		StageLogLine& operator<<(const std::string& value);
+	};
+
+	/// Runs named stages in the order of their dependencies.
+	/// The stages, which do not depend on each other, run concurrently.
+	class PG_EXPORTS BuildPipeline
+	{
+		struct Stage
+		{
+			std::string Name;
+			std::vector<std::string> DependsOn;
+			std::function<auto (ErrMsgList* errMsg) -> bool> RunFun;
+		};
+		std::vector<Stage> stages_;
+	public:
+		/// The stages the new stage depends on must be added first.
+		void addStage(const std::string& name, const std::vector<std::string>& dependsOn, std::function<auto (ErrMsgList* errMsg) -> bool> runFun);
+
+		/// Stops when any stage fails; the stages running concurrently with it are completed.
+		bool run(int threadsCount, ErrMsgList* errMsg);
+	};
+
+	/// Copies the file or the directory tree; existing destination files are replaced.
+	/// Files are copied rather than hard linked, so that editing the output doesn't modify the cached artifact.
+	PG_EXPORTS bool copyTree(const boost::filesystem::path& srcPath, const boost::filesystem::path& dstPath, ErrMsgList* errMsg);
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <array>
+#include <cstdint>
 #include <memory>
 #include <unordered_map>
 #include <QString>
@@ -230,6 +231,19 @@ namespace PticaGovorun
 		*topErrMsg = std::move(newTopMsg);
 	}
 
+	/// Computes 64-bit FNV-1a hash of a sequence of bytes.
+	/// Used to detect changes of data; the hash is not suitable for cryptographic purposes.
+	inline std::uint64_t hashFnv1a64(const void* data, size_t size, std::uint64_t hash = 14695981039346656037ULL)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
 	/// The functional analogue of <b>PG_DEBUG</b> flag.
 	inline auto pgDebug() -> bool
 	{ 
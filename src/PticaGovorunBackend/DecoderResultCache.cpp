@@ -0,0 +1,251 @@
+#include "DecoderResultCache.h"
+#include <cstring>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include "CoreUtils.h"
+
+namespace PticaGovorun
+{
+	namespace
+	{
+		const char FileHeader[] = "PGDECCACHE1\n";
+		const size_t FileHeaderSize = sizeof(FileHeader) - 1;
+
+		// record: payloadSize (uint32), payload, checksum of payload (uint32)
+		// payload: key, hypothesis, wordsCount (uint32), words
+		// string: size in bytes (uint32), utf8 bytes
+		// word: string, begSample (int32), endSample (int32), prob (float)
+		const size_t RecordOverheadSize = 2 * sizeof(std::uint32_t);
+
+		template <typename T>
+		void appendPod(T value, std::string& buf)
+		{
+			buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		void appendString(boost::wstring_view value, std::string& utf8Buf, std::string& buf)
+		{
+			utf8Buf.clear();
+			toUtf8StdString(value, utf8Buf);
+			appendPod((std::uint32_t)utf8Buf.size(), buf);
+			buf.append(utf8Buf);
+		}
+
+		std::uint32_t payloadChecksum(boost::string_view payload)
+		{
+			return (std::uint32_t)hashFnv1a64(payload.data(), payload.size());
+		}
+
+		// Reads the binary values sequentially; stops on the first value which doesn't fit into the data.
+		class PayloadReader
+		{
+			boost::string_view data_;
+			bool ok_ = true;
+		public:
+			explicit PayloadReader(boost::string_view data) : data_(data) {}
+
+			bool ok() const { return ok_; }
+
+			template <typename T>
+			T readPod()
+			{
+				T value = T();
+				if (!ok_ || data_.size() < sizeof(T))
+				{
+					ok_ = false;
+					return value;
+				}
+				std::memcpy(&value, data_.data(), sizeof(T));
+				data_.remove_prefix(sizeof(T));
+				return value;
+			}
+
+			void readString(std::wstring& value)
+			{
+				auto size = readPod<std::uint32_t>();
+				if (!ok_ || data_.size() < size)
+				{
+					ok_ = false;
+					return;
+				}
+				value = utf8s2ws(data_.substr(0, size));
+				data_.remove_prefix(size);
+			}
+		};
+
+		DecoderCacheKey readKey(PayloadReader& reader)
+		{
+			DecoderCacheKey key;
+			key.SamplesHash = reader.readPod<std::uint64_t>();
+			key.ModelHash = reader.readPod<std::uint64_t>();
+			key.ConfigHash = reader.readPod<std::uint64_t>();
+			key.SamplesCount = reader.readPod<std::uint32_t>();
+			return key;
+		}
+	}
+
+	DecoderCacheKey makeDecoderCacheKey(gsl::span<const short> samples, float sampleRate, boost::wstring_view modelVersion, boost::string_view decoderConfig)
+	{
+		DecoderCacheKey key;
+		key.SamplesHash = hashFnv1a64(&sampleRate, sizeof(sampleRate));
+		key.SamplesHash = hashFnv1a64(samples.data(), samples.size() * sizeof(short), key.SamplesHash);
+		key.ModelHash = hashFnv1a64(modelVersion.data(), modelVersion.size() * sizeof(wchar_t));
+		key.ConfigHash = hashFnv1a64(decoderConfig.data(), decoderConfig.size());
+		key.SamplesCount = (std::uint32_t)samples.size();
+		return key;
+	}
+
+	void appendFileFingerprint(const boost::filesystem::path& filePath, std::string& decoderConfig)
+	{
+		boost::system::error_code ec;
+		std::int64_t fileSize = (std::int64_t)boost::filesystem::file_size(filePath, ec);
+		if (ec)
+			fileSize = -1;
+		std::int64_t modifTime = (std::int64_t)boost::filesystem::last_write_time(filePath, ec);
+		if (ec)
+			modifTime = 0;
+
+		decoderConfig.append(toUtf8StdString(filePath.wstring()));
+		decoderConfig.push_back('|');
+		decoderConfig.append(std::to_string(fileSize));
+		decoderConfig.push_back('|');
+		decoderConfig.append(std::to_string(modifTime));
+		decoderConfig.push_back('\n');
+	}
+
+	bool DecoderResultCache::open(const boost::filesystem::path& filePath, ErrMsgList* errMsg)
+	{
+		std::lock_guard<std::mutex> lk(mutex_);
+		keyToOffset_.clear();
+		file_.close();
+		file_.setFileName(toQStringBfs(filePath));
+		if (!file_.open(QIODevice::ReadWrite))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't open decoder cache (%1%)") % filePath.string()));
+			return false;
+		}
+
+		if (file_.size() == 0)
+		{
+			if (file_.write(FileHeader, FileHeaderSize) != (qint64)FileHeaderSize || !file_.flush())
+			{
+				pushErrorMsg(errMsg, str(boost::format("Can't write decoder cache (%1%)") % filePath.string()));
+				return false;
+			}
+			return true;
+		}
+
+		QByteArray bytes = file_.readAll();
+		boost::string_view data(bytes.constData(), bytes.size());
+		if (data.substr(0, FileHeaderSize) != boost::string_view(FileHeader, FileHeaderSize))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Unknown format of decoder cache (%1%)") % filePath.string()));
+			return false;
+		}
+
+		// build the index; only the key of each record is parsed
+		size_t offset = FileHeaderSize;
+		while (data.size() - offset >= RecordOverheadSize)
+		{
+			std::uint32_t payloadSize;
+			std::memcpy(&payloadSize, data.data() + offset, sizeof(payloadSize));
+			if (data.size() - offset - RecordOverheadSize < payloadSize)
+				break;
+
+			boost::string_view payload = data.substr(offset + sizeof(std::uint32_t), payloadSize);
+			std::uint32_t checksum;
+			std::memcpy(&checksum, payload.data() + payload.size(), sizeof(checksum));
+			if (checksum != payloadChecksum(payload))
+				break;
+
+			PayloadReader reader(payload);
+			DecoderCacheKey key = readKey(reader);
+			if (!reader.ok())
+				break;
+			keyToOffset_[key] = (std::int64_t)offset;
+			offset += RecordOverheadSize + payloadSize;
+		}
+
+		// drop the torn record, so that new records are appended right after the last valid one
+		if (offset < data.size() && !file_.resize((qint64)offset))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't truncate decoder cache (%1%)") % filePath.string()));
+			return false;
+		}
+		return true;
+	}
+
+	bool DecoderResultCache::find(const DecoderCacheKey& key, DecodedResult& result) const
+	{
+		std::lock_guard<std::mutex> lk(mutex_);
+		auto it = keyToOffset_.find(key);
+		if (it == keyToOffset_.end())
+			return false;
+
+		std::uint32_t payloadSize;
+		if (!file_.seek(it->second) ||
+			file_.read(reinterpret_cast<char*>(&payloadSize), sizeof(payloadSize)) != sizeof(payloadSize))
+			return false;
+		recordBuf_.resize(payloadSize);
+		if (file_.read(&recordBuf_[0], payloadSize) != (qint64)payloadSize)
+			return false;
+
+		PayloadReader reader(recordBuf_);
+		readKey(reader);
+		reader.readString(result.Hypothesis);
+		auto wordsCount = reader.readPod<std::uint32_t>();
+		result.Words.clear();
+		for (std::uint32_t i = 0; i < wordsCount && reader.ok(); ++i)
+		{
+			DecodedWord word;
+			reader.readString(word.Word);
+			word.BegSample = reader.readPod<std::int32_t>();
+			word.EndSample = reader.readPod<std::int32_t>();
+			word.Prob = reader.readPod<float>();
+			result.Words.push_back(std::move(word));
+		}
+		return reader.ok();
+	}
+
+	bool DecoderResultCache::put(const DecoderCacheKey& key, const DecodedResult& result, ErrMsgList* errMsg)
+	{
+		std::lock_guard<std::mutex> lk(mutex_);
+		recordBuf_.clear();
+		appendPod((std::uint32_t)0, recordBuf_); // payload size is patched below
+
+		appendPod(key.SamplesHash, recordBuf_);
+		appendPod(key.ModelHash, recordBuf_);
+		appendPod(key.ConfigHash, recordBuf_);
+		appendPod(key.SamplesCount, recordBuf_);
+
+		std::string utf8Buf;
+		appendString(result.Hypothesis, utf8Buf, recordBuf_);
+		appendPod((std::uint32_t)result.Words.size(), recordBuf_);
+		for (const DecodedWord& word : result.Words)
+		{
+			appendString(word.Word, utf8Buf, recordBuf_);
+			appendPod((std::int32_t)word.BegSample, recordBuf_);
+			appendPod((std::int32_t)word.EndSample, recordBuf_);
+			appendPod(word.Prob, recordBuf_);
+		}
+
+		std::uint32_t payloadSize = (std::uint32_t)(recordBuf_.size() - sizeof(std::uint32_t));
+		std::memcpy(&recordBuf_[0], &payloadSize, sizeof(payloadSize));
+		appendPod(payloadChecksum(boost::string_view(recordBuf_).substr(sizeof(std::uint32_t))), recordBuf_);
+
+		qint64 offset = file_.size();
+		if (!file_.seek(offset) || file_.write(recordBuf_.data(), recordBuf_.size()) != (qint64)recordBuf_.size() || !file_.flush())
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't write decoder cache (%1%)") % file_.fileName().toStdString()));
+			return false;
+		}
+		keyToOffset_[key] = (std::int64_t)offset;
+		return true;
+	}
+
+	size_t DecoderResultCache::size() const
+	{
+		std::lock_guard<std::mutex> lk(mutex_);
+		return keyToOffset_.size();
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <QFile>
+#include <boost/filesystem/path.hpp>
+#include <boost/utility/string_view.hpp>
+#include <gsl/span>
+#include "PticaGovorunCore.h"
+#include "ComponentsInfrastructure.h"
+
+namespace PticaGovorun
+{
+	/// The word, recognized by the speech decoder.
+	struct DecodedWord
+	{
+		std::wstring Word; // pronCode
+		long BegSample = -1;
+		long EndSample = -1;
+		float Prob = 0; // posterior probability
+	};
+
+	struct DecodedResult
+	{
+		std::wstring Hypothesis;
+		std::vector<DecodedWord> Words;
+	};
+
+	/// Identifies the result of decoding of the audio with the specific speech model and decoder parameters.
+	struct DecoderCacheKey
+	{
+		std::uint64_t SamplesHash = 0; // samples and sample rate
+		std::uint64_t ModelHash = 0; // speech model version
+		std::uint64_t ConfigHash = 0; // decoder parameters
+		std::uint32_t SamplesCount = 0;
+
+		bool operator==(const DecoderCacheKey& other) const
+		{
+			return SamplesHash == other.SamplesHash && ModelHash == other.ModelHash &&
+				ConfigHash == other.ConfigHash && SamplesCount == other.SamplesCount;
+		}
+	};
+
+	PG_EXPORTS DecoderCacheKey makeDecoderCacheKey(gsl::span<const short> samples, float sampleRate, boost::wstring_view modelVersion, boost::string_view decoderConfig);
+
+	/// Appends the path, size and modification time of the file, so that the decoder configuration changes when
+	/// the file (eg language model) is rebuilt.
+	PG_EXPORTS void appendFileFingerprint(const boost::filesystem::path& filePath, std::string& decoderConfig);
+
+	/// Persists results of the speech decoder, so that the same audio is not decoded again with the same model.
+	/// The results are appended to the file; the index of keys to offsets of records is kept in memory and
+	/// the record is read from the file on request. Methods may be called from multiple threads.
+	class PG_EXPORTS DecoderResultCache
+	{
+		struct KeyHasher
+		{
+			size_t operator()(const DecoderCacheKey& key) const
+			{
+				return (size_t)(key.SamplesHash ^ key.ModelHash ^ key.ConfigHash);
+			}
+		};
+
+		mutable QFile file_;
+		std::unordered_map<DecoderCacheKey, std::int64_t, KeyHasher> keyToOffset_;
+		mutable std::mutex mutex_;
+		mutable std::string recordBuf_;
+	public:
+		/// Creates the file if it doesn't exist. The record, which was partially written when the previous
+		/// process was interrupted, is cut off.
+		bool open(const boost::filesystem::path& filePath, ErrMsgList* errMsg);
+
+		/// Returns false if there is no result for the key.
+		bool find(const DecoderCacheKey& key, DecodedResult& result) const;
+
+		/// Appends the result to the file. The later result for the same key overrides the earlier one.
+		bool put(const DecoderCacheKey& key, const DecodedResult& result, ErrMsgList* errMsg);
+
+		size_t size() const;
+	};
+}
@@ -1,6 +1,7 @@
 #include "FileHelpers.h"
 #include <boost/format.hpp>
 #include <QFile>
+#include <QSaveFile>
 #include <QTextStream>
 
 namespace PticaGovorun
@@ -20,4 +21,46 @@ namespace PticaGovorun
 		text.append(textBytes.data(), textBytes.size());
 		return true;
 	}
-}
+
+	bool readAllBytes(const boost::filesystem::path& filePath, std::vector<char>& bytes, ErrMsgList* errMsg)
+	{
+		QFile file(toQString(filePath.wstring()));
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			if (errMsg != nullptr) errMsg->utf8Msg = str(boost::format("Can't read file %s") % filePath.string());
+			return false;
+		}
+
+		qint64 fileSize = file.size();
+		bytes.resize((size_t)fileSize);
+		if (fileSize > 0 && file.read(bytes.data(), fileSize) != fileSize)
+		{
+			if (errMsg != nullptr) errMsg->utf8Msg = str(boost::format("Can't read file %s") % filePath.string());
+			return false;
+		}
+		return true;
+	}
+
+	bool writeAllBytes(const boost::filesystem::path& filePath, boost::string_view bytes, ErrMsgList* errMsg)
+	{
+		// the bytes go into the temporary file, which replaces the target on commit
+		QSaveFile file(toQString(filePath.wstring()));
+		if (!file.open(QIODevice::WriteOnly))
+		{
+			if (errMsg != nullptr) errMsg->utf8Msg = str(boost::format("Can't write file %s") % filePath.string());
+			return false;
+		}
+
+		if (!bytes.empty() && file.write(bytes.data(), bytes.size()) != (qint64)bytes.size())
+		{
+			if (errMsg != nullptr) errMsg->utf8Msg = str(boost::format("Can't write file %s") % filePath.string());
+			return false;
+		}
+		if (!file.commit())
+		{
+			if (errMsg != nullptr) errMsg->utf8Msg = str(boost::format("Can't replace file %s") % filePath.string());
+			return false;
+		}
+		return true;
+	}
+}
\ No newline at end of file
@@ -1,10 +1,18 @@
 #pragma once
 #include <string>
+#include <vector>
 #include <boost/filesystem.hpp>
+#include <boost/utility/string_view.hpp>
 #include "PticaGovorunCore.h" // PG_EXPORTS
 #include "ComponentsInfrastructure.h"
 
 namespace PticaGovorun
 {
 	PG_EXPORTS bool readAllText(const boost::filesystem::path& appExeRelPath, std::string& text, ErrMsgList* errMsg);
+
+	/// Reads the file content without any conversion. The buffer is resized to the file size.
+	PG_EXPORTS bool readAllBytes(const boost::filesystem::path& filePath, std::vector<char>& bytes, ErrMsgList* errMsg);
+
+	/// Writes the bytes into the file with one call. The file is replaced atomically, so the interrupted write leaves the old file.
+	PG_EXPORTS bool writeAllBytes(const boost::filesystem::path& filePath, boost::string_view bytes, ErrMsgList* errMsg);
 }
@@ -0,0 +1,326 @@
+#include "KaldiFeatureArchive.h"
+#include <cstdint>
+#include <cstring>
+#include <boost/format.hpp>
+#include "CoreUtils.h"
+#include "FileHelpers.h"
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	namespace
+	{
+		// binary object starts with \0B, then goes the token of the matrix type
+		const char BinaryMarker[2] = { '\0', 'B' };
+		const char FloatMatrixToken[3] = { 'F', 'M', ' ' };
+		const char DoubleMatrixToken[3] = { 'D', 'M', ' ' };
+		const size_t MatrixHeaderSize = sizeof(BinaryMarker) + sizeof(FloatMatrixToken) + 2 * (1 + sizeof(std::int32_t));
+	}
+
+	bool KaldiArchiveWriter::open(const boost::filesystem::path& arkFilePath, const boost::filesystem::path& scpFilePath, ErrMsgList* errMsg)
+	{
+		arkFile_.setFileName(toQStringBfs(arkFilePath));
+		if (!arkFile_.open(QIODevice::WriteOnly))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't open file for writing (%1%)") % arkFilePath.string()));
+			return false;
+		}
+		arkPathUtf8_ = toUtf8StdString(arkFilePath.wstring());
+		scpFilePath_ = scpFilePath;
+		scpBuf_.clear();
+		return true;
+	}
+
+	void KaldiArchiveWriter::setScpArkPath(const boost::filesystem::path& arkPath)
+	{
+		arkPathUtf8_ = toUtf8StdString(arkPath.wstring());
+	}
+
+	bool KaldiArchiveWriter::writeMatrix(boost::string_view key, gsl::span<const float> data, int cols, ErrMsgList* errMsg)
+	{
+		if (key.find(' ') != boost::string_view::npos)
+		{
+			pushErrorMsg(errMsg, str(boost::format("Key of the matrix can't contain spaces (%1%)") % key));
+			return false;
+		}
+		PG_Assert(cols > 0 && data.size() % cols == 0);
+		std::int32_t rowsInt = (std::int32_t)(data.size() / cols);
+		std::int32_t colsInt = cols;
+
+		// key <space> \0B FM <space> (int32 size, rows) (int32 size, cols) data
+		matHeader_.assign(key.data(), key.size());
+		matHeader_.push_back(' ');
+		qint64 matOffset = arkFile_.pos() + (qint64)matHeader_.size(); // scp refers to the matrix, not to the key
+		matHeader_.append(BinaryMarker, sizeof(BinaryMarker));
+		matHeader_.append(FloatMatrixToken, sizeof(FloatMatrixToken));
+		matHeader_.push_back((char)sizeof(rowsInt));
+		matHeader_.append(reinterpret_cast<const char*>(&rowsInt), sizeof(rowsInt));
+		matHeader_.push_back((char)sizeof(colsInt));
+		matHeader_.append(reinterpret_cast<const char*>(&colsInt), sizeof(colsInt));
+
+		qint64 dataSize = (qint64)(data.size() * sizeof(float));
+		if (arkFile_.write(matHeader_.data(), matHeader_.size()) != (qint64)matHeader_.size() ||
+			arkFile_.write(reinterpret_cast<const char*>(data.data()), dataSize) != dataSize)
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't write matrix into archive (%1%)") % arkPathUtf8_));
+			return false;
+		}
+
+		// key <space> arkPath:offset
+		scpBuf_.append(key.data(), key.size());
+		scpBuf_.push_back(' ');
+		scpBuf_.append(arkPathUtf8_);
+		scpBuf_.push_back(':');
+		scpBuf_.append(std::to_string(matOffset));
+		scpBuf_.push_back('\n');
+		return true;
+	}
+
+	bool KaldiArchiveWriter::close(ErrMsgList* errMsg)
+	{
+		// the buffered tail of the archive is written on flush, so the disk full error shows up here
+		bool flushed = arkFile_.flush();
+		arkFile_.close();
+		if (!flushed || arkFile_.error() != QFileDevice::NoError)
+		{
+			pushErrorMsg(errMsg, toUtf8StdString(arkFile_.errorString()));
+			pushErrorMsg(errMsg, str(boost::format("Can't write archive (%1%)") % arkPathUtf8_));
+			return false;
+		}
+		if (scpFilePath_.empty())
+			return true;
+		return writeAllBytes(scpFilePath_, scpBuf_, errMsg);
+	}
+
+	KaldiArchiveReader::~KaldiArchiveReader()
+	{
+		for (MappedArchive& archive : archives_)
+		{
+			if (archive.Data != nullptr)
+				archive.File->unmap(const_cast<uchar*>(archive.Data));
+		}
+	}
+
+	bool KaldiArchiveReader::mapArchive(const boost::filesystem::path& arkFilePath, int& archiveInd, ErrMsgList* errMsg)
+	{
+		MappedArchive archive;
+		archive.FilePath = arkFilePath;
+		archive.File = std::make_unique<QFile>(toQStringBfs(arkFilePath));
+		if (!archive.File->open(QIODevice::ReadOnly))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't open file for reading (%1%)") % arkFilePath.string()));
+			return false;
+		}
+		archive.Size = (size_t)archive.File->size();
+		if (archive.Size > 0)
+		{
+			archive.Data = archive.File->map(0, archive.Size);
+			if (archive.Data == nullptr)
+			{
+				pushErrorMsg(errMsg, str(boost::format("Can't map file into memory (%1%)") % arkFilePath.string()));
+				return false;
+			}
+		}
+		archiveInd = (int)archives_.size();
+		archives_.push_back(std::move(archive));
+		return true;
+	}
+
+	bool KaldiArchiveReader::openScp(const boost::filesystem::path& scpFilePath, ErrMsgList* errMsg)
+	{
+		std::vector<char> bytes;
+		if (!readAllBytes(scpFilePath, bytes, errMsg))
+			return false;
+
+		std::unordered_map<std::string, int> arkPathToInd;
+		boost::string_view text(bytes.data(), bytes.size());
+		while (!text.empty())
+		{
+			size_t eolInd = text.find('\n');
+			boost::string_view line = text.substr(0, eolInd);
+			text.remove_prefix(eolInd == boost::string_view::npos ? text.size() : eolInd + 1);
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+			if (line.empty())
+				continue;
+
+			// key <space> arkPath:offset
+			size_t spaceInd = line.find(' ');
+			size_t colonInd = line.rfind(':');
+			if (spaceInd == boost::string_view::npos || colonInd == boost::string_view::npos || colonInd < spaceInd)
+			{
+				pushErrorMsg(errMsg, str(boost::format("Can't parse scp line (%1%)") % line.to_string()));
+				return false;
+			}
+			std::string key = line.substr(0, spaceInd).to_string();
+			std::string arkPath = line.substr(spaceInd + 1, colonInd - spaceInd - 1).to_string();
+			std::string offsetStr = line.substr(colonInd + 1).to_string();
+
+			auto arkIt = arkPathToInd.find(arkPath);
+			if (arkIt == arkPathToInd.end())
+			{
+				boost::filesystem::path arkFilePath = utf8s2ws(arkPath);
+				if (arkFilePath.is_relative())
+					arkFilePath = scpFilePath.parent_path() / arkFilePath;
+
+				int archiveInd = -1;
+				if (!mapArchive(arkFilePath, archiveInd, errMsg))
+					return false;
+				arkIt = arkPathToInd.insert(std::make_pair(arkPath, archiveInd)).first;
+			}
+
+			MatrixLocation loc{ arkIt->second, (size_t)std::stoull(offsetStr) };
+			if (keyToLocation_.insert(std::make_pair(key, loc)).second)
+				keys_.push_back(key);
+		}
+		return true;
+	}
+
+	bool KaldiArchiveReader::openArk(const boost::filesystem::path& arkFilePath, ErrMsgList* errMsg)
+	{
+		int archiveInd = -1;
+		if (!mapArchive(arkFilePath, archiveInd, errMsg))
+			return false;
+
+		const MappedArchive& archive = archives_[archiveInd];
+		const char* data = reinterpret_cast<const char*>(archive.Data);
+		size_t pos = 0;
+		while (pos < archive.Size)
+		{
+			const char* spacePtr = static_cast<const char*>(std::memchr(data + pos, ' ', archive.Size - pos));
+			if (spacePtr == nullptr)
+			{
+				pushErrorMsg(errMsg, "Can't find the key of the matrix");
+				return false;
+			}
+			std::string key(data + pos, spacePtr);
+			size_t matOffset = spacePtr + 1 - data;
+
+			bool isDouble = false;
+			int rows = -1;
+			int cols = -1;
+			size_t dataOffset = 0;
+			if (!parseMatrixHeader(archive, matOffset, isDouble, rows, cols, dataOffset, errMsg))
+				return false;
+
+			if (keyToLocation_.insert(std::make_pair(key, MatrixLocation{ archiveInd, matOffset })).second)
+				keys_.push_back(key);
+			pos = dataOffset + (size_t)rows * cols * (isDouble ? sizeof(double) : sizeof(float));
+		}
+		return true;
+	}
+
+	const std::vector<std::string>& KaldiArchiveReader::keys() const
+	{
+		return keys_;
+	}
+
+	bool KaldiArchiveReader::contains(boost::string_view key) const
+	{
+		return keyToLocation_.find(key.to_string()) != keyToLocation_.end();
+	}
+
+	bool KaldiArchiveReader::matrixLocation(boost::string_view key, boost::filesystem::path& arkFilePath, size_t& offset, ErrMsgList* errMsg) const
+	{
+		auto it = keyToLocation_.find(key.to_string());
+		if (it == keyToLocation_.end())
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't find matrix (%1%)") % key.to_string()));
+			return false;
+		}
+		arkFilePath = archives_[it->second.ArchiveInd].FilePath;
+		offset = it->second.Offset;
+		return true;
+	}
+
+	bool KaldiArchiveReader::parseMatrixHeader(const MappedArchive& archive, size_t offset, bool& isDouble, int& rows, int& cols, size_t& dataOffset, ErrMsgList* errMsg) const
+	{
+		if (offset + MatrixHeaderSize > archive.Size)
+		{
+			pushErrorMsg(errMsg, "Unexpected end of the archive");
+			return false;
+		}
+		const char* header = reinterpret_cast<const char*>(archive.Data) + offset;
+		if (std::memcmp(header, BinaryMarker, sizeof(BinaryMarker)) != 0)
+		{
+			pushErrorMsg(errMsg, "Only binary archives are supported");
+			return false;
+		}
+		header += sizeof(BinaryMarker);
+
+		if (std::memcmp(header, FloatMatrixToken, sizeof(FloatMatrixToken)) == 0)
+			isDouble = false;
+		else if (std::memcmp(header, DoubleMatrixToken, sizeof(DoubleMatrixToken)) == 0)
+			isDouble = true;
+		else
+		{
+			pushErrorMsg(errMsg, "Only float and double matrices are supported");
+			return false;
+		}
+		header += sizeof(FloatMatrixToken);
+
+		std::int32_t dims[2];
+		for (std::int32_t& dim : dims)
+		{
+			if (*header != (char)sizeof(std::int32_t))
+			{
+				pushErrorMsg(errMsg, "Matrix dimensions must be int32");
+				return false;
+			}
+			std::memcpy(&dim, header + 1, sizeof(dim));
+			header += 1 + sizeof(dim);
+		}
+		rows = dims[0];
+		cols = dims[1];
+		dataOffset = offset + MatrixHeaderSize;
+		if (rows < 0 || cols < 0)
+		{
+			pushErrorMsg(errMsg, "Matrix dimensions must be non-negative");
+			return false;
+		}
+
+		size_t dataSize = (size_t)rows * cols * (isDouble ? sizeof(double) : sizeof(float));
+		if (dataOffset + dataSize > archive.Size)
+		{
+			pushErrorMsg(errMsg, "Matrix data exceeds the archive");
+			return false;
+		}
+		return true;
+	}
+
+	bool KaldiArchiveReader::readMatrix(boost::string_view key, std::vector<float>& data, int& rows, int& cols, ErrMsgList* errMsg) const
+	{
+		auto it = keyToLocation_.find(key.to_string());
+		if (it == keyToLocation_.end())
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't find matrix (%1%)") % key.to_string()));
+			return false;
+		}
+
+		const MappedArchive& archive = archives_[it->second.ArchiveInd];
+		bool isDouble = false;
+		size_t dataOffset = 0;
+		if (!parseMatrixHeader(archive, it->second.Offset, isDouble, rows, cols, dataOffset, errMsg))
+			return false;
+
+		// the data in the archive is not aligned, hence is copied
+		size_t count = (size_t)rows * cols;
+		data.resize(count);
+		const uchar* src = archive.Data + dataOffset;
+		if (!isDouble)
+		{
+			if (count > 0)
+				std::memcpy(data.data(), src, count * sizeof(float));
+		}
+		else
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				double value;
+				std::memcpy(&value, src + i * sizeof(double), sizeof(double));
+				data[i] = (float)value;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <QFile>
+#include <boost/filesystem/path.hpp>
+#include <boost/utility/string_view.hpp>
+#include <gsl/span>
+#include "PticaGovorunCore.h"
+#include "ComponentsInfrastructure.h"
+
+namespace PticaGovorun
+{
+	/// Writes float matrices (eg features of utterances) in Kaldi's binary archive format (ark)
+	/// and the index of matrices (scp), which maps the key of each matrix to its offset in the archive.
+	class PG_EXPORTS KaldiArchiveWriter
+	{
+		QFile arkFile_;
+		std::string arkPathUtf8_;
+		boost::filesystem::path scpFilePath_;
+		std::string scpBuf_;
+		std::string matHeader_;
+	public:
+		/// scpFilePath may be empty, then the index is not written.
+		bool open(const boost::filesystem::path& arkFilePath, const boost::filesystem::path& scpFilePath, ErrMsgList* errMsg);
+
+		/// Sets the path of the archive as it is written into the index. By default it is the path the archive was opened with.
+		/// The relative path is resolved by KaldiArchiveReader against the directory of the scp file.
+		void setScpArkPath(const boost::filesystem::path& arkPath);
+
+		/// Appends the matrix with rows=data.size()/cols. The key must not contain spaces.
+		bool writeMatrix(boost::string_view key, gsl::span<const float> data, int cols, ErrMsgList* errMsg);
+
+		/// Flushes the archive and writes the index.
+		bool close(ErrMsgList* errMsg);
+	};
+
+	/// Reads matrices from Kaldi's binary archives by key. The archives are mapped into memory.
+	/// Float (FM) and double (DM) matrices are supported; compressed matrices are not.
+	class PG_EXPORTS KaldiArchiveReader
+	{
+		struct MatrixLocation
+		{
+			int ArchiveInd;
+			size_t Offset; // offset of the binary matrix in the archive
+		};
+		struct MappedArchive
+		{
+			boost::filesystem::path FilePath;
+			std::unique_ptr<QFile> File;
+			const uchar* Data = nullptr;
+			size_t Size = 0;
+		};
+		std::vector<MappedArchive> archives_;
+		std::vector<std::string> keys_; // in the order of the scp or the archive
+		std::unordered_map<std::string, MatrixLocation> keyToLocation_;
+	public:
+		KaldiArchiveReader() = default;
+		KaldiArchiveReader(const KaldiArchiveReader&) = delete;
+		KaldiArchiveReader& operator=(const KaldiArchiveReader&) = delete;
+		~KaldiArchiveReader();
+
+		/// Loads the index of matrices. The scp lines have the format: key arkPath:offset
+		/// The relative arkPath is resolved against the directory of the scp file.
+		bool openScp(const boost::filesystem::path& scpFilePath, ErrMsgList* errMsg);
+
+		/// Scans the archive to find all matrices. Used when there is no scp file.
+		bool openArk(const boost::filesystem::path& arkFilePath, ErrMsgList* errMsg);
+
+		const std::vector<std::string>& keys() const;
+		bool contains(boost::string_view key) const;
+
+		/// Gets the archive and the offset of the matrix, as they are referred from scp files.
+		bool matrixLocation(boost::string_view key, boost::filesystem::path& arkFilePath, size_t& offset, ErrMsgList* errMsg) const;
+
+		/// Reads the matrix row by row into data.
+		bool readMatrix(boost::string_view key, std::vector<float>& data, int& rows, int& cols, ErrMsgList* errMsg) const;
+	private:
+		bool mapArchive(const boost::filesystem::path& arkFilePath, int& archiveInd, ErrMsgList* errMsg);
+
+		/// Parses the header of the binary matrix at offset. dataOffset is the offset of the first element.
+		bool parseMatrixHeader(const MappedArchive& archive, size_t offset, bool& isDouble, int& rows, int& cols, size_t& dataOffset, ErrMsgList* errMsg) const;
+	};
+}
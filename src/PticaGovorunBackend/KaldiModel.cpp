@@ -1,5 +1,10 @@
 #include "KaldiModel.h"
+#include <array>
 #include <boost/format.hpp>
+#include "CoreUtils.h"
+#include "FileHelpers.h"
+#include "KaldiFeatureArchive.h"
+#include "ParallelUtils.h"
 
 namespace PticaGovorun
 {
@@ -12,6 +17,12 @@ namespace PticaGovorun
 	{
 	}
 
+	void KaldiModelBuilder::setSegmentFeatures(const boost::filesystem::path& trainScpFilePath, const boost::filesystem::path& testScpFilePath)
+	{
+		segFeatsScpPaths_[0] = trainScpFilePath;
+		segFeatsScpPaths_[1] = testScpFilePath;
+	}
+
 	bool KaldiModelBuilder::generate(gsl::span<const AssignedPhaseAudioSegment> segRefs, ErrMsgList* errMsg) const
 	{
 		if (!boost::filesystem::create_directories(outDirPath_))
@@ -19,46 +30,60 @@ namespace PticaGovorun
 			pushErrorMsg(errMsg, str(boost::format("Can't create output directory (%1%)") % outDirPath_.string()));
 			return false;
 		}
-		std::vector<AssignedPhaseAudioSegmentAndUttId> segAndUttIds;
-		segAndUttIds.reserve(segRefs.size());
-		std::transform(segRefs.begin(), segRefs.end(), std::back_inserter(segAndUttIds), [](const auto& segRef)
+
+		// partition segments by phase once, so that each writer gets only its utterances
+		std::array<std::vector<AssignedPhaseAudioSegmentAndUttId>, 2> phaseSegs; // train, test
+		for (const AssignedPhaseAudioSegment& segRef : segRefs)
 		{
 			std::string uttId;
 			createUtteranceId(segRef, &uttId);
-			return AssignedPhaseAudioSegmentAndUttId{ &segRef, std::move(uttId) };
-		});
+			auto& segs = phaseSegs[segRef.Phase == ResourceUsagePhase::Train ? 0 : 1];
+			segs.push_back(AssignedPhaseAudioSegmentAndUttId{ &segRef, std::move(uttId) });
+		}
 
 		// each line in wav.scp must be sorted by speakerId and then by uttId
-		std::sort(segAndUttIds.begin(), segAndUttIds.end(), [](const auto& x, const auto& y)
+		for (auto& segs : phaseSegs)
 		{
-			return x.UttId < y.UttId;
-		});
+			std::sort(segs.begin(), segs.end(), [](const auto& x, const auto& y)
+			{
+				return x.UttId < y.UttId;
+			});
+		}
 
-		if (!writeUttId2SpeakerId(segAndUttIds, ResourceUsagePhase::Train, outDirPath_ / "train_utt2spk", errMsg))
-			return false;
-		if (!writeUttId2SpeakerId(segAndUttIds, ResourceUsagePhase::Test, outDirPath_ / "test_utt2spk", errMsg))
-			return false;
-		if (!writeUttId2WavPathAbs(segAndUttIds, ResourceUsagePhase::Train, outDirPath_ / "train_wav.scp", errMsg))
-			return false;
-		if (!writeUttId2WavPathAbs(segAndUttIds, ResourceUsagePhase::Test, outDirPath_ / "test_wav.scp", errMsg))
-			return false;
-		if (!writeUttId2Transcription(segAndUttIds, ResourceUsagePhase::Train, pronCodeDisplayTrain_, outDirPath_ / "train_text", errMsg))
-			return false;
-		if (!writeUttId2Transcription(segAndUttIds, ResourceUsagePhase::Test, pronCodeDisplayTest_, outDirPath_ / "test_text", errMsg))
-			return false;
-		
-		std::map<boost::string_view, std::vector<boost::string_view>> spkId2UttIdListTrain;
-		createSpkIdToUttIdListMap(segAndUttIds, ResourceUsagePhase::Train, &spkId2UttIdListTrain);
-		if (!writeSpkId2UttIdList(spkId2UttIdListTrain, outDirPath_ / "train_spk2uttId.map", errMsg))
-			return false;
+		std::vector<std::function<auto (ErrMsgList* errMsg) -> bool>> writers;
+		for (size_t phaseInd = 0; phaseInd < phaseSegs.size(); ++phaseInd)
+		{
+			gsl::span<const AssignedPhaseAudioSegmentAndUttId> segs = phaseSegs[phaseInd];
+			std::string prefix = phaseInd == 0 ? "train_" : "test_";
+			auto pronCodeDisplay = phaseInd == 0 ? pronCodeDisplayTrain_ : pronCodeDisplayTest_;
+
+			writers.push_back([=](ErrMsgList* errMsg) { return writeUttId2SpeakerId(segs, outDirPath_ / (prefix + "utt2spk"), errMsg); });
+			writers.push_back([=](ErrMsgList* errMsg) { return writeUttId2WavPathAbs(segs, outDirPath_ / (prefix + "wav.scp"), errMsg); });
+			writers.push_back([=](ErrMsgList* errMsg) { return writeUttId2Transcription(segs, pronCodeDisplay, outDirPath_ / (prefix + "text"), errMsg); });
+			writers.push_back([=](ErrMsgList* errMsg) { return writeSpkId2UttIdList(segs, outDirPath_ / (prefix + "spk2uttId.map"), errMsg); });
+			boost::filesystem::path segFeatsScpPath = segFeatsScpPaths_[phaseInd];
+			if (!segFeatsScpPath.empty())
+				writers.push_back([=](ErrMsgList* errMsg) { return writeFeaturesScp(segs, segFeatsScpPath, outDirPath_ / (prefix + "feats.scp"), errMsg); });
+		}
 
-		std::map<boost::string_view, std::vector<boost::string_view>> spkId2UttIdListTest;
-		createSpkIdToUttIdListMap(segAndUttIds, ResourceUsagePhase::Test, &spkId2UttIdListTest);
-		if (!writeSpkId2UttIdList(spkId2UttIdListTest, outDirPath_ / "test_spk2uttId.map", errMsg))
-			return false;
+		std::vector<ErrMsgList> writerErrs(writers.size());
+		std::vector<char> writerOk(writers.size(), false);
+		parallelFor(writers.size(), -1, [&](size_t writerInd, int threadInd)
+		{
+			writerOk[writerInd] = writers[writerInd](&writerErrs[writerInd]);
+		});
 
+		for (size_t writerInd = 0; writerInd < writers.size(); ++writerInd)
+		{
+			if (!writerOk[writerInd])
+			{
+				pushErrorMsg(errMsg, str(writerErrs[writerInd]));
+				return false;
+			}
+		}
 		return true;
 	}
+
 	void KaldiModelBuilder::createUtteranceId(const AssignedPhaseAudioSegment& segRef, std::string* uttId)
 	{
 		// Kaldi requires all utterances to be sorted my speakerId
@@ -70,101 +95,51 @@ namespace PticaGovorun
 		uttId->append(segName.data(), segName.size());
 	}
 
-	void KaldiModelBuilder::createSpkIdToUttIdListMap(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs, ResourceUsagePhase targetPhase, std::map<boost::string_view, std::vector<boost::string_view>>* spkId2UttIdList)
-	{
-		for (const auto& segAndUttId : segsRefs)
-		{
-			if (segAndUttId.SegRef->Phase != targetPhase)
-				continue;
-
-			auto& uttIdList = (*spkId2UttIdList)[segAndUttId.SegRef->Seg->SpeakerBriefId];
-			uttIdList.push_back(segAndUttId.UttId);
-		}
-	}
-
-	bool KaldiModelBuilder::writeUttId2SpeakerId(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs, ResourceUsagePhase targetPhase,
+	bool KaldiModelBuilder::writeUttId2SpeakerId(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
 		const boost::filesystem::path& filePath,
 		ErrMsgList* errMsg) const
 	{
-		QFile file(toQStringBfs(filePath));
-		if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
-		{
-			pushErrorMsg(errMsg, str(boost::format("Can't open file for writing (%1%)") % filePath.string()));
-			return false;
-		}
-
-		QTextStream txtStream(&file);
-		txtStream.setCodec("UTF-8");
-		txtStream.setGenerateByteOrderMark(false);
-
-		std::vector<boost::wstring_view> pronCodes;
-		GrowOnlyPinArena<wchar_t> arena(1024);
-		std::string uttId;
+		std::string buf;
 		for (const auto& segAndUttId : segsRefs)
 		{
-			if (segAndUttId.SegRef->Phase != targetPhase)
-				continue;
-
 			// utteranceId <space> speakerId
-			txtStream << utf8ToQString(segAndUttId.UttId) << " " << utf8ToQString(segAndUttId.SegRef->Seg->SpeakerBriefId) << "\n";
+			buf.append(segAndUttId.UttId);
+			buf.push_back(' ');
+			buf.append(segAndUttId.SegRef->Seg->SpeakerBriefId);
+			buf.push_back('\n');
 		}
-		return true;
+		return writeAllBytes(filePath, buf, errMsg);
 	}
 
-	bool KaldiModelBuilder::writeUttId2WavPathAbs(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs, ResourceUsagePhase targetPhase,
+	bool KaldiModelBuilder::writeUttId2WavPathAbs(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
 		const boost::filesystem::path& filePath,
 		ErrMsgList* errMsg) const
 	{
-		QFile file(toQStringBfs(filePath));
-		if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
-		{
-			pushErrorMsg(errMsg, str(boost::format("Can't open file for writing (%1%)") % filePath.string()));
-			return false;
-		}
-
-		QTextStream txtStream(&file);
-		txtStream.setCodec("UTF-8");
-		txtStream.setGenerateByteOrderMark(false);
-
-		std::vector<boost::wstring_view> pronCodes;
-		GrowOnlyPinArena<wchar_t> arena(1024);
+		std::string buf;
 		for (const auto& segAndUttId : segsRefs)
 		{
-			if (segAndUttId.SegRef->Phase != targetPhase)
-				continue;
-
-			// utteranceId <space> speakerId
+			// utteranceId <space> wavFilePath
 			auto audioFilePathAbs = segAndUttId.SegRef->OutAudioSegPathParts.AudioSegFilePathNoExt + ".wav";
-			txtStream << utf8ToQString(segAndUttId.UttId) << " " << audioFilePathAbs << "\n";
+			buf.append(segAndUttId.UttId);
+			buf.push_back(' ');
+			buf.append(toUtf8StdString(audioFilePathAbs));
+			buf.push_back('\n');
 		}
-		return true;
+		return writeAllBytes(filePath, buf, errMsg);
 	}
 
-	bool KaldiModelBuilder::writeUttId2Transcription(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs, ResourceUsagePhase targetPhase,
+	bool KaldiModelBuilder::writeUttId2Transcription(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
 		std::function<auto (boost::wstring_view)->boost::wstring_view> pronCodeDisplay,
 		const boost::filesystem::path& filePath, ErrMsgList* errMsg) const
 	{
-		QFile file(toQStringBfs(filePath));
-		if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
-		{
-			pushErrorMsg(errMsg, str(boost::format("Can't open file for writing (%1%)") % filePath.string()));
-			return false;
-		}
-
-		QTextStream txtStream(&file);
-		txtStream.setCodec("UTF-8");
-		txtStream.setGenerateByteOrderMark(false);
-
+		std::string buf;
 		std::vector<boost::wstring_view> pronCodes;
 		GrowOnlyPinArena<wchar_t> arena(1024);
 		for (const auto& segAndUttId : segsRefs)
 		{
-			if (segAndUttId.SegRef->Phase != targetPhase)
-				continue;
-
-			// utteranceId <space> speakerId
-			auto audioFilePathAbs = segAndUttId.SegRef->OutAudioSegPathParts.AudioSegFilePathNoExt + ".wav";
-			txtStream << utf8ToQString(segAndUttId.UttId) << " ";
+			// utteranceId <space> transcription
+			buf.append(segAndUttId.UttId);
+			buf.push_back(' ');
 
 			// output TranscriptText mangling a pronCode if necessary (eg clothes(2)->clothes2)
 			pronCodes.clear();
@@ -180,42 +155,76 @@ namespace PticaGovorun
 				if (dispName != boost::wstring_view())
 					dispPronCode = dispName;
 
-				txtStream << toQString(dispPronCode) << " ";
+				toUtf8StdString(dispPronCode, buf);
+				buf.push_back(' ');
 			}
 
-			txtStream << "\n";
+			buf.push_back('\n');
 		}
-		return true;
+		return writeAllBytes(filePath, buf, errMsg);
 	}
 
-	bool KaldiModelBuilder::writeSpkId2UttIdList(const std::map<boost::string_view, std::vector<boost::string_view>>& spkId2UttIdList,
+	bool KaldiModelBuilder::writeSpkId2UttIdList(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
 		const boost::filesystem::path& filePath, ErrMsgList* errMsg) const
 	{
-		QFile file(toQStringBfs(filePath));
-		if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+		// group utterances by speaker; stable sort keeps utterances of each speaker ordered
+		std::vector<const AssignedPhaseAudioSegmentAndUttId*> segsBySpeaker;
+		segsBySpeaker.reserve(segsRefs.size());
+		for (const auto& segAndUttId : segsRefs)
+			segsBySpeaker.push_back(&segAndUttId);
+		std::stable_sort(segsBySpeaker.begin(), segsBySpeaker.end(), [](const auto* x, const auto* y)
 		{
-			pushErrorMsg(errMsg, str(boost::format("Can't open file for writing (%1%)") % filePath.string()));
-			return false;
-		}
-
-		QTextStream txtStream(&file);
-		txtStream.setCodec("UTF-8");
-		txtStream.setGenerateByteOrderMark(false);
+			return x->SegRef->Seg->SpeakerBriefId < y->SegRef->Seg->SpeakerBriefId;
+		});
 
-		std::vector<boost::wstring_view> pronCodes;
-		GrowOnlyPinArena<wchar_t> arena(1024);
-		for (const auto& spkId2UttIdListPair : spkId2UttIdList)
+		std::string buf;
+		const std::string* curSpkId = nullptr;
+		for (const AssignedPhaseAudioSegmentAndUttId* segAndUttId : segsBySpeaker)
 		{
-			const auto& spkId = spkId2UttIdListPair.first;
-			txtStream << utf8ToQString(spkId) << " ";
-
-			for (const auto& uttId : spkId2UttIdListPair.second)
+			const std::string& spkId = segAndUttId->SegRef->Seg->SpeakerBriefId;
+			if (curSpkId == nullptr || *curSpkId != spkId)
 			{
-				txtStream << utf8ToQString(uttId) << " ";
+				if (curSpkId != nullptr)
+					buf.push_back('\n');
+				curSpkId = &spkId;
+
+				// speakerId <space> uttId1 <space> uttId2 ...
+				buf.append(spkId);
+				buf.push_back(' ');
 			}
+			buf.append(segAndUttId->UttId);
+			buf.push_back(' ');
+		}
+		if (curSpkId != nullptr)
+			buf.push_back('\n');
+		return writeAllBytes(filePath, buf, errMsg);
+	}
 
-			txtStream << "\n";
+	bool KaldiModelBuilder::writeFeaturesScp(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
+		const boost::filesystem::path& segFeatsScpFilePath, const boost::filesystem::path& scpFilePath,
+		ErrMsgList* errMsg) const
+	{
+		// segments' features are keyed by file id, as in *.fileids
+		KaldiArchiveReader segFeats;
+		if (!segFeats.openScp(segFeatsScpFilePath, errMsg))
+			return false;
+
+		std::string buf;
+		boost::filesystem::path arkFilePath;
+		for (const auto& segAndUttId : segsRefs)
+		{
+			size_t offset = 0;
+			if (!segFeats.matrixLocation(toUtf8StdString(segAndUttId.SegRef->OutAudioSegPathParts.WavOutRelFilePathNoExt), arkFilePath, offset, errMsg))
+				return false;
+
+			// utteranceId <space> arkFilePath:offset
+			buf.append(segAndUttId.UttId);
+			buf.push_back(' ');
+			buf.append(toUtf8StdString(boost::filesystem::absolute(arkFilePath).wstring()));
+			buf.push_back(':');
+			buf.append(std::to_string(offset));
+			buf.push_back('\n');
 		}
-		return true;
+		return writeAllBytes(scpFilePath, buf, errMsg);
 	}
 }
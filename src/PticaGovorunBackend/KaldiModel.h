@@ -1,11 +1,13 @@
 #pragma once
+#include <array>
+#include <functional>
 #include <boost/filesystem.hpp>
 #include <gsl/span>
 #include "SphinxModel.h"
 
 namespace PticaGovorun
 {
-	class KaldiModelBuilder
+	class PG_EXPORTS KaldiModelBuilder
 	{
 		struct AssignedPhaseAudioSegmentAndUttId
 		{
@@ -16,10 +18,17 @@ namespace PticaGovorun
 		boost::filesystem::path outDirPath_;
 		std::function<auto (boost::wstring_view)->boost::wstring_view> pronCodeDisplayTrain_;
 		std::function<auto (boost::wstring_view)->boost::wstring_view> pronCodeDisplayTest_;
+		std::array<boost::filesystem::path, 2> segFeatsScpPaths_; // train, test
 	public:
 		KaldiModelBuilder(const boost::filesystem::path& outDirPath,
 			std::function<auto (boost::wstring_view)->boost::wstring_view> pronCodeDisplayTrain,
 			std::function<auto (boost::wstring_view)->boost::wstring_view> pronCodeDisplayTest);
+
+		/// Sets the index (scp) of features of the output wav segments, see SphinxTrainDataBuilder::buildWavSegments.
+		/// Then feats.scp refers to the segments' archives, so Kaldi doesn't compute the features.
+		void setSegmentFeatures(const boost::filesystem::path& trainScpFilePath, const boost::filesystem::path& testScpFilePath);
+
+		/// Writes the files of Kaldi's data directory for train and test phases. The files are written concurrently.
 		bool generate(gsl::span<const AssignedPhaseAudioSegment> segsRefs, ErrMsgList* errMsg) const;
 
 
@@ -27,23 +36,27 @@ namespace PticaGovorun
 		/// UttId should start with speakerId (is it mandatory?) so when all utterances are sorted, they become ordered by speakerId.
 		static void createUtteranceId(const AssignedPhaseAudioSegment& segRef, std::string* uttId);
 
-		static void createSpkIdToUttIdListMap(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs, ResourceUsagePhase targetPhase,
-			std::map<boost::string_view, std::vector<boost::string_view>>* spkId2UttIdList);
+		// The writers accept the utterances of one phase, sorted by uttId.
 
-		bool writeUttId2SpeakerId(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs, ResourceUsagePhase targetPhase,
+		bool writeUttId2SpeakerId(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
 			const boost::filesystem::path& filePath,
 			ErrMsgList* errMsg) const;
 
-		bool writeUttId2WavPathAbs(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs, ResourceUsagePhase targetPhase,
+		bool writeUttId2WavPathAbs(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
 			const boost::filesystem::path& filePath,
 			ErrMsgList* errMsg) const;
 
-		bool writeUttId2Transcription(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs, ResourceUsagePhase targetPhase,
+		bool writeUttId2Transcription(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
 			std::function<auto (boost::wstring_view)->boost::wstring_view> pronCodeDisplay,
 			const boost::filesystem::path& filePath,
 			ErrMsgList* errMsg) const;
-		
-		bool writeSpkId2UttIdList(const std::map<boost::string_view, std::vector<boost::string_view>>& spkId2UttIdList,
+
+		bool writeSpkId2UttIdList(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
 			const boost::filesystem::path& filePath, ErrMsgList* errMsg) const;
+
+		/// Writes the index of utterances' features, which refers to the matrices of the segments' archive by uttId.
+		bool writeFeaturesScp(gsl::span<const AssignedPhaseAudioSegmentAndUttId> segsRefs,
+			const boost::filesystem::path& segFeatsScpFilePath, const boost::filesystem::path& scpFilePath,
+			ErrMsgList* errMsg) const;
 	};
 }
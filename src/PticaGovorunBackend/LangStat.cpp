@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <numeric>
 #include <functional>
 #include "LangStat.h"
@@ -221,6 +222,37 @@ namespace PticaGovorun
 		return const_cast<WordsUsageInfo*>(this)->getOrAddWordPart(partText, partSide, wasAdded);
 	}
 
+	WordPart* WordsUsageInfo::restoreWordPart(int wordPartId, WordPart&& wordPart)
+	{
+		PG_Assert(wordPartId > 0);
+		PG_Assert2(allWordParts_.find(wordPartId) == allWordParts_.end(), "Word part id is already used");
+
+		wordPart.setId(wordPartId);
+		auto it = allWordParts_.insert(std::make_pair(wordPartId, std::move(wordPart))).first;
+		WordPart* result = &it->second;
+
+		partTextToWordPart_.insert(std::make_pair(result->partText(), result));
+
+		// new word parts get ids after the restored ones
+		nextWordPartId_ = std::max(nextWordPartId_, wordPartId + 1);
+		return result;
+	}
+
+	void WordsUsageInfo::clear()
+	{
+		nextWordPartId_ = 1;
+		partTextToWordPart_.clear();
+		allWordParts_.clear();
+		wordSeqKeyToUsage_.clear();
+	}
+
+	void WordsUsageInfo::reserve(size_t wordPartsCount, size_t wordSeqCount)
+	{
+		allWordParts_.reserve(wordPartsCount);
+		partTextToWordPart_.reserve(wordPartsCount);
+		wordSeqKeyToUsage_.reserve(wordSeqCount);
+	}
+
 	const WordPart* WordsUsageInfo::wordPartById(int wordPartId) const
 	{
 		auto it = allWordParts_.find(wordPartId);
@@ -117,6 +117,12 @@ namespace PticaGovorun
 		WordPart* getOrAddWordPart(const std::wstring& partText, WordPartSide partSide, bool* wasAdded = nullptr);
 		const WordPart* getOrAddWordPart(const std::wstring& partText, WordPartSide partSide, bool* wasAdded = nullptr) const;
 
+		// Inserts the word part with the given id. Used to restore the previously saved usage.
+		WordPart* restoreWordPart(int wordPartId, WordPart&& wordPart);
+
+		void clear();
+		void reserve(size_t wordPartsCount, size_t wordSeqCount);
+
 	public:
 		WordSeqUsage* getOrAddWordSequence(WordSeqKey wordIds, bool* wasAdded = nullptr);
 		const WordSeqUsage* getWordSequence(WordSeqKey wordIds) const;
@@ -0,0 +1,388 @@
+#include "PackedDeclensionDictionary.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include "CoreUtils.h"
+#include "FileHelpers.h"
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	namespace
+	{
+		const char PackedMagic[8] = { 'P', 'G', 'D', 'E', 'C', 'L', '0', '1' };
+
+		// the layout of the file: header, groups, forms, index of forms, string pool
+		struct PackedHeader
+		{
+			char Magic[8];
+			std::uint32_t WCharSize;
+			std::uint32_t GroupsCount;
+			std::uint32_t FormsCount;
+			std::uint32_t PoolSize; // in wchar_t
+		};
+
+		// bit fields of tags: (shift, bits); the field value is stored as enum value+1, zero means the absent value
+		struct TagField
+		{
+			int Shift;
+			int Bits;
+		};
+		const TagField FormWordClass{ 0, 4 };
+		const TagField FormCase{ 4, 3 };
+		const TagField FormTense{ 7, 2 };
+		const TagField FormPerson{ 9, 4 };
+		const TagField FormMultiplicity{ 13, 2 };
+		const TagField FormIsInfinitive{ 15, 2 };
+		const TagField FormMandative{ 17, 2 };
+		const TagField FormGender{ 19, 2 };
+		const TagField FormDegree{ 21, 2 };
+		const TagField FormActiveOrPassive{ 23, 2 };
+
+		const TagField GroupWordClass{ 0, 4 };
+		const TagField GroupIsBeing{ 4, 2 };
+		const TagField GroupGender{ 6, 2 };
+		const TagField GroupNumberCategory{ 8, 2 };
+		const TagField GroupPerfectiveAspect{ 10, 2 };
+		const TagField GroupTransitive{ 12, 2 };
+		const TagField GroupPerson{ 14, 4 };
+
+		template <typename T>
+		std::uint32_t packField(const boost::optional<T>& value, TagField field)
+		{
+			if (value == boost::none)
+				return 0;
+			std::uint32_t code = (std::uint32_t)value.get() + 1;
+			PG_DbgAssert(code < (1u << field.Bits));
+			return code << field.Shift;
+		}
+
+		template <typename T>
+		void unpackField(std::uint32_t tags, TagField field, boost::optional<T>& value)
+		{
+			std::uint32_t code = (tags >> field.Shift) & ((1u << field.Bits) - 1);
+			if (code == 0)
+				value = boost::none;
+			else
+				value = static_cast<T>(code - 1);
+		}
+
+		template <typename T>
+		void appendArray(const std::vector<T>& items, std::string& buf)
+		{
+			buf.append(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+		}
+	}
+
+	std::uint32_t packFormTags(const WordDeclensionForm& form)
+	{
+		return packField(form.WordClass, FormWordClass) |
+			packField(form.Case, FormCase) |
+			packField(form.Tense, FormTense) |
+			packField(form.Person, FormPerson) |
+			packField(form.Multiplicity, FormMultiplicity) |
+			packField(form.IsInfinitive, FormIsInfinitive) |
+			packField(form.Mandative, FormMandative) |
+			packField(form.Gender, FormGender) |
+			packField(form.Degree, FormDegree) |
+			packField(form.ActiveOrPassive, FormActiveOrPassive);
+	}
+
+	void unpackFormTags(std::uint32_t tags, WordDeclensionForm& form)
+	{
+		unpackField(tags, FormWordClass, form.WordClass);
+		unpackField(tags, FormCase, form.Case);
+		unpackField(tags, FormTense, form.Tense);
+		unpackField(tags, FormPerson, form.Person);
+		unpackField(tags, FormMultiplicity, form.Multiplicity);
+		unpackField(tags, FormIsInfinitive, form.IsInfinitive);
+		unpackField(tags, FormMandative, form.Mandative);
+		unpackField(tags, FormGender, form.Gender);
+		unpackField(tags, FormDegree, form.Degree);
+		unpackField(tags, FormActiveOrPassive, form.ActiveOrPassive);
+	}
+
+	std::uint32_t packGroupTags(const WordDeclensionGroup& group)
+	{
+		return packField(group.WordClass, GroupWordClass) |
+			packField(group.IsBeing, GroupIsBeing) |
+			packField(group.Gender, GroupGender) |
+			packField(group.NumberCategory, GroupNumberCategory) |
+			packField(group.PerfectiveAspect, GroupPerfectiveAspect) |
+			packField(group.Transitive, GroupTransitive) |
+			packField(group.Person, GroupPerson);
+	}
+
+	void unpackGroupTags(std::uint32_t tags, WordDeclensionGroup& group)
+	{
+		unpackField(tags, GroupWordClass, group.WordClass);
+		unpackField(tags, GroupIsBeing, group.IsBeing);
+		unpackField(tags, GroupGender, group.Gender);
+		unpackField(tags, GroupNumberCategory, group.NumberCategory);
+		unpackField(tags, GroupPerfectiveAspect, group.PerfectiveAspect);
+		unpackField(tags, GroupTransitive, group.Transitive);
+		unpackField(tags, GroupPerson, group.Person);
+	}
+
+	bool writePackedDeclensionDictionary(const std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>>& declinedWords,
+		const boost::filesystem::path& filePath, ErrMsgList* errMsg)
+	{
+		std::vector<const WordDeclensionGroup*> sortedGroups;
+		sortedGroups.reserve(declinedWords.size());
+		for (const auto& pair : declinedWords)
+			sortedGroups.push_back(pair.second.get());
+		std::sort(sortedGroups.begin(), sortedGroups.end(), [](const WordDeclensionGroup* a, const WordDeclensionGroup* b)
+		{
+			return a->Name < b->Name;
+		});
+
+		std::wstring pool;
+		auto addName = [&pool](const std::wstring& name, std::uint32_t& offset, std::uint32_t& length)
+		{
+			offset = (std::uint32_t)pool.size();
+			length = (std::uint32_t)name.size();
+			pool.append(name);
+		};
+
+		std::vector<PackedDeclensionGroup> groups(sortedGroups.size());
+		std::vector<PackedDeclensionForm> forms;
+		for (size_t groupInd = 0; groupInd < sortedGroups.size(); ++groupInd)
+		{
+			const WordDeclensionGroup& group = *sortedGroups[groupInd];
+			PackedDeclensionGroup& packedGroup = groups[groupInd];
+			addName(group.Name, packedGroup.NameOffset, packedGroup.NameLength);
+			packedGroup.Tags = packGroupTags(group);
+			packedGroup.FirstFormInd = (std::uint32_t)forms.size();
+			packedGroup.FormsCount = (std::uint32_t)group.Forms.size();
+			for (const WordDeclensionForm& form : group.Forms)
+			{
+				PackedDeclensionForm packedForm;
+				addName(form.Name, packedForm.NameOffset, packedForm.NameLength);
+				packedForm.Tags = packFormTags(form);
+				packedForm.GroupInd = (std::uint32_t)groupInd;
+				forms.push_back(packedForm);
+			}
+		}
+
+		auto formName = [&pool](const PackedDeclensionForm& form)
+		{
+			return boost::wstring_view(pool.data() + form.NameOffset, form.NameLength);
+		};
+		std::vector<std::uint32_t> formIndex(forms.size());
+		std::iota(formIndex.begin(), formIndex.end(), 0);
+		std::sort(formIndex.begin(), formIndex.end(), [&](std::uint32_t a, std::uint32_t b)
+		{
+			return formName(forms[a]) < formName(forms[b]);
+		});
+
+		PackedHeader header;
+		std::memcpy(header.Magic, PackedMagic, sizeof(PackedMagic));
+		header.WCharSize = sizeof(wchar_t);
+		header.GroupsCount = (std::uint32_t)groups.size();
+		header.FormsCount = (std::uint32_t)forms.size();
+		header.PoolSize = (std::uint32_t)pool.size();
+
+		std::string buf;
+		buf.append(reinterpret_cast<const char*>(&header), sizeof(header));
+		appendArray(groups, buf);
+		appendArray(forms, buf);
+		appendArray(formIndex, buf);
+		buf.append(reinterpret_cast<const char*>(pool.data()), pool.size() * sizeof(wchar_t));
+
+		// the reader never sees the partially written file
+		boost::filesystem::path tmpFilePath = filePath;
+		tmpFilePath += ".tmp";
+		if (!writeAllBytes(tmpFilePath, buf, errMsg))
+			return false;
+		boost::system::error_code ec;
+		boost::filesystem::rename(tmpFilePath, filePath, ec);
+		if (ec)
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't replace file (%1%)") % filePath.string()));
+			return false;
+		}
+		return true;
+	}
+
+	PackedDeclensionDictionary::PackedDeclensionDictionary() = default;
+	PackedDeclensionDictionary::~PackedDeclensionDictionary() = default;
+
+	bool PackedDeclensionDictionary::open(const boost::filesystem::path& filePath, ErrMsgList* errMsg)
+	{
+		groups_ = gsl::span<const PackedDeclensionGroup>();
+		forms_ = gsl::span<const PackedDeclensionForm>();
+		formIndex_ = gsl::span<const std::uint32_t>();
+		pool_ = nullptr;
+
+		file_ = std::make_unique<QFile>(toQStringBfs(filePath));
+		if (!file_->open(QIODevice::ReadOnly))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't open file (%1%)") % filePath.string()));
+			return false;
+		}
+
+		size_t fileSize = (size_t)file_->size();
+		const uchar* data = fileSize >= sizeof(PackedHeader) ? file_->map(0, fileSize) : nullptr;
+		if (data == nullptr)
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't map file (%1%)") % filePath.string()));
+			return false;
+		}
+
+		auto fail = [errMsg, &filePath]() -> bool
+		{
+			pushErrorMsg(errMsg, str(boost::format("Corrupted packed declension dictionary (%1%)") % filePath.string()));
+			return false;
+		};
+
+		const PackedHeader& header = *reinterpret_cast<const PackedHeader*>(data);
+		if (std::memcmp(header.Magic, PackedMagic, sizeof(PackedMagic)) != 0 || header.WCharSize != sizeof(wchar_t))
+			return fail();
+
+		size_t groupsOffset = sizeof(PackedHeader);
+		size_t formsOffset = groupsOffset + header.GroupsCount * sizeof(PackedDeclensionGroup);
+		size_t indexOffset = formsOffset + header.FormsCount * sizeof(PackedDeclensionForm);
+		size_t poolOffset = indexOffset + header.FormsCount * sizeof(std::uint32_t);
+		if (poolOffset + header.PoolSize * sizeof(wchar_t) != fileSize)
+			return fail();
+
+		groups_ = gsl::span<const PackedDeclensionGroup>(reinterpret_cast<const PackedDeclensionGroup*>(data + groupsOffset), header.GroupsCount);
+		forms_ = gsl::span<const PackedDeclensionForm>(reinterpret_cast<const PackedDeclensionForm*>(data + formsOffset), header.FormsCount);
+		formIndex_ = gsl::span<const std::uint32_t>(reinterpret_cast<const std::uint32_t*>(data + indexOffset), header.FormsCount);
+		pool_ = reinterpret_cast<const wchar_t*>(data + poolOffset);
+
+		// check references once, so that queries don't need to
+		auto nameFits = [&header](std::uint32_t offset, std::uint32_t length) { return offset <= header.PoolSize && length <= header.PoolSize - offset; };
+		for (const PackedDeclensionGroup& group : groups_)
+		{
+			if (!nameFits(group.NameOffset, group.NameLength) || group.FirstFormInd > header.FormsCount || group.FormsCount > header.FormsCount - group.FirstFormInd)
+				return fail();
+		}
+		for (const PackedDeclensionForm& form : forms_)
+		{
+			if (!nameFits(form.NameOffset, form.NameLength) || form.GroupInd >= header.GroupsCount)
+				return fail();
+		}
+		for (std::uint32_t formInd : formIndex_)
+		{
+			if (formInd >= header.FormsCount)
+				return fail();
+		}
+		return true;
+	}
+
+	gsl::span<const PackedDeclensionGroup> PackedDeclensionDictionary::groups() const
+	{
+		return groups_;
+	}
+
+	gsl::span<const PackedDeclensionForm> PackedDeclensionDictionary::forms(const PackedDeclensionGroup& group) const
+	{
+		return forms_.subspan(group.FirstFormInd, group.FormsCount);
+	}
+
+	const PackedDeclensionGroup& PackedDeclensionDictionary::group(const PackedDeclensionForm& form) const
+	{
+		return groups_[form.GroupInd];
+	}
+
+	boost::wstring_view PackedDeclensionDictionary::name(const PackedDeclensionGroup& group) const
+	{
+		return boost::wstring_view(pool_ + group.NameOffset, group.NameLength);
+	}
+
+	boost::wstring_view PackedDeclensionDictionary::name(const PackedDeclensionForm& form) const
+	{
+		return boost::wstring_view(pool_ + form.NameOffset, form.NameLength);
+	}
+
+	const PackedDeclensionGroup* PackedDeclensionDictionary::findGroup(boost::wstring_view groupName) const
+	{
+		auto it = std::lower_bound(groups_.begin(), groups_.end(), groupName, [this](const PackedDeclensionGroup& group, boost::wstring_view x)
+		{
+			return name(group) < x;
+		});
+		if (it == groups_.end() || name(*it) != groupName)
+			return nullptr;
+		return &*it;
+	}
+
+	void PackedDeclensionDictionary::findFormGroups(boost::wstring_view formName, std::vector<const PackedDeclensionGroup*>& groups) const
+	{
+		auto it = std::lower_bound(formIndex_.begin(), formIndex_.end(), formName, [this](std::uint32_t formInd, boost::wstring_view x)
+		{
+			return name(forms_[formInd]) < x;
+		});
+		for (; it != formIndex_.end() && name(forms_[*it]) == formName; ++it)
+		{
+			const PackedDeclensionGroup* owningGroup = &group(forms_[*it]);
+			if (std::find(groups.begin(), groups.end(), owningGroup) == groups.end())
+				groups.push_back(owningGroup);
+		}
+	}
+
+	int PackedDeclensionDictionary::uniqueFormsCount() const
+	{
+		int count = 0;
+		for (size_t i = 0; i < (size_t)formIndex_.size(); ++i)
+		{
+			if (i == 0 || name(forms_[formIndex_[i]]) != name(forms_[formIndex_[i - 1]]))
+				count++;
+		}
+		return count;
+	}
+
+	void PackedDeclensionDictionary::unpackGroup(const PackedDeclensionGroup& packedGroup, WordDeclensionGroup& group) const
+	{
+		boost::wstring_view groupName = name(packedGroup);
+		group.Name.assign(groupName.data(), groupName.size());
+		unpackGroupTags(packedGroup.Tags, group);
+
+		gsl::span<const PackedDeclensionForm> packedForms = forms(packedGroup);
+		group.Forms.resize(packedForms.size());
+		for (size_t i = 0; i < (size_t)packedForms.size(); ++i)
+		{
+			WordDeclensionForm& form = group.Forms[i];
+			boost::wstring_view formName = name(packedForms[i]);
+			form.Name.assign(formName.data(), formName.size());
+			unpackFormTags(packedForms[i].Tags, form);
+			form.OwningWordGroup = &group;
+		}
+	}
+
+	bool loadPackedDeclensionDictionary(gsl::span<const boost::filesystem::path> xmlFilePaths, const boost::filesystem::path& packedFilePath,
+		PackedDeclensionDictionary& dict, ErrMsgList* errMsg)
+	{
+		boost::system::error_code ec;
+		bool upToDate = boost::filesystem::exists(packedFilePath, ec);
+		if (upToDate)
+		{
+			std::time_t packedTime = boost::filesystem::last_write_time(packedFilePath, ec);
+			for (const boost::filesystem::path& xmlFilePath : xmlFilePaths)
+			{
+				if (boost::filesystem::last_write_time(xmlFilePath, ec) > packedTime)
+					upToDate = false;
+			}
+		}
+		if (upToDate && dict.open(packedFilePath, nullptr))
+			return true;
+
+		// compile the packed file from XML
+		std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>> declinedWords;
+		for (const boost::filesystem::path& xmlFilePath : xmlFilePaths)
+		{
+			std::wstring loadErrMsg;
+			if (!loadUkrainianWordDeclensionXml(xmlFilePath.wstring(), declinedWords, &loadErrMsg))
+			{
+				pushErrorMsg(errMsg, toUtf8StdString(loadErrMsg));
+				pushErrorMsg(errMsg, str(boost::format("Can't load declension dictionary (%1%)") % xmlFilePath.string()));
+				return false;
+			}
+		}
+		if (!writePackedDeclensionDictionary(declinedWords, packedFilePath, errMsg))
+			return false;
+		return dict.open(packedFilePath, errMsg);
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <QFile>
+#include <boost/filesystem/path.hpp>
+#include <boost/utility/string_view.hpp>
+#include <gsl/span>
+#include "PticaGovorunCore.h"
+#include "ComponentsInfrastructure.h"
+#include "TextProcessing.h"
+
+namespace PticaGovorun
+{
+	/// The group of word forms in the packed declension dictionary.
+	struct PackedDeclensionGroup
+	{
+		std::uint32_t NameOffset; // in the string pool
+		std::uint32_t NameLength;
+		std::uint32_t Tags; // see packGroupTags
+		std::uint32_t FirstFormInd;
+		std::uint32_t FormsCount;
+	};
+
+	/// The word form in the packed declension dictionary.
+	struct PackedDeclensionForm
+	{
+		std::uint32_t NameOffset; // in the string pool
+		std::uint32_t NameLength;
+		std::uint32_t Tags; // see packFormTags
+		std::uint32_t GroupInd;
+	};
+
+	/// Packs grammatical fields of the word form into bit fields of 32-bit word; the absent field is packed as zero.
+	PG_EXPORTS std::uint32_t packFormTags(const WordDeclensionForm& form);
+	/// Sets the grammatical fields of the form; the name and the owning group are not changed.
+	PG_EXPORTS void unpackFormTags(std::uint32_t tags, WordDeclensionForm& form);
+
+	PG_EXPORTS std::uint32_t packGroupTags(const WordDeclensionGroup& group);
+	PG_EXPORTS void unpackGroupTags(std::uint32_t tags, WordDeclensionGroup& group);
+
+	/// Writes the declension dictionary in the binary format, which PackedDeclensionDictionary maps into memory.
+	/// The file is specific to the platform (the size of wchar_t).
+	PG_EXPORTS bool writePackedDeclensionDictionary(const std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>>& declinedWords,
+		const boost::filesystem::path& filePath, ErrMsgList* errMsg);
+
+	/// The declension dictionary, mapped into memory from the file, written by writePackedDeclensionDictionary.
+	/// All names are stored in one string pool. Groups are ordered by name; forms of each group are stored contiguously;
+	/// the index of forms, ordered by name, maps the form into its group.
+	class PG_EXPORTS PackedDeclensionDictionary
+	{
+		std::unique_ptr<QFile> file_;
+		gsl::span<const PackedDeclensionGroup> groups_;
+		gsl::span<const PackedDeclensionForm> forms_;
+		gsl::span<const std::uint32_t> formIndex_; // form indices ordered by form name
+		const wchar_t* pool_ = nullptr;
+	public:
+		PackedDeclensionDictionary();
+		PackedDeclensionDictionary(const PackedDeclensionDictionary&) = delete;
+		~PackedDeclensionDictionary();
+
+		bool open(const boost::filesystem::path& filePath, ErrMsgList* errMsg);
+
+		gsl::span<const PackedDeclensionGroup> groups() const;
+		gsl::span<const PackedDeclensionForm> forms(const PackedDeclensionGroup& group) const;
+		const PackedDeclensionGroup& group(const PackedDeclensionForm& form) const;
+
+		/// The names point into mapped memory and exist while the dictionary is open.
+		boost::wstring_view name(const PackedDeclensionGroup& group) const;
+		boost::wstring_view name(const PackedDeclensionForm& form) const;
+
+		/// Returns null if there is no group with such name.
+		const PackedDeclensionGroup* findGroup(boost::wstring_view groupName) const;
+
+		/// Finds all groups, which contain the word form.
+		void findFormGroups(boost::wstring_view formName, std::vector<const PackedDeclensionGroup*>& groups) const;
+
+		/// The number of unique word forms, see uniqueDeclinedWordsCount.
+		int uniqueFormsCount() const;
+
+		/// Materializes the group with all its forms.
+		void unpackGroup(const PackedDeclensionGroup& packedGroup, WordDeclensionGroup& group) const;
+	};
+
+	/// Opens the packed declension dictionary, which is compiled from XML declension dictionaries.
+	/// The packed file is recompiled if it is absent or older than any of XML files.
+	PG_EXPORTS bool loadPackedDeclensionDictionary(gsl::span<const boost::filesystem::path> xmlFilePaths, const boost::filesystem::path& packedFilePath,
+		PackedDeclensionDictionary& dict, ErrMsgList* errMsg);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <algorithm>
+
+namespace PticaGovorun
+{
+	/// Gets the number of threads to use when a caller doesn't specify it.
+	inline int defaultThreadsCount()
+	{
+		unsigned int hwThreads = std::thread::hardware_concurrency();
+		return hwThreads == 0 ? 1 : (int)hwThreads;
+	}
+
+	/// Gets the number of threads which <b>parallelFor</b> will actually use to process given number of items.
+	/// threadsCount<=0 requests all hardware threads.
+	inline int parallelThreadsCount(size_t itemsCount, int threadsCount)
+	{
+		if (threadsCount <= 0)
+			threadsCount = defaultThreadsCount();
+		if (itemsCount < (size_t)threadsCount)
+			threadsCount = (int)std::max<size_t>(1, itemsCount);
+		return threadsCount;
+	}
+
+	/// Calls itemFun(itemInd, threadInd) for each item in [0; itemsCount) on a pool of threads.
+	/// Items are grabbed dynamically, so the order of processing is arbitrary. Each thread has its own
+	/// threadInd in [0; parallelThreadsCount(itemsCount, threadsCount)), which may be used to address
+	/// per-thread accumulators without locking.
+	/// The first exception thrown by itemFun is rethrown in the calling thread after all workers finish.
+	template <typename ItemFun>
+	void parallelFor(size_t itemsCount, int threadsCount, ItemFun itemFun)
+	{
+		threadsCount = parallelThreadsCount(itemsCount, threadsCount);
+		if (threadsCount == 1)
+		{
+			for (size_t i = 0; i < itemsCount; ++i)
+				itemFun(i, 0);
+			return;
+		}
+
+		std::atomic<size_t> nextItemInd{ 0 };
+		std::atomic<bool> failed{ false };
+		std::exception_ptr firstError;
+		std::atomic_flag errorLock = ATOMIC_FLAG_INIT;
+
+		auto workerFun = [&](int threadInd)
+		{
+			try
+			{
+				while (!failed.load(std::memory_order_relaxed))
+				{
+					size_t itemInd = nextItemInd.fetch_add(1, std::memory_order_relaxed);
+					if (itemInd >= itemsCount)
+						break;
+					itemFun(itemInd, threadInd);
+				}
+			}
+			catch (...)
+			{
+				if (!errorLock.test_and_set())
+					firstError = std::current_exception();
+				failed = true;
+			}
+		};
+
+		std::vector<std::thread> workers;
+		workers.reserve(threadsCount - 1);
+		for (int threadInd = 1; threadInd < threadsCount; ++threadInd)
+			workers.emplace_back(workerFun, threadInd);
+		workerFun(0); // the calling thread does its share of work
+
+		for (std::thread& worker : workers)
+			worker.join();
+
+		if (firstError != nullptr)
+			std::rethrow_exception(firstError);
+	}
+}
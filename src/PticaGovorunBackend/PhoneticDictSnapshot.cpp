@@ -0,0 +1,120 @@
+#include "PhoneticDictSnapshot.h"
+#include <tuple>
+#include "CoreUtils.h"
+
+namespace PticaGovorun
+{
+	const std::map<boost::wstring_view, PhoneticWord>* PhoneticDictSnapshot::dictById(const QString& dictId) const
+	{
+		if (dictId.compare("persian", Qt::CaseInsensitive) == 0)
+			return WellFormed.get();
+		if (dictId.compare("broken", Qt::CaseInsensitive) == 0)
+			return Broken.get();
+		if (dictId.compare("filler", Qt::CaseInsensitive) == 0)
+			return Filler.get();
+		if (dictId.compare("shrekky", Qt::CaseInsensitive) == 0)
+			return Shrekky.get();
+		return nullptr;
+	}
+
+	const PhoneticWord* PhoneticDictSnapshot::findPhoneticWord(const QString& dictId, boost::wstring_view word) const
+	{
+		const std::map<boost::wstring_view, PhoneticWord>* dict = dictById(dictId);
+		if (dict == nullptr)
+			return nullptr;
+		auto it = dict->find(word);
+		if (it == dict->end())
+			return nullptr;
+		return &it->second;
+	}
+
+	SharedPhoneticDicts::SharedPhoneticDicts()
+	{
+		typedef std::map<boost::wstring_view, PhoneticWord> PhoneticDict;
+		auto snapshot = std::make_shared<PhoneticDictSnapshot>();
+		snapshot->WellFormed = std::make_shared<PhoneticDict>();
+		snapshot->Broken = std::make_shared<PhoneticDict>();
+		snapshot->Filler = std::make_shared<PhoneticDict>();
+		snapshot->Shrekky = std::make_shared<PhoneticDict>();
+		snapshot_ = snapshot;
+	}
+
+	SharedPhoneticDicts::SharedPhoneticDicts(std::shared_ptr<const PhoneticDictSnapshot> snapshot)
+		: snapshot_(snapshot)
+	{
+	}
+
+	std::shared_ptr<const PhoneticDictSnapshot> SharedPhoneticDicts::snapshot() const
+	{
+		return std::atomic_load(&snapshot_);
+	}
+
+	void SharedPhoneticDicts::publish(std::shared_ptr<PhoneticDictSnapshot> snapshot)
+	{
+		std::lock_guard<std::mutex> lk(editMutex_);
+		std::shared_ptr<const PhoneticDictSnapshot> curSnapshot = std::atomic_load(&snapshot_);
+		snapshot->Version = curSnapshot->Version + 1;
+		std::atomic_store(&snapshot_, std::shared_ptr<const PhoneticDictSnapshot>(snapshot));
+	}
+
+	bool SharedPhoneticDicts::createUpdateDeletePhoneticWord(const QString& dictId, const QString& word, const QString& pronLinesAsStr, QString* errMsg)
+	{
+		std::lock_guard<std::mutex> lk(editMutex_);
+		std::shared_ptr<const PhoneticDictSnapshot> curSnapshot = std::atomic_load(&snapshot_);
+
+		// only the dictionaries, which are edited by a user, are editable here
+		std::shared_ptr<PhoneticDictSnapshot> newSnapshot = std::make_shared<PhoneticDictSnapshot>(*curSnapshot);
+		std::shared_ptr<const std::map<boost::wstring_view, PhoneticWord>>* targetDictRef = nullptr;
+		if (dictId.compare("persian", Qt::CaseInsensitive) == 0)
+			targetDictRef = &newSnapshot->WellFormed;
+		else if (dictId.compare("broken", Qt::CaseInsensitive) == 0)
+			targetDictRef = &newSnapshot->Broken;
+		if (targetDictRef == nullptr || *targetDictRef == nullptr)
+			return false;
+
+		// strings of this edit; the arena is frozen when the new snapshot is published
+		auto stringArena = std::make_shared<GrowOnlyPinArena<wchar_t>>(word.size() + pronLinesAsStr.size() + 1);
+
+		bool parseOp;
+		const char* errMsgC;
+		std::vector<PronunciationFlavour> prons;
+		std::tie(parseOp, errMsgC) = parsePronuncLinesNew(*curSnapshot->PhoneReg, pronLinesAsStr.toStdWString(), prons, *stringArena);
+		if (!parseOp)
+		{
+			*errMsg = QString::fromLatin1(errMsgC);
+			return false;
+		}
+
+		auto targetDict = std::make_shared<std::map<boost::wstring_view, PhoneticWord>>(**targetDictRef);
+
+		std::vector<wchar_t> wordBuff;
+		boost::wstring_view wordRef = toWStringRef(word, wordBuff);
+		auto itWord = targetDict->find(wordRef);
+		if (prons.empty())
+		{
+			// treat empty pronunciations as a request to delete a word
+			if (itWord == targetDict->end())
+				return true;
+			targetDict->erase(itWord);
+		}
+		else
+		{
+			PhoneticWord wordItem;
+			if (itWord != targetDict->end())
+				wordItem = itWord->second;
+			else if (!registerWord(wordRef, *stringArena, wordItem.Word))
+			{
+				*errMsg = "Can't allocate new word.";
+				return false;
+			}
+			wordItem.Pronunciations = std::move(prons);
+			(*targetDict)[wordItem.Word] = wordItem;
+		}
+
+		*targetDictRef = targetDict;
+		newSnapshot->StringArenas.push_back(stringArena);
+		newSnapshot->Version += 1;
+		std::atomic_store(&snapshot_, std::shared_ptr<const PhoneticDictSnapshot>(newSnapshot));
+		return true;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <QString>
+#include <boost/utility/string_view.hpp>
+#include "PticaGovorunCore.h"
+#include "ComponentsInfrastructure.h"
+#include "PhoneticService.h"
+
+namespace PticaGovorun
+{
+	/// Immutable phonetic dictionaries, which may be read concurrently by many transcription or recognition sessions.
+	/// Each dictionary is shared between consecutive snapshots until it is edited.
+	struct PG_EXPORTS PhoneticDictSnapshot
+	{
+		std::shared_ptr<const PhoneRegistry> PhoneReg;
+
+		// words and pronCodes of all dictionaries point into these arenas
+		std::vector<std::shared_ptr<const GrowOnlyPinArena<wchar_t>>> StringArenas;
+
+		std::shared_ptr<const std::map<boost::wstring_view, PhoneticWord>> WellFormed;
+		std::shared_ptr<const std::map<boost::wstring_view, PhoneticWord>> Broken;
+		std::shared_ptr<const std::map<boost::wstring_view, PhoneticWord>> Filler;
+		std::shared_ptr<const std::map<boost::wstring_view, PhoneticWord>> Shrekky;
+
+		int Version = 0; // incremented on each edit
+
+		/// The dictionary by its id (persian, broken, filler or shrekky), as in SpeechData::findPhoneticWord.
+		/// Returns null for unknown id.
+		const std::map<boost::wstring_view, PhoneticWord>* dictById(const QString& dictId) const;
+
+		const PhoneticWord* findPhoneticWord(const QString& dictId, boost::wstring_view word) const;
+	};
+
+	/// Holds the current snapshot of phonetic dictionaries. Readers take the snapshot without waiting for editors
+	/// and may keep it as long as they need. The edit publishes the new snapshot, in which only the edited
+	/// dictionary is copied.
+	class PG_EXPORTS SharedPhoneticDicts
+	{
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot_; // accessed with std::atomic_load and std::atomic_store
+		std::mutex editMutex_; // one edit at a time, so that concurrent edits are not lost
+	public:
+		/// Starts with empty dictionaries.
+		SharedPhoneticDicts();
+		explicit SharedPhoneticDicts(std::shared_ptr<const PhoneticDictSnapshot> snapshot);
+		SharedPhoneticDicts(const SharedPhoneticDicts&) = delete;
+
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot() const;
+
+		/// Replaces the whole snapshot, eg. when dictionaries are reloaded.
+		void publish(std::shared_ptr<PhoneticDictSnapshot> snapshot);
+
+		/// Copy-on-write edit of persian or broken dictionary, see SpeechData::createUpdateDeletePhoneticWord. Empty pronunciations delete the word.
+		bool createUpdateDeletePhoneticWord(const QString& dictId, const QString& word, const QString& pronLinesAsStr, QString* errMsg);
+	};
+}
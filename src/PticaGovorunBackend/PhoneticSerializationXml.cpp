@@ -180,7 +180,7 @@ namespace PticaGovorun
 
 					PronunciationFlavour pron;
 					pron.PronCode = arenaWordRef;
-					pron.Phones = std::move(phones);
+					pron.Phones.assign(phones.begin(), phones.end());
 					wordPron.Pronunciations.push_back(pron);
 					singlePronPerWord = true;
 				}
@@ -215,7 +215,7 @@ namespace PticaGovorun
 						if (errMsg != nullptr) errMsg->utf8Msg = "Can't parse phone list";
 						return false;
 					}
-					pron.Phones = std::move(phones);
+					pron.Phones.assign(phones.begin(), phones.end());
 				}
 
 				if (pron.PronCode.empty() || pron.Phones.empty())
@@ -1,9 +1,17 @@
 ﻿#include "PhoneticService.h"
 #include <array>
+#include <cstring>
+#include <limits>
+#include <mutex>
 #include <QDirIterator>
+#include <QFile>
 #include <QXmlStreamReader>
 #include <QString>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
 #include "CoreUtils.h"
+#include "PackedDeclensionDictionary.h"
+#include "ParallelUtils.h"
 #include <utility>
 #include "assertImpl.h"
 
@@ -116,8 +124,9 @@ namespace PticaGovorun
 
 	PhoneId PhoneRegistry::extendPhoneId(int validPhoneId) const
 	{
+		PG_DbgAssert2(validPhoneId > 0 && validPhoneId <= std::numeric_limits<PhoneId::id_type>::max(), "PhoneId doesn't fit in PhoneId:id_type");
 		PhoneId result;
-		result.Id = validPhoneId;
+		result.Id = static_cast<PhoneId::id_type>(validPhoneId);
 		if (pgDebug())
 		{
 			static std::string phoneStr;
@@ -185,6 +194,7 @@ namespace PticaGovorun
 	PhoneId PhoneRegistry::newVowelPhone(const std::string& basicPhoneStr, bool isStressed)
 	{
 		int phoneId = nextPhoneId_++;
+		PG_Assert2(phoneId <= std::numeric_limits<PhoneId::id_type>::max(), "Too many phones");
 
 		Phone phone;
 		phone.Id = phoneId;
@@ -197,6 +207,7 @@ namespace PticaGovorun
 	PhoneId PhoneRegistry::newConsonantPhone(const std::string& basicPhoneStr, boost::optional<SoftHardConsonant> softHard)
 	{
 		int phoneId = nextPhoneId_++;
+		PG_Assert2(phoneId <= std::numeric_limits<PhoneId::id_type>::max(), "Too many phones");
 
 		Phone phone;
 		phone.Id = phoneId;
@@ -473,6 +484,24 @@ namespace PticaGovorun
 			phoneReg.newConsonantPhone("SH", palatalProxy); // SH''
 	}
 
+	std::shared_ptr<const PhoneRegistry> sharedPhoneRegistryUk(bool allowSoftHardConsonant, bool allowVowelStress, PalatalSupport palatalSupport)
+	{
+		static std::mutex mutex;
+		static std::map<std::tuple<bool, bool, PalatalSupport>, std::weak_ptr<const PhoneRegistry>> phoneRegs;
+
+		std::lock_guard<std::mutex> lk(mutex);
+		std::weak_ptr<const PhoneRegistry>& cached = phoneRegs[std::make_tuple(allowSoftHardConsonant, allowVowelStress, palatalSupport)];
+		std::shared_ptr<const PhoneRegistry> result = cached.lock();
+		if (result != nullptr)
+			return result;
+
+		auto phoneReg = std::make_shared<PhoneRegistry>();
+		phoneReg->setPalatalSupport(palatalSupport);
+		initPhoneRegistryUk(*phoneReg, allowSoftHardConsonant, allowVowelStress);
+		cached = phoneReg;
+		return phoneReg;
+	}
+
 	bool usuallyHardBasicPhone(const PhoneRegistry& phoneReg, Phone::BasicPhoneIdT basicPhoneId)
 	{
 		bool suc = true;
@@ -689,7 +718,7 @@ namespace PticaGovorun
 		pronName = pronId.substr(0, openBraceInd);
 	}
 
-	bool isWordStressAssigned(const PhoneRegistry& phoneReg, const std::vector<PhoneId>& phoneIds)
+	bool isWordStressAssigned(const PhoneRegistry& phoneReg, wv::slice<PhoneId> phoneIds)
 	{
 		int numVowels = 0;
 		int numStressedVowels = 0;
@@ -828,7 +857,7 @@ namespace PticaGovorun
 
 			PronunciationFlavour pron;
 			pron.PronCode = arenaWordRef;
-			pron.Phones = phones;
+			pron.Phones.assign(phones.begin(), phones.end());
 			curPronGroup.Pronunciations.push_back(pron);
 		}
 
@@ -981,7 +1010,7 @@ namespace PticaGovorun
 
 			PronunciationFlavour pron;
 			pron.PronCode = arenaPronAsWord;
-			pron.Phones = std::move(phones);
+			pron.Phones.assign(phones.begin(), phones.end());
 			result.push_back(pron);
 		}
 		return std::make_tuple(true, nullptr);
@@ -1154,6 +1183,11 @@ namespace PticaGovorun
 		std::copy(outputPhones_.begin(), outputPhones_.end(), std::back_inserter(phoneIds));
 	}
 
+	void WordPhoneticTranscriber::copyOutputPhoneIds(PronunciationPhones& phoneIds) const
+	{
+		std::copy(outputPhones_.begin(), outputPhones_.end(), std::back_inserter(phoneIds));
+	}
+
 	void WordPhoneticTranscriber::setStressedSyllableIndFun(decltype(stressedSyllableIndFun_) stressedSyllableFun)
 	{
 		stressedSyllableIndFun_ = stressedSyllableFun;
@@ -3212,11 +3246,12 @@ namespace PticaGovorun
 		PG_Assert(wasAdded);
 	}
 
-	void UkrainianPhoneticSplitter::bootstrapFromDeclinedWords(const std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>>& words, const std::wstring& targetWord, const std::unordered_set<std::wstring>& processedWords)
+	void UkrainianPhoneticSplitter::bootstrapFromDeclinedWords(const PackedDeclensionDictionary& words, const std::wstring& targetWord, const std::unordered_set<std::wstring>& processedWords)
 	{
-		for (const auto& pair : words)
+		WordDeclensionGroup wordGroup; // only one group is unpacked at a time
+		for (const PackedDeclensionGroup& packedGroup : words.groups())
 		{
-			const WordDeclensionGroup& wordGroup = *pair.second;
+			words.unpackGroup(packedGroup, wordGroup);
 			bool contains = processedWords.find(wordGroup.Name) != processedWords.end();
 			if (false && !contains)
 				continue;
@@ -3423,6 +3458,248 @@ namespace PticaGovorun
 		return wordUsage_;
 	}
 
+	namespace
+	{
+		const char WordUsageSnapshotMagic[4] = { 'P', 'G', 'W', 'U' };
+		const std::uint32_t WordUsageSnapshotVersion = 1;
+
+		// The snapshot file is: header, word parts, word sequences, text of word parts (UTF-16).
+		// The records have fixed size, so the loaded file is used in place.
+		struct WordUsageSnapshotHeader
+		{
+			char Magic[4];
+			std::uint32_t Version;
+			std::uint64_t Key;
+			std::uint64_t WordPartsCount;
+			std::uint64_t WordSeqCount;
+			std::uint64_t TextSize; // number of UTF-16 code units
+			std::int64_t SeqOneWordCounter;
+			std::int64_t SeqTwoWordsCounter;
+		};
+
+		struct WordPartSnapshot
+		{
+			std::int32_t Id;
+			std::uint32_t TextOffset;
+			std::uint32_t TextSize;
+			std::uint8_t PartSide;
+			std::uint8_t Removed;
+			std::uint16_t Padding;
+		};
+
+		struct WordSeqSnapshot
+		{
+			std::int32_t PartIds[2];
+			std::int32_t PartCount;
+			std::int32_t Padding;
+			std::int64_t UsedCount;
+		};
+	}
+
+	bool UkrainianPhoneticSplitter::saveWordUsageSnapshot(const boost::filesystem::path& filePath, std::uint64_t key, ErrMsgList* errMsg) const
+	{
+		std::vector<const WordPart*> wordParts;
+		wordUsage_.copyWordParts(wordParts);
+
+		std::vector<const WordSeqUsage*> wordSeqs;
+		wordUsage_.copyWordSeq(wordSeqs);
+
+		std::vector<WordPartSnapshot> partRecs;
+		partRecs.reserve(wordParts.size());
+		std::vector<ushort> text;
+		for (const WordPart* wordPart : wordParts)
+		{
+			QString partText = QString::fromStdWString(wordPart->partText());
+
+			WordPartSnapshot rec = {};
+			rec.Id = wordPart->id();
+			rec.TextOffset = (std::uint32_t)text.size();
+			rec.TextSize = (std::uint32_t)partText.size();
+			rec.PartSide = (std::uint8_t)wordPart->partSide();
+			rec.Removed = wordPart->removed() ? 1 : 0;
+			partRecs.push_back(rec);
+
+			text.insert(text.end(), partText.utf16(), partText.utf16() + partText.size());
+		}
+
+		std::vector<WordSeqSnapshot> seqRecs;
+		seqRecs.reserve(wordSeqs.size());
+		for (const WordSeqUsage* seq : wordSeqs)
+		{
+			WordSeqSnapshot rec = {};
+			std::copy(seq->Key.PartIds.begin(), seq->Key.PartIds.end(), rec.PartIds);
+			rec.PartCount = seq->Key.PartCount;
+			rec.UsedCount = seq->UsedCount;
+			seqRecs.push_back(rec);
+		}
+
+		WordUsageSnapshotHeader header = {};
+		std::copy_n(WordUsageSnapshotMagic, sizeof(header.Magic), header.Magic);
+		header.Version = WordUsageSnapshotVersion;
+		header.Key = key;
+		header.WordPartsCount = partRecs.size();
+		header.WordSeqCount = seqRecs.size();
+		header.TextSize = text.size();
+		header.SeqOneWordCounter = seqOneWordCounter_;
+		header.SeqTwoWordsCounter = seqTwoWordsCounter_;
+
+		boost::system::error_code ec;
+		boost::filesystem::create_directories(filePath.parent_path(), ec);
+
+		// write into the temporary file, so that the interrupted save doesn't leave the corrupted snapshot
+		QString filePathQ = toQStringBfs(filePath);
+		QString tmpFilePathQ = filePathQ + ".tmp";
+		{
+			QFile file(tmpFilePathQ);
+			if (!file.open(QIODevice::WriteOnly))
+			{
+				pushErrorMsg(errMsg, str(boost::format("Can't open file for writing (%1%)") % filePath.string()));
+				return false;
+			}
+
+			auto writeBlock = [&file](const void* data, size_t size) -> bool
+			{
+				return file.write(reinterpret_cast<const char*>(data), size) == (qint64)size;
+			};
+			bool op = writeBlock(&header, sizeof(header)) &&
+				writeBlock(partRecs.data(), partRecs.size() * sizeof(WordPartSnapshot)) &&
+				writeBlock(seqRecs.data(), seqRecs.size() * sizeof(WordSeqSnapshot)) &&
+				writeBlock(text.data(), text.size() * sizeof(ushort));
+			if (!op)
+			{
+				pushErrorMsg(errMsg, str(boost::format("Can't write word usage snapshot (%1%)") % filePath.string()));
+				return false;
+			}
+		}
+
+		QFile::remove(filePathQ);
+		if (!QFile::rename(tmpFilePathQ, filePathQ))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't rename word usage snapshot (%1%)") % filePath.string()));
+			return false;
+		}
+		return true;
+	}
+
+	bool UkrainianPhoneticSplitter::loadWordUsageSnapshot(const boost::filesystem::path& filePath, std::uint64_t key, bool& loaded, ErrMsgList* errMsg)
+	{
+		loaded = false;
+		QFile file(toQStringBfs(filePath));
+		if (!file.exists())
+			return true;
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't open file for reading (%1%)") % filePath.string()));
+			return false;
+		}
+
+		// the snapshot of the different version or with other key is ignored and will be overwritten
+		qint64 fileSize = file.size();
+		if (fileSize < (qint64)sizeof(WordUsageSnapshotHeader))
+			return true;
+
+		const uchar* data = file.map(0, fileSize);
+		if (data == nullptr)
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't map file into memory (%1%)") % filePath.string()));
+			return false;
+		}
+
+		WordUsageSnapshotHeader header;
+		std::memcpy(&header, data, sizeof(header));
+		if (!std::equal(header.Magic, header.Magic + sizeof(header.Magic), WordUsageSnapshotMagic) ||
+			header.Version != WordUsageSnapshotVersion ||
+			header.Key != key)
+			return true;
+
+		qint64 expectedSize = sizeof(WordUsageSnapshotHeader) +
+			header.WordPartsCount * sizeof(WordPartSnapshot) +
+			header.WordSeqCount * sizeof(WordSeqSnapshot) +
+			header.TextSize * sizeof(ushort);
+		if (fileSize != expectedSize)
+			return true;
+
+		const uchar* partsData = data + sizeof(WordUsageSnapshotHeader);
+		const uchar* seqsData = partsData + header.WordPartsCount * sizeof(WordPartSnapshot);
+		const ushort* text = reinterpret_cast<const ushort*>(seqsData + header.WordSeqCount * sizeof(WordSeqSnapshot));
+		auto partRecs = reinterpret_cast<const WordPartSnapshot*>(partsData);
+		auto seqRecs = reinterpret_cast<const WordSeqSnapshot*>(seqsData);
+
+		// the snapshot is a cache, so the corrupted one is validated before the usage is modified and is rebuilt by the caller
+		auto corrupted = [&](const char* reason) -> bool
+		{
+			file.unmap(const_cast<uchar*>(data));
+			pushErrorMsg(errMsg, str(boost::format("Word usage snapshot is corrupted: %1% (%2%)") % reason % filePath.string()));
+			return false;
+		};
+		auto isPartText = [text](const WordPartSnapshot& rec, boost::wstring_view partText) -> bool
+		{
+			if (rec.PartSide != (std::uint8_t)WordPartSide::WholeWord || rec.TextSize != partText.size())
+				return false;
+			return std::equal(partText.begin(), partText.end(), text + rec.TextOffset, [](wchar_t ch, ushort code) { return (ushort)ch == code; });
+		};
+
+		std::unordered_set<int> partIds;
+		partIds.reserve(header.WordPartsCount);
+		bool hasSentStart = false;
+		bool hasSentEnd = false;
+		for (size_t i = 0; i < header.WordPartsCount; ++i)
+		{
+			const WordPartSnapshot& rec = partRecs[i];
+			if (rec.Id <= 0 || !partIds.insert(rec.Id).second)
+				return corrupted("invalid or duplicate word part id");
+			if ((std::uint64_t)rec.TextOffset + rec.TextSize > header.TextSize)
+				return corrupted("word part text is out of range");
+			if (rec.PartSide > (std::uint8_t)WordPartSide::WholeWord)
+				return corrupted("invalid word part side");
+			hasSentStart = hasSentStart || isPartText(rec, L"<s>");
+			hasSentEnd = hasSentEnd || isPartText(rec, L"</s>");
+		}
+		if (!hasSentStart || !hasSentEnd)
+			return corrupted("no sentence start or end word parts");
+
+		for (size_t i = 0; i < header.WordSeqCount; ++i)
+		{
+			const WordSeqSnapshot& rec = seqRecs[i];
+			if (rec.PartCount != 1 && rec.PartCount != 2)
+				return corrupted("invalid word sequence length");
+			for (int partInd = 0; partInd < rec.PartCount; ++partInd)
+			{
+				if (partIds.find(rec.PartIds[partInd]) == partIds.end())
+					return corrupted("word sequence refers to unknown word part");
+			}
+		}
+
+		wordUsage_.clear();
+		wordUsage_.reserve(header.WordPartsCount, header.WordSeqCount);
+
+		for (size_t i = 0; i < header.WordPartsCount; ++i)
+		{
+			const WordPartSnapshot& rec = partRecs[i];
+			std::wstring partText = QString::fromUtf16(text + rec.TextOffset, rec.TextSize).toStdWString();
+			WordPart wordPart(partText, (WordPartSide)rec.PartSide);
+			wordPart.setRemoved(rec.Removed != 0);
+			wordUsage_.restoreWordPart(rec.Id, std::move(wordPart));
+		}
+
+		for (size_t i = 0; i < header.WordSeqCount; ++i)
+		{
+			const WordSeqSnapshot& rec = seqRecs[i];
+			WordSeqKey seqKey = rec.PartCount == 1 ? WordSeqKey({ rec.PartIds[0] }) : WordSeqKey({ rec.PartIds[0], rec.PartIds[1] });
+			WordSeqUsage* seqUsage = wordUsage_.getOrAddWordSequence(seqKey);
+			seqUsage->UsedCount = rec.UsedCount;
+		}
+		file.unmap(const_cast<uchar*>(data));
+
+		seqOneWordCounter_ = header.SeqOneWordCounter;
+		seqTwoWordsCounter_ = header.SeqTwoWordsCounter;
+
+		sentStartWordPart_ = wordUsage_.wordPartByValue(L"<s>", WordPartSide::WholeWord);
+		sentEndWordPart_ = wordUsage_.wordPartByValue(L"</s>", WordPartSide::WholeWord);
+		loaded = true;
+		return true;
+	}
+
 	void UkrainianPhoneticSplitter::printSuffixUsageStatistics() const
 	{
 		auto sureSuffixesCopy = sureSuffixes;
@@ -3535,6 +3812,30 @@ namespace PticaGovorun
 		std::wstring errorStdWString() const { return xml_.errorString().toStdWString(); }
 	};
 
+	namespace
+	{
+		/// Finds *.fb2 files of the text corpus; files with BROKEN in the path are skipped.
+		/// At most maxFileToProcess files are taken (-1 for all).
+		void findCorpusFb2Files(const boost::filesystem::path& textFilesDir, int maxFileToProcess,
+			std::vector<QString>& txtPaths, std::vector<QString>* skippedPaths)
+		{
+			QDirIterator it(toQStringBfs(textFilesDir), QStringList() << "*.fb2", QDir::Files, QDirIterator::Subdirectories);
+			while (it.hasNext())
+			{
+				if (maxFileToProcess != -1 && txtPaths.size() == (size_t)maxFileToProcess)
+					break;
+				QString txtPath = it.next();
+				if (txtPath.contains("BROKEN", Qt::CaseSensitive))
+				{
+					if (skippedPaths != nullptr)
+						skippedPaths->push_back(txtPath);
+					continue;
+				}
+				txtPaths.push_back(txtPath);
+			}
+		}
+	}
+
 	void UkrainianPhoneticSplitter::gatherWordPartsSequenceUsage(const boost::filesystem::path& textFilesDir, long& totalPreSplitWords, int maxFileToProcess)
 	{
 		QFile corpusFile;
@@ -3567,22 +3868,14 @@ namespace PticaGovorun
 		std::vector<const WordPart*> wordParts;
 		wordParts.reserve(1024*1024);
 
-		QString textFilesDirQ = toQStringBfs(textFilesDir);
-		QDirIterator it(textFilesDirQ, QStringList() << "*.fb2", QDir::Files, QDirIterator::Subdirectories);
-		int processedFiles = 0;
-		while (it.hasNext())
-		{
-			if (maxFileToProcess != -1 && processedFiles == maxFileToProcess)
-				break;
-
-			//if (processedFiles >= 2) break; // process less work
+		std::vector<QString> txtPaths;
+		std::vector<QString> skippedPaths;
+		findCorpusFb2Files(textFilesDir, maxFileToProcess, txtPaths, &skippedPaths);
+		for (const QString& txtPath : skippedPaths)
+			std::wcout << L"SKIPPED " << txtPath.toStdWString() <<std::endl;
 
-			QString txtPath = it.next();
-			if (txtPath.contains("BROKEN", Qt::CaseSensitive))
-			{
-				std::wcout << L"SKIPPED " << txtPath.toStdWString() <<std::endl;
-				continue;
-			}
+		for (const QString& txtPath : txtPaths)
+		{
 			std::wcout << txtPath.toStdWString() <<std::endl;
 
 			//
@@ -3614,14 +3907,6 @@ namespace PticaGovorun
 				std::vector<RawTextLexeme> oneSent(sent.begin(), sent.end());
 				removeWhitespaceLexemes(oneSent);
 
-				auto needExpansionAfter = [&]() -> bool {
-					return std::any_of(std::begin(oneSent), std::end(oneSent), [](const RawTextLexeme& x)
-					{
-						return x.Class == PartOfSpeech::Numeral || // arabic or roman
-							x.ValueStr == L"¬";
-					});
-				};
-
 				//if (corpusNormalizDebug_ && needExpansionAfter())
 				if (outputCorpusNormaliz_)
 				{
@@ -3641,22 +3926,9 @@ namespace PticaGovorun
 				}
 				
 				//
-				if (needExpansionAfter())
+				if (!prepareLangModelSentence(oneSent))
 					return; // keep language model clean
 
-				// remove unnecessary lexemes
-				{
-					auto newEnd = std::remove_if(std::begin(oneSent), std::end(oneSent),
-						[](auto& x)
-					{
-						return
-							x.RunType == TextRunType::Whitespace ||
-							x.RunType == TextRunType::Punctuation ||
-							x.RunType == TextRunType::PunctuationStopSentence;
-					});
-					oneSent.erase(newEnd, std::end(oneSent));
-				}
-
 				if (outputCorpus_)
 				{
 					corpusStream << toQString(sentStartWordPart_->partText()) << " ";
@@ -3690,9 +3962,104 @@ namespace PticaGovorun
 			{
 				std::wcerr <<"XmlError: " << fb2Reader.errorStdWString() << std::endl;
 			}
+		}
+	}
 
-			++processedFiles;
+	bool prepareLangModelSentence(std::vector<RawTextLexeme>& lexemes)
+	{
+		bool needExpansion = std::any_of(std::begin(lexemes), std::end(lexemes), [](const RawTextLexeme& x)
+		{
+			return x.Class == PartOfSpeech::Numeral || // arabic or roman
+				x.ValueStr == L"¬";
+		});
+		if (needExpansion)
+			return false;
+
+		// remove unnecessary lexemes
+		auto newEnd = std::remove_if(std::begin(lexemes), std::end(lexemes),
+			[](auto& x)
+		{
+			return
+				x.RunType == TextRunType::Whitespace ||
+				x.RunType == TextRunType::Punctuation ||
+				x.RunType == TextRunType::PunctuationStopSentence;
+		});
+		lexemes.erase(newEnd, std::end(lexemes));
+		return true;
+	}
+
+	bool parseLangModelSentencesParallel(const boost::filesystem::path& textFilesDir, const boost::filesystem::path& numDictPath,
+		int maxFileToProcess, int threadsCount, OnLangModelSentence onSent, size_t& filesCount, ErrMsgList* errMsg)
+	{
+		std::vector<QString> txtPaths;
+		findCorpusFb2Files(textFilesDir, maxFileToProcess, txtPaths, nullptr);
+		filesCount = txtPaths.size();
+
+		// sentence parser and numbers expander keep the state of the current sentence, hence each thread has its own
+		threadsCount = parallelThreadsCount(txtPaths.size(), threadsCount);
+		std::vector<std::shared_ptr<SentenceParser>> threadParsers(threadsCount);
+		for (int threadInd = 0; threadInd < threadsCount; ++threadInd)
+		{
+			auto abbrExp = std::make_shared<AbbreviationExpanderUkr>();
+			abbrExp->stringArena_ = std::make_shared<GrowOnlyPinArena<wchar_t>>(10000);
+
+			std::wstring errMsgW;
+			if (!abbrExp->load(numDictPath, &errMsgW))
+			{
+				pushErrorMsg(errMsg, toUtf8StdString(errMsgW));
+				pushErrorMsg(errMsg, "Can't load numbers dictionary.");
+				return false;
+			}
+
+			auto sentParser = std::make_shared<SentenceParser>(1024);
+			sentParser->setAbbrevExpander(abbrExp);
+			threadParsers[threadInd] = sentParser;
 		}
+
+		std::vector<char> fileFailed(txtPaths.size(), false);
+		std::vector<std::wstring> fileXmlErrors(txtPaths.size()); // workers don't write to the console
+		parallelFor(txtPaths.size(), threadsCount, [&](size_t fileInd, int threadInd)
+		{
+			QFile file(txtPaths[fileInd]);
+			if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+			{
+				fileFailed[fileInd] = true;
+				return;
+			}
+			QXmlStreamReader xml(&file);
+			Fb2TextBlockReader fb2Reader(xml);
+
+			std::vector<RawTextLexeme> oneSent;
+			SentenceParser& sentParser = *threadParsers[threadInd];
+			sentParser.setTextBlockReader(&fb2Reader);
+			sentParser.setOnNextSentence([&](gsl::span<const RawTextLexeme>& sent)
+			{
+				oneSent.assign(sent.begin(), sent.end());
+				removeWhitespaceLexemes(oneSent);
+				if (!prepareLangModelSentence(oneSent))
+					return;
+				onSent(fileInd, threadInd, oneSent);
+			});
+			sentParser.run();
+
+			if (fb2Reader.hasError())
+				fileXmlErrors[fileInd] = fb2Reader.errorStdWString();
+		});
+
+		// malformed xml doesn't fail the run, the sentences before the error are used
+		for (size_t fileInd = 0; fileInd < txtPaths.size(); ++fileInd)
+		{
+			if (!fileXmlErrors[fileInd].empty())
+				std::wcerr << L"XmlError: " << txtPaths[fileInd].toStdWString() << L" " << fileXmlErrors[fileInd] << std::endl;
+		}
+
+		auto failedIt = std::find(fileFailed.begin(), fileFailed.end(), true);
+		if (failedIt != fileFailed.end())
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't open file %1%") % toUtf8StdString(txtPaths[failedIt - fileFailed.begin()])));
+			return false;
+		}
+		return true;
 	}
 
 	void UkrainianPhoneticSplitter::analyzeSentence(const std::vector<wv::slice<wchar_t>>& words, std::vector<RawTextLexeme>& lexemes) const
@@ -3714,27 +4081,14 @@ namespace PticaGovorun
 			{
 				for (size_t charInd = 0; charInd < word.size(); ++charInd)
 				{
-					wchar_t ch = word[charInd];
-					bool isDigit = isDigitChar(ch);
-					if (isDigit)
-						digitsCount += 1;
-					bool isRomanCh = isRomanNumeral(ch);
-					if (isRomanCh)
-						romanChCount += 1;
-					bool isEng = isEnglishChar(ch);
-					if (isEng)
-						engCount++;
-					bool isExclEng = isExclusiveEnglishChar(ch);
-					if (isExclEng)
-						exclEngCount++;
-					bool isRus = isRussianChar(ch);
-					if (isRus)
-						rusCount++;
-					bool isExclRus = isExclusiveRussianChar(ch);
-					if (isExclRus)
-						exclRusCount++;
-					if (ch == L'-' || ch == L'\'')
-						hyphenCount++;
+					std::uint16_t charClass = charClassMask(word[charInd]);
+					digitsCount += (charClass & CharClassDigit) != 0;
+					romanChCount += (charClass & CharClassRomanNumeral) != 0;
+					engCount += (charClass & CharClassEnglish) != 0;
+					exclEngCount += (charClass & CharClassExclusiveEnglish) != 0;
+					rusCount += (charClass & CharClassRussian) != 0;
+					exclRusCount += (charClass & CharClassExclusiveRussian) != 0;
+					hyphenCount += (charClass & CharClassHyphen) != 0;
 				}
 			};
 			wordCharUsage(wordSlice);
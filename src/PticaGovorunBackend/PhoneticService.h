@@ -1,9 +1,12 @@
 ﻿#pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <tuple>
+#include <functional>
 #include <unordered_set>
 #include <map>
+#include <memory>
 #include <QTextCodec>
 #include <QTextStream>
 #include <boost/optional.hpp>
@@ -13,6 +16,7 @@
 #include "PticaGovorunCore.h"
 #include "LangStat.h"
 #include "TextProcessing.h"
+#include "SmallVector.h"
 
 namespace PticaGovorun
 {
@@ -41,7 +45,7 @@ namespace PticaGovorun
 	// B2 = palatized (kind of half-soft) B
 	struct PG_EXPORTS Phone
 	{
-		typedef IdWithDebugStr<int, char, 4> PhoneIdT;
+		typedef IdWithDebugStr<std::uint8_t, char, 4> PhoneIdT; // there are about a hundred phones
 		int Id;
 		typedef IdWithDebugStr<int, char, 3> BasicPhoneIdT;
 		BasicPhoneIdT BasicPhoneId;
@@ -51,6 +55,9 @@ namespace PticaGovorun
 
 	typedef Phone::PhoneIdT PhoneId;
 
+	// Phones of most pronunciations fit in inline storage.
+	typedef SmallVector<PhoneId, 16> PronunciationPhones;
+
 	// Palatal are slightly soft consonants.
 	enum class PalatalSupport
 	{
@@ -116,6 +123,10 @@ namespace PticaGovorun
 
 	PG_EXPORTS void initPhoneRegistryUk(PhoneRegistry& phoneReg, bool allowSoftHardConsonant, bool allowVowelStress);
 
+	/// Returns the initialized phone registry, which is shared by all callers with the same settings.
+	/// The registry is created on the first request and released when the last user releases it.
+	PG_EXPORTS std::shared_ptr<const PhoneRegistry> sharedPhoneRegistryUk(bool allowSoftHardConsonant, bool allowVowelStress, PalatalSupport palatalSupport);
+
 	// Returns true if the basic phone becomes half-softened (palatized) in certain letter combinations (before letter I).
 	// Returns false if phone becomes soft in certain letter combinations.
 	bool usuallyHardBasicPhone(const PhoneRegistry& phoneReg, Phone::BasicPhoneIdT basicPhoneId);
@@ -143,7 +154,7 @@ namespace PticaGovorun
 		boost::wstring_view PronCode;
 
 		// The actual phones of this pronunciation.
-		std::vector<PhoneId> Phones;
+		PronunciationPhones Phones;
 	};
 
 	// Represents all possible pronunciations of a word.
@@ -189,7 +200,7 @@ namespace PticaGovorun
 	public:
 		UkrainianPhoneticSplitter();
 
-		void bootstrapFromDeclinedWords(const std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>>& declinedWords, const std::wstring& targetWord,
+		void bootstrapFromDeclinedWords(const PackedDeclensionDictionary& declinedWords, const std::wstring& targetWord,
 			const std::unordered_set<std::wstring>& processedWords);
 
 		void gatherWordPartsSequenceUsage(const boost::filesystem::path& textFilesDir, long& totalPreSplitWords, int maxFileToProcess);
@@ -198,6 +209,14 @@ namespace PticaGovorun
 		WordsUsageInfo& wordUsage();
 		void printSuffixUsageStatistics() const;
 
+		/// Saves word parts and n-gram usage into the binary file, so that the text corpus is not parsed on the next run.
+		/// key = identifies the inputs (text corpus, splitter settings) the usage was collected from.
+		bool saveWordUsageSnapshot(const boost::filesystem::path& filePath, std::uint64_t key, ErrMsgList* errMsg) const;
+
+		/// Loads the word usage, saved with the same key. loaded=false if there is no such snapshot.
+		/// Returns false if the snapshot is corrupted; the word usage is not modified then, so the caller can rebuild it.
+		bool loadWordUsageSnapshot(const boost::filesystem::path& filePath, std::uint64_t key, bool& loaded, ErrMsgList* errMsg);
+
 		// Gets the number of sequences with 'wordSeqLength' words per sequence.
 		long wordSeqCount(int wordsPerSeq) const;
 		const WordPart* sentStartWordPart() const;
@@ -223,6 +242,20 @@ namespace PticaGovorun
 		void calcLangStatistics(const std::vector<const WordPart*>& wordParts);
 	};
 
+	/// Removes punctuation from the sentence, which was already stripped of whitespace.
+	/// Returns false if the sentence must not be used for language model, because it has numbers to expand.
+	PG_EXPORTS bool prepareLangModelSentence(std::vector<RawTextLexeme>& lexemes);
+
+	/// Receives the sentence of fileInd-th file, prepared by prepareLangModelSentence.
+	typedef std::function<void(size_t fileInd, int threadInd, const std::vector<RawTextLexeme>& sent)> OnLangModelSentence;
+
+	/// Parses *.fb2 files in the directory like UkrainianPhoneticSplitter::gatherWordPartsSequenceUsage does.
+	/// Files are processed concurrently on parallelThreadsCount(filesCount, threadsCount) threads, each thread has its own
+	/// sentence parser and numbers expander, loaded from numDictPath.
+	/// @filesCount receives the number of processed files
+	PG_EXPORTS bool parseLangModelSentencesParallel(const boost::filesystem::path& textFilesDir, const boost::filesystem::path& numDictPath,
+		int maxFileToProcess, int threadsCount, OnLangModelSentence onSent, size_t& filesCount, ErrMsgList* errMsg);
+
 	// equality by value
 	PG_EXPORTS bool operator == (const Pronunc& a, const Pronunc& b);
 	PG_EXPORTS bool operator < (const Pronunc& a, const Pronunc& b);
@@ -242,7 +275,7 @@ namespace PticaGovorun
 	PG_EXPORTS std::tuple<bool, const char*> loadPronunciationVocabulary(const std::wstring& vocabFilePathAbs, std::map<std::wstring, std::vector<std::string>>& wordToPhoneList, const QTextCodec& textCodec); // TODO: remove
 #endif
 	PG_EXPORTS void parsePronId(boost::wstring_view pronId, boost::wstring_view& pronName);
-	PG_EXPORTS bool isWordStressAssigned(const PhoneRegistry& phoneReg, const std::vector<PhoneId>& phoneIds);
+	PG_EXPORTS bool isWordStressAssigned(const PhoneRegistry& phoneReg, wv::slice<PhoneId> phoneIds);
 
 	/// Checks that pronCode in 'clothes(1)' format and not 'clothes' (without round parantheses).
 	bool isPronCodeDefinesStress(boost::wstring_view pronCode);
@@ -304,6 +337,7 @@ namespace PticaGovorun
 	public:
 		void transcribe(const PhoneRegistry& phoneReg, const std::wstring& word);
 		void copyOutputPhoneIds(std::vector<PhoneId>& phoneIds) const;
+		void copyOutputPhoneIds(PronunciationPhones& phoneIds) const;
 		
 		void setStressedSyllableIndFun(StressedSyllableIndFunT value);
 
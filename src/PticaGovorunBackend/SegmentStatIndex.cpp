@@ -0,0 +1,361 @@
+#include "SegmentStatIndex.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <QFile>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include "CoreUtils.h"
+#include "FileHelpers.h"
+#include "ParallelUtils.h"
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	size_t SegmentStatIndex::segmentsCount() const
+	{
+		return DurationSec.size();
+	}
+
+	ResourceUsagePhase SegmentStatIndex::phase(size_t segInd) const
+	{
+		return (ResourceUsagePhase)Phase[segInd];
+	}
+
+	gsl::span<const std::uint16_t> SegmentStatIndex::phoneCounts(size_t segInd) const
+	{
+		return gsl::span<const std::uint16_t>(PhoneCounts.data() + segInd * PhonesDim, PhonesDim);
+	}
+
+	gsl::span<const std::int32_t> SegmentStatIndex::wordIds(size_t segInd) const
+	{
+		std::uint32_t beg = WordIdsOffset[segInd];
+		std::uint32_t end = WordIdsOffset[segInd + 1];
+		return gsl::span<const std::int32_t>(WordIds.data() + beg, end - beg);
+	}
+
+	bool buildSegmentStatIndex(size_t segmentsCount, int phonesDim, int threadsCount,
+		std::function<bool(size_t segInd, int threadInd, SegmentStatRow& row, ErrMsgList* errMsg)> rowFun,
+		SegmentStatIndex& index, ErrMsgList* errMsg)
+	{
+		index = SegmentStatIndex();
+		index.PhonesDim = phonesDim;
+		index.DurationSec.resize(segmentsCount);
+		index.SpeakerInd.resize(segmentsCount);
+		index.Phase.resize(segmentsCount);
+		index.PhoneCounts.assign(segmentsCount * phonesDim, 0);
+
+		// numeric columns are filled concurrently; speakers and words are numbered afterwards in the order of segments
+		std::vector<std::string> segSpeakers(segmentsCount);
+		std::vector<std::vector<std::wstring>> segWords(segmentsCount);
+		std::vector<ErrMsgList> segErrs(segmentsCount);
+		std::vector<char> segFailed(segmentsCount, false);
+		threadsCount = parallelThreadsCount(segmentsCount, threadsCount);
+		std::vector<SegmentStatRow> threadRows(threadsCount);
+		parallelFor(segmentsCount, threadsCount, [&](size_t segInd, int threadInd)
+		{
+			SegmentStatRow& row = threadRows[threadInd];
+			row.Words.clear();
+			row.Phones.clear();
+			if (!rowFun(segInd, threadInd, row, &segErrs[segInd]))
+			{
+				segFailed[segInd] = true;
+				return;
+			}
+
+			index.DurationSec[segInd] = row.DurationSec;
+			index.Phase[segInd] = (std::uint8_t)row.Phase;
+			std::uint16_t* counts = &index.PhoneCounts[segInd * phonesDim];
+			for (PhoneId phoneId : row.Phones)
+			{
+				PG_Assert2(phoneId.Id < phonesDim, "PhoneId is out of range of phone counters");
+				counts[phoneId.Id] += 1;
+			}
+			segSpeakers[segInd] = row.SpeakerId;
+			segWords[segInd].swap(row.Words);
+		});
+
+		auto failedIt = std::find(segFailed.begin(), segFailed.end(), true);
+		if (failedIt != segFailed.end())
+		{
+			size_t segInd = failedIt - segFailed.begin();
+			if (errMsg != nullptr) *errMsg = std::move(segErrs[segInd]);
+			pushErrorMsg(errMsg, str(boost::format("Can't index segment %1%") % segInd));
+			return false;
+		}
+
+		std::map<std::string, std::int32_t> speakerToInd;
+		std::unordered_map<std::wstring, std::int32_t> wordToId;
+		index.WordIdsOffset.reserve(segmentsCount + 1);
+		index.WordIdsOffset.push_back(0);
+		for (size_t segInd = 0; segInd < segmentsCount; ++segInd)
+		{
+			auto speakerIt = speakerToInd.find(segSpeakers[segInd]);
+			if (speakerIt == speakerToInd.end())
+			{
+				speakerIt = speakerToInd.insert(std::make_pair(segSpeakers[segInd], (std::int32_t)index.SpeakerIds.size())).first;
+				index.SpeakerIds.push_back(segSpeakers[segInd]);
+			}
+			index.SpeakerInd[segInd] = speakerIt->second;
+
+			for (std::wstring& word : segWords[segInd])
+			{
+				auto wordIt = wordToId.find(word);
+				if (wordIt == wordToId.end())
+				{
+					wordIt = wordToId.insert(std::make_pair(word, (std::int32_t)index.Words.size())).first;
+					index.Words.push_back(std::move(word));
+				}
+				index.WordIds.push_back(wordIt->second);
+			}
+			index.WordIdsOffset.push_back((std::uint32_t)index.WordIds.size());
+		}
+		return true;
+	}
+
+	namespace
+	{
+		void resetPhaseStat(const SegmentStatIndex& index, SegmentPhaseStat& stat)
+		{
+			stat = SegmentPhaseStat();
+			stat.PhoneCounts.assign(index.PhonesDim, 0);
+			stat.SpeakerDurSec.assign(index.SpeakerIds.size(), 0);
+		}
+
+		void addPhaseStat(const SegmentPhaseStat& src, SegmentPhaseStat& dst)
+		{
+			dst.UtterCount += src.UtterCount;
+			dst.WordCount += src.WordCount;
+			dst.DurationSec += src.DurationSec;
+			for (size_t i = 0; i < dst.PhoneCounts.size(); ++i)
+				dst.PhoneCounts[i] += src.PhoneCounts[i];
+			for (size_t i = 0; i < dst.SpeakerDurSec.size(); ++i)
+				dst.SpeakerDurSec[i] += src.SpeakerDurSec[i];
+		}
+	}
+
+	void computePhaseStat(const SegmentStatIndex& index, int threadsCount, SegmentPhaseStat& trainStat, SegmentPhaseStat& testStat)
+	{
+		// Each block of segments is summed separately and the blocks are summed in order,
+		// so the sums of durations don't depend on the number of threads.
+		const size_t BlockSize = 4096;
+		size_t segmentsCount = index.segmentsCount();
+		size_t blocksCount = (segmentsCount + BlockSize - 1) / BlockSize;
+		std::vector<SegmentPhaseStat> blockStats(2 * blocksCount); // train and test stat of each block
+		parallelFor(blocksCount, threadsCount, [&](size_t blockInd, int threadInd)
+		{
+			SegmentPhaseStat& blockTrain = blockStats[2 * blockInd];
+			SegmentPhaseStat& blockTest = blockStats[2 * blockInd + 1];
+			resetPhaseStat(index, blockTrain);
+			resetPhaseStat(index, blockTest);
+
+			size_t segEnd = std::min(segmentsCount, (blockInd + 1) * BlockSize);
+			for (size_t segInd = blockInd * BlockSize; segInd < segEnd; ++segInd)
+			{
+				SegmentPhaseStat& stat = index.phase(segInd) == ResourceUsagePhase::Train ? blockTrain : blockTest;
+				stat.UtterCount += 1;
+				stat.WordCount += (int)(index.WordIdsOffset[segInd + 1] - index.WordIdsOffset[segInd]);
+				stat.DurationSec += index.DurationSec[segInd];
+				stat.SpeakerDurSec[index.SpeakerInd[segInd]] += index.DurationSec[segInd];
+
+				const std::uint16_t* counts = &index.PhoneCounts[segInd * index.PhonesDim];
+				std::int64_t* sums = stat.PhoneCounts.data();
+				for (int phoneInd = 0; phoneInd < index.PhonesDim; ++phoneInd)
+					sums[phoneInd] += counts[phoneInd];
+			}
+		});
+
+		resetPhaseStat(index, trainStat);
+		resetPhaseStat(index, testStat);
+		for (size_t blockInd = 0; blockInd < blocksCount; ++blockInd)
+		{
+			addPhaseStat(blockStats[2 * blockInd], trainStat);
+			addPhaseStat(blockStats[2 * blockInd + 1], testStat);
+		}
+	}
+
+	void findTestOnlyPhones(const SegmentPhaseStat& trainStat, const SegmentPhaseStat& testStat, std::vector<int>& phoneIds)
+	{
+		PG_Assert(trainStat.PhoneCounts.size() == testStat.PhoneCounts.size());
+		for (size_t phoneInd = 0; phoneInd < testStat.PhoneCounts.size(); ++phoneInd)
+		{
+			if (testStat.PhoneCounts[phoneInd] > 0 && trainStat.PhoneCounts[phoneInd] == 0)
+				phoneIds.push_back((int)phoneInd);
+		}
+	}
+
+	namespace
+	{
+		const char SegmentStatIndexMagic[4] = { 'P', 'G', 'S', 'I' };
+		const std::uint32_t SegmentStatIndexVersion = 1;
+
+		// The file is: header, columns (in the order of fields of SegmentStatIndex), string offsets, UTF-8 text of speaker ids and words.
+		struct SegmentStatIndexHeader
+		{
+			char Magic[4];
+			std::uint32_t Version;
+			std::uint64_t SegmentsCount;
+			std::uint64_t WordIdsCount;
+			std::uint64_t SpeakersCount;
+			std::uint64_t WordsCount;
+			std::uint64_t TextSize;
+			std::int32_t PhonesDim;
+			std::int32_t Padding;
+		};
+	}
+
+	bool saveSegmentStatIndex(const SegmentStatIndex& index, const boost::filesystem::path& filePath, ErrMsgList* errMsg)
+	{
+		// speaker ids, then words; the end of i-th string is the start of (i+1)-th string
+		std::vector<std::uint32_t> strOffsets;
+		std::string text;
+		strOffsets.push_back(0);
+		for (const std::string& speakerId : index.SpeakerIds)
+		{
+			text.append(speakerId);
+			strOffsets.push_back((std::uint32_t)text.size());
+		}
+		std::string wordUtf8;
+		for (const std::wstring& word : index.Words)
+		{
+			toUtf8StdString(word, wordUtf8);
+			text.append(wordUtf8);
+			strOffsets.push_back((std::uint32_t)text.size());
+		}
+
+		SegmentStatIndexHeader header = {};
+		std::copy_n(SegmentStatIndexMagic, sizeof(header.Magic), header.Magic);
+		header.Version = SegmentStatIndexVersion;
+		header.SegmentsCount = index.segmentsCount();
+		header.WordIdsCount = index.WordIds.size();
+		header.SpeakersCount = index.SpeakerIds.size();
+		header.WordsCount = index.Words.size();
+		header.TextSize = text.size();
+		header.PhonesDim = index.PhonesDim;
+
+		std::string bytes;
+		auto appendBlock = [&bytes](const void* data, size_t size)
+		{
+			bytes.append(reinterpret_cast<const char*>(data), size);
+		};
+		appendBlock(&header, sizeof(header));
+		appendBlock(index.DurationSec.data(), index.DurationSec.size() * sizeof(float));
+		appendBlock(index.SpeakerInd.data(), index.SpeakerInd.size() * sizeof(std::int32_t));
+		appendBlock(index.Phase.data(), index.Phase.size() * sizeof(std::uint8_t));
+		appendBlock(index.PhoneCounts.data(), index.PhoneCounts.size() * sizeof(std::uint16_t));
+		appendBlock(index.WordIdsOffset.data(), index.WordIdsOffset.size() * sizeof(std::uint32_t));
+		appendBlock(index.WordIds.data(), index.WordIds.size() * sizeof(std::int32_t));
+		appendBlock(strOffsets.data(), strOffsets.size() * sizeof(std::uint32_t));
+		appendBlock(text.data(), text.size());
+
+		boost::system::error_code ec;
+		boost::filesystem::create_directories(filePath.parent_path(), ec);
+
+		// the file is replaced atomically, so the interrupted save doesn't leave the corrupted index
+		return writeAllBytes(filePath, bytes, errMsg);
+	}
+
+	bool loadSegmentStatIndex(const boost::filesystem::path& filePath, SegmentStatIndex& index, ErrMsgList* errMsg)
+	{
+		QFile file(toQStringBfs(filePath));
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Can't open file for reading (%1%)") % filePath.string()));
+			return false;
+		}
+		QByteArray data = file.readAll();
+
+		SegmentStatIndexHeader header;
+		if (data.size() < (int)sizeof(header))
+		{
+			pushErrorMsg(errMsg, str(boost::format("Segment stat index is truncated (%1%)") % filePath.string()));
+			return false;
+		}
+		std::memcpy(&header, data.constData(), sizeof(header));
+		if (!std::equal(header.Magic, header.Magic + sizeof(header.Magic), SegmentStatIndexMagic) ||
+			header.Version != SegmentStatIndexVersion)
+		{
+			pushErrorMsg(errMsg, str(boost::format("Unknown format of segment stat index (%1%)") % filePath.string()));
+			return false;
+		}
+
+		auto corrupted = [&](const char* reason) -> bool
+		{
+			pushErrorMsg(errMsg, str(boost::format("Segment stat index has %1% (%2%)") % reason % filePath.string()));
+			return false;
+		};
+
+		// the counts are bounded by the file size, so the expected size doesn't overflow
+		std::uint64_t fileSize = (std::uint64_t)data.size();
+		if (header.PhonesDim < 0 || header.SegmentsCount > fileSize || header.WordIdsCount > fileSize ||
+			header.SpeakersCount > fileSize || header.WordsCount > fileSize || header.TextSize > fileSize)
+			return corrupted("wrong counts");
+
+		std::uint64_t segs = header.SegmentsCount;
+		std::uint64_t stringsCount = header.SpeakersCount + header.WordsCount;
+		std::uint64_t expectedSize = sizeof(header) +
+			segs * (sizeof(float) + sizeof(std::int32_t) + sizeof(std::uint8_t) + header.PhonesDim * sizeof(std::uint16_t)) +
+			(segs + 1) * sizeof(std::uint32_t) +
+			header.WordIdsCount * sizeof(std::int32_t) +
+			(stringsCount + 1) * sizeof(std::uint32_t) +
+			header.TextSize;
+		if (fileSize != expectedSize)
+			return corrupted("wrong size");
+
+		const char* cur = data.constData() + sizeof(header);
+		auto readColumn = [&cur](auto& column, size_t count)
+		{
+			column.resize(count);
+			size_t size = count * sizeof(column[0]);
+			if (size > 0)
+				std::memcpy(column.data(), cur, size);
+			cur += size;
+		};
+
+		index = SegmentStatIndex();
+		index.PhonesDim = header.PhonesDim;
+		readColumn(index.DurationSec, segs);
+		readColumn(index.SpeakerInd, segs);
+		readColumn(index.Phase, segs);
+		readColumn(index.PhoneCounts, segs * header.PhonesDim);
+		readColumn(index.WordIdsOffset, segs + 1);
+		readColumn(index.WordIds, header.WordIdsCount);
+		std::vector<std::uint32_t> strOffsets;
+		readColumn(strOffsets, stringsCount + 1);
+		const char* text = cur;
+
+		// the columns index each other, so are validated once here and are used unchecked afterwards
+		for (size_t segInd = 0; segInd < segs; ++segInd)
+		{
+			if (index.SpeakerInd[segInd] < 0 || (std::uint64_t)index.SpeakerInd[segInd] >= header.SpeakersCount)
+				return corrupted("wrong speaker index");
+			if (index.Phase[segInd] > (std::uint8_t)ResourceUsagePhase::Test)
+				return corrupted("wrong phase");
+		}
+		if (index.WordIdsOffset[0] != 0 || index.WordIdsOffset[segs] != header.WordIdsCount)
+			return corrupted("wrong word offsets");
+		for (size_t segInd = 0; segInd < segs; ++segInd)
+		{
+			if (index.WordIdsOffset[segInd] > index.WordIdsOffset[segInd + 1])
+				return corrupted("wrong word offsets");
+		}
+		for (std::int32_t wordId : index.WordIds)
+		{
+			if (wordId < 0 || (std::uint64_t)wordId >= header.WordsCount)
+				return corrupted("wrong word id");
+		}
+
+		for (size_t i = 0; i < stringsCount; ++i)
+		{
+			if (strOffsets[i] > strOffsets[i + 1] || strOffsets[i + 1] > header.TextSize)
+				return corrupted("wrong string offsets");
+			boost::string_view strRef(text + strOffsets[i], strOffsets[i + 1] - strOffsets[i]);
+			if (i < header.SpeakersCount)
+				index.SpeakerIds.push_back(std::string(strRef.data(), strRef.size()));
+			else
+				index.Words.push_back(utf8s2ws(strRef));
+		}
+		return true;
+	}
+}
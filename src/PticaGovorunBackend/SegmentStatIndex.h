@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <boost/filesystem/path.hpp>
+#include <gsl/span>
+#include "PticaGovorunCore.h"
+#include "ComponentsInfrastructure.h"
+#include "PhoneticService.h"
+#include "SpeechProcessing.h"
+
+namespace PticaGovorun
+{
+	/// Columnar index of speech segments, used to compute corpus statistics without expanding transcriptions
+	/// into phones again. The i-th element of each column describes the i-th segment.
+	struct PG_EXPORTS SegmentStatIndex
+	{
+		int PhonesDim = 0; // the number of phone counters per segment; PhoneId::Id is in [0; PhonesDim)
+
+		std::vector<float> DurationSec; // speech without padded silence
+		std::vector<std::int32_t> SpeakerInd; // index in SpeakerIds
+		std::vector<std::uint8_t> Phase; // ResourceUsagePhase
+		std::vector<std::uint16_t> PhoneCounts; // PhonesDim counters per segment
+		std::vector<std::uint32_t> WordIdsOffset; // words of i-th segment are WordIds[WordIdsOffset[i]; WordIdsOffset[i+1])
+		std::vector<std::int32_t> WordIds; // index in Words
+
+		std::vector<std::string> SpeakerIds;
+		std::vector<std::wstring> Words; // pronCodes
+
+		size_t segmentsCount() const;
+		ResourceUsagePhase phase(size_t segInd) const;
+		gsl::span<const std::uint16_t> phoneCounts(size_t segInd) const;
+		gsl::span<const std::int32_t> wordIds(size_t segInd) const;
+	};
+
+	/// The segment to put in the index.
+	struct SegmentStatRow
+	{
+		float DurationSec = 0;
+		std::string SpeakerId;
+		ResourceUsagePhase Phase = ResourceUsagePhase::Train;
+		std::vector<std::wstring> Words;
+		std::vector<PhoneId> Phones;
+	};
+
+	/// Builds the index of segmentsCount segments. rowFun(segInd, threadInd, row, errMsg) fills the row of a segment and is called
+	/// concurrently on parallelThreadsCount(segmentsCount, threadsCount) threads. Speakers and words get ids in the order
+	/// of segments, so the index is the same for any number of threads.
+	PG_EXPORTS bool buildSegmentStatIndex(size_t segmentsCount, int phonesDim, int threadsCount,
+		std::function<bool(size_t segInd, int threadInd, SegmentStatRow& row, ErrMsgList* errMsg)> rowFun,
+		SegmentStatIndex& index, ErrMsgList* errMsg);
+
+	/// Totals of segments of one phase.
+	struct PG_EXPORTS SegmentPhaseStat
+	{
+		int UtterCount = 0;
+		int WordCount = 0;
+		double DurationSec = 0;
+		std::vector<std::int64_t> PhoneCounts; // indexed by PhoneId::Id
+		std::vector<double> SpeakerDurSec; // indexed like SegmentStatIndex::SpeakerIds
+	};
+
+	/// Sums the columns of train and test segments on threadsCount threads.
+	PG_EXPORTS void computePhaseStat(const SegmentStatIndex& index, int threadsCount, SegmentPhaseStat& trainStat, SegmentPhaseStat& testStat);
+
+	/// Finds phones which are used in the test portion but not in the train portion.
+	PG_EXPORTS void findTestOnlyPhones(const SegmentPhaseStat& trainStat, const SegmentPhaseStat& testStat, std::vector<int>& phoneIds);
+
+	PG_EXPORTS bool saveSegmentStatIndex(const SegmentStatIndex& index, const boost::filesystem::path& filePath, ErrMsgList* errMsg);
+	PG_EXPORTS bool loadSegmentStatIndex(const boost::filesystem::path& filePath, SegmentStatIndex& index, ErrMsgList* errMsg);
+}
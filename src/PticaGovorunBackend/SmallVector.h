@@ -0,0 +1,209 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	/// The vector of trivial elements, which keeps up to InlineCapacity elements inside the object and allocates
+	/// the buffer on heap only for longer sequences. Used for short sequences (eg phones of a pronunciation), of which
+	/// there are hundreds of thousands, so that each sequence doesn't cost a heap allocation.
+	template <typename T, size_t InlineCapacity>
+	class SmallVector
+	{
+		static_assert(std::is_trivial<T>::value, "Elements are copied as raw memory");
+		static_assert(InlineCapacity > 0, "Use std::vector when there is no inline storage");
+
+		std::uint32_t size_ = 0;
+		std::uint32_t capacity_ = InlineCapacity;
+		union
+		{
+			T inline_[InlineCapacity];
+			T* heap_;
+		};
+	public:
+		typedef T value_type;
+		typedef T& reference;
+		typedef const T& const_reference;
+		typedef T* iterator;
+		typedef const T* const_iterator;
+		typedef size_t size_type;
+
+		SmallVector() {}
+
+		SmallVector(std::initializer_list<T> items)
+		{
+			assign(items.begin(), items.end());
+		}
+
+		template <typename InputIt>
+		SmallVector(InputIt first, InputIt last)
+		{
+			assign(first, last);
+		}
+
+		SmallVector(const SmallVector& other)
+		{
+			assign(other.begin(), other.end());
+		}
+
+		SmallVector(SmallVector&& other)
+		{
+			moveFrom(other);
+		}
+
+		~SmallVector()
+		{
+			freeHeap();
+		}
+
+		SmallVector& operator=(const SmallVector& other)
+		{
+			if (this != &other)
+				assign(other.begin(), other.end());
+			return *this;
+		}
+
+		SmallVector& operator=(SmallVector&& other)
+		{
+			if (this != &other)
+			{
+				freeHeap();
+				moveFrom(other);
+			}
+			return *this;
+		}
+
+		bool isInline() const { return capacity_ == InlineCapacity; }
+
+		T* data() { return isInline() ? inline_ : heap_; }
+		const T* data() const { return isInline() ? inline_ : heap_; }
+
+		size_t size() const { return size_; }
+		size_t capacity() const { return capacity_; }
+		bool empty() const { return size_ == 0; }
+
+		iterator begin() { return data(); }
+		iterator end() { return data() + size_; }
+		const_iterator begin() const { return data(); }
+		const_iterator end() const { return data() + size_; }
+		const_iterator cbegin() const { return begin(); }
+		const_iterator cend() const { return end(); }
+
+		T& operator[](size_t i) { PG_DbgAssert(i < size_); return data()[i]; }
+		const T& operator[](size_t i) const { PG_DbgAssert(i < size_); return data()[i]; }
+
+		T& front() { return (*this)[0]; }
+		const T& front() const { return (*this)[0]; }
+		T& back() { return (*this)[size_ - 1]; }
+		const T& back() const { return (*this)[size_ - 1]; }
+
+		void reserve(size_t newCapacity)
+		{
+			if (newCapacity <= capacity_)
+				return;
+			T* newBuf = new T[newCapacity];
+			std::memcpy(newBuf, data(), size_ * sizeof(T));
+			freeHeap();
+			heap_ = newBuf;
+			capacity_ = (std::uint32_t)newCapacity;
+		}
+
+		void resize(size_t newSize)
+		{
+			resize(newSize, T());
+		}
+
+		void resize(size_t newSize, const T& value)
+		{
+			reserve(newSize);
+			if (newSize > size_)
+				std::fill(data() + size_, data() + newSize, value);
+			size_ = (std::uint32_t)newSize;
+		}
+
+		void clear() { size_ = 0; }
+
+		void push_back(const T& value)
+		{
+			if (size_ == capacity_)
+			{
+				T copy = value; // value may point into this vector
+				reserve(2 * capacity_);
+				data()[size_++] = copy;
+				return;
+			}
+			data()[size_++] = value;
+		}
+
+		void pop_back()
+		{
+			PG_DbgAssert(size_ > 0);
+			--size_;
+		}
+
+		template <typename InputIt>
+		void assign(InputIt first, InputIt last)
+		{
+			clear();
+			typedef typename std::iterator_traits<InputIt>::iterator_category Category;
+			if (std::is_base_of<std::forward_iterator_tag, Category>::value)
+				reserve((size_t)std::distance(first, last));
+			for (; first != last; ++first)
+				push_back(*first);
+		}
+
+		/// Frees the heap buffer if the elements fit into inline storage.
+		void shrink_to_fit()
+		{
+			if (isInline() || size_ > InlineCapacity)
+				return;
+			T* heap = heap_;
+			std::memcpy(inline_, heap, size_ * sizeof(T));
+			delete[] heap;
+			capacity_ = InlineCapacity;
+		}
+
+	private:
+		void freeHeap()
+		{
+			if (!isInline())
+				delete[] heap_;
+			capacity_ = InlineCapacity;
+		}
+
+		void moveFrom(SmallVector& other)
+		{
+			size_ = other.size_;
+			capacity_ = other.capacity_;
+			if (other.isInline())
+				std::memcpy(inline_, other.inline_, size_ * sizeof(T));
+			else
+				heap_ = other.heap_; // take the buffer
+			other.size_ = 0;
+			other.capacity_ = InlineCapacity;
+		}
+	};
+
+	template <typename T, size_t InlineCapacity>
+	bool operator==(const SmallVector<T, InlineCapacity>& x, const SmallVector<T, InlineCapacity>& y)
+	{
+		return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
+	}
+
+	template <typename T, size_t InlineCapacity>
+	bool operator!=(const SmallVector<T, InlineCapacity>& x, const SmallVector<T, InlineCapacity>& y)
+	{
+		return !(x == y);
+	}
+
+	template <typename T, size_t InlineCapacity>
+	bool operator<(const SmallVector<T, InlineCapacity>& x, const SmallVector<T, InlineCapacity>& y)
+	{
+		return std::lexicographical_compare(x.begin(), x.end(), y.begin(), y.end());
+	}
+}
@@ -1,8 +1,11 @@
 #include <functional>
+#include <algorithm>
 #include "SpeechAnnotation.h"
 #include <QDir>
 #include <QDirIterator>
+#include <boost/filesystem.hpp>
 #include "CoreUtils.h"
+#include "ParallelUtils.h"
 #include "PhoneticService.h"
 #include "assertImpl.h"
 
@@ -440,4 +443,53 @@ namespace PticaGovorun
 		};
 		flatRec(node);
 	}
+
+	void findAnnotationFilesFlat(const boost::filesystem::path& annotRootDir, std::vector<AnnotSpeechFileNode>& result, int threadsCount)
+	{
+		namespace bfs = boost::filesystem;
+		auto isAnnotFile = [](const bfs::path& filePath) -> bool
+		{
+			std::wstring ext = filePath.extension().wstring();
+			std::transform(ext.begin(), ext.end(), ext.begin(), ::towlower);
+			return ext == L".xml";
+		};
+		auto toFileNode = [](const bfs::path& filePath) -> AnnotSpeechFileNode
+		{
+			AnnotSpeechFileNode fileRecord;
+			fileRecord.FileNameNoExt = toQStringBfs(filePath.stem());
+			fileRecord.SpeechAnnotationAbsPath = toQStringBfs(bfs::absolute(filePath));
+			return fileRecord;
+		};
+
+		boost::system::error_code ec;
+		std::vector<bfs::path> subDirs;
+		for (bfs::directory_iterator it(annotRootDir, ec), end; !ec && it != end; it.increment(ec))
+		{
+			const bfs::path& entryPath = it->path();
+			if (bfs::is_directory(it->status()))
+				subDirs.push_back(entryPath);
+			else if (bfs::is_regular_file(it->status()) && isAnnotFile(entryPath))
+				result.push_back(toFileNode(entryPath));
+		}
+
+		// scan subdirectories on multiple threads; each subdirectory gets its own list
+		std::vector<std::vector<AnnotSpeechFileNode>> subDirFiles(subDirs.size());
+		parallelFor(subDirs.size(), threadsCount, [&](size_t subDirInd, int threadInd)
+		{
+			boost::system::error_code dirErr;
+			std::vector<AnnotSpeechFileNode>& files = subDirFiles[subDirInd];
+			for (bfs::recursive_directory_iterator it(subDirs[subDirInd], dirErr), end; !dirErr && it != end; it.increment(dirErr))
+			{
+				if (bfs::is_regular_file(it->status()) && isAnnotFile(it->path()))
+					files.push_back(toFileNode(it->path()));
+			}
+		});
+		for (const std::vector<AnnotSpeechFileNode>& files : subDirFiles)
+			std::copy(files.begin(), files.end(), std::back_inserter(result));
+
+		std::sort(result.begin(), result.end(), [](const AnnotSpeechFileNode& a, const AnnotSpeechFileNode& b)
+		{
+			return a.SpeechAnnotationAbsPath < b.SpeechAnnotationAbsPath;
+		});
+	}
 }
\ No newline at end of file
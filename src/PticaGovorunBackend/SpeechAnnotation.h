@@ -4,6 +4,7 @@
 #include <tuple>
 #include <unordered_set>
 #include <boost/utility/string_view.hpp>
+#include <boost/filesystem/path.hpp>
 #include "SpeechProcessing.h"
 #include "assertImpl.h"
 
@@ -170,4 +171,8 @@ namespace PticaGovorun
 
 	// Gets the list of wav files from given hierarchy.
 	PG_EXPORTS void flat(const AnnotSpeechDirNode& node, std::vector<AnnotSpeechFileNode>& result);
+
+	// Finds all speech annotation files in the directory tree without constructing the hierarchy.
+	// Top level subdirectories are scanned in parallel. The result is ordered by file path.
+	PG_EXPORTS void findAnnotationFilesFlat(const boost::filesystem::path& annotRootDir, std::vector<AnnotSpeechFileNode>& result, int threadsCount = -1);
 }
@@ -1,15 +1,22 @@
+﻿#include <algorithm>
 #include <chrono>
+#include <set>
 #include "SpeechDataValidation.h"
 #include "PhoneticService.h"
 #include "AppHelpers.h"
 #include "SpeechAnnotation.h"
 #include "SpeechProcessing.h"
+#include "XmlAudioMarkup.h"
+#include "ParallelUtils.h"
+#include "FileHelpers.h"
 
 namespace PticaGovorun
 {
 	namespace
 	{
 		static const size_t WordsCount = 200000;
+		static const size_t SuggestedWordsMaxCount = 100;
+		typedef std::map<boost::wstring_view, PhoneticWord> PhoneticDict;
 	}
 
 	SpeechData::SpeechData(const boost::filesystem::path& speechProjDir_)
@@ -21,38 +28,49 @@ namespace PticaGovorun
 	{
 	}
 
-	void SpeechData::setPhoneReg(std::shared_ptr<PhoneRegistry> phoneReg)
+	void SpeechData::setPhoneReg(std::shared_ptr<const PhoneRegistry> phoneReg)
 	{
 		phoneReg_ = phoneReg;
+		phoneticDicts_.publish(copyPhoneticDicts());
 	}
 
 	void SpeechData::setStringArena(std::shared_ptr<GrowOnlyPinArena<wchar_t>> stringArena)
 	{
 		stringArena_ = stringArena;
+		phoneticDicts_.publish(copyPhoneticDicts());
 	}
 
 	bool SpeechData::Load(bool shrekkyDict, ErrMsgList* errMsg)
 	{
+		auto wellFormed = std::make_shared<PhoneticDict>();
 		if (!loadPhoneticDictionaryXml(persianDictPath(), *phoneReg_, phoneticDictWellFormedWords_, *stringArena_, errMsg))
 		{
 			pushErrorMsg(errMsg, "Can't load WellFormed phonetic dictionary");
 			return false;
 		}
-		reshapeAsDict(phoneticDictWellFormedWords_, phoneticDictWellFormed_);
+		reshapeAsDict(phoneticDictWellFormedWords_, *wellFormed);
 
+		auto broken = std::make_shared<PhoneticDict>();
 		if (!loadPhoneticDictionaryXml(brokenDictPath(), *phoneReg_, phoneticDictBrokenWords_, *stringArena_, errMsg))
 		{
 			pushErrorMsg(errMsg, "Can't load Broken phonetic dictionary");
 			return false;
 		}
-		reshapeAsDict(phoneticDictBrokenWords_, phoneticDictBroken_);
+		reshapeAsDict(phoneticDictBrokenWords_, *broken);
 
+		auto filler = std::make_shared<PhoneticDict>();
 		if (!loadPhoneticDictionaryXml(fillerDictPath(), *phoneReg_, phoneticDictFillerWords_, *stringArena_, errMsg))
 		{
 			pushErrorMsg(errMsg, "Can't load Filler phonetic dictionary");
 			return false;
 		}
-		reshapeAsDict(phoneticDictFillerWords_, phoneticDictFiller_);
+		reshapeAsDict(phoneticDictFillerWords_, *filler);
+
+		std::shared_ptr<PhoneticDictSnapshot> snapshot = copyPhoneticDicts();
+		snapshot->WellFormed = wellFormed;
+		snapshot->Broken = broken;
+		snapshot->Filler = filler;
+		phoneticDicts_.publish(snapshot);
 
 		if (shrekkyDict && !loadShrekkyDict(errMsg))
 		{
@@ -60,6 +78,7 @@ namespace PticaGovorun
 			return false;
 		}
 
+		invalidateSuggestIndices();
 		return true;
 	}
 
@@ -89,7 +108,13 @@ namespace PticaGovorun
 			return false;
 		}
 
-		reshapeAsDict(phoneticDictWords, phoneticDictShrekky_);
+		auto shrekky = std::make_shared<PhoneticDict>();
+		reshapeAsDict(phoneticDictWords, *shrekky);
+
+		std::shared_ptr<PhoneticDictSnapshot> snapshot = copyPhoneticDicts();
+		snapshot->Shrekky = shrekky;
+		phoneticDicts_.publish(snapshot);
+		suggestIndexShrekky_.invalidate();
 		return true;
 	}
 
@@ -100,8 +125,9 @@ namespace PticaGovorun
 			return pair.second;
 		};
 
-		std::vector<PhoneticWord> words(phoneticDictWellFormed_.size());
-		std::transform(std::begin(phoneticDictWellFormed_), std::end(phoneticDictWellFormed_), std::begin(words), selectSecondFun);
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot = phoneticDicts_.snapshot();
+		std::vector<PhoneticWord> words(snapshot->WellFormed->size());
+		std::transform(std::begin(*snapshot->WellFormed), std::end(*snapshot->WellFormed), std::begin(words), selectSecondFun);
 		if (!savePhoneticDictionaryXml(words, persianDictPath(), *phoneReg_, errMsg))
 		{
 			pushErrorMsg(errMsg, "Can't save WellFormed phonetic dict");
@@ -109,8 +135,8 @@ namespace PticaGovorun
 		}
 
 		//
-		words.resize(phoneticDictBroken_.size());
-		std::transform(std::begin(phoneticDictBroken_), std::end(phoneticDictBroken_), std::begin(words), selectSecondFun);
+		words.resize(snapshot->Broken->size());
+		std::transform(std::begin(*snapshot->Broken), std::end(*snapshot->Broken), std::begin(words), selectSecondFun);
 		if (!savePhoneticDictionaryXml(words, brokenDictPath(), *phoneReg_, errMsg))
 		{
 			pushErrorMsg(errMsg, "Can't save Broken phonetic dict");
@@ -119,6 +145,41 @@ namespace PticaGovorun
 		return true;
 	}
 
+	std::shared_ptr<PhoneticDictSnapshot> SpeechData::copyPhoneticDicts() const
+	{
+		auto snapshot = std::make_shared<PhoneticDictSnapshot>(*phoneticDicts_.snapshot());
+		snapshot->PhoneReg = phoneReg_;
+
+		// words of loaded dictionaries point into the string arena
+		if (stringArena_ != nullptr && std::find(snapshot->StringArenas.begin(), snapshot->StringArenas.end(), stringArena_) == snapshot->StringArenas.end())
+			snapshot->StringArenas.push_back(stringArena_);
+		return snapshot;
+	}
+
+	std::shared_ptr<const PhoneticDictSnapshot> SpeechData::phoneticDictSnapshot() const
+	{
+		return phoneticDicts_.snapshot();
+	}
+
+	const std::map<boost::wstring_view, PhoneticWord>& SpeechData::phoneticDictWellFormed() const
+	{
+		return *phoneticDicts_.snapshot()->WellFormed;
+	}
+
+	const std::map<boost::wstring_view, PhoneticWord>& SpeechData::phoneticDictBroken() const
+	{
+		return *phoneticDicts_.snapshot()->Broken;
+	}
+
+	const std::map<boost::wstring_view, PhoneticWord>& SpeechData::phoneticDictFiller() const
+	{
+		return *phoneticDicts_.snapshot()->Filler;
+	}
+
+	const std::map<boost::wstring_view, PhoneticWord>& SpeechData::phoneticDictShrekky() const
+	{
+		return *phoneticDicts_.snapshot()->Shrekky;
+	}
 
 	boost::filesystem::path SpeechData::speechProjDir() const
 	{
@@ -150,6 +211,16 @@ namespace PticaGovorun
 		return AppHelpers::mapPath("pgdata/Julius/shrekky/shrekkyDic.voca").toStdWString();
 	}
 
+	boost::filesystem::path SpeechData::validationCachePath() const
+	{
+		return speechProjDir_ / "validationCache.txt";
+	}
+
+	void SpeechData::setUseValidationCache(bool value)
+	{
+		useValidationCache_ = value;
+	}
+
 	bool SpeechData::convertTextToPhoneListString(boost::wstring_view text, std::string& speechPhonesString, bool& validAllPhones, ErrMsgList* errMsg)
 	{
 		validAllPhones = false;
@@ -190,7 +261,7 @@ namespace PticaGovorun
 			}
 			else
 			{
-				const std::vector<PhoneId>& wordPhones = prons.front().Phones;
+				const PronunciationPhones& wordPhones = prons.front().Phones;
 				std::string phoneListStr;
 				if (!phoneListToStr(*phoneReg_, wordPhones, phoneListStr))
 				{
@@ -213,9 +284,10 @@ namespace PticaGovorun
 
 	bool SpeechData::findPronAsWordPhoneticExpansions(boost::wstring_view pronAsWord, std::vector<PronunciationFlavour>& prons)
 	{
-		bool found1 = findPronAsWordPhoneticExpansions(phoneticDictWellFormed_, pronAsWord, prons);
-		bool found2 = findPronAsWordPhoneticExpansions(phoneticDictBroken_, pronAsWord, prons);
-		bool found3 = findPronAsWordPhoneticExpansions(phoneticDictFiller_, pronAsWord, prons);
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot = phoneticDicts_.snapshot();
+		bool found1 = findPronAsWordPhoneticExpansions(*snapshot->WellFormed, pronAsWord, prons);
+		bool found2 = findPronAsWordPhoneticExpansions(*snapshot->Broken, pronAsWord, prons);
+		bool found3 = findPronAsWordPhoneticExpansions(*snapshot->Filler, pronAsWord, prons);
 		return found1 || found2 || found3;
 	}
 
@@ -249,134 +321,95 @@ namespace PticaGovorun
 
 	const PhoneticWord* SpeechData::findPhoneticWord(const QString& browseDictStr, const std::wstring& word) const
 	{
-		const std::map<boost::wstring_view, PhoneticWord>* dict = nullptr;
-		if (browseDictStr.compare("shrekky", Qt::CaseInsensitive) == 0)
-			dict = &phoneticDictShrekky_;
-		else if (browseDictStr.compare("broken", Qt::CaseInsensitive) == 0)
-			dict = &phoneticDictBroken_;
-		else if (browseDictStr.compare("persian", Qt::CaseInsensitive) == 0)
-			dict = &phoneticDictWellFormed_;
-		if (dict == nullptr)
-			return nullptr;
-
-		auto it = dict->find(word);
-		if (it != std::end(*dict))
-		{
-			const PhoneticWord& pron = it->second;
-			return &pron;
-		}
-		return nullptr;
+		// the current snapshot is kept by this object until the next edit
+		return phoneticDicts_.snapshot()->findPhoneticWord(browseDictStr, word);
 	}
 
 	bool SpeechData::createUpdateDeletePhoneticWord(const QString& dictId, const QString& word, const QString& pronLinesAsStr, QString* errMsg)
 	{
-		std::map<boost::wstring_view, PhoneticWord>* targetDict = nullptr;
-		if (dictId.compare("persian", Qt::CaseInsensitive) == 0)
-			targetDict = &phoneticDictWellFormed_;
-		else if (dictId.compare("broken", Qt::CaseInsensitive) == 0)
-			targetDict = &phoneticDictBroken_;
-		if (targetDict == nullptr)
+		std::shared_ptr<const PhoneticDictSnapshot> oldSnapshot = phoneticDicts_.snapshot();
+		if (!phoneticDicts_.createUpdateDeletePhoneticWord(dictId, word, pronLinesAsStr, errMsg))
 			return false;
 
-		PhoneticWord wordItem;
-
-		std::vector<wchar_t> wordBuff;
-		boost::wstring_view wordRef = toWStringRef(word, wordBuff);
-		boost::wstring_view arenaWordRef;
-
-		auto itWord = targetDict->find(wordRef);
-		if (itWord != std::end(*targetDict))
-		{
-			arenaWordRef = itWord->first;
-			wordItem = itWord->second;
-		}
-		else
-		{
-			if (!registerWord(wordRef, *stringArena_, arenaWordRef))
-			{
-				*errMsg = "Can't allocate new word.";
-				return false;
-			}
-			wordItem.Word = arenaWordRef;
+		// keep the suggestion index in sync with the dictionary
+		WordPrefixIndex* suggestIndex = nullptr;
+		browseDict(dictId, &suggestIndex);
+		if (suggestIndex != nullptr && suggestIndex->isBuilt())
+		{
+			std::vector<wchar_t> wordBuff;
+			boost::wstring_view wordRef = toWStringRef(word, wordBuff);
+			const PhoneticWord* oldWord = oldSnapshot->findPhoneticWord(dictId, wordRef);
+			if (oldWord != nullptr)
+				suggestIndex->removeWord(*oldWord);
+			const PhoneticWord* newWord = phoneticDicts_.snapshot()->findPhoneticWord(dictId, wordRef);
+			if (newWord != nullptr)
+				suggestIndex->addWord(*newWord);
 		}
+		return true;
+	}
 
-		//
-		bool parseOp;
-		const char* errMsgC;
-		std::vector<PronunciationFlavour> prons;
-		// TODO: memory leak; string arena always grow
-		std::tie(parseOp, errMsgC) = parsePronuncLinesNew(*phoneReg_, pronLinesAsStr.toStdWString(), prons, *stringArena_);
-		if (!parseOp)
+	const std::map<boost::wstring_view, PhoneticWord>* SpeechData::browseDict(const QString& browseDictStr, WordPrefixIndex** suggestIndex)
+	{
+		if (browseDictStr.compare("shrekky", Qt::CaseInsensitive) == 0)
 		{
-			*errMsg = QString::fromLatin1(errMsgC);
-			return false;
+			*suggestIndex = &suggestIndexShrekky_;
+			return &phoneticDictShrekky();
 		}
-		if (prons.empty())
+		if (browseDictStr.compare("broken", Qt::CaseInsensitive) == 0)
 		{
-			// treat empty pronunciations as a request to delete a word
-			(*targetDict).erase(wordRef);
+			*suggestIndex = &suggestIndexBroken_;
+			return &phoneticDictBroken();
 		}
-		else
+		if (browseDictStr.compare("persian", Qt::CaseInsensitive) == 0)
 		{
-			// create or update
-			wordItem.Pronunciations = std::move(prons);
-			PG_DbgAssert(arenaWordRef != boost::wstring_view());
-			(*targetDict)[arenaWordRef] = wordItem;
+			*suggestIndex = &suggestIndexWellFormed_;
+			return &phoneticDictWellFormed();
 		}
-		return true;
+		*suggestIndex = nullptr;
+		return nullptr;
+	}
+
+	void SpeechData::invalidateSuggestIndices()
+	{
+		suggestIndexWellFormed_.invalidate();
+		suggestIndexBroken_.invalidate();
+		suggestIndexShrekky_.invalidate();
 	}
 
 	void SpeechData::suggesedWordsUserInput(const QString& browseDictStr, const QString& currentWord, QStringList& result)
 	{
-		std::map<boost::wstring_view, PhoneticWord>* dict = nullptr;
-		if (browseDictStr.compare("shrekky", Qt::CaseInsensitive) == 0)
-			dict = &phoneticDictShrekky_;
-		else if (browseDictStr.compare("broken", Qt::CaseInsensitive) == 0)
-			dict = &phoneticDictBroken_;
-		else if (browseDictStr.compare("persian", Qt::CaseInsensitive) == 0)
-			dict = &phoneticDictWellFormed_;
+		suggesedWordsUserInput(browseDictStr, currentWord, SuggestedWordsMaxCount, false, result);
+	}
+
+	void SpeechData::suggesedWordsUserInput(const QString& browseDictStr, const QString& currentWord, size_t maxResults, bool allowTypo, QStringList& result)
+	{
+		WordPrefixIndex* suggestIndex = nullptr;
+		const std::map<boost::wstring_view, PhoneticWord>* dict = browseDict(browseDictStr, &suggestIndex);
 		if (dict == nullptr)
 			return;
 
-		for (const auto& pair : *dict)
-		{
-			const PhoneticWord& wordAndProns = pair.second;
-
-			QString wordDict = QString::fromWCharArray(wordAndProns.Word.data(), wordAndProns.Word.size());
-
-			// try to match word itself
-			bool match = wordDict.startsWith(currentWord, Qt::CaseInsensitive);
+		if (!suggestIndex->isBuilt())
+			suggestIndex->build(*dict);
 
-			// try to match its pronunciations
-			if (!match)
-			{
-				for (const PronunciationFlavour& prons : wordAndProns.Pronunciations)
-				{
-					QString pronAsWord = QString::fromWCharArray(prons.PronCode.data(), prons.PronCode.size());
-
-					if (pronAsWord.startsWith(currentWord, Qt::CaseInsensitive))
-					{
-						match = true;
-						break; // process the next word
-					}
-				}
-			}
+		std::vector<wchar_t> wordBuff;
+		boost::wstring_view prefix = toWStringRef(currentWord, wordBuff);
 
-			if (match)
-			{
-				// the word itself, not its pronunciation (which looks like word) is shown
-				result.append(wordDict);
+		std::vector<boost::wstring_view> words;
+		suggestIndex->findWords(prefix, maxResults, allowTypo, words);
 
-				if (result.count() > 100)
-					break;
-			}
-		}
+		// the word itself, not its pronunciation (which looks like word) is shown
+		for (boost::wstring_view word : words)
+			result.append(toQString(word));
 	}
 
 	bool SpeechData::validate(bool checkStress, QStringList* errMsgs)
 	{
-		bool phDict = validatePhoneticDictionary(checkStress, errMsgs);
-		bool annot = validateAllSpeechAnnotations(errMsgs);
+		std::vector<AnnotSpeechFileNode> annotFiles;
+		std::vector<AnnotValidationEntry> annotResults;
+		validateSpeechAnnotFilesCached(annotFiles, annotResults);
+
+		bool phDict = validatePhoneticDictionary(checkStress, annotResults, errMsgs);
+		bool annot = validateAllSpeechAnnotations(annotFiles, annotResults, errMsgs);
 
 		bool valid = phDict && annot;
 #if PG_DEBUG // postcondition
@@ -393,41 +426,9 @@ namespace PticaGovorun
 		return valid;
 	}
 
-	void SpeechData::iterateAllSpeechAnnotations(boost::wstring_view annotDir,
-		std::function<void(const AnnotSpeechFileNode&)> onAnnotFile,
-		std::function<void(const SpeechAnnotation&)> onAnnot,
-		std::function<void(const char*)> onAnnotError)
-	{
-		QString curDirQ = toQString(annotDir);
-
-		AnnotSpeechDirNode annotStructure;
-		populateAnnotationFileStructure(curDirQ, annotStructure);
-
-		std::vector<AnnotSpeechFileNode> annotInfos;
-		flat(annotStructure, annotInfos);
-
-		std::map<boost::wstring_view, int> pronIdToUsedCount;
-		for (const AnnotSpeechFileNode& fileItem : annotInfos)
-		{
-			if (onAnnotFile != nullptr) onAnnotFile(fileItem);
-
-			SpeechAnnotation annot;
-			bool loadOp;
-			const char* errMsg;
-			std::tie(loadOp, errMsg) = loadAudioMarkupFromXml(fileItem.SpeechAnnotationAbsPath.toStdWString(), annot);
-			if (!loadOp)
-			{
-				if (onAnnotError != nullptr)  onAnnotError(errMsg);
-				continue;
-			}
-
-			if (onAnnot != nullptr) onAnnot(annot);
-		}
-	}
-
 	// phonetic dictionary
 
-	bool SpeechData::validatePhoneticDictionary(bool checkStress, QStringList* errMsgs)
+	bool SpeechData::validatePhoneticDictionary(bool checkStress, const std::vector<AnnotValidationEntry>& annotResults, QStringList* errMsgs)
 	{
 		// stress
 
@@ -442,7 +443,7 @@ namespace PticaGovorun
 			errMsgs->append(msg);
 		}
 
-		bool d3 = validatePhoneticDictAllPronsAreUsed(errMsgs);
+		bool d3 = validatePhoneticDictAllPronsAreUsed(annotResults, errMsgs);
 		return d1 && d2 && d3;
 	}
 
@@ -471,13 +472,12 @@ namespace PticaGovorun
 		return result;
 	}
 
-	bool SpeechData::validatePhoneticDictAllPronsAreUsed(QStringList* errMsgs)
+	bool SpeechData::validatePhoneticDictAllPronsAreUsed(const std::vector<AnnotValidationEntry>& annotResults, QStringList* errMsgs)
 	{
-		GrowOnlyPinArena<wchar_t> arena(1024);
 		std::map<boost::wstring_view, int> pronIdToUsedCount;
 
 		// set up all words in phonetic dictionary for counting
-		auto pushPronIds = [&pronIdToUsedCount](const decltype(phoneticDictWellFormed_)& dict) -> void
+		auto pushPronIds = [&pronIdToUsedCount](const PhoneticDict& dict) -> void
 		{
 			for (const auto& pair : dict)
 			{
@@ -485,24 +485,30 @@ namespace PticaGovorun
 					pronIdToUsedCount[pron.PronCode] = 0;
 			}
 		};
-		pushPronIds(phoneticDictWellFormed_);
-		pushPronIds(phoneticDictBroken_);
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot = phoneticDicts_.snapshot();
+		pushPronIds(*snapshot->WellFormed);
+		pushPronIds(*snapshot->Broken);
 
 		bool gotError = false;
-		auto countFun = [this, &pronIdToUsedCount, &arena](const SpeechAnnotation& annot)
+		for (const AnnotValidationEntry& annotResult : annotResults)
 		{
-			// count usage of pronIds in phonetic dictionary
-			phoneticDictCountPronUsage(annot, arena, pronIdToUsedCount);
-		};
-		auto oneAnnotErrFun = [this, errMsgs, &gotError](const char* errMsg)
-		{
-			gotError = true;
-			errMsgs->push_back(QString::fromLatin1(errMsg));
-		};
-
-		auto annotDir = speechAnnotDirPath().wstring();
-		iterateAllSpeechAnnotations(annotDir, nullptr, countFun, oneAnnotErrFun);
+			if (!annotResult.LoadError.isEmpty())
+			{
+				gotError = true;
+				if (errMsgs != nullptr)
+					errMsgs->push_back(annotResult.LoadError);
+				continue;
+			}
 
+			// count usage of pronIds in phonetic dictionary
+			for (const auto& usage : annotResult.PronUsage)
+			{
+				// do not implicitly add the word to counting dict!
+				auto it = pronIdToUsedCount.find(usage.first);
+				if (it != pronIdToUsedCount.end())
+					it->second += usage.second;
+			}
+		}
 		if (gotError)
 			return false;
 
@@ -519,67 +525,175 @@ namespace PticaGovorun
 		return numErrs == 0;
 	}
 
-	void SpeechData::phoneticDictCountPronUsage(const SpeechAnnotation& speechAnnot, 
-		GrowOnlyPinArena<wchar_t>& arena,
-		std::map<boost::wstring_view, int>& pronIdToUsedCount)
-	{
-		std::vector<std::pair<const TimePointMarker*, const TimePointMarker*>> segments;
-		collectAnnotatedSegments(speechAnnot.markers(), segments);
+	// speech annotation
 
-		std::vector<wchar_t> textBuff;
-		for (const std::pair<const TimePointMarker*, const TimePointMarker*>& seg : segments)
+	bool SpeechData::validateAllSpeechAnnotations(const std::vector<AnnotSpeechFileNode>& annotFiles, const std::vector<AnnotValidationEntry>& annotResults, QStringList* errMsgs)
+	{
+		int errNum = 0;
+		for (size_t fileInd = 0; fileInd < annotFiles.size(); ++fileInd)
 		{
-			if (seg.first->Language == SpeechLanguage::Ukrainian)
-			{
-				const QString& text = seg.first->TranscripText;
-				boost::wstring_view textRef = toWStringRef(text, textBuff);
+			const AnnotValidationEntry& annotResult = annotResults[fileInd];
+			if (!annotResult.LoadError.isEmpty() && errMsgs != nullptr)
+				errMsgs->push_back(annotResult.LoadError);
 
-				std::vector<boost::wstring_view> wordsAsSlices;
-				splitUtteranceIntoPronuncList(textRef, arena, wordsAsSlices);
-
-				for (boost::wstring_view pronAsWordRef : wordsAsSlices)
+			// if file gets messages then we will prepend it with anot file's path
+			const QStringList& fileItemMsgs = annotResult.Msgs;
+			if (!fileItemMsgs.empty())
+			{
+				errNum += fileItemMsgs.size();
+				if (errMsgs != nullptr)
 				{
-					// do not implicitly add the word to counting dict!
-					auto it = pronIdToUsedCount.find(pronAsWordRef);
-					if (it != pronIdToUsedCount.end())
-						pronIdToUsedCount[pronAsWordRef]++;
+					errMsgs->append(QString("File=%1\n").arg(annotFiles[fileInd].SpeechAnnotationAbsPath));
+					(*errMsgs) << fileItemMsgs << "\n";
 				}
 			}
 		}
+		return errNum == 0;
 	}
 
-	// speech annotation
-
-	bool SpeechData::validateAllSpeechAnnotations(QStringList* errMsgs)
+	void SpeechData::validateSpeechAnnotFilesCached(std::vector<AnnotSpeechFileNode>& annotFiles, std::vector<AnnotValidationEntry>& annotResults)
 	{
-		int errNum = 0;
-		QString curSpeechFileAbsPath;
-		auto oneAnnotFileFun = [this, &curSpeechFileAbsPath](const AnnotSpeechFileNode& fileNode)
+		findAnnotationFilesFlat(speechAnnotDirPath(), annotFiles);
+
+		// the cache is optional; on any error all files are validated
+		SpeechDataValidationCache cache;
+		if (useValidationCache_)
+			cache.load(validationCachePath(), nullptr);
+
+		std::map<std::wstring, std::wstring> dictEntries;
+		collectPhoneticDictEntries(dictEntries);
+
+		std::set<std::wstring> dictAffectedTokens;
+		collectDictChangeAffectedTokens(cache.dictEntries(), dictEntries, dictAffectedTokens);
+
+		auto usesChangedDictEntries = [&dictAffectedTokens](const AnnotValidationEntry& entry) -> bool
 		{
-			curSpeechFileAbsPath = fileNode.SpeechAnnotationAbsPath;
+			for (const auto& usage : entry.PronUsage)
+				if (dictAffectedTokens.find(usage.first) != dictAffectedTokens.end())
+					return true;
+			return false;
 		};
-		auto oneAnnotErrFun = [this, errMsgs](const char* errMsg)
+
+		int threadsCount = parallelThreadsCount(annotFiles.size(), -1);
+		std::vector<AudioMarkupXmlBuffers> threadBuffs(threadsCount);
+		std::vector<std::unique_ptr<GrowOnlyPinArena<wchar_t>>> threadArenas;
+		for (int i = 0; i < threadsCount; ++i)
+			threadArenas.push_back(std::make_unique<GrowOnlyPinArena<wchar_t>>(1024));
+
+		annotResults.resize(annotFiles.size());
+		parallelFor(annotFiles.size(), threadsCount, [&](size_t fileInd, int threadInd)
 		{
-			errMsgs->push_back(QString::fromLatin1(errMsg));
-		};
-		auto oneAnnotFun = [this, errMsgs, &curSpeechFileAbsPath, &errNum](const SpeechAnnotation& annot)
+			const QString& annotPath = annotFiles[fileInd].SpeechAnnotationAbsPath;
+			boost::filesystem::path annotPathBfs = toBfs(annotPath);
+			AnnotValidationEntry& result = annotResults[fileInd];
+
+			std::int64_t fileSize = -1;
+			std::int64_t modifTime = 0;
+			readFileStamp(annotPathBfs, fileSize, modifTime);
+
+			const AnnotValidationEntry* cached = cache.findFile(annotPath);
+			bool cacheUsable = cached != nullptr && !usesChangedDictEntries(*cached);
+			if (cacheUsable && cached->hasFileStamp(fileSize, modifTime))
+			{
+				result = *cached;
+				return;
+			}
+
+			AudioMarkupXmlBuffers& buffs = threadBuffs[threadInd];
+			ErrMsgList errMsg;
+			if (!readAllBytes(annotPathBfs, buffs.FileContent, &errMsg))
+			{
+				result = AnnotValidationEntry();
+				result.LoadError = combineErrorMessages(errMsg);
+				return;
+			}
+			std::uint64_t contentHash = hashFnv1a64(buffs.FileContent.data(), buffs.FileContent.size());
+			if (cacheUsable && cached->ContentHash == contentHash)
+			{
+				// file was touched but not changed
+				result = *cached;
+			}
+			else
+			{
+				result = AnnotValidationEntry();
+				result.ContentHash = contentHash;
+				boost::string_view xmlText(buffs.FileContent.data(), buffs.FileContent.size());
+				validateSpeechAnnotFile(xmlText, buffs, *threadArenas[threadInd], result);
+			}
+			result.FileSize = fileSize;
+			result.ModifTime = modifTime;
+		});
+
+		if (useValidationCache_)
 		{
-			// accumulate error messages in different temporary list
-			// if it gets messages then we will prepend it with anot file's path
-			QStringList fileItemMsgs;
-			validateOneSpeechAnnot(annot, &fileItemMsgs);
+			std::vector<QString> annotPaths;
+			annotPaths.reserve(annotFiles.size());
+			for (const AnnotSpeechFileNode& fileItem : annotFiles)
+				annotPaths.push_back(fileItem.SpeechAnnotationAbsPath);
+			cache.setFiles(annotPaths, annotResults);
+			cache.setDictEntries(dictEntries);
 
-			if (!fileItemMsgs.empty())
+			// failure to write the cache just slows down the next validation
+			cache.save(validationCachePath(), nullptr);
+		}
+	}
+
+	void SpeechData::validateSpeechAnnotFile(boost::string_view xmlText, AudioMarkupXmlBuffers& buffs, GrowOnlyPinArena<wchar_t>& arena, AnnotValidationEntry& result)
+	{
+		SpeechAnnotation annot;
+		ErrMsgList errMsg;
+		if (!parseAudioMarkupXml(xmlText, annot, buffs, &errMsg))
+		{
+			result.LoadError = combineErrorMessages(errMsg);
+			return;
+		}
+
+		validateOneSpeechAnnot(annot, &result.Msgs);
+
+		// count all pronCodes, so that the usage doesn't depend on phonetic dictionary
+		std::vector<std::pair<const TimePointMarker*, const TimePointMarker*>> segments;
+		collectAnnotatedSegments(annot.markers(), segments);
+
+		std::vector<wchar_t> textBuff;
+		std::vector<boost::wstring_view> wordsAsSlices;
+		for (const std::pair<const TimePointMarker*, const TimePointMarker*>& seg : segments)
+		{
+			if (seg.first->Language != SpeechLanguage::Ukrainian)
+				continue;
+
+			boost::wstring_view textRef = toWStringRef(seg.first->TranscripText, textBuff);
+
+			wordsAsSlices.clear();
+			splitUtteranceIntoPronuncList(textRef, arena, wordsAsSlices);
+			for (boost::wstring_view pronAsWordRef : wordsAsSlices)
+				result.PronUsage[toStdWString(pronAsWordRef)]++;
+		}
+		arena.clear(); // the words were copied
+	}
+
+	void SpeechData::collectPhoneticDictEntries(std::map<std::wstring, std::wstring>& dictEntries) const
+	{
+		auto pushDict = [&dictEntries](const std::map<boost::wstring_view, PhoneticWord>& dict, const wchar_t* tag)
+		{
+			for (const auto& pair : dict)
 			{
-				errNum += fileItemMsgs.size();
-				errMsgs->append(QString("File=%1\n").arg(curSpeechFileAbsPath));
-				(*errMsgs) << fileItemMsgs << "\n";
+				std::wstring key = tag;
+				key.append(L" ");
+				key.append(pair.first.data(), pair.first.size());
+
+				std::wstring pronCodes;
+				for (const PronunciationFlavour& pron : pair.second.Pronunciations)
+				{
+					if (!pronCodes.empty()) pronCodes.push_back(L' ');
+					pronCodes.append(pron.PronCode.data(), pron.PronCode.size());
+				}
+				dictEntries[key] = pronCodes;
 			}
 		};
-
-		auto annotDir = speechAnnotDirPath().wstring();
-		iterateAllSpeechAnnotations(annotDir, oneAnnotFileFun, oneAnnotFun, oneAnnotErrFun);
-		return errNum == 0;
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot = phoneticDicts_.snapshot();
+		pushDict(*snapshot->WellFormed, L"known");
+		pushDict(*snapshot->Broken, L"broken");
+		pushDict(*snapshot->Filler, L"filler");
 	}
 
 	void SpeechData::validateOneSpeechAnnot(const SpeechAnnotation& annot, QStringList* errMsgs)
@@ -658,6 +772,7 @@ namespace PticaGovorun
 		};
 
 		// iterate through words
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot = phoneticDicts_.snapshot();
 		std::wstringstream msgBuf;
 		boost::wstring_view outSimilarPronAsWordDictKnown;
 		boost::wstring_view outExactWordDictKnown;
@@ -669,9 +784,9 @@ namespace PticaGovorun
 			outExactWordDictKnown.clear();
 			outSimilarPronAsWordDictBroken.clear();
 			outExactWordDictBroken.clear();
-			bool isKnown = isPronAsWordInDict(phoneticDictWellFormed_, pronCode, outExactWordDictKnown, outSimilarPronAsWordDictKnown);
-			bool isBroken = isPronAsWordInDict(phoneticDictBroken_, pronCode, outExactWordDictBroken, outSimilarPronAsWordDictBroken);
-			bool isFiller = isPronAsWordInDict(phoneticDictFiller_, pronCode, outExactWordDictBroken, outSimilarPronAsWordDictBroken);
+			bool isKnown = isPronAsWordInDict(*snapshot->WellFormed, pronCode, outExactWordDictKnown, outSimilarPronAsWordDictKnown);
+			bool isBroken = isPronAsWordInDict(*snapshot->Broken, pronCode, outExactWordDictBroken, outSimilarPronAsWordDictBroken);
+			bool isFiller = isPronAsWordInDict(*snapshot->Filler, pronCode, outExactWordDictBroken, outSimilarPronAsWordDictBroken);
 
 			if (!isKnown && !isBroken && !isFiller)
 			{
@@ -714,15 +829,20 @@ namespace PticaGovorun
 
 	void SpeechData::mergePhoneticDictOnlyNew(const std::vector<PhoneticWord>& extraPhoneticDict)
 	{
+		suggestIndexWellFormed_.invalidate();
+
 		struct BackRef
 		{
 			size_t WellKnownVectorInd;
-			decltype(phoneticDictWellFormed_)::iterator WellKnownDictIt;
+			PhoneticDict::iterator WellKnownDictIt;
 		};
 		std::map<boost::wstring_view, BackRef> existData;
 
 		auto& wordsVect = phoneticDictWellFormedWords_;
-		auto& wordsDict = phoneticDictWellFormed_;
+
+		// the merge is one edit; only well formed dictionary is copied
+		auto wordsDictPtr = std::make_shared<PhoneticDict>(phoneticDictWellFormed());
+		auto& wordsDict = *wordsDictPtr;
 
 		// collect references to existent data
 		for (size_t i = 0; i<wordsVect.size(); ++i)
@@ -782,5 +902,9 @@ namespace PticaGovorun
 				mergeWord(baseWord, extraWord);
 			}
 		}
+
+		std::shared_ptr<PhoneticDictSnapshot> snapshot = copyPhoneticDicts();
+		snapshot->WellFormed = wordsDictPtr;
+		phoneticDicts_.publish(snapshot);
 	}
 }
\ No newline at end of file
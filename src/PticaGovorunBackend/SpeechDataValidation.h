@@ -5,7 +5,11 @@
 #include <boost/filesystem/path.hpp>
 #include "PticaGovorunCore.h"
 #include "PhoneticService.h"
+#include "PhoneticDictSnapshot.h"
 #include "SpeechAnnotation.h"
+#include "SpeechDataValidationCache.h"
+#include "XmlAudioMarkup.h"
+#include "WordPrefixIndex.h"
 
 namespace PticaGovorun
 {
@@ -15,20 +19,23 @@ namespace PticaGovorun
 	{
 		const boost::filesystem::path speechProjDir_;
 
-		std::shared_ptr<PhoneRegistry> phoneReg_;
+		std::shared_ptr<const PhoneRegistry> phoneReg_;
 		std::shared_ptr<GrowOnlyPinArena<wchar_t>> stringArena_;
+		SharedPhoneticDicts phoneticDicts_; // the only storage of phonetic dictionaries; each edit publishes the new snapshot
+		bool useValidationCache_ = true;
+
+		// prefix indices for suggestion of words; built on first request
+		WordPrefixIndex suggestIndexWellFormed_;
+		WordPrefixIndex suggestIndexBroken_;
+		WordPrefixIndex suggestIndexShrekky_;
 
 	public:
 		std::vector<PhoneticWord> phoneticDictWellFormedWords_;
 		std::vector<PhoneticWord> phoneticDictBrokenWords_;
 		std::vector<PhoneticWord> phoneticDictFillerWords_;
-		std::map<boost::wstring_view, PhoneticWord> phoneticDictWellFormed_;
-		std::map<boost::wstring_view, PhoneticWord> phoneticDictBroken_;
-		std::map<boost::wstring_view, PhoneticWord> phoneticDictFiller_;
-		std::map<boost::wstring_view, PhoneticWord> phoneticDictShrekky_;
 	public:
 		explicit SpeechData(const boost::filesystem::path& speechProjDir);
-		void setPhoneReg(std::shared_ptr<PhoneRegistry> phoneReg);
+		void setPhoneReg(std::shared_ptr<const PhoneRegistry> phoneReg);
 		void setStringArena(std::shared_ptr<GrowOnlyPinArena<wchar_t>> stringArena);
 		SpeechData(const SpeechData&) = delete;
 		~SpeechData();
@@ -39,6 +46,16 @@ namespace PticaGovorun
 		// Saves all phonetic dictionaries.
 		bool saveDict(ErrMsgList* errMsg);
 
+		/// The current snapshot of phonetic dictionaries, which may be shared by many sessions.
+		/// Each edit or reload of dictionaries publishes the next snapshot; the taken snapshot is not changed.
+		std::shared_ptr<const PhoneticDictSnapshot> phoneticDictSnapshot() const;
+
+		/// Dictionaries of the current snapshot. The references are valid until the next edit of dictionaries.
+		const std::map<boost::wstring_view, PhoneticWord>& phoneticDictWellFormed() const;
+		const std::map<boost::wstring_view, PhoneticWord>& phoneticDictBroken() const;
+		const std::map<boost::wstring_view, PhoneticWord>& phoneticDictFiller() const;
+		const std::map<boost::wstring_view, PhoneticWord>& phoneticDictShrekky() const;
+
 		//
 
 		boost::filesystem::path speechProjDir() const;
@@ -52,17 +69,33 @@ namespace PticaGovorun
 		boost::filesystem::path fillerDictPath();
 		boost::filesystem::path shrekkyDictPath();
 
+		// results of the last validation
+		boost::filesystem::path validationCachePath() const;
+
+		/// Whether the validation reuses results of previous validation for unchanged annotation files.
+		void setUseValidationCache(bool value);
+
 		/// Returns true if the phone list string is populated.
 		bool convertTextToPhoneListString(boost::wstring_view text, std::string& speechPhonesString, bool& validAllPhones, ErrMsgList* errMsg);
 		bool findPronAsWordPhoneticExpansions(boost::wstring_view pronAsWord, std::vector<PronunciationFlavour>& prons);
 	private:
 		bool findPronAsWordPhoneticExpansions(const std::map<boost::wstring_view, PhoneticWord>& phoneticDict, boost::wstring_view pronCode, std::vector<PronunciationFlavour>& prons);
 	public:
+		/// The word is valid until the next edit of dictionaries.
 		const PhoneticWord* findPhoneticWord(const QString& browseDictStr, const std::wstring& word) const;
 		bool createUpdateDeletePhoneticWord(const QString& dictId, const QString& word, const QString& pronLinesAsStr, QString* errMsg);
 
 		void suggesedWordsUserInput(const QString& browseDictStr, const QString& currentWord, QStringList& result);
 
+		/// Finds words, which or which pronCode starts with the user input, ignoring case.
+		/// allowTypo=true also suggests words which match the input with one mistyped letter.
+		void suggesedWordsUserInput(const QString& browseDictStr, const QString& currentWord, size_t maxResults, bool allowTypo, QStringList& result);
+	private:
+		const std::map<boost::wstring_view, PhoneticWord>* browseDict(const QString& browseDictStr, WordPrefixIndex** suggestIndex);
+		void invalidateSuggestIndices();
+
+		/// The copy of the current snapshot to change and publish. Only pointers to dictionaries are copied.
+		std::shared_ptr<PhoneticDictSnapshot> copyPhoneticDicts() const;
 	public:
 		bool validate(bool checkStress, QStringList* errMsgs);
 
@@ -72,27 +105,27 @@ namespace PticaGovorun
 
 		void mergePhoneticDictOnlyNew(const std::vector<PhoneticWord>& extraPhoneticDict);
 	private:
-		bool validatePhoneticDictionary(bool checkStress, QStringList* errMsgs);
+		bool validatePhoneticDictionary(bool checkStress, const std::vector<AnnotValidationEntry>& annotResults, QStringList* errMsgs);
 
 		/// For a word with multiple pronunciations checks if none or all pronCodes have marked stress.
 		/// eg. valid=(word=setup, setup(1) setup(2)) or wrong=(word=setup, setup setup(1))
 		bool validatePhoneticDictNoneOrAllPronunciationsSpecifyStress(const std::vector<PhoneticWord>& phoneticDictPronCodes, std::vector<const PhoneticWord*>* invalidWords);
 
-		bool validatePhoneticDictAllPronsAreUsed(QStringList* errMsgs);
-
-		// Add each pronId usage from speech annotation to the dict.
-		// Used to calculate which pronIds in phonetic dict are not used.
-		void phoneticDictCountPronUsage(const SpeechAnnotation& speechAnnot, GrowOnlyPinArena<wchar_t>& arena, std::map<boost::wstring_view, int>& pronIdToUsedCount);
+		bool validatePhoneticDictAllPronsAreUsed(const std::vector<AnnotValidationEntry>& annotResults, QStringList* errMsgs);
 
 		// speech annotation
 
 		void validateOneSpeechAnnotHasPhoneticExpansion(const SpeechAnnotation& speechAnnot, QStringList& checkMsgs);
 
-		bool validateAllSpeechAnnotations(QStringList* errMsgs);
+		bool validateAllSpeechAnnotations(const std::vector<AnnotSpeechFileNode>& annotFiles, const std::vector<AnnotValidationEntry>& annotResults, QStringList* errMsgs);
+
+		/// Validates each speech annotation file. Results of unchanged files, which do not use changed entries of
+		/// phonetic dictionary, are taken from validation cache.
+		void validateSpeechAnnotFilesCached(std::vector<AnnotSpeechFileNode>& annotFiles, std::vector<AnnotValidationEntry>& annotResults);
+
+		void validateSpeechAnnotFile(boost::string_view xmlText, AudioMarkupXmlBuffers& buffs, GrowOnlyPinArena<wchar_t>& arena, AnnotValidationEntry& result);
 
-		static void iterateAllSpeechAnnotations(boost::wstring_view annotDir,
-			std::function<void(const AnnotSpeechFileNode&)> onAnnotFile,
-			std::function<void(const SpeechAnnotation&)> onAnnot,
-			std::function<void(const char*)> onAnnotError);
+		// key=dictionary tag and word, value=space separated pronCodes
+		void collectPhoneticDictEntries(std::map<std::wstring, std::wstring>& dictEntries) const;
 	};
 }
@@ -0,0 +1,287 @@
+#include "SpeechDataValidationCache.h"
+#include <cstdlib>
+#include <cstdio>
+#include <QFile>
+#include <boost/filesystem.hpp>
+#include "CoreUtils.h"
+#include "FileHelpers.h"
+
+namespace PticaGovorun
+{
+	namespace
+	{
+		const char* CacheHeader = "#PticaGovorun speech data validation cache v1";
+		const char FieldSep = '\t';
+
+		void appendEscaped(boost::string_view value, std::string& buf)
+		{
+			for (char c : value)
+			{
+				switch (c)
+				{
+				case '\\': buf.append("\\\\"); break;
+				case '\t': buf.append("\\t"); break;
+				case '\n': buf.append("\\n"); break;
+				case '\r': buf.append("\\r"); break;
+				default: buf.push_back(c);
+				}
+			}
+		}
+
+		void appendField(boost::string_view value, std::string& buf)
+		{
+			buf.push_back(FieldSep);
+			appendEscaped(value, buf);
+		}
+
+		void appendField(boost::wstring_view value, std::string& utf8Buf, std::string& buf)
+		{
+			utf8Buf.clear();
+			toUtf8StdString(value, utf8Buf);
+			appendField(utf8Buf, buf);
+		}
+
+		void appendField(const QString& value, std::string& buf)
+		{
+			QByteArray valueUtf8 = value.toUtf8();
+			appendField(boost::string_view(valueUtf8.constData(), valueUtf8.size()), buf);
+		}
+
+		void splitFields(boost::string_view line, std::vector<std::string>& fields)
+		{
+			fields.clear();
+			fields.emplace_back();
+			for (size_t i = 0; i < line.size(); ++i)
+			{
+				char c = line[i];
+				if (c == FieldSep)
+					fields.emplace_back();
+				else if (c == '\\' && i + 1 < line.size())
+				{
+					char escaped = line[++i];
+					switch (escaped)
+					{
+					case 't': fields.back().push_back('\t'); break;
+					case 'n': fields.back().push_back('\n'); break;
+					case 'r': fields.back().push_back('\r'); break;
+					default: fields.back().push_back(escaped);
+					}
+				}
+				else if (c != '\r')
+					fields.back().push_back(c);
+			}
+		}
+
+		void addTokensOfDictEntry(boost::wstring_view dictKey, boost::wstring_view pronCodes, std::set<std::wstring>& tokens)
+		{
+			// dictKey=tag and word
+			size_t sepInd = dictKey.find(L' ');
+			boost::wstring_view word = sepInd == boost::wstring_view::npos ? dictKey : dictKey.substr(sepInd + 1);
+			tokens.insert(toStdWString(word));
+
+			while (!pronCodes.empty())
+			{
+				size_t endInd = pronCodes.find(L' ');
+				boost::wstring_view pronCode = pronCodes.substr(0, endInd);
+				pronCodes.remove_prefix(endInd == boost::wstring_view::npos ? pronCodes.size() : endInd + 1);
+				if (pronCode.empty())
+					continue;
+
+				tokens.insert(toStdWString(pronCode));
+
+				// pronCode=setup(2) is suggested for token=setup
+				size_t bracketInd = pronCode.find(L'(');
+				if (bracketInd != boost::wstring_view::npos)
+					tokens.insert(toStdWString(pronCode.substr(0, bracketInd)));
+			}
+		}
+	}
+
+	bool AnnotValidationEntry::hasFileStamp(std::int64_t fileSize, std::int64_t modifTime) const
+	{
+		return fileSize != -1 && FileSize == fileSize && ModifTime == modifTime;
+	}
+
+	void readFileStamp(const boost::filesystem::path& filePath, std::int64_t& fileSize, std::int64_t& modifTime)
+	{
+		boost::system::error_code ec;
+		fileSize = (std::int64_t)boost::filesystem::file_size(filePath, ec);
+		modifTime = ec ? 0 : (std::int64_t)boost::filesystem::last_write_time(filePath, ec);
+		if (ec)
+			fileSize = -1;
+	}
+
+	bool SpeechDataValidationCache::load(const boost::filesystem::path& filePath, ErrMsgList* errMsg)
+	{
+		files_.clear();
+		dictEntries_.clear();
+
+		std::vector<char> bytes;
+		if (!readAllBytes(filePath, bytes, errMsg))
+			return false;
+
+		auto fail = [this, errMsg](const char* msg) -> bool
+		{
+			files_.clear();
+			dictEntries_.clear();
+			pushErrorMsg(errMsg, msg);
+			return false;
+		};
+
+		boost::string_view text(bytes.data(), bytes.size());
+		std::vector<std::string> fields;
+		AnnotValidationEntry* curEntry = nullptr;
+		bool isHeader = true;
+		while (!text.empty())
+		{
+			size_t eolInd = text.find('\n');
+			boost::string_view line = text.substr(0, eolInd);
+			text.remove_prefix(eolInd == boost::string_view::npos ? text.size() : eolInd + 1);
+			if (isHeader)
+			{
+				isHeader = false;
+				if (line != CacheHeader)
+					return fail("Unknown format of validation cache");
+				continue;
+			}
+			if (line.empty())
+				continue;
+
+			splitFields(line, fields);
+			const std::string& kind = fields[0];
+			if (kind == "D" && fields.size() == 3)
+			{
+				dictEntries_[utf8s2ws(fields[1])] = utf8s2ws(fields[2]);
+			}
+			else if (kind == "F" && fields.size() == 5)
+			{
+				curEntry = &files_[QString::fromStdString(fields[1])];
+				curEntry->FileSize = std::strtoll(fields[2].c_str(), nullptr, 10);
+				curEntry->ModifTime = std::strtoll(fields[3].c_str(), nullptr, 10);
+				curEntry->ContentHash = std::strtoull(fields[4].c_str(), nullptr, 16);
+			}
+			else if (curEntry != nullptr && kind == "L" && fields.size() == 2)
+				curEntry->LoadError = QString::fromStdString(fields[1]);
+			else if (curEntry != nullptr && kind == "M" && fields.size() == 2)
+				curEntry->Msgs.append(QString::fromStdString(fields[1]));
+			else if (curEntry != nullptr && kind == "U" && fields.size() == 3)
+				curEntry->PronUsage[utf8s2ws(fields[1])] = std::atoi(fields[2].c_str());
+			else
+				return fail("Corrupted validation cache");
+		}
+		return true;
+	}
+
+	bool SpeechDataValidationCache::save(const boost::filesystem::path& filePath, ErrMsgList* errMsg) const
+	{
+		std::string buf;
+		std::string utf8Buf;
+		buf.append(CacheHeader);
+		buf.push_back('\n');
+
+		for (const auto& pair : dictEntries_)
+		{
+			buf.push_back('D');
+			appendField(pair.first, utf8Buf, buf);
+			appendField(pair.second, utf8Buf, buf);
+			buf.push_back('\n');
+		}
+
+		char numBuf[32];
+		for (const auto& pair : files_)
+		{
+			const AnnotValidationEntry& entry = pair.second;
+			buf.push_back('F');
+			appendField(pair.first, buf);
+			appendField(std::to_string(entry.FileSize), buf);
+			appendField(std::to_string(entry.ModifTime), buf);
+			int numLen = std::snprintf(numBuf, sizeof(numBuf), "%llx", (unsigned long long)entry.ContentHash);
+			appendField(boost::string_view(numBuf, numLen), buf);
+			buf.push_back('\n');
+
+			if (!entry.LoadError.isEmpty())
+			{
+				buf.push_back('L');
+				appendField(entry.LoadError, buf);
+				buf.push_back('\n');
+			}
+			for (const QString& msg : entry.Msgs)
+			{
+				buf.push_back('M');
+				appendField(msg, buf);
+				buf.push_back('\n');
+			}
+			for (const auto& usage : entry.PronUsage)
+			{
+				buf.push_back('U');
+				appendField(usage.first, utf8Buf, buf);
+				appendField(std::to_string(usage.second), buf);
+				buf.push_back('\n');
+			}
+		}
+
+		boost::filesystem::path tmpPath = filePath;
+		tmpPath += ".tmp";
+		{
+			QFile file(toQStringBfs(tmpPath));
+			if (!file.open(QIODevice::WriteOnly) || file.write(buf.data(), buf.size()) != (qint64)buf.size())
+			{
+				pushErrorMsg(errMsg, "Can't write validation cache");
+				return false;
+			}
+		}
+		boost::system::error_code ec;
+		boost::filesystem::rename(tmpPath, filePath, ec);
+		if (ec)
+		{
+			pushErrorMsg(errMsg, ec.message());
+			pushErrorMsg(errMsg, "Can't replace validation cache");
+			return false;
+		}
+		return true;
+	}
+
+	const AnnotValidationEntry* SpeechDataValidationCache::findFile(const QString& annotFilePath) const
+	{
+		auto it = files_.find(annotFilePath);
+		return it != files_.end() ? &it->second : nullptr;
+	}
+
+	void SpeechDataValidationCache::setFiles(const std::vector<QString>& annotFilePaths, const std::vector<AnnotValidationEntry>& entries)
+	{
+		PG_Assert2(annotFilePaths.size() == entries.size(), "Each file must have validation entry");
+		files_.clear();
+		for (size_t i = 0; i < annotFilePaths.size(); ++i)
+			files_[annotFilePaths[i]] = entries[i];
+	}
+
+	const std::map<std::wstring, std::wstring>& SpeechDataValidationCache::dictEntries() const
+	{
+		return dictEntries_;
+	}
+
+	void SpeechDataValidationCache::setDictEntries(const std::map<std::wstring, std::wstring>& dictEntries)
+	{
+		dictEntries_ = dictEntries;
+	}
+
+	void collectDictChangeAffectedTokens(const std::map<std::wstring, std::wstring>& oldDictEntries,
+		const std::map<std::wstring, std::wstring>& newDictEntries, std::set<std::wstring>& affectedTokens)
+	{
+		// removed or changed entries
+		for (const auto& oldPair : oldDictEntries)
+		{
+			auto newIt = newDictEntries.find(oldPair.first);
+			if (newIt == newDictEntries.end() || newIt->second != oldPair.second)
+				addTokensOfDictEntry(oldPair.first, oldPair.second, affectedTokens);
+		}
+
+		// added or changed entries
+		for (const auto& newPair : newDictEntries)
+		{
+			auto oldIt = oldDictEntries.find(newPair.first);
+			if (oldIt == oldDictEntries.end() || oldIt->second != newPair.second)
+				addTokensOfDictEntry(newPair.first, newPair.second, affectedTokens);
+		}
+	}
+}
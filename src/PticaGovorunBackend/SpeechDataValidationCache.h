@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <QString>
+#include <QStringList>
+#include <boost/filesystem/path.hpp>
+#include "PticaGovorunCore.h"
+#include "ComponentsInfrastructure.h"
+
+namespace PticaGovorun
+{
+	/// The result of validation of one speech annotation file.
+	struct PG_EXPORTS AnnotValidationEntry
+	{
+		std::int64_t FileSize = -1;
+		std::int64_t ModifTime = 0;
+		std::uint64_t ContentHash = 0;
+		QString LoadError; // not empty if the file can't be loaded
+		QStringList Msgs; // validation messages for the file
+		std::map<std::wstring, int> PronUsage; // pronCode -> number of occurences in Ukrainian segments, independent of phonetic dictionary
+
+		/// Whether the file has the same size and modification time as when it was validated.
+		bool hasFileStamp(std::int64_t fileSize, std::int64_t modifTime) const;
+	};
+
+	/// Reads the size and the modification time of the file. fileSize=-1 if the file can't be accessed.
+	PG_EXPORTS void readFileStamp(const boost::filesystem::path& filePath, std::int64_t& fileSize, std::int64_t& modifTime);
+
+	/// Persists results of speech data validation between runs, so that only changed annotation files and
+	/// annotation files which use changed phonetic dictionary entries are validated again.
+	class PG_EXPORTS SpeechDataValidationCache
+	{
+		std::map<QString, AnnotValidationEntry> files_; // key=annotation file path
+
+		// The phonetic dictionary, the cached messages were computed with.
+		// key=dictionary tag and word, value=space separated pronCodes
+		std::map<std::wstring, std::wstring> dictEntries_;
+	public:
+		bool load(const boost::filesystem::path& filePath, ErrMsgList* errMsg);
+		bool save(const boost::filesystem::path& filePath, ErrMsgList* errMsg) const;
+
+		const AnnotValidationEntry* findFile(const QString& annotFilePath) const;
+
+		/// Replaces all entries with new ones; entries of deleted files are dropped.
+		void setFiles(const std::vector<QString>& annotFilePaths, const std::vector<AnnotValidationEntry>& entries);
+
+		const std::map<std::wstring, std::wstring>& dictEntries() const;
+		void setDictEntries(const std::map<std::wstring, std::wstring>& dictEntries);
+	};
+
+	/// Finds the transcription tokens, which validation outcome may be affected by the difference of two phonetic dictionaries.
+	/// The token is affected if it matches the changed word, its pronCode or pronCode without '(N)' suffix.
+	PG_EXPORTS void collectDictChangeAffectedTokens(const std::map<std::wstring, std::wstring>& oldDictEntries,
+		const std::map<std::wstring, std::wstring>& newDictEntries, std::set<std::wstring>& affectedTokens);
+}
@@ -20,6 +20,14 @@
 
 namespace PticaGovorun 
 {
+	gsl::span<const short> AnnotatedSpeechSegment::samples() const
+	{
+		if (FileSamples == nullptr)
+			return OwnSamples;
+		gsl::span<const short> result = *FileSamples;
+		return result.subspan(FileSamplesStartInd, FileSamplesEndInd - FileSamplesStartInd);
+	}
+
 	ptrdiff_t AnnotatedAudioSegment::durationSamples() const
 	{
 		PG_DbgAssert(EndSampleInd != -1);
@@ -618,9 +626,9 @@ namespace PticaGovorun
 			blankSegs.push_back(blankSeg);
 		}
 
-		// audio frames are lazy loaded
+		// audio frames are lazy loaded; segments refer to the samples of the file
 		float sampleRateAnnot = speechAnnot.audioSampleRate();
-		std::vector<short> audioSamples;
+		std::shared_ptr<std::vector<short>> audioSamples;
 
 		// remove [sp]
 		std::vector<boost::wstring_view> words;
@@ -697,11 +705,12 @@ namespace PticaGovorun
 			if (loadAudio)
 			{
 				// lazy load audio samples
-				if (audioSamples.empty())
+				if (audioSamples == nullptr)
 				{
 					// load wav file
 					float sampleRateAudio;
-					if (!readAllSamplesFormatAware(audioFilePath.toStdWString(), audioSamples, &sampleRateAudio, errMsg))
+					audioSamples = std::make_shared<std::vector<short>>();
+					if (!readAllSamplesFormatAware(audioFilePath.toStdWString(), *audioSamples, &sampleRateAudio, errMsg))
 					{
 						pushErrorMsg(errMsg, std::string("Can't read wav file: ") + audioFilePath.toUtf8().toStdString());
 						return false;
@@ -713,12 +722,34 @@ namespace PticaGovorun
 					}
 				}
 
+				// while the parts of a segment are adjacent, the segment is a view of the file's samples;
+				// the samples are copied only when some part of the segment is skipped
+				const std::vector<short>& fileSamples = *audioSamples;
+				ptrdiff_t viewStartInd = -1;
+				ptrdiff_t viewEndInd = -1;
 				std::vector<short> segSamples;
-				segSamples.reserve(blankSeg.EndMarker->SampleInd - blankSeg.StartMarker->SampleInd);
+				bool isView = true;
 
-				auto pushSamples = [&segSamples,&audioSamples](ptrdiff_t startSampInd, ptrdiff_t endSampInd)
+				auto pushSamples = [&](ptrdiff_t startSampInd, ptrdiff_t endSampInd)
 				{
-					std::copy(audioSamples.begin()+startSampInd, audioSamples.begin()+endSampInd, std::back_inserter(segSamples));
+					if (isView)
+					{
+						if (viewStartInd == -1)
+						{
+							viewStartInd = startSampInd;
+							viewEndInd = endSampInd;
+							return;
+						}
+						if (viewEndInd == startSampInd)
+						{
+							viewEndInd = endSampInd;
+							return;
+						}
+						isView = false;
+						segSamples.reserve(blankSeg.EndMarker->SampleInd - blankSeg.StartMarker->SampleInd);
+						segSamples.assign(fileSamples.begin() + viewStartInd, fileSamples.begin() + viewEndInd);
+					}
+					std::copy(fileSamples.begin()+startSampInd, fileSamples.begin()+endSampInd, std::back_inserter(segSamples));
 				};
 
 				// inter-speech silence's segment consists of two phone markers
@@ -750,9 +781,16 @@ namespace PticaGovorun
 					if (m2.Id == blankSeg.EndMarker->Id) // reached the end of a segment
 						break;
 				}
-				seg.Samples = std::move(segSamples);
+				if (isView)
+				{
+					seg.FileSamples = audioSamples;
+					seg.FileSamplesStartInd = viewStartInd == -1 ? 0 : viewStartInd;
+					seg.FileSamplesEndInd = viewEndInd == -1 ? 0 : viewEndInd;
+				}
+				else
+					seg.OwnSamples = std::move(segSamples);
 			}
-			segments.push_back(seg);
+			segments.push_back(std::move(seg));
 		}
 
 		return true;
@@ -1426,6 +1464,71 @@ void computeMfccVelocityAccel(const wv::slice<short> samples, int frameSize, int
 	}
 }
 
+int computeMfccVelocityAccelFeatures(gsl::span<const short> samples, float sampleRate, std::vector<float>& mfccFeatures)
+{
+	int frameSize = (int)(sampleRate * 0.025f);
+	int frameShift = (int)(sampleRate * 0.010f);
+	int binCount = 24; // number of bins in the triangular filter bank
+	int fftNum = getMinDftPointsCount(frameSize);
+	TriangularFilterBank filterBank;
+	buildTriangularFilterBank(sampleRate, binCount, fftNum, filterBank);
+
+	const int mfccCount = 12;
+	// +1 for usage of cepstral0 coef
+	// *3 for velocity and acceleration coefs
+	int mfccVecLen = 3 * (mfccCount + 1);
+
+	int framesCount = slidingWindowsCount((long)samples.size(), frameSize, frameShift);
+	mfccFeatures.assign(mfccVecLen * framesCount, 0);
+	if (framesCount > 0)
+	{
+		wv::slice<short> samplesSlice = wv::make_view(const_cast<short*>(samples.data()), samples.size());
+		computeMfccVelocityAccel(samplesSlice, frameSize, frameShift, framesCount, mfccCount, mfccVecLen, filterBank, mfccFeatures);
+	}
+	return mfccVecLen;
+}
+
+void computeSpectrumLogPower(gsl::span<const short> frameSamples, int fftNum, const TriangularFilterBank* filterBank,
+	std::vector<float>& wavePointsRe, std::vector<float>& wavePointsIm, gsl::span<float> powers)
+{
+	PG_Assert2(frameSamples.size() <= fftNum, "The frame doesn't fit into DFT points");
+	int dftHalf = fftNum / 2;
+	int binCount = filterBank != nullptr ? filterBank->BinCount : dftHalf;
+	PG_Assert2(powers.size() >= binCount, "Not enough space for all powers");
+	if (filterBank != nullptr)
+		PG_Assert(filterBank->FftNum == fftNum);
+
+	wavePointsRe.assign(fftNum, 0);
+	wavePointsIm.assign(fftNum, 0);
+	std::copy(frameSamples.begin(), frameSamples.end(), wavePointsRe.begin());
+	hammingInplace(wv::make_view(wavePointsRe.data(), frameSamples.size()));
+
+	FFT(wavePointsRe.data(), wavePointsIm.data(), (int)std::log2(fftNum));
+
+	std::fill_n(powers.begin(), binCount, 0.0f);
+	for (int fftFreqInd = 0; fftFreqInd < dftHalf; ++fftFreqInd)
+	{
+		float re = wavePointsRe[fftFreqInd];
+		float im = wavePointsIm[fftFreqInd];
+		float power = re*re + im*im;
+		if (filterBank == nullptr)
+		{
+			powers[fftFreqInd] = power;
+			continue;
+		}
+
+		const FilterHitInfo& freqHitInfo = filterBank->fftFreqIndToHitInfo[fftFreqInd];
+		if (freqHitInfo.LeftBinInd != FilterHitInfo::NoBin)
+			powers[freqHitInfo.LeftBinInd] += freqHitInfo.LeftFilterResponse * power;
+		if (freqHitInfo.RightBinInd != FilterHitInfo::NoBin)
+			powers[freqHitInfo.RightBinInd] += freqHitInfo.RightFilterResponse * power;
+	}
+
+	// 10*log10 is in dB; +1 avoids log of zero for silence
+	for (int i = 0; i < binCount; ++i)
+		powers[i] = 10 * std::log10(1 + powers[i]);
+}
+
 	bool pgDetectVoiceActivity(gsl::span<const short> samples, float sampRate, std::vector<SegmentSpeechActivity>& activity, ErrMsgList* errMsg)
 	{
 		static const float wlen = 0.025625f;
@@ -184,7 +184,7 @@ struct TimePointMarker
 bool includeInTrainOrTest(const TimePointMarker& marker);
 
 // Represents annotated part of a speech audio used for training the speech recognizer.
-struct AnnotatedSpeechSegment
+struct PG_EXPORTS AnnotatedSpeechSegment
 {
 	int SegmentId;
 
@@ -200,8 +200,17 @@ struct AnnotatedSpeechSegment
 
 	float SampleRate = -1;
 
+	// Samples of the whole audio file. The buffer is shared by all segments of the file, so the audio is not duplicated.
+	std::shared_ptr<const std::vector<short>> FileSamples;
+	ptrdiff_t FileSamplesStartInd = 0; // range [start;end) of segment's samples in FileSamples
+	ptrdiff_t FileSamplesEndInd = 0;
+
+	// Samples of the segment, which are not contiguous in the audio file (eg when inter-speech silence is removed).
+	// Used when FileSamples is empty.
+	std::vector<short> OwnSamples;
+
 	// Actual samples in [StartMarker; EndMarker) range.
-	std::vector<short> Samples;
+	gsl::span<const short> samples() const;
 	
 	int StartMarkerId = -1;
 	int EndMarkerId = -1;
@@ -357,6 +366,17 @@ PG_EXPORTS void slidingWindows(long startFrameInd, long framesCount, int windowS
 
 PG_EXPORTS void computeMfccVelocityAccel(const wv::slice<short> samples, int frameSize, int frameShift, int framesCount, int mfcc_dim, int mfccVecLen, const TriangularFilterBank& filterBank, wv::slice<float> mfccFeatures);
 
+// Computes MFCC with velocity and acceleration using 25ms frames with 10ms shift.
+// Returns the number of features per frame.
+PG_EXPORTS int computeMfccVelocityAccelFeatures(gsl::span<const short> samples, float sampleRate, std::vector<float>& mfccFeatures);
+
+// Computes the power spectrum of one frame in dB. The frame is weighted with Hamming window and padded with zeros up to fftNum.
+// When filterBank is null, powers has fftNum/2 values, one per DFT frequency. Otherwise the power is accumulated
+// in filterBank->BinCount bins of the mel scale.
+// wavePointsRe and wavePointsIm are the DFT buffers; they are reused by subsequent calls to avoid allocations.
+PG_EXPORTS void computeSpectrumLogPower(gsl::span<const short> frameSamples, int fftNum, const TriangularFilterBank* filterBank,
+	std::vector<float>& wavePointsRe, std::vector<float>& wavePointsIm, gsl::span<float> powers);
+
 PG_EXPORTS bool pgDetectVoiceActivity(gsl::span<const short> samples, float sampRate, std::vector<SegmentSpeechActivity>& activity, ErrMsgList* errMsg);
 
 }
@@ -2,8 +2,10 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <array>
 #include <random>
 #include <chrono> // std::chrono::system_clock
+#include <sstream>
 #include <boost/format.hpp>
 #include <boost/algorithm/string/join.hpp>
 #include <QDir>
@@ -19,6 +21,12 @@
 #include "G729If.h"
 #include "XmlAudioMarkup.h"
 #include "KaldiModel.h"
+#include "KaldiFeatureArchive.h"
+#include "BuildPipeline.h"
+#include "PackedDeclensionDictionary.h"
+#include "TrainTestPartition.h"
+#include "VocabularySelection.h"
+#include "ParallelUtils.h"
 
 namespace PticaGovorun
 {
@@ -94,7 +102,7 @@ namespace PticaGovorun
 					addPhones(pron.Phones);
 			}
 		}
-		void addPhones(const std::vector<PhoneId>& phones)
+		void addPhones(wv::slice<PhoneId> phones)
 		{
 			for (PhoneId ph : phones)
 				phoneIdsSet_.insert(ph);
@@ -248,7 +256,7 @@ namespace PticaGovorun
 				//std::wcout << L"Ignored denied word: " << wordPart->partText() << std::endl; // debug
 			}
 		}
-		std::wcout << L"Ignored denied words: " << deniedWordsCounter << std::endl; // info
+		StageLogLine() << L"Ignored denied words: " << deniedWordsCounter; // info
 	}
 
 	/// Maps a name of each pronCode to Sphinx-complint name (base name plus other pronCodes with parenthesis).
@@ -343,9 +351,6 @@ namespace PticaGovorun
 	{
 		const WordsUsageInfo& wordUsage = phoneticSplitter.wordUsage();
 
-		std::vector<const WordPart*> allWordParts;
-		wordUsage.copyWordParts(allWordParts);
-
 		// push sure words from manual phonetic dictionaries
 		std::vector<PhoneticWord> wordPartSureInclude;
 		std::set<boost::wstring_view> chosenPronCodes;
@@ -431,37 +436,12 @@ namespace PticaGovorun
 
 		//
 
-		struct PhWordAndCounter
-		{
-			PhoneticWord PhWord;
-			ptrdiff_t UsageCounter;
-		};
-		std::vector<PhWordAndCounter> wordPartCandidates;
+		int takeUnigrams = -1; // no limit
+		if (maxUnigramsCount > 0)
+			takeUnigrams = std::max(0, maxUnigramsCount - (int)wordPartSureInclude.size());
 
-		ptrdiff_t noPromotionCounter = 0;
-		for (const WordPart* wordPart : allWordParts)
+		if (takeUnigrams != 0)
 		{
-			if (wordPart->removed())
-			{
-				noPromotionCounter += 1;
-				continue;
-			}
-			// the word already included?
-			auto sureIt = chosenPronCodes.find(wordPart->partText());
-			if (sureIt != std::end(chosenPronCodes))
-				continue;
-
-			// <s> and </s> are already added as the words from Filler dictionary
-			if (wordPart == phoneticSplitter.sentStartWordPart() ||
-				wordPart == phoneticSplitter.sentEndWordPart())
-			{
-//				auto wordIt = phoneticDictFiller_.find(wordPart->partText());
-//				PG_Assert(wordIt != std::end(phoneticDictFiller_));
-//				const PhoneticWord& word = wordIt->second;
-//				wordPartSureInclude.push_back(word);
-				continue;
-			}
-
 			// the pronCode must expand in phones from the training set
 			auto coverTrainPhonesOnlyFun = [](const std::vector<PhoneId>& pronPhones, const std::set<PhoneId>& trainPhoneIds)
 			{
@@ -471,72 +451,63 @@ namespace PticaGovorun
 				});
 			};
 
+			// candidates are checked concurrently; the transcriber keeps the state of the current word, hence each thread has its own
+			int threadsCount = defaultThreadsCount();
+			std::vector<WordPhoneticTranscriber> threadTranscribers(threadsCount, phoneticTranscriber);
+
+			std::vector<std::int64_t> wordPartIdToUsage;
+			collectUnigramUsage(wordUsage, nullptr, wordPartIdToUsage);
+			std::vector<std::vector<PhoneId>> wordPartIdToPhones(wordPartIdToUsage.size());
+
 			// add words which can be spelled with phones from active phone set
-			auto spellFun = [&wordUsage, &phoneticSplitter, &phoneReg, &phoneticTranscriber](const WordPart* part, std::vector<PhoneId>& resultPhones) -> bool
+			auto acceptWordPart = [&](int wordPartId, int threadInd) -> bool
 			{
-				PG_Assert(part != phoneticSplitter.sentStartWordPart() && part != phoneticSplitter.sentEndWordPart());
-
-				bool spellOp;
-				const char* errMsg;
-				const std::wstring& partTxt = part->partText();
+				const WordPart* wordPart = wordUsage.wordPartById(wordPartId);
+				if (wordPart == nullptr || wordPart->removed()) // denied words are marked as removed
+					return false;
 
-				phoneticTranscriber.transcribe(phoneReg, partTxt);
-				if (phoneticTranscriber.hasError())
+				// the word already included?
+				if (chosenPronCodes.find(wordPart->partText()) != std::end(chosenPronCodes))
 					return false;
 
-				phoneticTranscriber.copyOutputPhoneIds(resultPhones);
-				return true;
-			};
-			WordSeqKey seqKey({ wordPart->id() });
-			long wordSeqUsage = wordUsage.getWordSequenceUsage(seqKey);
-			bool isFreqUsage = minWordPartUsage == -1 || wordSeqUsage >= minWordPartUsage;
+				// <s> and </s> are already added as the words from Filler dictionary
+				if (wordPart == phoneticSplitter.sentStartWordPart() ||
+					wordPart == phoneticSplitter.sentEndWordPart())
+					return false;
 
-			std::vector<PhoneId> phonesTmp;
-			if (isFreqUsage && spellFun(wordPart, phonesTmp))
-			{
-				bool knownPhones = coverTrainPhonesOnlyFun(phonesTmp, trainPhoneIds);
-				if (knownPhones)
-				{
-					PhoneticWord word;
-					word.Word = wordPart->partText();
-					PronunciationFlavour pron;
-					pron.PronCode = wordPart->partText();
-					pron.Phones = std::move(phonesTmp);
-					word.Pronunciations.push_back(pron);
-					wordPartCandidates.push_back(PhWordAndCounter{ std::move(word), wordSeqUsage });
-					continue;
-				}
-			}
+				WordPhoneticTranscriber& transcriber = threadTranscribers[threadInd];
+				transcriber.transcribe(phoneReg, wordPart->partText());
+				if (transcriber.hasError())
+					return false;
 
-			// ignore the word
-			noPromotionCounter++;
-			//std::wcout <<"no promotion Word->PronCode: " << wordPart->partText() << std::endl; // debug
-		}
+				std::vector<PhoneId> phones;
+				transcriber.copyOutputPhoneIds(phones);
+				if (!coverTrainPhonesOnlyFun(phones, trainPhoneIds))
+					return false;
 
-		std::wcout << "no promotion Word->PronCode: " << noPromotionCounter << std::endl;
+				wordPartIdToPhones[wordPartId] = std::move(phones);
+				return true;
+			};
 
-		//
-		if (maxUnigramsCount > 0)
-		{
-			int takeUnigrams = maxUnigramsCount - (int)wordPartSureInclude.size();
-			if (takeUnigrams < 0)
-				takeUnigrams = 0;
+			std::vector<int> chosenWordPartIds;
+			selectTopUsedWordParts(wordPartIdToUsage, minWordPartUsage, takeUnigrams, threadsCount, acceptWordPart, chosenWordPartIds);
+			StageLogLine() << "chosen word parts: " << chosenWordPartIds.size();
 
-			// sort descending by UsageCount
-			std::sort(wordPartCandidates.begin(), wordPartCandidates.end(), [&wordUsage](const PhWordAndCounter& a, const PhWordAndCounter& b)
+			for (int wordPartId : chosenWordPartIds)
 			{
-				return a.UsageCounter > b.UsageCounter;
-			});
-
-			// take N most used unigrams
-			if (wordPartCandidates.size() > takeUnigrams)
-				wordPartCandidates.resize(takeUnigrams);
+				const WordPart* wordPart = wordUsage.wordPartById(wordPartId);
+				std::vector<PhoneId>& phones = wordPartIdToPhones[wordPartId];
+
+				PhoneticWord word;
+				word.Word = wordPart->partText();
+				PronunciationFlavour pron;
+				pron.PronCode = wordPart->partText();
+				pron.Phones.assign(phones.begin(), phones.end());
+				word.Pronunciations.push_back(pron);
+				wordPartSureInclude.push_back(std::move(word));
+			}
 		}
 
-		std::transform(std::begin(wordPartCandidates), std::end(wordPartCandidates), std::back_inserter(wordPartSureInclude), [](PhWordAndCounter& a) -> PhoneticWord&& {
-			return std::move(a.PhWord);
-		});
-
 		// sort lexicographically
 		std::sort(wordPartSureInclude.begin(), wordPartSureInclude.end(), [&wordUsage](const PhoneticWord& a, const PhoneticWord& b)
 		{
@@ -684,6 +655,9 @@ namespace PticaGovorun
 		const char* ConfigAudPadSilEnd = "aud.padSilEnd";
 		const char* ConfigAudMinSilDurMs = "aud.minSilDurMs";
 		const char* ConfigAudMaxNoiseLevelDb = "aud.maxNoiseLevelDb";
+		const char* ConfigAudOutputFeatures = "aud.outputFeatures";
+		const char* ConfigUseBuildCache = "useBuildCache";
+		const char* ConfigBuildCacheDir = "buildCacheDir";
 
 		speechProjDirPath_ = toBfs(AppHelpers::configParamQString(ConfigSpeechModelDir, "ERROR_path_does_not_exist"));
 		speechProjDirPath_ = speechProjDirPath_.normalize();
@@ -718,6 +692,7 @@ namespace PticaGovorun
 		bool padSilStart = AppHelpers::configParamBool(ConfigAudPadSilStart, true); // pad the audio segment with the silence segment
 		bool padSilEnd = AppHelpers::configParamBool(ConfigAudPadSilEnd, true);
 		int minSilDurMs = AppHelpers::configParamInt(ConfigAudMinSilDurMs, 300); // minimal duration (milliseconds) of flanked silence
+		bool outputFeatures = AppHelpers::configParamBool(ConfigAudOutputFeatures, false); // true to write MFCC features of output wav segments
 		float maxNoiseLevelDb = (float)AppHelpers::configParamDouble(ConfigAudMaxNoiseLevelDb, 0); // (default 0) files with bigger noise level (dB) are ignored; set value=0 to ignore
 		bool allowSoftHardConsonant = AppHelpers::configParamBool(ConfigAllowSoftHardConsonant, true); // true to use soft consonants (TS1) in addition to nomral consonants (TS)
 		bool allowVowelStress = AppHelpers::configParamBool(ConfigAllowVowelStress, true); // true to use stressed vowels (A1) in addition to unstressed vowels (A)
@@ -725,6 +700,13 @@ namespace PticaGovorun
 		bool useBrokenPronsInTrainOnly = true;
 		const double trainCasesRatio = AppHelpers::configParamDouble(ConfigTrainCasesRatio, 0.7);
 		const float outSampleRate = 16000; // Sphinx requires 16k
+		if (outputFeatures && !outputWav)
+		{
+			std::wcout << "Info: features are computed from output wav segments. Set aud.outputWav=true" << std::endl;
+			outputFeatures = false;
+		}
+		bool useBuildCache = AppHelpers::configParamBool(ConfigUseBuildCache, true); // true to reuse the outputs of unchanged stages from previous runs
+		auto buildCacheDirPath = toBfs(AppHelpers::configParamQString(ConfigBuildCacheDir, AppHelpers::mapPath("../../../data/TrainSphinx/BuildCache")));
 
 		// words with greater usage counter are inlcuded in language model
 		// note, the positive threshold may evict the rare words
@@ -747,86 +729,10 @@ namespace PticaGovorun
 		speechData_->setPhoneReg(std::shared_ptr<PhoneRegistry>(&phoneReg_, [](auto) {}));
 		speechData_->setStringArena(stringArena_);
 
-		if (!speechData_->Load(false, errMsg))
-		{
-			pushErrorMsg(errMsg, "Can't load speech data");
-			return false;
-		}
-
-		// merge BrownBear dictionary
-		QStringList errMsgList;
-		if (includeBrownBear)
-		{
-			auto brownBearDictPath = speechData_->speechProjDir() / "PhoneticDict/phoneticBrownBear.xml";
-			std::vector<PhoneticWord> phoneticDictWordsBrownBear;
-			if (!loadPhoneticDictionaryXml(brownBearDictPath, phoneReg_, phoneticDictWordsBrownBear, *stringArena_, errMsg))
-			{
-				pushErrorMsg(errMsg, "Can't load phonetic dictionary");
-				return false;
-			}
-
-			speechData_->mergePhoneticDictOnlyNew(phoneticDictWordsBrownBear);
-
-			// check merged data, but avoid checking stress, because other dicts may not specify stress
-			if (!speechData_->validate(false, &errMsgList))
-			{
-				pushErrorMsg(errMsg, toUtf8StdString(errMsgList.join('\n')));
-				return false;
-			}
-		}
-		else
-		{
-			if (!speechData_->validate(true, &errMsgList))
-			{
-				pushErrorMsg(errMsg, toUtf8StdString(errMsgList.join('\n')));
-				return false;
-			}
-		}
-
-		//
-		if (!populatePronCodeToObjAndValidatePhoneticDictsHaveNoDuplicates(errMsg))
-			return false;
-
-		auto denyWordsFilePath = speechData_->speechProjDir() / "LM/denyWords.txt";
-		std::unordered_set<std::wstring> denyWords;
-		if (boost::filesystem::exists(denyWordsFilePath)) // optional list of denied words
-		{
-			if (!loadWordList(denyWordsFilePath, denyWords, errMsg))
-			{
-				pushErrorMsg(errMsg, "Can't load 'denyWords.txt' dictionary");
-				return false;
-			}
-		}
-
-		if (!validatePhoneticDictsHaveNoDeniedWords(denyWords, errMsg))
-			return false;
-
-		// load annotation
-		
 		auto speechWavRootDir = speechData_->speechProjDir() / "SpeechAudio";
 		auto speechAnnotRootDir = speechData_->speechProjDir() / "SpeechAnnot";
 		auto wavDirToAnalyze = speechData_->speechProjDir() / "SpeechAudio";
 
-		if (!loadAudioAnnotation(speechWavRootDir, speechAnnotRootDir, wavDirToAnalyze, removeSilenceAnnot, removeInterSpeechSilence, padSilStart, padSilEnd, maxNoiseLevelDb, errMsg))
-			return false;
-
-		std::wcout << "Found annotated segments: " << segments_.size() << std::endl; // debug
-		if (segments_.empty())
-		{
-			pushErrorMsg(errMsg, "There is no annotated audio");
-			return false;
-		}
-
-		//
-		std::vector<AssignedPhaseAudioSegment> phaseAssignedSegs;
-		std::set<PhoneId> trainPhoneIds;
-		if (!partitionTrainTestData(segments_, trainCasesRatio, swapTrainTestData, useBrokenPronsInTrainOnly, phaseAssignedSegs, trainPhoneIds, errMsg))
-		{
-			pushErrorMsg(errMsg, "Can't fix train/test partitioning");
-			return false;
-		}
-
-		//
 		auto audioOutDirPath =  outFilePath("/wav/");
 
 		std::string dataPartNameTrain = dbName_ + "_train";
@@ -835,163 +741,397 @@ namespace PticaGovorun
 		auto outDirWavTrain = audioOutDirPath / dataPartNameTrain;
 		auto outDirWavTest = audioOutDirPath / dataPartNameTest;
 
-		//
-		if (outputPhoneticDictAndLangModelAndTranscript)
-		{
-			bool allowPhoneticWordSplit = false;
-			phoneticSplitter_.setAllowPhoneticWordSplit(allowPhoneticWordSplit);
-			phoneticSplitter_.outputCorpus_ = outputCorpus;
+		// the data, shared between the stages
+		std::unordered_set<std::wstring> denyWords;
+		std::vector<AssignedPhaseAudioSegment> phaseAssignedSegs;
+		std::set<PhoneId> trainPhoneIds;
+
+		PronCodeToDisplayNameMap pronCodeToSphinxMappingTest(stringArena_.get());
+		PronCodeToDisplayNameMap pronCodeToSphinxMappingTrain(stringArena_.get());
+		std::map<boost::wstring_view, boost::wstring_view> pronCodeToDisplayNameTest;
+		std::map<boost::wstring_view, boost::wstring_view> pronCodeToDisplayNameTrain;
 
-			phoneticSplitter_.corpusFilePath_ = outDirPath_ / "corpusUtters.txt";
+		static auto pronCodeDisplayHelper = [](const std::map<boost::wstring_view, boost::wstring_view>& pronCodeToDisplayName, boost::wstring_view pronCode)->boost::wstring_view
+		{
+			auto it = pronCodeToDisplayName.find(pronCode);
+			if (it != std::end(pronCodeToDisplayName))
+				return it->second;
+			return boost::wstring_view();
+		};
+		auto pronCodeDisplayTest = [&pronCodeToDisplayNameTest](boost::wstring_view pronCode)->boost::wstring_view
+		{
+			return pronCodeDisplayHelper(pronCodeToDisplayNameTest, pronCode);
+		};
+		auto pronCodeDisplayTrain = [&pronCodeToDisplayNameTrain](boost::wstring_view pronCode)->boost::wstring_view
+		{
+			return pronCodeDisplayHelper(pronCodeToDisplayNameTrain, pronCode);
+		};
 
-			// init sentence parser
-			auto sentParser = std::make_shared<SentenceParser>(1024);
-			auto abbrExp = std::make_shared<AbbreviationExpanderUkr>();
-			abbrExp->stringArena_ = stringArena_;
+		// the stages with unchanged inputs are restored from the cache of previous runs
+		boost::filesystem::path buildCacheDir;
+		if (useBuildCache)
+			buildCacheDir = buildCacheDirPath;
+		BuildStageCache stageCache(buildCacheDir);
 
-			auto numDictPath = AppHelpers::mapPath("pgdata/LM_ua/numsCardOrd.xml").toStdWString();
-			std::wstring errMsgW;
-			if (!abbrExp->load(numDictPath, &errMsgW))
+		BuildPipeline pipeline;
+		pipeline.addStage("speechData", {}, [&](ErrMsgList* errMsg) -> bool
+		{
+			if (!speechData_->Load(false, errMsg))
 			{
-				pushErrorMsg(errMsg, toUtf8StdString(errMsgW));
-				pushErrorMsg(errMsg, "Can't load numbers dictionary.");
+				pushErrorMsg(errMsg, "Can't load speech data");
 				return false;
 			}
-			sentParser->setAbbrevExpander(abbrExp);
-			phoneticSplitter_.setSentParser(sentParser);
 
-			//
-			int maxFilesToProcess = AppHelpers::configParamInt("textWorld.maxFilesToProcess", -1);
-			if (!phoneticSplitterLoad(phoneticSplitter_, maxFilesToProcess, errMsg))
-				return false;
+			// merge BrownBear dictionary
+			QStringList errMsgList;
+			if (includeBrownBear)
+			{
+				auto brownBearDictPath = speechData_->speechProjDir() / "PhoneticDict/phoneticBrownBear.xml";
+				std::vector<PhoneticWord> phoneticDictWordsBrownBear;
+				if (!loadPhoneticDictionaryXml(brownBearDictPath, phoneReg_, phoneticDictWordsBrownBear, *stringArena_, errMsg))
+				{
+					pushErrorMsg(errMsg, "Can't load phonetic dictionary");
+					return false;
+				}
 
-			// we call it before propogating pronCodes to words
-			rejectDeniedWords(denyWords, phoneticSplitter_.wordUsage());
+				speechData_->mergePhoneticDictOnlyNew(phoneticDictWordsBrownBear);
 
-			//
-			auto stressDictFilePath = speechData_->speechProjDir() / "LM/stressDictUk.xml";
-			std::unordered_map<std::wstring, int> wordToStressedSyllable;
-			if (boost::filesystem::exists(stressDictFilePath)) // optional stress syllable dictionary
-			{
-				if (!loadStressedSyllableDictionaryXml(stressDictFilePath, wordToStressedSyllable, errMsg))
+				// check merged data, but avoid checking stress, because other dicts may not specify stress
+				if (!speechData_->validate(false, &errMsgList))
+				{
+					pushErrorMsg(errMsg, toUtf8StdString(errMsgList.join('\n')));
 					return false;
+				}
 			}
-
-			auto getStressedSyllableIndFun = [&wordToStressedSyllable](boost::wstring_view word, std::vector<int>& stressedSyllableInds) -> bool
+			else
 			{
-				auto it = wordToStressedSyllable.find(std::wstring(word.data(), word.size()));
-				if (it == wordToStressedSyllable.end())
+				if (!speechData_->validate(true, &errMsgList))
+				{
+					pushErrorMsg(errMsg, toUtf8StdString(errMsgList.join('\n')));
 					return false;
-				stressedSyllableInds.push_back(it->second);
-				return true;
-			};
-
-			WordPhoneticTranscriber phoneticTranscriber;
-			phoneticTranscriber.setStressedSyllableIndFun(getStressedSyllableIndFun); // augment pronunciations with stress
+				}
+			}
 
 			//
-
-			// propogate pronunciations from well formed words
-			// broken words will be pulled before Train phase
-			///promoteWordsToPronCodes(phoneticSplitter_, phoneticDictWellFormed_);
-
-			PronCodeToDisplayNameMap pronCodeToSphinxMappingTest(stringArena_.get());
-			buildPronCodeToSphinxNameMap(speechData_->phoneticDictWellFormed_, speechData_->phoneticDictBroken_, /*includeBrokenWords*/ false, pronCodeToSphinxMappingTest);
-			std::wcout << "pronCode to Sphinx map Test: " << pronCodeToSphinxMappingTest.map.size() << std::endl;
-
-			std::map<boost::wstring_view, boost::wstring_view> pronCodeToDisplayNameTest;
-			if (!buildPronCodeToDisplayName(pronCodeToSphinxMappingTest, pronCodeToDisplayNameTest, errMsg))
+			if (!populatePronCodeToObjAndValidatePhoneticDictsHaveNoDuplicates(errMsg))
 				return false;
 
-			static auto pronCodeDisplayHelper = [](const std::map<boost::wstring_view, boost::wstring_view>& pronCodeToDisplayName, boost::wstring_view pronCode)->boost::wstring_view
-			{
-				auto it = pronCodeToDisplayName.find(pronCode);
-				if (it != std::end(pronCodeToDisplayName))
-					return it->second;
-				return boost::wstring_view();
-			};
-			auto pronCodeDisplayTest = [&pronCodeToDisplayNameTest](boost::wstring_view pronCode)->boost::wstring_view
-			{
-				return pronCodeDisplayHelper(pronCodeToDisplayNameTest, pronCode);
-			};
-
-			// now, well formed words and no broken words are used
-			if (!buildPhaseSpecificParts(ResourceUsagePhase::Test, minWordPartUsage, maxUnigramsCount, allowPhoneticWordSplit, trainPhoneIds, gramDim, pronCodeDisplayTest, phoneticTranscriber, &dictWordsCountTest_, &phonesCountTest_, errMsg))
+			auto denyWordsFilePath = speechData_->speechProjDir() / "LM/denyWords.txt";
+			if (boost::filesystem::exists(denyWordsFilePath)) // optional list of denied words
 			{
-				pushErrorMsg(errMsg, "Can't build Test phase specific parts.");
-				return false;
+				if (!loadWordList(denyWordsFilePath, denyWords, errMsg))
+				{
+					pushErrorMsg(errMsg, "Can't load 'denyWords.txt' dictionary");
+					return false;
+				}
 			}
 
-			// propogate also pronunciations from well formed words
-			///promoteWordsToPronCodes(phoneticSplitter_, phoneticDictBroken_);
-
-			PronCodeToDisplayNameMap pronCodeToSphinxMappingTrain(stringArena_.get());
-			buildPronCodeToSphinxNameMap(speechData_->phoneticDictWellFormed_, speechData_->phoneticDictBroken_, /*includeBrokenWords*/ true, pronCodeToSphinxMappingTrain);
-			std::wcout << "pronCode to Sphinx map Train: " << pronCodeToSphinxMappingTrain.map.size() << std::endl;
-
-			std::map<boost::wstring_view, boost::wstring_view> pronCodeToDisplayNameTrain;
-			if (!buildPronCodeToDisplayName(pronCodeToSphinxMappingTrain, pronCodeToDisplayNameTrain, errMsg))
+			if (!validatePhoneticDictsHaveNoDeniedWords(denyWords, errMsg))
 				return false;
+			return true;
+		});
 
-			auto pronCodeDisplayTrain = [&pronCodeToDisplayNameTrain](boost::wstring_view pronCode)->boost::wstring_view
-			{
-				return pronCodeDisplayHelper(pronCodeToDisplayNameTrain, pronCode);
-			};
+		pipeline.addStage("annotation", { "speechData" }, [&](ErrMsgList* errMsg) -> bool
+		{
+			if (!loadAudioAnnotation(speechWavRootDir, speechAnnotRootDir, wavDirToAnalyze, removeSilenceAnnot, removeInterSpeechSilence, padSilStart, padSilEnd, maxNoiseLevelDb, errMsg))
+				return false;
 
-			// .dic and .arpa files are different
-			// broken words goes in dict and lang model in train phase only
-			// alternatively we can always ignore broken words, but it is a pity to not use the markup
-			// now, well formed words and broken words are used
-			if (!buildPhaseSpecificParts(ResourceUsagePhase::Train, minWordPartUsage, maxUnigramsCount, allowPhoneticWordSplit, trainPhoneIds, gramDim, pronCodeDisplayTrain, phoneticTranscriber, &dictWordsCountTrain_, &phonesCountTrain_, errMsg))
+			StageLogLine() << "Found annotated segments: " << segments_.size(); // debug
+			if (segments_.empty())
 			{
-				pushErrorMsg(errMsg, "Can't build Train phase specific parts.");
+				pushErrorMsg(errMsg, "There is no annotated audio");
 				return false;
 			}
 
-			// filler dictionary
-			if (!writePhoneticDictSphinx(speechData_->phoneticDictFillerWords_, phoneReg_, outFilePath(dbName_ + ".filler"), nullptr, errMsg))
+			//
+			if (!partitionTrainTestData(segments_, trainCasesRatio, swapTrainTestData, useBrokenPronsInTrainOnly, phaseAssignedSegs, trainPhoneIds, errMsg))
 			{
-				pushErrorMsg(errMsg, "Can't write Filler phonetic dictionary");
+				pushErrorMsg(errMsg, "Can't fix train/test partitioning");
 				return false;
 			}
 
-			// trasnscripts
-			auto audioSrcRootDir = speechWavRootDir;
-
 			// find where to put output audio segments
+			auto audioSrcRootDir = speechWavRootDir;
 			fixWavSegmentOutputPathes(audioSrcRootDir, audioOutDirPath, ResourceUsagePhase::Train, outDirWavTrain, phaseAssignedSegs);
 			fixWavSegmentOutputPathes(audioSrcRootDir, audioOutDirPath, ResourceUsagePhase::Test, outDirWavTest, phaseAssignedSegs);
+			return true;
+		});
 
-			if (!writeFileIdAndTranscription(phaseAssignedSegs, ResourceUsagePhase::Train, outFilePath(dataPartNameTrain + ".fileids"), pronCodeDisplayTrain, outFilePath(dataPartNameTrain + ".transcription"), padSilStart, padSilEnd, errMsg))
+		pipeline.addStage("pronCodeDisplay", { "speechData" }, [&](ErrMsgList* errMsg) -> bool
+		{
+			// now, well formed words and no broken words are used
+			buildPronCodeToSphinxNameMap(speechData_->phoneticDictWellFormed(), speechData_->phoneticDictBroken(), /*includeBrokenWords*/ false, pronCodeToSphinxMappingTest);
+			StageLogLine() << "pronCode to Sphinx map Test: " << pronCodeToSphinxMappingTest.map.size();
+
+			if (!buildPronCodeToDisplayName(pronCodeToSphinxMappingTest, pronCodeToDisplayNameTest, errMsg))
 				return false;
-			if (!writeFileIdAndTranscription(phaseAssignedSegs, ResourceUsagePhase::Test, outFilePath(dataPartNameTest + ".fileids"), pronCodeDisplayTest, outFilePath(dataPartNameTest + ".transcription"), padSilStart, padSilEnd, errMsg))
+
+			// now, well formed words and broken words are used
+			buildPronCodeToSphinxNameMap(speechData_->phoneticDictWellFormed(), speechData_->phoneticDictBroken(), /*includeBrokenWords*/ true, pronCodeToSphinxMappingTrain);
+			StageLogLine() << "pronCode to Sphinx map Train: " << pronCodeToSphinxMappingTrain.map.size();
+
+			if (!buildPronCodeToDisplayName(pronCodeToSphinxMappingTrain, pronCodeToDisplayNameTrain, errMsg))
 				return false;
+			return true;
+		});
 
-			// required for Kaldi model
-			static const bool outKaldiModel = true;
-			if (outKaldiModel)
+		if (outputPhoneticDictAndLangModelAndTranscript)
+		{
+			// the most expensive stage: parses text corpus and builds arpa language model
+			pipeline.addStage("langModel", { "annotation", "pronCodeDisplay" }, [&](ErrMsgList* errMsg) -> bool
 			{
-				KaldiModelBuilder kaldiModel(outDirPath_ / "Kaldi", pronCodeDisplayTrain, pronCodeDisplayTest);
-				if (!kaldiModel.generate(phaseAssignedSegs, errMsg))
+				int maxFilesToProcess = AppHelpers::configParamInt("textWorld.maxFilesToProcess", -1);
+
+				StageKeyBuilder keyBuilder;
+				keyBuilder.addConfig("version", 1);
+				keyBuilder.addConfig(ConfigGramDim, gramDim);
+				keyBuilder.addConfig(ConfigMinWordPartUsage, minWordPartUsage);
+				keyBuilder.addConfig(ConfigMaxUnigramsCount, maxUnigramsCount);
+				keyBuilder.addConfig(ConfigIncludeBrownBear, includeBrownBear);
+				keyBuilder.addConfig(ConfigAllowSoftHardConsonant, allowSoftHardConsonant);
+				keyBuilder.addConfig(ConfigAllowVowelStress, allowVowelStress);
+				keyBuilder.addConfig(ConfigOutputCorpus, outputCorpus);
+				keyBuilder.addConfig("textWorld.maxFilesToProcess", maxFilesToProcess);
+				keyBuilder.addConfig(ConfigUseBrokenPronsInTrainOnly, useBrokenPronsInTrainOnly);
+				std::string phoneStr;
+				for (PhoneId phoneId : trainPhoneIds)
+				{
+					phoneStr.clear();
+					if (!phoneToStr(phoneReg_, phoneId, phoneStr))
+						return false;
+					keyBuilder.addString(phoneStr);
+				}
+				// phonetic dictionaries and word lists are small, hence the content is hashed
+				// the text corpus is big, hence only file stamps are hashed
+				auto numDictPath = toBfs(AppHelpers::mapPath("pgdata/LM_ua/numsCardOrd.xml"));
+				if (!keyBuilder.addDir(speechProjDirPath_ / "PhoneticDict", true, errMsg) ||
+					!keyBuilder.addDir(speechProjDirPath_ / "LM", true, errMsg) ||
+					!keyBuilder.addFileContent(numDictPath, errMsg))
 					return false;
-			}
+				if (!keyBuilder.addDir(speechProjDirPath_ / "textWorld", false, errMsg) ||
+					!keyBuilder.addDir(speechProjDirPath_ / "declinationDictUk", false, errMsg))
+					return false;
+
+				std::vector<boost::filesystem::path> outFiles;
+				for (const char* fileSuffix : { "_train", "_test" })
+				{
+					outFiles.push_back(str(boost::format("corpusVocab%1%.vocab") % fileSuffix));
+					outFiles.push_back(str(boost::format("%1%%2%.arpa") % dbName_ % fileSuffix));
+					outFiles.push_back(str(boost::format("%1%%2%.dic") % dbName_ % fileSuffix));
+					outFiles.push_back(str(boost::format("%1%%2%.phone") % dbName_ % fileSuffix));
+				}
+				if (outputCorpus)
+					outFiles.push_back("corpusUtters.txt");
+
+				std::map<std::string, std::string> stageValues;
+				auto buildLangModel = [&](std::map<std::string, std::string>& values, ErrMsgList* errMsg) -> bool
+				{
+					bool allowPhoneticWordSplit = false;
+					phoneticSplitter_.setAllowPhoneticWordSplit(allowPhoneticWordSplit);
+					phoneticSplitter_.outputCorpus_ = outputCorpus;
+
+					phoneticSplitter_.corpusFilePath_ = outDirPath_ / "corpusUtters.txt";
+
+					// init sentence parser
+					auto sentParser = std::make_shared<SentenceParser>(1024);
+					auto abbrExp = std::make_shared<AbbreviationExpanderUkr>();
+					abbrExp->stringArena_ = stringArena_;
+
+					std::wstring errMsgW;
+					if (!abbrExp->load(numDictPath.wstring(), &errMsgW))
+					{
+						pushErrorMsg(errMsg, toUtf8StdString(errMsgW));
+						pushErrorMsg(errMsg, "Can't load numbers dictionary.");
+						return false;
+					}
+					sentParser->setAbbrevExpander(abbrExp);
+					phoneticSplitter_.setSentParser(sentParser);
+
+					//
+					// the word usage doesn't depend on LM parameters (gramDim, maxUnigramsCount,...), hence is reused when only they change
+					boost::filesystem::path wordUsageSnapshotPath;
+					if (!buildCacheDir.empty())
+						wordUsageSnapshotPath = buildCacheDir / "wordUsage.bin";
+					if (!phoneticSplitterLoad(phoneticSplitter_, maxFilesToProcess, wordUsageSnapshotPath, errMsg))
+						return false;
+
+					// we call it before propogating pronCodes to words
+					rejectDeniedWords(denyWords, phoneticSplitter_.wordUsage());
+
+					//
+					auto stressDictFilePath = speechData_->speechProjDir() / "LM/stressDictUk.xml";
+					std::unordered_map<std::wstring, int> wordToStressedSyllable;
+					if (boost::filesystem::exists(stressDictFilePath)) // optional stress syllable dictionary
+					{
+						if (!loadStressedSyllableDictionaryXml(stressDictFilePath, wordToStressedSyllable, errMsg))
+							return false;
+					}
+
+					auto getStressedSyllableIndFun = [&wordToStressedSyllable](boost::wstring_view word, std::vector<int>& stressedSyllableInds) -> bool
+					{
+						auto it = wordToStressedSyllable.find(std::wstring(word.data(), word.size()));
+						if (it == wordToStressedSyllable.end())
+							return false;
+						stressedSyllableInds.push_back(it->second);
+						return true;
+					};
+
+					WordPhoneticTranscriber phoneticTranscriber;
+					phoneticTranscriber.setStressedSyllableIndFun(getStressedSyllableIndFun); // augment pronunciations with stress
+
+					//
+
+					// propogate pronunciations from well formed words
+					// broken words will be pulled before Train phase
+					///promoteWordsToPronCodes(phoneticSplitter_, phoneticDictWellFormed_);
+
+					// now, well formed words and no broken words are used
+					if (!buildPhaseSpecificParts(ResourceUsagePhase::Test, minWordPartUsage, maxUnigramsCount, allowPhoneticWordSplit, trainPhoneIds, gramDim, pronCodeDisplayTest, phoneticTranscriber, &dictWordsCountTest_, &phonesCountTest_, errMsg))
+					{
+						pushErrorMsg(errMsg, "Can't build Test phase specific parts.");
+						return false;
+					}
+
+					// propogate also pronunciations from well formed words
+					///promoteWordsToPronCodes(phoneticSplitter_, phoneticDictBroken_);
+
+					// .dic and .arpa files are different
+					// broken words goes in dict and lang model in train phase only
+					// alternatively we can always ignore broken words, but it is a pity to not use the markup
+					// now, well formed words and broken words are used
+					if (!buildPhaseSpecificParts(ResourceUsagePhase::Train, minWordPartUsage, maxUnigramsCount, allowPhoneticWordSplit, trainPhoneIds, gramDim, pronCodeDisplayTrain, phoneticTranscriber, &dictWordsCountTrain_, &phonesCountTrain_, errMsg))
+					{
+						pushErrorMsg(errMsg, "Can't build Train phase specific parts.");
+						return false;
+					}
+
+					values["dictWordsCountTrain"] = std::to_string(dictWordsCountTrain_);
+					values["dictWordsCountTest"] = std::to_string(dictWordsCountTest_);
+					values["phonesCountTrain"] = std::to_string(phonesCountTrain_);
+					values["phonesCountTest"] = std::to_string(phonesCountTest_);
+					return true;
+				};
+				if (!stageCache.runCached("langModel", keyBuilder.key(), outFiles, outDirPath_, stageValues, buildLangModel, errMsg))
+					return false;
+
+				dictWordsCountTrain_ = std::stoi(stageValues["dictWordsCountTrain"]);
+				dictWordsCountTest_ = std::stoi(stageValues["dictWordsCountTest"]);
+				phonesCountTrain_ = std::stoi(stageValues["phonesCountTrain"]);
+				phonesCountTest_ = std::stoi(stageValues["phonesCountTest"]);
+				return true;
+			});
 		}
 
 		// write wavs
 
+		// wav segments do not depend on the language model, hence are built concurrently with it
 		if (outputWav)
 		{
-			if (!boost::filesystem::create_directories(outDirWavTrain) || !boost::filesystem::create_directories(outDirWavTest))
+			pipeline.addStage("wav", { "annotation" }, [&](ErrMsgList* errMsg) -> bool
 			{
-				pushErrorMsg(errMsg, "Can't create wav train/test subfolder");
-				return false;
-			}
-			if (!buildWavSegments(phaseAssignedSegs, outSampleRate, padSilStart, padSilEnd, minSilDurMs, vadKind, errMsg))
-				return false;
+				StageKeyBuilder keyBuilder;
+				keyBuilder.addConfig("version", 2);
+				keyBuilder.addConfig(ConfigRandSeed, randSeed);
+				std::ostringstream genState; // silence padding is chosen randomly
+				genState << gen_;
+				keyBuilder.addString(genState.str());
+				keyBuilder.addConfig("outSampleRate", outSampleRate);
+				keyBuilder.addConfig(ConfigAudVad, vadKindStr);
+				keyBuilder.addConfig(ConfigAudPadSilStart, padSilStart);
+				keyBuilder.addConfig(ConfigAudPadSilEnd, padSilEnd);
+				keyBuilder.addConfig(ConfigAudMinSilDurMs, minSilDurMs);
+				keyBuilder.addConfig(ConfigAudOutputFeatures, outputFeatures);
+				for (const AssignedPhaseAudioSegment& segRef : phaseAssignedSegs)
+				{
+					const AnnotatedSpeechSegment& seg = *segRef.Seg;
+					keyBuilder.addString(segRef.OutAudioSegPathParts.AudioSegFilePathNoExt.toStdString());
+					keyBuilder.addConfig("phase", (int)segRef.Phase);
+					keyBuilder.addFileStamp(seg.AudioFilePath); // audio files are big
+					if (!keyBuilder.addFileContent(seg.AnnotFilePath, errMsg))
+						return false;
+					keyBuilder.addConfig("start", seg.StartMarker.SampleInd);
+					keyBuilder.addConfig("end", seg.EndMarker.SampleInd);
+					keyBuilder.addWString(seg.TranscriptText);
+				}
+
+				std::map<std::string, std::string> stageValues;
+				auto buildWav = [&](std::map<std::string, std::string>& values, ErrMsgList* errMsg) -> bool
+				{
+					if (!boost::filesystem::create_directories(outDirWavTrain) || !boost::filesystem::create_directories(outDirWavTest))
+					{
+						pushErrorMsg(errMsg, "Can't create wav train/test subfolder");
+						return false;
+					}
+					if (!buildWavSegments(phaseAssignedSegs, outSampleRate, padSilStart, padSilEnd, minSilDurMs, vadKind, outputFeatures, errMsg))
+						return false;
+
+					values["audioDurationSecTrain"] = std::to_string(audioDurationSecTrain_);
+					values["audioDurationSecTest"] = std::to_string(audioDurationSecTest_);
+					values["audioDurationNoPaddingSecTrain"] = std::to_string(audioDurationNoPaddingSecTrain_);
+					values["audioDurationNoPaddingSecTest"] = std::to_string(audioDurationNoPaddingSecTest_);
+					for (const auto& pair : speakerIdToAudioDurSec_)
+						values["speakerDur." + toUtf8StdString(pair.first)] = std::to_string(pair.second);
+					return true;
+				};
+				if (!stageCache.runCached("wav", keyBuilder.key(), { "wav" }, outDirPath_, stageValues, buildWav, errMsg))
+					return false;
+
+				audioDurationSecTrain_ = std::stod(stageValues["audioDurationSecTrain"]);
+				audioDurationSecTest_ = std::stod(stageValues["audioDurationSecTest"]);
+				audioDurationNoPaddingSecTrain_ = std::stod(stageValues["audioDurationNoPaddingSecTrain"]);
+				audioDurationNoPaddingSecTest_ = std::stod(stageValues["audioDurationNoPaddingSecTest"]);
+				static const boost::string_view SpeakerDurPrefix = "speakerDur.";
+				speakerIdToAudioDurSec_.clear();
+				for (const auto& pair : stageValues)
+				{
+					if (boost::string_view(pair.first).starts_with(SpeakerDurPrefix))
+						speakerIdToAudioDurSec_[utf8s2ws(boost::string_view(pair.first).substr(SpeakerDurPrefix.size()))] = std::stod(pair.second);
+				}
+				return true;
+			});
 		}
 
+		// transcripts are written after wav segments, because Kaldi refers to the features of the output wav segments
+		if (outputPhoneticDictAndLangModelAndTranscript)
+		{
+			std::vector<std::string> transcriptsDeps = { "annotation", "pronCodeDisplay" };
+			if (outputFeatures)
+				transcriptsDeps.push_back("wav");
+			pipeline.addStage("transcripts", transcriptsDeps, [&](ErrMsgList* errMsg) -> bool
+			{
+				// filler dictionary
+				if (!writePhoneticDictSphinx(speechData_->phoneticDictFillerWords_, phoneReg_, outFilePath(dbName_ + ".filler"), nullptr, errMsg))
+				{
+					pushErrorMsg(errMsg, "Can't write Filler phonetic dictionary");
+					return false;
+				}
+
+				// trasnscripts
+				if (!writeFileIdAndTranscription(phaseAssignedSegs, ResourceUsagePhase::Train, outFilePath(dataPartNameTrain + ".fileids"), pronCodeDisplayTrain, outFilePath(dataPartNameTrain + ".transcription"), padSilStart, padSilEnd, errMsg))
+					return false;
+				if (!writeFileIdAndTranscription(phaseAssignedSegs, ResourceUsagePhase::Test, outFilePath(dataPartNameTest + ".fileids"), pronCodeDisplayTest, outFilePath(dataPartNameTest + ".transcription"), padSilStart, padSilEnd, errMsg))
+					return false;
+
+				// required for Kaldi model
+				static const bool outKaldiModel = true;
+				if (outKaldiModel)
+				{
+					KaldiModelBuilder kaldiModel(outDirPath_ / "Kaldi", pronCodeDisplayTrain, pronCodeDisplayTest);
+					if (outputFeatures)
+						kaldiModel.setSegmentFeatures(outFilePath("wav") / (dbName_ + "_train_feats.scp"), outFilePath("wav") / (dbName_ + "_test_feats.scp"));
+					if (!kaldiModel.generate(phaseAssignedSegs, errMsg))
+						return false;
+				}
+				return true;
+			});
+		}
+
+		if (!pipeline.run(-1, errMsg))
+			return false;
+
 		// generate statistics
-		generateDataStat(phaseAssignedSegs);
+		if (!generateDataStat(phaseAssignedSegs, outFilePath("segmentStats.bin"), errMsg))
+			return false;
 
 		// stop timer
 		std::chrono::time_point<Clock> now2 = Clock::now();
@@ -1015,6 +1155,8 @@ namespace PticaGovorun
 		speechModelConfig[ConfigAudPadSilStart] = QVariant::fromValue(padSilStart);
 		speechModelConfig[ConfigAudPadSilEnd] = QVariant::fromValue(padSilEnd);
 		speechModelConfig[ConfigAudMinSilDurMs] = QVariant::fromValue(minSilDurMs);
+		speechModelConfig[ConfigAudOutputFeatures] = QVariant::fromValue(outputFeatures);
+		speechModelConfig[ConfigUseBuildCache] = QVariant::fromValue(useBuildCache);
 		if (!printDataStat(generationDate, speechModelConfig, outFilePath("dataStats.txt"), errMsg))
 			return false;
 		return true;
@@ -1082,7 +1224,7 @@ namespace PticaGovorun
 		WordsUsageInfo& wordUsage = phoneticSplitter.wordUsage();
 
 		ptrdiff_t unigramTotalUsageCounter = wordsTotalUsage(wordUsage, vocabWords, nullptr);
-		std::wcout << "unigramTotalUsageCounter (based on text corpus): " << unigramTotalUsageCounter << std::endl; // debug
+		StageLogLine() << "unigramTotalUsageCounter (based on text corpus): " << unigramTotalUsageCounter; // debug
 
 		// The fillers which have usage initialized from text corpus (the ordinary fillers do not get into arpa langugae model).
 		// The probability of usaged is leveraged when text corpus is emtpy.
@@ -1114,11 +1256,11 @@ namespace PticaGovorun
 		}
 
 		PG_DbgAssert(reservedSpace < 1);
-		std::wcout << "reare words to get assigned minimal usage: " << recoveredUsage << std::endl; // debug
-		std::wcout << "reserved prob space for [inh], [eee] etc: " << reservedSpace << std::endl; // debug
+		StageLogLine() << "reare words to get assigned minimal usage: " << recoveredUsage; // debug
+		StageLogLine() << "reserved prob space for [inh], [eee] etc: " << reservedSpace; // debug
 
 		ptrdiff_t newTotalUsage = std::trunc<ptrdiff_t>((unigramTotalUsageCounter + recoveredUsage) / (1 - reservedSpace));
-		std::wcout << "newTotalUsage: " << newTotalUsage << std::endl; // debug
+		StageLogLine() << "newTotalUsage: " << newTotalUsage; // debug
 
 		// recover usage of wordParts with unknown usage (those which where not covered in text corpus)
 		auto recoverUsage = [&wordUsage, &wordPartIdToRecoveredUsage, newTotalUsage](const PhoneticWord& phWord)
@@ -1151,7 +1293,7 @@ namespace PticaGovorun
 
 #if PG_DEBUG
 		auto totalUsageAfter = wordsTotalUsage(wordUsage, vocabWords, &wordPartIdToRecoveredUsage);
-		std::wcout << "unigramTotalUsageCounter (with guessed usage of inh, eee words)= " << totalUsageAfter << std::endl;
+		StageLogLine() << "unigramTotalUsageCounter (with guessed usage of inh, eee words)= " << totalUsageAfter;
 #endif
 		return true;
 	}
@@ -1175,8 +1317,8 @@ namespace PticaGovorun
 		if (!chooseSeedUnigramsNew(phoneticSplitter_, minWordPartUsage, maxUnigramsCount, allowPhoneticWordSplit, phoneReg_, expandWellFormedWordFun, trainPhoneIds, phoneticTranscriber, phase, seedPhoneticWords, errMsg))
 			return false;
 
-		std::wcout << "phase=" << (phase == ResourceUsagePhase::Train ? "train" : "test")
-			<< " seed unigrams count=" << seedPhoneticWords.size() << std::endl;
+		StageLogLine() << "phase=" << (phase == ResourceUsagePhase::Train ? "train" : "test")
+			<< " seed unigrams count=" << seedPhoneticWords.size();
 
 		// build seed words (vocabulary) for arpa LM
 		std::vector<PhoneticWord> seedWordsLangModel;
@@ -1194,7 +1336,7 @@ namespace PticaGovorun
 			return false;
 
 		//
-		std::wcout << "Generating Arpa LM" << std::endl;
+		StageLogLine() << "Generating Arpa LM";
 		ArpaLanguageModel langModel(gramDim);
 		langModel.generate(seedWordsLangModel, wordPartIdToRecoveredUsage, phoneticSplitter_);
 
@@ -1210,7 +1352,7 @@ namespace PticaGovorun
 		if (phase == ResourceUsagePhase::Test)
 		{
 			std::vector<boost::wstring_view> brokenPronCodes;
-			if (!rulePhoneticDicHasNoBrokenPronCodes(seedPhoneticWords, speechData_->phoneticDictBroken_, &brokenPronCodes))
+			if (!rulePhoneticDicHasNoBrokenPronCodes(seedPhoneticWords, speechData_->phoneticDictBroken(), &brokenPronCodes))
 			{
 				std::wostringstream buf;
 				buf << "Found broken pronunciations in phonetic dictionary: ";
@@ -1276,20 +1418,6 @@ namespace PticaGovorun
 		return false;
 	}
 
-	bool SphinxTrainDataBuilder::isBrokenUtterance(boost::wstring_view text) const
-	{
-		std::vector<boost::wstring_view> textWords;
-		GrowOnlyPinArena<wchar_t> arena(1024);
-		splitUtteranceIntoPronuncList(text, arena, textWords);
-
-		bool hasBrokenWord = std::any_of(textWords.begin(), textWords.end(), [this](boost::wstring_view word)
-		{
-			auto it = pronCodeToObjBroken_.find(word);
-			return it != pronCodeToObjBroken_.end();
-		});
-		return hasBrokenWord;
-	}
-
 	const PronunciationFlavour* SphinxTrainDataBuilder::expandWellKnownPronCode(boost::wstring_view pronCode, bool useBrokenDict) const
 	{
 		auto it = pronCodeToObjWellFormed_.find(pronCode);
@@ -1312,19 +1440,20 @@ namespace PticaGovorun
 
 	const PhoneticWord* SphinxTrainDataBuilder::findWellKnownWord(boost::wstring_view word, bool useBrokenDict) const
 	{
-		auto it = speechData_->phoneticDictWellFormed_.find(word);
-		if (it != speechData_->phoneticDictWellFormed_.end())
+		std::shared_ptr<const PhoneticDictSnapshot> dicts = speechData_->phoneticDictSnapshot();
+		auto it = dicts->WellFormed->find(word);
+		if (it != dicts->WellFormed->end())
 			return &it->second;
 
 		if (useBrokenDict)
 		{
-			it = speechData_->phoneticDictBroken_.find(word);
-			if (it != speechData_->phoneticDictBroken_.end())
+			it = dicts->Broken->find(word);
+			if (it != dicts->Broken->end())
 				return &it->second;
 		}
 
-		it = speechData_->phoneticDictFiller_.find(word);
-		if (it != speechData_->phoneticDictFiller_.end())
+		it = dicts->Filler->find(word);
+		if (it != dicts->Filler->end())
 			return &it->second;
 
 		return nullptr;
@@ -1407,49 +1536,44 @@ namespace PticaGovorun
 		return true;
 	}
 
-	void SphinxTrainDataBuilder::loadDeclinationDictionary(std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>>& declinedWordDict)
+	bool SphinxTrainDataBuilder::loadDeclinationDictionary(PackedDeclensionDictionary& declinedWordDict, ErrMsgList* errMsg)
 	{
-		auto dictPathArray = {
-			//LR"path(C:\devb\PticaGovorunProj\srcrep\build\x64\Debug\tmp2.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk01-а-вапно-вапнований).htm.20150228220948.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk02-вапнований-гіберелін-гібернація).htm.20150228213543.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk03-гібернація-дипромоній-дипрофен).htm.20150228141620.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk04-дипрофен-запорошеність-запорошення).htm.20150228220515.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk05-запорошення-іонування-іонувати).htm.20150301145100.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk06-іонувати-кластогенний-клатрат).htm.20150302001636.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk07-клатрат-макроцистис-макроцит).htm.20150316142905.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk08-макроцит-м'яшкурити-н).htm.20150325111235.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk09-н-нестравність-нестратифікований).htm.20150301230606.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk10-нестратифікований-однокенотронний-однокислотний)8.htm.20150301230840.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk11-однокислотний-поконання-поконати).htm.20150325000544.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk12-поконати-п'ять-р).htm.20150408175213.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk13-р-ряцькувати-с).htm.20150407185103.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk14-с-строщити-строювати).htm.20150407185337.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk15-строювати-тях-у).htm.20150407185443.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk16-у-чхун-ш).htm.20150301231717.xml)path",
-			LR"path(C:\devb\PticaGovorunProj\data\declinationDictUk\uk17-ш-ящурячий-end).htm.20150301232344.xml)path",
+		// the files are read from the speech project directory, which is hashed into the keys of the language model and word usage
+		auto dictDirPath = speechProjDirPath_ / "declinationDictUk";
+		std::vector<const wchar_t*> dictFileNames = {
+			LR"path(uk01-а-вапно-вапнований).htm.20150228220948.xml)path",
+			LR"path(uk02-вапнований-гіберелін-гібернація).htm.20150228213543.xml)path",
+			LR"path(uk03-гібернація-дипромоній-дипрофен).htm.20150228141620.xml)path",
+			LR"path(uk04-дипрофен-запорошеність-запорошення).htm.20150228220515.xml)path",
+			LR"path(uk05-запорошення-іонування-іонувати).htm.20150301145100.xml)path",
+			LR"path(uk06-іонувати-кластогенний-клатрат).htm.20150302001636.xml)path",
+			LR"path(uk07-клатрат-макроцистис-макроцит).htm.20150316142905.xml)path",
+			LR"path(uk08-макроцит-м'яшкурити-н).htm.20150325111235.xml)path",
+			LR"path(uk09-н-нестравність-нестратифікований).htm.20150301230606.xml)path",
+			LR"path(uk10-нестратифікований-однокенотронний-однокислотний)8.htm.20150301230840.xml)path",
+			LR"path(uk11-однокислотний-поконання-поконати).htm.20150325000544.xml)path",
+			LR"path(uk12-поконати-п'ять-р).htm.20150408175213.xml)path",
+			LR"path(uk13-р-ряцькувати-с).htm.20150407185103.xml)path",
+			LR"path(uk14-с-строщити-строювати).htm.20150407185337.xml)path",
+			LR"path(uk15-строювати-тях-у).htm.20150407185443.xml)path",
+			LR"path(uk16-у-чхун-ш).htm.20150301231717.xml)path",
+			LR"path(uk17-ш-ящурячий-end).htm.20150301232344.xml)path",
 		};
+		std::vector<boost::filesystem::path> dictPathArray;
+		for (const wchar_t* fileName : dictFileNames)
+			dictPathArray.push_back(dictDirPath / fileName);
 
-		std::chrono::time_point<Clock> now1 = Clock::now();
+		// XML files are compiled once into the packed dictionary, which is then mapped into memory
+		// the packed file is put outside of the dictionary directory to not change the stamps of the directory
+		auto packedDictPath = speechProjDirPath_ / "declinationDictUk.packed";
 
-		int declinationFileCount = 0;
-		for (auto& dictPath : dictPathArray)
-		{
-			std::wstring errMsg;
-			bool loadOp = loadUkrainianWordDeclensionXml(dictPath, declinedWordDict, &errMsg);
-			if (!loadOp)
-			{
-				std::wcerr << errMsg << std::endl;
-				return;
-			}
-			std::wcout <<dictPath <<std::endl;
-			declinationFileCount++;
-			if (false && declinationFileCount <= 3)
-				break;
-		}
+		std::chrono::time_point<Clock> now1 = Clock::now();
+		if (!loadPackedDeclensionDictionary(dictPathArray, packedDictPath, declinedWordDict, errMsg))
+			return false;
 		std::chrono::time_point<Clock> now2 = Clock::now();
 		auto elapsedSec = std::chrono::duration_cast<std::chrono::seconds>(now2 - now1).count();
-		std::wcout << L"loaded declination dict in " << elapsedSec << L"s" << std::endl;
+		StageLogLine() << L"loaded declination dict in " << elapsedSec << L"s";
+		return true;
 	}
 
 	bool SphinxTrainDataBuilder::phoneticSplitterBootstrapOnDeclinedWords(UkrainianPhoneticSplitter& phoneticSplitter, ErrMsgList* errMsg)
@@ -1457,11 +1581,12 @@ namespace PticaGovorun
 		if (!phoneticSplitter.allowPhoneticWordSplit())
 			return true;
 
-		std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>> declinedWordDict;
-		loadDeclinationDictionary(declinedWordDict);
+		PackedDeclensionDictionary declinedWordDict;
+		if (!loadDeclinationDictionary(declinedWordDict, errMsg))
+			return false;
 
 		auto processedWordsFilePath = speechData_->speechProjDir() / "declinationDictUk/uk-done.txt";
-		std::wcout << "processedWordsFile=" << processedWordsFilePath.wstring() << std::endl;
+		StageLogLine() << "processedWordsFile=" << processedWordsFilePath.wstring();
 
 		std::unordered_set<std::wstring> processedWords;
 		if (!loadWordList(processedWordsFilePath, processedWords, errMsg))
@@ -1469,7 +1594,7 @@ namespace PticaGovorun
 			pushErrorMsg(errMsg, "Can't load 'uk-done.txt' dictionary");
 			return false;
 		}
-		std::wcout << "processedWords.size=" << processedWords.size() << std::endl;
+		StageLogLine() << "processedWords.size=" << processedWords.size();
 
 		std::wstring targetWord;
 
@@ -1477,15 +1602,15 @@ namespace PticaGovorun
 		phoneticSplitter.bootstrapFromDeclinedWords(declinedWordDict, targetWord, processedWords);
 		std::chrono::time_point<Clock> now2 = Clock::now();
 		auto elapsedSec = std::chrono::duration_cast<std::chrono::seconds>(now2 - now1).count();
-		std::wcout << L"phonetic split of declinartion dict took=" << elapsedSec << L"s" << std::endl;
+		StageLogLine() << L"phonetic split of declinartion dict took=" << elapsedSec << L"s";
 
-		int uniqueDeclWordsCount = uniqueDeclinedWordsCount(declinedWordDict);
-		std::wcout << L"wordGroupsCount=" << declinedWordDict.size() << L" uniqueDeclWordsCount=" << uniqueDeclWordsCount << std::endl;
+		int uniqueDeclWordsCount = declinedWordDict.uniqueFormsCount();
+		StageLogLine() << L"wordGroupsCount=" << declinedWordDict.groups().size() << L" uniqueDeclWordsCount=" << uniqueDeclWordsCount;
 
 		WordsUsageInfo& wordUsage = phoneticSplitter.wordUsage();
 		double uniquenessRatio = wordUsage.wordPartsCount() / (double)uniqueDeclWordsCount;
-		std::wcout << L" wordParts=" << wordUsage.wordPartsCount() << std::endl;
-		std::wcout << L" uniquenessRatio=" << uniquenessRatio << std::endl;
+		StageLogLine() << L" wordParts=" << wordUsage.wordPartsCount();
+		StageLogLine() << L" uniquenessRatio=" << uniquenessRatio;
 		return true;
 	}
 
@@ -1515,35 +1640,81 @@ namespace PticaGovorun
 	void SphinxTrainDataBuilder::phoneticSplitterCollectWordUsageInText(UkrainianPhoneticSplitter& phoneticSplitter, int maxFilesToProcess)
 	{
 		auto txtDirPath = speechProjDirPath_ / "textWorld";
-		std::wcout << "txtDir=" << txtDirPath << std::endl;
+		StageLogLine() << "txtDir=" << txtDirPath;
 		long totalPreSplitWords = 0;
 
 		std::chrono::time_point<Clock> now1 = Clock::now();
 		phoneticSplitter.gatherWordPartsSequenceUsage(txtDirPath, totalPreSplitWords, maxFilesToProcess);
 		std::chrono::time_point<Clock> now2 = Clock::now();
 		auto elapsedSec = std::chrono::duration_cast<std::chrono::seconds>(now2 - now1).count();
-		std::wcout << L"gatherWordPartsSequenceUsage took=" << elapsedSec << L"s" << std::endl;
+		StageLogLine() << L"gatherWordPartsSequenceUsage took=" << elapsedSec << L"s";
 
 		WordsUsageInfo& wordUsage = phoneticSplitter.wordUsage();
-		std::wcout << L"number of word parts: " << wordUsage.wordPartsCount() << std::endl;
+		StageLogLine() << L"number of word parts: " << wordUsage.wordPartsCount();
 
 		std::array<ptrdiff_t, 2> wordSeqSizes;
 		wordUsage.wordSeqCountPerSeqSize(wordSeqSizes);
 		for (int seqDim = 0; seqDim < wordSeqSizes.size(); ++seqDim)
 		{
 			auto wordsPerNGram = wordSeqSizes[seqDim];
-			std::wcout << L"text corpus has #" << seqDim + 1 << " words: " << wordsPerNGram << std::endl;
+			StageLogLine() << L"text corpus has #" << seqDim + 1 << " words: " << wordsPerNGram;
 		}
 
 		phoneticSplitter.printSuffixUsageStatistics();
 	}
 
-	bool SphinxTrainDataBuilder::phoneticSplitterLoad(UkrainianPhoneticSplitter& phoneticSplitter, int maxFilesToProcess, ErrMsgList* errMsg)
+	bool SphinxTrainDataBuilder::phoneticSplitterLoad(UkrainianPhoneticSplitter& phoneticSplitter, int maxFilesToProcess, const boost::filesystem::path& snapshotFilePath, ErrMsgList* errMsg)
 	{
+		// the corpus is written while the text is parsed, hence the snapshot can't be used
+		bool useSnapshot = !snapshotFilePath.empty() && !phoneticSplitter.outputCorpus_;
+		std::uint64_t snapshotKey = 0;
+		if (useSnapshot)
+		{
+			StageKeyBuilder keyBuilder;
+			keyBuilder.addConfig("version", 1);
+			keyBuilder.addConfig("allowPhoneticWordSplit", phoneticSplitter.allowPhoneticWordSplit());
+			keyBuilder.addConfig("textWorld.maxFilesToProcess", maxFilesToProcess);
+
+			// the text corpus is big, hence only the list of files and their stamps are hashed
+			if (!keyBuilder.addDir(speechProjDirPath_ / "textWorld", false, errMsg) ||
+				!keyBuilder.addDir(speechProjDirPath_ / "declinationDictUk", false, errMsg) ||
+				!keyBuilder.addFileContent(toBfs(AppHelpers::mapPath("pgdata/LM_ua/numsCardOrd.xml")), errMsg))
+				return false;
+
+			// words of phonetic dictionaries are registered as word parts
+			for (const auto* words : { &speechData_->phoneticDictWellFormedWords_, &speechData_->phoneticDictBrokenWords_, &speechData_->phoneticDictFillerWords_ })
+			{
+				keyBuilder.addConfig("wordsCount", words->size());
+				for (const PhoneticWord& word : *words)
+					keyBuilder.addWString(word.Word);
+			}
+			snapshotKey = keyBuilder.key();
+
+			// the unreadable snapshot is treated as a miss
+			bool loaded = false;
+			ErrMsgList snapshotErrMsg;
+			if (!phoneticSplitter.loadWordUsageSnapshot(snapshotFilePath, snapshotKey, loaded, &snapshotErrMsg))
+				StageLogLine(true) << "Can't load word usage snapshot, rebuilding it. " << str(snapshotErrMsg);
+			if (loaded)
+			{
+				StageLogLine() << L"word usage is loaded from snapshot=" << snapshotFilePath.wstring();
+				StageLogLine() << L"number of word parts: " << phoneticSplitter.wordUsage().wordPartsCount();
+				return true;
+			}
+		}
+
 		if (!phoneticSplitterBootstrapOnDeclinedWords(phoneticSplitter, errMsg))
 			return false;
 		phoneticSplitterRegisterWordsFromPhoneticDictionary(phoneticSplitter);
 		phoneticSplitterCollectWordUsageInText(phoneticSplitter, maxFilesToProcess);
+
+		if (useSnapshot)
+		{
+			// failure to save the snapshot doesn't fail the build
+			ErrMsgList snapshotErrMsg;
+			if (!phoneticSplitter.saveWordUsageSnapshot(snapshotFilePath, snapshotKey, &snapshotErrMsg))
+				StageLogLine(true) << "Can't save word usage snapshot. " << str(snapshotErrMsg);
+		}
 		return true;
 	}
 
@@ -1594,7 +1765,7 @@ namespace PticaGovorun
 			// fillers should not be in seed words
 			auto it = std::find_if(std::begin(seedUnigrams), std::end(seedUnigrams), [this](const PhoneticWord& word) -> bool
 			{
-				const auto& fillerDict = speechData_->phoneticDictFiller_;
+				const auto& fillerDict = speechData_->phoneticDictFiller();
 				bool isFiller = fillerDict.find(word.Word) != std::end(fillerDict);
 				return isFiller;
 			});
@@ -1696,146 +1867,129 @@ namespace PticaGovorun
 
 	bool SphinxTrainDataBuilder::partitionTrainTestData(const std::vector<AnnotatedSpeechSegment>& segments, double trainCasesRatio, bool swapTrainTestData, bool useBrokenPronsInTrainOnly, std::vector<AssignedPhaseAudioSegment>& outSegRefs, std::set<PhoneId>& trainPhoneIds, ErrMsgList* errMsg)
 	{
-		// partition train-test data
-		std::vector<std::reference_wrapper<const AnnotatedSpeechSegment>> rejectedSegments;
-		std::uniform_real_distribution<float> rnd(0, 1);
-		for (const AnnotatedSpeechSegment& seg : segments)
+		// expand pronCodes of each segment into phones once; dictionaries are only read here, so segments are processed concurrently
+		int threadsCount = parallelThreadsCount(segments.size(), -1);
+		std::vector<std::unique_ptr<GrowOnlyPinArena<wchar_t>>> threadArenas;
+		for (int i = 0; i < threadsCount; ++i)
+			threadArenas.push_back(std::make_unique<GrowOnlyPinArena<wchar_t>>(1024));
+		std::vector<std::vector<boost::wstring_view>> threadPronCodes(threadsCount);
+
+		std::vector<PhoneSet> segPhones(segments.size());
+		std::vector<char> segBroken(segments.size(), false);
+		std::vector<std::wstring> segUnknownPronCode(segments.size());
+		parallelFor(segments.size(), threadsCount, [&](size_t segInd, int threadInd)
+		{
+			GrowOnlyPinArena<wchar_t>& arena = *threadArenas[threadInd];
+			std::vector<boost::wstring_view>& pronCodes = threadPronCodes[threadInd];
+			arena.clear();
+			pronCodes.clear();
+			splitUtteranceIntoPronuncList(segments[segInd].TranscriptText, arena, pronCodes);
+
+			for (boost::wstring_view pronCode : pronCodes)
+			{
+				if (pronCodeToObjBroken_.find(pronCode) != pronCodeToObjBroken_.end())
+					segBroken[segInd] = true;
+
+				const PronunciationFlavour* pron = expandWellKnownPronCode(pronCode, true);
+				if (pron == nullptr)
+				{
+					segUnknownPronCode[segInd] = toStdWString(pronCode);
+					return;
+				}
+				for (PhoneId phoneId : pron->Phones)
+					segPhones[segInd].set(phoneId.Id);
+			}
+		});
+
+		// the first error in the order of segments, so that the error is the same on each run
+		auto unknownIt = std::find_if(segUnknownPronCode.begin(), segUnknownPronCode.end(), [](const std::wstring& pronCode) { return !pronCode.empty(); });
+		if (unknownIt != segUnknownPronCode.end())
+		{
+			if (errMsg != nullptr) errMsg->utf8Msg = toUtf8StdString(str(boost::wformat(L"Can't map pronCode %1% into phonelist") % *unknownIt));
+			return false;
+		}
+
+		std::vector<PartitionItem> items;
+		std::vector<const AnnotatedSpeechSegment*> itemSegs;
+		int rejectedSegmentsCount = 0;
+		for (size_t segInd = 0; segInd < segments.size(); ++segInd)
 		{
+			const AnnotatedSpeechSegment& seg = segments[segInd];
 			bool isAlwaysTest = seg.ContentMarker.ExcludePhase == ResourceUsagePhase::Train;
 			bool isAlwaysTrain = seg.ContentMarker.ExcludePhase == ResourceUsagePhase::Test;
 
-			bool broken = isBrokenUtterance(seg.TranscriptText);
 			if (useBrokenPronsInTrainOnly)
 			{
-				isAlwaysTrain |= broken;
+				isAlwaysTrain |= segBroken[segInd] != 0;
 			}
 			// #includeBrownBear
-			//isAlwaysTrain |= seg.ContentMarker.SpeakerBriefId == L"BrownBear1";
+			//isAlwaysTrain |= seg.SpeakerBriefId == "BrownBear1";
 
 			if (isAlwaysTrain && isAlwaysTest)
 			{
 				// eg when excluded from training segment has broken words
-				rejectedSegments.push_back(std::ref(seg));
+				rejectedSegmentsCount += 1;
 				continue;
 			}
 
-			auto segRef = AssignedPhaseAudioSegment();
-			segRef.Seg = &seg;
-
+			PartitionItem item;
+			item.SpeakerBriefId = seg.SpeakerBriefId;
+			item.StableKey = seg.AnnotFilePath + L"#" + std::to_wstring(seg.StartMarkerId);
 			if (isAlwaysTest)
-				segRef.Phase = ResourceUsagePhase::Test;
+				item.FixedPhase = ResourceUsagePhase::Test;
 			else if (isAlwaysTrain)
-				segRef.Phase = ResourceUsagePhase::Train;
-			else
-			{
-				PG_Assert(!isAlwaysTrain && !isAlwaysTest);
-
-				float val = rnd(gen_);
-				ResourceUsagePhase phase = val < trainCasesRatio ? ResourceUsagePhase::Train : ResourceUsagePhase::Test;
-
-				if (swapTrainTestData)
-				{
-					if (phase == ResourceUsagePhase::Train)
-						phase = ResourceUsagePhase::Test;
-					else if (phase == ResourceUsagePhase::Test)
-						phase = ResourceUsagePhase::Train;
-				}
-
-				segRef.Phase = phase;
-			}
-			outSegRefs.push_back(segRef);
+				item.FixedPhase = ResourceUsagePhase::Train;
+			item.Phones = segPhones[segInd];
+			items.push_back(std::move(item));
+			itemSegs.push_back(&seg);
 		}
-		if (!rejectedSegments.empty()) // TODO: print rejected segment: annot file path, segment IDs
-			std::wcout << "Rejected segments: " << rejectedSegments.size() << std::endl; // info
+		if (rejectedSegmentsCount > 0) // TODO: print rejected segment: annot file path, segment IDs
+			StageLogLine() << "Rejected segments: " << rejectedSegmentsCount; // info
 
-		return putSentencesWithRarePhonesInTrain(outSegRefs, trainPhoneIds, errMsg);
-	}
+		std::vector<ResourceUsagePhase> phases;
+		std::uint32_t seed = gen_();
+		partitionTrainTestBySpeaker(items, trainCasesRatio, seed, threadsCount, phases);
 
-	// Fix train/test split so that if a (rare) phone exist only in one data set, then this is the Test data set.
-	// This is necessary for the rare phones to end up in the train data set. Otherwise Sphinx emits warning and errors:
-	// WARNING: "accum.c", line 633: The following senones never occur in the input data...
-	// WARNING: "main.c", line 145: No triphones involving DZ1
-	bool SphinxTrainDataBuilder::putSentencesWithRarePhonesInTrain(std::vector<AssignedPhaseAudioSegment>& segments, std::set<PhoneId>& trainPhoneIds, ErrMsgList* errMsg) const
-	{
-		PhoneAccumulator trainAcc;
-		PhoneAccumulator testAcc;
-		std::vector<boost::wstring_view> pronCodes;
-		GrowOnlyPinArena<wchar_t> arena(1024);
-		for (const auto& segRef : segments)
+		if (swapTrainTestData)
 		{
-			PhoneAccumulator& acc = segRef.Phase == ResourceUsagePhase::Train ? trainAcc : testAcc;
-			
-			pronCodes.clear();
-			arena.clear();
-			splitUtteranceIntoPronuncList(segRef.Seg->TranscriptText, arena, pronCodes);
-			
-			for (auto pronCode : pronCodes)
+			for (size_t itemInd = 0; itemInd < items.size(); ++itemInd)
 			{
-				const PronunciationFlavour* pron = expandWellKnownPronCode(pronCode, true);
-				if (pron == nullptr)
-				{
-					if (errMsg != nullptr) errMsg->utf8Msg = toUtf8StdString(str(boost::wformat(L"Can't map pronCode %1% into phonelist") % pronCode));
-					return false;
-				}
-				acc.addPhones(pron->Phones);
+				if (items[itemInd].FixedPhase != boost::none)
+					continue;
+				phases[itemInd] = phases[itemInd] == ResourceUsagePhase::Train ? ResourceUsagePhase::Test : ResourceUsagePhase::Train;
 			}
 		}
 
-		//
-		trainAcc.copyPhoneList(putInsert(trainPhoneIds));
-		
-		std::vector<PhoneId> trainPhones;
-		std::vector<PhoneId> testPhones;
-		trainAcc.copyPhoneList(putBack(trainPhones));
-		testAcc.copyPhoneList(putBack(testPhones));
-
-		// phones which exist only in test portion but not in train
-		std::vector<PhoneId> testOnlyPhoneIds;
-		std::sort(trainPhones.begin(), trainPhones.end());
-		std::sort(testPhones.begin(), testPhones.end());
-		std::set_difference(testPhones.begin(), testPhones.end(), trainPhoneIds.begin(), trainPhoneIds.end(), std::back_inserter(testOnlyPhoneIds));
+		// Fix train/test split so that if a (rare) phone exist only in one data set, then this is the Test data set.
+		// This is necessary for the rare phones to end up in the train data set. Otherwise Sphinx emits warning and errors:
+		// WARNING: "accum.c", line 633: The following senones never occur in the input data...
+		// WARNING: "main.c", line 145: No triphones involving DZ1
+		PhoneSet uncoveredPhones;
+		int testToTrainMove = coverTestPhonesInTrain(items, phases, &uncoveredPhones);
+		if (testToTrainMove > 0)
+			StageLogLine() << L"Moved " << testToTrainMove << L" sentences with rare phones to Train portion"; // info
+		if (uncoveredPhones.any())
+			StageLogLine() << L"Phones exist only in segments excluded from training: " << uncoveredPhones.count(); // warn
 
-		//
-		auto sentHasRarePhone = [&pronCodes, this](boost::wstring_view text, const std::vector<PhoneId>& rarePhoneIds) -> bool
+		PhoneSet trainPhones;
+		for (size_t itemInd = 0; itemInd < items.size(); ++itemInd)
 		{
-			pronCodes.clear();
-			GrowOnlyPinArena<wchar_t> arena(1024);
-			splitUtteranceIntoPronuncList(text, arena, pronCodes);
-
-			return std::any_of(pronCodes.begin(), pronCodes.end(), [this, &rarePhoneIds](boost::wstring_view pronCode) -> bool
-			{
-				const PronunciationFlavour* pron = expandWellKnownPronCode(pronCode, true);
-				PG_Assert2(pron != nullptr, "PronCode can't be expanded into phones, but has been successfully expanded before");
-				
-				return std::any_of(pron->Phones.begin(), pron->Phones.end(), [&rarePhoneIds](PhoneId phId) -> bool
-				{
-					return std::find(rarePhoneIds.begin(), rarePhoneIds.end(), phId) != rarePhoneIds.end();
-				});
-			});
-		};
+			if (phases[itemInd] == ResourceUsagePhase::Train)
+				trainPhones |= items[itemInd].Phones;
 
-		// put sentences with testOnly (rare) phones into train portion
-		int testToTrainMove = 0;
-		for (PhoneId phoneId : testOnlyPhoneIds)
+			auto segRef = AssignedPhaseAudioSegment();
+			segRef.Seg = itemSegs[itemInd];
+			segRef.Phase = phases[itemInd];
+			outSegRefs.push_back(segRef);
+		}
+		for (size_t phoneIdInt = 0; phoneIdInt < trainPhones.size(); ++phoneIdInt)
 		{
-			for (auto& segRef : segments)
-			{
-				if (segRef.Phase != ResourceUsagePhase::Test)
-					continue;
-				if (sentHasRarePhone(segRef.Seg->TranscriptText, testOnlyPhoneIds))
-				{
-					segRef.Phase = ResourceUsagePhase::Train;
-					testToTrainMove++;
-				}
-			}
+			if (trainPhones.test(phoneIdInt))
+				trainPhoneIds.insert(phoneReg_.extendPhoneId((int)phoneIdInt));
 		}
-		if (testToTrainMove > 0)
-			std::wcout << L"Moved " << testToTrainMove << L" sentences with rare phones to Train portion" << std::endl; // info
-
 		return true;
 	}
 
-
 	QString generateSegmentFileNameNoExt(const QString& baseFileName, const AnnotatedSpeechSegment& seg)
 	{
 		QLatin1Char filler('0');
@@ -1967,8 +2121,23 @@ namespace PticaGovorun
 		return true;
 	}
 
-	bool SphinxTrainDataBuilder::buildWavSegments(const std::vector<AssignedPhaseAudioSegment>& segsRefs, float targetSampleRate, bool padSilStart, bool padSilEnd, float minSilDurMs, boost::optional<VadImplKind> vadKind, ErrMsgList* errMsg)
+	bool SphinxTrainDataBuilder::buildWavSegments(const std::vector<AssignedPhaseAudioSegment>& segsRefs, float targetSampleRate, bool padSilStart, bool padSilEnd, float minSilDurMs, boost::optional<VadImplKind> vadKind, bool outputFeatures, ErrMsgList* errMsg)
 	{
+		// features of train and test segments
+		std::array<KaldiArchiveWriter, 2> featWriters;
+		if (outputFeatures)
+		{
+			for (size_t phaseInd = 0; phaseInd < featWriters.size(); ++phaseInd)
+			{
+				std::string featsName = dbName_ + (phaseInd == 0 ? "_train_feats" : "_test_feats");
+				auto arkFilePath = outFilePath("wav") / (featsName + ".ark");
+				if (!featWriters[phaseInd].open(arkFilePath, outFilePath("wav") / (featsName + ".scp"), errMsg))
+					return false;
+				featWriters[phaseInd].setScpArkPath(featsName + ".ark"); // relative, so the wav folder can be moved
+			}
+		}
+		std::vector<float> segFeatures;
+
 		// group segmets by source wav file, so wav files are read sequentially
 
 		typedef std::vector<const AssignedPhaseAudioSegment*> VecPerFile;
@@ -1985,7 +2154,8 @@ namespace PticaGovorun
 
 		// audio frames are lazy loaded
 		float srcAudioSampleRate = -1;
-		std::vector<short> srcAudioSamples;
+		gsl::span<const short> srcAudioSamples;
+		std::vector<short> srcAudioSamplesBuf;
 		std::vector<short> segFramesResamp;
 		std::vector<short> segFramesPad;
 		std::vector<short> curFileAllSil;
@@ -1995,19 +2165,30 @@ namespace PticaGovorun
 			const std::wstring& wavFilePath = pair.first;
 			const VecPerFile& segs = pair.second;
 			
-			// load wav file
-			std::string srcAudioPath = QString::fromStdWString(wavFilePath).toStdString();
-			std::wcout << L"wav=" << wavFilePath << std::endl;
+			StageLogLine() << L"wav=" << wavFilePath;
 
-			srcAudioSamples.clear();
-			if (!readAllSamplesFormatAware(srcAudioPath, srcAudioSamples, &srcAudioSampleRate, errMsg))
+			// reuse the samples of the file, shared by loaded segments
+			PG_Assert(!segs.empty())
+			const AnnotatedSpeechSegment& firstSeg = *segs.front()->Seg;
+			if (firstSeg.FileSamples != nullptr)
 			{
-				pushErrorMsg(errMsg, "Can't read audio file.");
-				return false;
+				srcAudioSamples = *firstSeg.FileSamples;
+				srcAudioSampleRate = firstSeg.SampleRate;
+			}
+			else
+			{
+				// load wav file
+				std::string srcAudioPath = QString::fromStdWString(wavFilePath).toStdString();
+				srcAudioSamplesBuf.clear();
+				if (!readAllSamplesFormatAware(srcAudioPath, srcAudioSamplesBuf, &srcAudioSampleRate, errMsg))
+				{
+					pushErrorMsg(errMsg, "Can't read audio file.");
+					return false;
+				}
+				srcAudioSamples = srcAudioSamplesBuf;
 			}
 
 			SpeechAnnotation speechAnnot;
-			PG_Assert(!segs.empty())
 			auto audioMarkupFilePathAbs = boost::filesystem::path(segs.front()->Seg->AnnotFilePath);
 			if (!loadAudioMarkupXml(audioMarkupFilePathAbs, speechAnnot, errMsg))
 				return false;
@@ -2019,7 +2200,7 @@ namespace PticaGovorun
 				auto param = speechAnnot.getParameter("VAD");
 				if (param != nullptr)
 				{
-					std::wcout << "VAD: " << utf8s2ws(param->Value) << "\n";
+					StageLogLine() << "VAD: " << utf8s2ws(param->Value);
 
 					if (!parseVadKindStr(param->Value, annotVadKind, errMsg))
 						return false;
@@ -2037,7 +2218,7 @@ namespace PticaGovorun
 				if (silenceFilePathParam != nullptr)
 				{
 					boost::filesystem::path silenceFilePath = audioMarkupFilePathAbs.parent_path() / silenceFilePathParam->Value;
-					std::wcout << "importSilenceFile: " << silenceFilePath.wstring() << "\n"; // debug
+					StageLogLine() << "importSilenceFile: " << silenceFilePath.wstring(); // debug
 
 					if (!readAllSamplesFormatAware(silenceFilePath, curFileAllSil, &srcAudioSampleRate, errMsg))
 						return false;
@@ -2080,7 +2261,7 @@ namespace PticaGovorun
 				//PG_DbgAssert(segLen >= 0);
 				//gsl::span<const short> segFramesNoPad = srcAudioSamples;
 				//segFramesNoPad = segFramesNoPad.subspan(seg.StartMarker.SampleInd, segLen);;
-				gsl::span<const short> segFramesNoPad = seg.Samples;
+				gsl::span<const short> segFramesNoPad = seg.samples();
 
 
 				// remove silence segments using VAD
@@ -2205,27 +2386,82 @@ namespace PticaGovorun
 					return false;
 				}
 #endif
+
+				// features are keyed by file id, as in *.fileids
+				if (outputFeatures)
+				{
+					int featVecLen = computeMfccVelocityAccelFeatures(segFramesOut, targetSampleRate, segFeatures);
+					KaldiArchiveWriter& featWriter = featWriters[segRef->Phase == ResourceUsagePhase::Train ? 0 : 1];
+					if (!featWriter.writeMatrix(toUtf8StdString(segRef->OutAudioSegPathParts.WavOutRelFilePathNoExt), segFeatures, featVecLen, errMsg))
+						return false;
+				}
+			}
+		}
+		if (outputFeatures)
+		{
+			for (KaldiArchiveWriter& featWriter : featWriters)
+			{
+				if (!featWriter.close(errMsg))
+					return false;
 			}
 		}
 		return true;
 	}
 
-	void SphinxTrainDataBuilder::generateDataStat(const std::vector<AssignedPhaseAudioSegment>& phaseAssignedSegs)
+	bool SphinxTrainDataBuilder::generateDataStat(const std::vector<AssignedPhaseAudioSegment>& phaseAssignedSegs, const boost::filesystem::path& indexFilePath, ErrMsgList* errMsg)
 	{
-		std::vector<boost::wstring_view> words;
-		GrowOnlyPinArena<wchar_t> arena(1024);
-		for (const auto& segRef : phaseAssignedSegs)
+		int threadsCount = parallelThreadsCount(phaseAssignedSegs.size(), -1);
+		std::vector<std::unique_ptr<GrowOnlyPinArena<wchar_t>>> threadArenas;
+		for (int i = 0; i < threadsCount; ++i)
+			threadArenas.push_back(std::make_unique<GrowOnlyPinArena<wchar_t>>(1024));
+		std::vector<std::vector<boost::wstring_view>> threadPronCodes(threadsCount);
+
+		auto segRowFun = [&](size_t segInd, int threadInd, SegmentStatRow& row, ErrMsgList* segErrMsg) -> bool
 		{
-			int& utterCounter = segRef.Phase == ResourceUsagePhase::Train ? utterCountTrain_ : utterCountTest_;
-			utterCounter += 1;
+			const AssignedPhaseAudioSegment& segRef = phaseAssignedSegs[segInd];
+			const AnnotatedSpeechSegment& seg = *segRef.Seg;
+			row.DurationSec = seg.SampleRate > 0 ? seg.samples().size() / seg.SampleRate : 0;
+			row.SpeakerId = seg.SpeakerBriefId;
+			row.Phase = segRef.Phase;
 
-			words.clear();
+			GrowOnlyPinArena<wchar_t>& arena = *threadArenas[threadInd];
+			std::vector<boost::wstring_view>& pronCodes = threadPronCodes[threadInd];
 			arena.clear();
-			splitUtteranceIntoPronuncList(segRef.Seg->TranscriptText, arena, words);
+			pronCodes.clear();
+			splitUtteranceIntoPronuncList(seg.TranscriptText, arena, pronCodes);
 
-			int& wordCounter = segRef.Phase == ResourceUsagePhase::Train ? wordCountTrain_ : wordCountTest_;
-			wordCounter += (int)words.size();
-		}
+			for (boost::wstring_view pronCode : pronCodes)
+			{
+				const PronunciationFlavour* pron = expandWellKnownPronCode(pronCode, true);
+				if (pron == nullptr)
+				{
+					pushErrorMsg(segErrMsg, toUtf8StdString(str(boost::wformat(L"Can't map pronCode %1% into phonelist") % pronCode)));
+					return false;
+				}
+				row.Words.push_back(toStdWString(pronCode));
+				row.Phones.insert(row.Phones.end(), pron->Phones.begin(), pron->Phones.end());
+			}
+			return true;
+		};
+		int phonesDim = phoneReg_.phonesCount() + 1; // phone ids start from 1
+		if (!buildSegmentStatIndex(phaseAssignedSegs.size(), phonesDim, threadsCount, segRowFun, segStatIndex_, errMsg))
+			return false;
+
+		computePhaseStat(segStatIndex_, threadsCount, segStatTrain_, segStatTest_);
+		utterCountTrain_ = segStatTrain_.UtterCount;
+		utterCountTest_ = segStatTest_.UtterCount;
+		wordCountTrain_ = segStatTrain_.WordCount;
+		wordCountTest_ = segStatTest_.WordCount;
+
+		std::vector<int> testOnlyPhoneIds;
+		findTestOnlyPhones(segStatTrain_, segStatTest_, testOnlyPhoneIds);
+		if (!testOnlyPhoneIds.empty())
+			std::wcout << L"Phones used in Test portion only: " << testOnlyPhoneIds.size() << std::endl; // warn
+
+		// the index is kept next to the generated model for later analysis
+		if (!saveSegmentStatIndex(segStatIndex_, indexFilePath, errMsg))
+			return false;
+		return true;
 	}
 
 	bool SphinxTrainDataBuilder::printDataStat(QDateTime genDate, const std::map<std::string, QVariant> speechModelConfig, const boost::filesystem::path& statFilePath, ErrMsgList* errMsg)
@@ -2274,6 +2510,25 @@ namespace PticaGovorun
 			double durSec = speakerIdToAudioDurSec_[speakerId];
 			outStream << QString("%1 %2").arg(toQString(speakerId)).arg(durSec / 3600, 0, 'f', TimePrec) << "\n";
 		}
+
+		// speech without padded silence, see segmentStats.bin
+		outStream << "\n#speakerId trainH testH (no padding)" << "\n";
+		for (size_t speakerInd = 0; speakerInd < segStatIndex_.SpeakerIds.size(); ++speakerInd)
+		{
+			outStream << QString("%1 %2 %3").arg(utf8ToQString(segStatIndex_.SpeakerIds[speakerInd]))
+				.arg(segStatTrain_.SpeakerDurSec[speakerInd] / 3600, 0, 'f', TimePrec)
+				.arg(segStatTest_.SpeakerDurSec[speakerInd] / 3600, 0, 'f', TimePrec) << "\n";
+		}
+
+		outStream << "\n#phone trainCount testCount" << "\n";
+		std::string phoneStr;
+		for (int phoneId = 1; phoneId < segStatIndex_.PhonesDim; ++phoneId)
+		{
+			phoneStr.clear();
+			if (!phoneToStr(phoneReg_, phoneId, phoneStr))
+				continue;
+			outStream << QString("%1 %2 %3").arg(QString::fromStdString(phoneStr)).arg(segStatTrain_.PhoneCounts[phoneId]).arg(segStatTest_.PhoneCounts[phoneId]) << "\n";
+		}
 		return true;
 	}
 
@@ -15,6 +15,7 @@
 #include "PhoneticService.h"
 #include "SpeechProcessing.h"
 #include "SpeechDataValidation.h"
+#include "SegmentStatIndex.h"
 
 namespace PticaGovorun
 {
@@ -108,7 +109,6 @@ namespace PticaGovorun
 	private:
 		boost::filesystem::path outFilePath(const boost::filesystem::path& relFilePath) const;
 		bool hasPhoneticExpansion(boost::wstring_view word, bool useBroken) const;
-		bool isBrokenUtterance(boost::wstring_view text) const;
 		const PronunciationFlavour* expandWellKnownPronCode(boost::wstring_view pronCode, bool useBrokenDict) const;
 		const PhoneticWord* findWellKnownWord(boost::wstring_view word, bool useBrokenDict) const;
 
@@ -127,11 +127,14 @@ namespace PticaGovorun
 			int* dictWordsCount = nullptr, int* phonesCount = nullptr, ErrMsgList* errMsg = nullptr);
 
 		//
-		void loadDeclinationDictionary(std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>>& declinedWordDict);
+		bool loadDeclinationDictionary(PackedDeclensionDictionary& declinedWordDict, ErrMsgList* errMsg);
 		bool phoneticSplitterBootstrapOnDeclinedWords(UkrainianPhoneticSplitter& phoneticSplitter, ErrMsgList* errMsg);
 		void phoneticSplitterCollectWordUsageInText(UkrainianPhoneticSplitter& phoneticSplitter, int maxFilesToProcess);
 		void phoneticSplitterRegisterWordsFromPhoneticDictionary(UkrainianPhoneticSplitter& phoneticSplitter);
-		bool phoneticSplitterLoad(UkrainianPhoneticSplitter& phoneticSplitter, int maxFilesToProcess, ErrMsgList* errMsg);
+
+		/// Collects word usage in the text corpus. snapshotFilePath = the file to save the collected usage to and
+		/// to load it from on the next run with the same inputs; empty to always parse the text corpus.
+		bool phoneticSplitterLoad(UkrainianPhoneticSplitter& phoneticSplitter, int maxFilesToProcess, const boost::filesystem::path& snapshotFilePath, ErrMsgList* errMsg);
 
 		// phonetic dict
 		void buildPhoneticDictionaryNew(const std::vector<PhoneticWord>& seedUnigrams, 
@@ -152,11 +155,9 @@ namespace PticaGovorun
 		//
 		bool loadAudioAnnotation(const boost::filesystem::path& wavRootDir, const boost::filesystem::path& annotRootDir, const boost::filesystem::path& wavDirToAnalyze,
 			bool removeSilenceAnnot, bool removeInterSpeechSilence, bool padSilStart, bool padSilEnd, float maxNoiseLevelDb, ErrMsgList* errMsg);
+		// Splits segments of each speaker into train and test portions and ensures that the test phoneset is a subset of train phoneset.
 		bool partitionTrainTestData(const std::vector<AnnotatedSpeechSegment>& segments, double trainCasesRatio, bool swapTrainTestData, bool useBrokenPronsInTrainOnly,
 			std::vector<AssignedPhaseAudioSegment>& outSegRefs, std::set<PhoneId>& trainPhoneIds, ErrMsgList* errMsg);
-
-		// Ensures that the test phoneset is a subset of train phoneset.
-		bool putSentencesWithRarePhonesInTrain(std::vector<AssignedPhaseAudioSegment>& segments, std::set<PhoneId>& trainPhoneIds, ErrMsgList* errMsg) const;
 		
 		void fixWavSegmentOutputPathes(const boost::filesystem::path& audioSrcRootDir,
 			const boost::filesystem::path& wavBaseOutDir,
@@ -170,9 +171,11 @@ namespace PticaGovorun
 			const boost::filesystem::path& transcriptionFilePath,
 			bool padSilStart, bool padSilEnd, ErrMsgList* errMsg);
 
-		bool buildWavSegments(const std::vector<AssignedPhaseAudioSegment>& segRefs, float targetSampleRate, bool padSilStart, bool padSilEnd, float minSilDurMs, boost::optional<VadImplKind> vadKind, ErrMsgList* errMsg);
+		/// outputFeatures=true to write MFCC features of output segments into <db>_train_feats.ark and <db>_test_feats.ark (with scp) in wav folder.
+		bool buildWavSegments(const std::vector<AssignedPhaseAudioSegment>& segRefs, float targetSampleRate, bool padSilStart, bool padSilEnd, float minSilDurMs, boost::optional<VadImplKind> vadKind, bool outputFeatures, ErrMsgList* errMsg);
 
-		void generateDataStat(const std::vector<AssignedPhaseAudioSegment>& phaseAssignedSegs);
+		// Builds the index of output segments, computes statistics on it and saves the index into indexFilePath.
+		bool generateDataStat(const std::vector<AssignedPhaseAudioSegment>& phaseAssignedSegs, const boost::filesystem::path& indexFilePath, ErrMsgList* errMsg);
 		
 		// Prints data statistics (speech segments, dictionaries).
 		bool printDataStat(QDateTime genDate, const std::map<std::string,QVariant> speechModelConfig, const boost::filesystem::path& statFilePath, ErrMsgList* errMsg);
@@ -210,6 +213,9 @@ namespace PticaGovorun
 		double audioDurationNoPaddingSecTrain_ = 0; // duration (in seconds) of speech only (no padded silence)
 		double audioDurationNoPaddingSecTest_ = 0;
 		std::map<std::wstring, double> speakerIdToAudioDurSec_;
+		SegmentStatIndex segStatIndex_;
+		SegmentPhaseStat segStatTrain_;
+		SegmentPhaseStat segStatTest_;
 	};
 
 	/// Writes phonetic dictionary to file.
@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <gsl/span>
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	/// Lock-free queue of items for exactly one producer thread and one consumer thread.
+	/// Read and write positions grow monotonically, so the consumer may skip everything written before some position.
+	template <typename T>
+	class SpscRingBuffer
+	{
+		std::vector<T> items_;
+		size_t mask_;
+		alignas(64) std::atomic<size_t> writePos_{ 0 }; // changed only by the producer
+		alignas(64) std::atomic<size_t> readPos_{ 0 }; // changed only by the consumer
+	public:
+		/// capacity must be a power of two.
+		explicit SpscRingBuffer(size_t capacity)
+			: items_(capacity),
+			mask_(capacity - 1)
+		{
+			PG_Assert2(capacity > 0 && (capacity & mask_) == 0, "Capacity must be a power of two");
+		}
+		SpscRingBuffer(const SpscRingBuffer&) = delete;
+		SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+		size_t capacity() const { return items_.size(); }
+
+		// producer
+
+		size_t writePosition() const { return writePos_.load(std::memory_order_relaxed); }
+
+		size_t writeAvailable() const
+		{
+			return capacity() - (writePos_.load(std::memory_order_relaxed) - readPos_.load(std::memory_order_acquire));
+		}
+
+		/// Appends as many items as there is free space for. Returns the number of written items.
+		size_t write(gsl::span<const T> items)
+		{
+			size_t writePos = writePos_.load(std::memory_order_relaxed);
+			size_t count = std::min<size_t>(items.size(), capacity() - (writePos - readPos_.load(std::memory_order_acquire)));
+			for (size_t i = 0; i < count; ++i)
+				items_[(writePos + i) & mask_] = items[i];
+			writePos_.store(writePos + count, std::memory_order_release);
+			return count;
+		}
+
+		// consumer
+
+		size_t readPosition() const { return readPos_.load(std::memory_order_relaxed); }
+
+		size_t readAvailable() const
+		{
+			return writePos_.load(std::memory_order_acquire) - readPos_.load(std::memory_order_relaxed);
+		}
+
+		/// Takes up to items.size() items. Returns the number of read items.
+		size_t read(gsl::span<T> items)
+		{
+			size_t readPos = readPos_.load(std::memory_order_relaxed);
+			size_t count = std::min<size_t>(items.size(), writePos_.load(std::memory_order_acquire) - readPos);
+			for (size_t i = 0; i < count; ++i)
+				items[i] = items_[(readPos + i) & mask_];
+			readPos_.store(readPos + count, std::memory_order_release);
+			return count;
+		}
+
+		/// Discards the items before given position. The position must not exceed the position of the producer.
+		void skipTo(size_t pos)
+		{
+			size_t readPos = readPos_.load(std::memory_order_relaxed);
+			if (pos > readPos)
+			{
+				PG_DbgAssert(pos <= writePos_.load(std::memory_order_acquire));
+				readPos_.store(pos, std::memory_order_release);
+			}
+		}
+	};
+}
@@ -1,6 +1,9 @@
 #include <vector>
 #include <array>
 #include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
 #include <boost/optional.hpp>
 #include "ClnUtils.h"
 #include "assertImpl.h"
@@ -309,6 +312,271 @@ namespace PticaGovorun
 		return result;
 	}
 
+	// Computes Levenshtein distance (unit costs of insert, remove and substitute) with Myers/Hyyro bit-parallel algorithm.
+	// Each column of the distance matrix is processed as a bit vector, so the work is O(ceil(m/64)*n).
+	// The letters must be comparable with operator<.
+	template <typename Letter>
+	size_t editDistanceBitParallel(wv::slice<Letter> first, wv::slice<Letter> second)
+	{
+		typedef std::uint64_t Word;
+		const size_t WordBits = 64;
+
+		// the pattern (vertical) is the shorter sequence
+		wv::slice<Letter> pattern = first.size() <= second.size() ? first : second;
+		wv::slice<Letter> text = first.size() <= second.size() ? second : first;
+		size_t m = pattern.size();
+		if (m == 0)
+			return text.size();
+
+		// distinct letters of the pattern
+		std::vector<Letter> alphabet(pattern.begin(), pattern.end());
+		std::sort(alphabet.begin(), alphabet.end());
+		alphabet.erase(std::unique(alphabet.begin(), alphabet.end(), [](const Letter& a, const Letter& b) { return !(a < b) && !(b < a); }), alphabet.end());
+
+		auto letterInd = [&alphabet](const Letter& x) -> size_t
+		{
+			auto it = std::lower_bound(alphabet.begin(), alphabet.end(), x);
+			if (it == alphabet.end() || x < *it)
+				return alphabet.size(); // the letter is not in the pattern
+			return std::distance(alphabet.begin(), it);
+		};
+
+		// Peq[letter][block] has bits set for pattern positions which match the letter
+		size_t blocksCount = (m + WordBits - 1) / WordBits;
+		std::vector<Word> peq((alphabet.size() + 1) * blocksCount, 0); // +1 for the letters absent in the pattern
+		for (size_t i = 0; i < m; ++i)
+			peq[letterInd(pattern[i]) * blocksCount + i / WordBits] |= Word(1) << (i % WordBits);
+
+		std::vector<Word> pv(blocksCount, ~Word(0));
+		std::vector<Word> mv(blocksCount, 0);
+		Word lastRowMask = Word(1) << ((m - 1) % WordBits);
+
+		size_t score = m;
+		for (const Letter& x : text)
+		{
+			const Word* eqBlocks = &peq[letterInd(x) * blocksCount];
+			int hin = 1; // the top row of the matrix grows by one in each column
+			for (size_t b = 0; b < blocksCount; ++b)
+			{
+				Word eq = eqBlocks[b];
+				Word p = pv[b];
+				Word n = mv[b];
+				Word hinIsNeg = hin < 0 ? 1 : 0;
+
+				Word xv = eq | n;
+				eq |= hinIsNeg;
+				Word xh = (((eq & p) + p) ^ p) | eq;
+				Word ph = n | ~(xh | p);
+				Word mh = p & xh;
+
+				Word highBit = b + 1 == blocksCount ? lastRowMask : (Word(1) << (WordBits - 1));
+				int hout = (ph & highBit) ? 1 : ((mh & highBit) ? -1 : 0);
+
+				ph <<= 1;
+				mh <<= 1;
+				mh |= hinIsNeg;
+				ph |= hin > 0 ? 1 : 0;
+				pv[b] = mh | ~(xv | ph);
+				mv[b] = ph & xv;
+				hin = hout;
+			}
+			score += hin; // the horizontal delta of the bottom row
+		}
+		return score;
+	}
+
+	// Computes edit distance in the diagonal band of the distance matrix (Ukkonen's cut-off).
+	// Returns false as soon as it is known that distance exceeds maxCost.
+	// Assumes that the cost of insertion and removal is at least one, so that the band of
+	// half-width maxCost contains all paths with cost<=maxCost.
+	template <typename Letter, typename EditCosts>
+	bool findEditDistanceBanded(wv::slice<Letter> first, wv::slice<Letter> second, const EditCosts& editCosts,
+		typename EditCosts::CostType maxCost, typename EditCosts::CostType& distance)
+	{
+		typedef typename EditCosts::CostType CostType;
+		const CostType Inf = std::numeric_limits<CostType>::max() / 2;
+
+		size_t sizeFirst = first.size();
+		size_t sizeSecond = second.size();
+		if (maxCost < 0)
+			return false;
+		size_t band = static_cast<size_t>(maxCost);
+		size_t sizeDiff = sizeFirst > sizeSecond ? sizeFirst - sizeSecond : sizeSecond - sizeFirst;
+		if (sizeDiff > band)
+			return false;
+
+		// rows are the prefixes of the second sequence, columns are the prefixes of the first sequence
+		std::vector<CostType> prevRow(sizeFirst + 1, Inf);
+		std::vector<CostType> curRow(sizeFirst + 1, Inf);
+
+		prevRow[0] = EditCosts::getZeroCosts();
+		for (size_t firstInd = 1; firstInd <= std::min(sizeFirst, band); ++firstInd)
+			prevRow[firstInd] = prevRow[firstInd - 1] + editCosts.getRemoveSymbolCost(first[firstInd - 1]);
+
+		for (size_t secondInd = 1; secondInd <= sizeSecond; ++secondInd)
+		{
+			size_t colFrom = secondInd > band ? secondInd - band : 0;
+			size_t colTo = std::min(sizeFirst, secondInd + band);
+
+			// the cell to the left of the band
+			if (colFrom > 0)
+				curRow[colFrom - 1] = Inf;
+
+			CostType rowMin = Inf;
+			for (size_t firstInd = colFrom; firstInd <= colTo; ++firstInd)
+			{
+				CostType cost = prevRow[firstInd] + editCosts.getInsertSymbolCost(second[secondInd - 1]);
+				if (firstInd > 0)
+				{
+					cost = std::min(cost, curRow[firstInd - 1] + editCosts.getRemoveSymbolCost(first[firstInd - 1]));
+					cost = std::min(cost, prevRow[firstInd - 1] + editCosts.getSubstituteSymbolCost(first[firstInd - 1], second[secondInd - 1]));
+				}
+				cost = std::min(cost, Inf);
+				curRow[firstInd] = cost;
+				rowMin = std::min(rowMin, cost);
+			}
+			if (colTo < sizeFirst)
+				curRow[colTo + 1] = Inf; // the cell to the right of the band
+
+			if (rowMin > maxCost) // all paths through this row are too expensive
+				return false;
+			std::swap(prevRow, curRow);
+		}
+
+		if (prevRow[sizeFirst] > maxCost)
+			return false;
+		distance = prevRow[sizeFirst];
+		return true;
+	}
+
+	namespace details
+	{
+		// Computes the costs to transform the first sequence into each prefix of the second sequence, using two rows of memory.
+		// reversed=true processes both sequences from the end, so the costs are for suffixes.
+		template <typename Letter, typename EditCosts>
+		void editDistanceLastRow(wv::slice<Letter> first, wv::slice<Letter> second, bool reversed, const EditCosts& editCosts,
+			std::vector<typename EditCosts::CostType>& row, std::vector<typename EditCosts::CostType>& rowBuff)
+		{
+			size_t sizeFirst = first.size();
+			size_t sizeSecond = second.size();
+			auto firstAt = [&](size_t i) -> const Letter& { return reversed ? first[sizeFirst - 1 - i] : first[i]; };
+			auto secondAt = [&](size_t j) -> const Letter& { return reversed ? second[sizeSecond - 1 - j] : second[j]; };
+
+			row.resize(sizeSecond + 1);
+			rowBuff.resize(sizeSecond + 1);
+			row[0] = EditCosts::getZeroCosts();
+			for (size_t j = 1; j <= sizeSecond; ++j)
+				row[j] = row[j - 1] + editCosts.getInsertSymbolCost(secondAt(j - 1));
+
+			for (size_t i = 1; i <= sizeFirst; ++i)
+			{
+				const Letter& a = firstAt(i - 1);
+				rowBuff[0] = row[0] + editCosts.getRemoveSymbolCost(a);
+				for (size_t j = 1; j <= sizeSecond; ++j)
+				{
+					const Letter& b = secondAt(j - 1);
+					auto removeCost = row[j] + editCosts.getRemoveSymbolCost(a);
+					auto insertCost = rowBuff[j - 1] + editCosts.getInsertSymbolCost(b);
+					auto substCost = row[j - 1] + editCosts.getSubstituteSymbolCost(a, b);
+					rowBuff[j] = std::min(std::min(removeCost, insertCost), substCost);
+				}
+				std::swap(row, rowBuff);
+			}
+		}
+
+		template <typename Letter, typename EditCosts>
+		void hirschbergRec(wv::slice<Letter> first, wv::slice<Letter> second, size_t firstOffset, size_t secondOffset,
+			const EditCosts& editCosts, EditDistance<Letter, EditCosts>& smallEditDist,
+			std::vector<typename EditCosts::CostType>& rowLeft, std::vector<typename EditCosts::CostType>& rowRight,
+			std::vector<typename EditCosts::CostType>& rowBuff, std::vector<EditStep>& smallRecipe,
+			std::vector<EditStep>& recipe)
+		{
+			const size_t FullMatrixMaxCells = 4096;
+
+			size_t sizeFirst = first.size();
+			size_t sizeSecond = second.size();
+			if (sizeFirst <= 1 || sizeSecond <= 1 || (sizeFirst + 1) * (sizeSecond + 1) <= FullMatrixMaxCells)
+			{
+				// the small problem is solved with full matrix
+				// the recipe of subproblem is validated against the subproblem's sequences, hence it is built separately
+				smallRecipe.clear();
+				smallEditDist.estimateAllDistances(first, second, editCosts);
+				smallEditDist.minCostRecipe(smallRecipe);
+				for (EditStep step : smallRecipe)
+				{
+					if (step.Change == StringEditOp::RemoveOp)
+						step.Remove.FirstRemoveInd += firstOffset;
+					else if (step.Change == StringEditOp::InsertOp)
+					{
+						step.Insert.FirstInsertInd += firstOffset;
+						step.Insert.SecondSourceInd += secondOffset;
+					}
+					else if (step.Change == StringEditOp::SubstituteOp)
+					{
+						step.Substitute.FirstInd += firstOffset;
+						step.Substitute.SecondInd += secondOffset;
+					}
+					recipe.push_back(step);
+				}
+				return;
+			}
+
+			// split the first sequence in halves and find where the optimal path crosses the middle
+			size_t firstMid = sizeFirst / 2;
+			wv::slice<Letter> firstLeft = wv::make_view(first.data(), firstMid);
+			wv::slice<Letter> firstRight = wv::make_view(first.data() + firstMid, sizeFirst - firstMid);
+			editDistanceLastRow(firstLeft, second, false, editCosts, rowLeft, rowBuff);
+			editDistanceLastRow(firstRight, second, true, editCosts, rowRight, rowBuff);
+
+			size_t secondMid = 0;
+			auto bestCost = rowLeft[0] + rowRight[sizeSecond];
+			for (size_t j = 1; j <= sizeSecond; ++j)
+			{
+				auto cost = rowLeft[j] + rowRight[sizeSecond - j];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					secondMid = j;
+				}
+			}
+
+			// the recipe is constructed from the end, as EditDistance::minCostRecipe does
+			wv::slice<Letter> secondLeft = wv::make_view(second.data(), secondMid);
+			wv::slice<Letter> secondRight = wv::make_view(second.data() + secondMid, sizeSecond - secondMid);
+			hirschbergRec(firstRight, secondRight, firstOffset + firstMid, secondOffset + secondMid, editCosts, smallEditDist, rowLeft, rowRight, rowBuff, smallRecipe, recipe);
+			hirschbergRec(firstLeft, secondLeft, firstOffset, secondOffset, editCosts, smallEditDist, rowLeft, rowRight, rowBuff, smallRecipe, recipe);
+		}
+	}
+
+	// Finds min cost edit recipe with Hirschberg's divide and conquer algorithm in linear memory.
+	// The recipe has the same layout as the one from EditDistance::minCostRecipe, but may differ from it
+	// when multiple recipes have the same min cost.
+	// Returns the cost of the recipe.
+	template <typename Letter, typename EditCosts>
+	typename EditCosts::CostType minCostRecipeHirschberg(wv::slice<Letter> first, wv::slice<Letter> second, const EditCosts& editCosts, std::vector<EditStep>& recipe)
+	{
+		typedef typename EditCosts::CostType CostType;
+
+		EditDistance<Letter, EditCosts> smallEditDist;
+		std::vector<CostType> rowLeft;
+		std::vector<CostType> rowRight;
+		std::vector<CostType> rowBuff;
+		std::vector<EditStep> smallRecipe;
+		details::hirschbergRec(first, second, 0, 0, editCosts, smallEditDist, rowLeft, rowRight, rowBuff, smallRecipe, recipe);
+
+		CostType cost = EditCosts::getZeroCosts();
+		for (const EditStep& step : recipe)
+		{
+			if (step.Change == StringEditOp::RemoveOp)
+				cost += editCosts.getRemoveSymbolCost(first[step.Remove.FirstRemoveInd]);
+			else if (step.Change == StringEditOp::InsertOp)
+				cost += editCosts.getInsertSymbolCost(second[step.Insert.SecondSourceInd]);
+			else if (step.Change == StringEditOp::SubstituteOp)
+				cost += editCosts.getSubstituteSymbolCost(first[step.Substitute.FirstInd], second[step.Substitute.SecondInd]);
+		}
+		return cost;
+	}
+
 	// Aligns two sequences of symbols. The function to convert symbol to string is given. Two string representations of symbols are separated
 	// with sepcified char. If text representation of two symbols have different size, then the shorter one is padded with 'padChar'.
 	template <typename Symbol, typename TextChar>
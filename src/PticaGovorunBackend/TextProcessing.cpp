@@ -1,5 +1,8 @@
 ﻿#include "TextProcessing.h"
 #include "assertImpl.h"
+#include "PackedDeclensionDictionary.h"
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <QChar>
 #include <cwchar>
@@ -8,45 +11,17 @@
 
 namespace PticaGovorun
 {
-	void TextParser::setInputText(boost::wstring_view text)
-	{
-		text_ = text;
-		curCharInd_ = 0;
-	}
-
-	void TextParser::setTextRunDest(std::vector<RawTextRun>* textRunDest)
-	{
-		textRunDest_ = textRunDest;
-	}
-
-	bool TextParser::parseTokensTillDot(std::vector<RawTextRun>& tokens)
+	namespace
 	{
-		PG_Assert2(curCharInd_ != -1, "Text buffer to read was not initialized. Call setInputText");
-		textRunDest_ = &tokens;
-
-		// entire buffer is processed, no sentences left
-		if (curCharInd_ >= text_.size())
-			return false;
-
-		textRunStartInd_ = -1; // start of new word in input stream of characters
-		//outCharInd_ = -1; // the chars are processed without any shifts
-		//gotApostrophe_ = false;
-		//gotHyphen_ = false;
-
-		for (; curCharInd_ < text_.size();)
+		TextRunType classifyTextRunChar(wchar_t ch)
 		{
-			wchar_t chw = text_[curCharInd_];
-			switch (chw)
+			switch (ch)
 			{
 			case L'.': // dot is the end of a sentence or the indicator of an abbreviation; the caller must decide
 			case L'?':
 			case L'!':
 			case L'…': // horizontal ellipsis code=8230
-				{
-					finishTextRunIfStarted();
-					createSingleCharRun(TextRunType::PunctuationStopSentence);
-					return true;
-				}
+				return TextRunType::PunctuationStopSentence;
 			case L'_': // dec=31  us information separator one (underscore)
 			case L'\"': // dec=34 quotation mark
 			case L'#': // dec=35 number sign
@@ -90,9 +65,7 @@ namespace PticaGovorun
 			case L'\'': // apostrophe dec=39
 			case L'’': // right single quotation mark dec=8217
 			case L'`': // grave accent (on the tilde key) dec=96
-				finishTextRunIfStarted();
-				createSingleCharRun(TextRunType::Punctuation);
-				break;
+				return TextRunType::Punctuation;
 				//case L'¬': // not sign (optional hyphen)
 				//	// the word should be merged, as if this mark doesn't exist
 				//	if (isWordStarted()) // if the word already started
@@ -130,9 +103,7 @@ namespace PticaGovorun
 			case L'\n':
 			case L' ': // space
 			case L' ': // dec=160 no-break space (weird case after long hyphen, not a space)
-				continueRun(TextRunType::Whitespace);
-				curCharInd_ += 1;
-				break;
+				return TextRunType::Whitespace;
 
 			case L'0':
 			case L'1':
@@ -144,17 +115,151 @@ namespace PticaGovorun
 			case L'7':
 			case L'8':
 			case L'9':
-				continueRun(TextRunType::Digit);
-				curCharInd_ += 1;
-				break;
+				return TextRunType::Digit;
 			default:
 				// alphabetical character
-				continueRun(TextRunType::Alpha);
-				curCharInd_ += 1;
-				break;
+				return TextRunType::Alpha;
 			} // switch char
 		}
 
+		// Basic Latin, Latin-1 Supplement and Cyrillic; other chars are classified on each call
+		const int CharClassTableSize = 0x0500;
+
+		std::uint16_t textRunTypeBits(TextRunType runType)
+		{
+			switch (runType)
+			{
+			case TextRunType::Digit: return CharClassDigit;
+			case TextRunType::Whitespace: return CharClassWhitespace;
+			case TextRunType::Punctuation: return CharClassPunctuation;
+			case TextRunType::PunctuationStopSentence: return CharClassPunctuationStopSentence;
+			default: return 0;
+			}
+		}
+
+		std::uint16_t computeCharClassMask(wchar_t ch)
+		{
+			std::uint16_t mask = textRunTypeBits(classifyTextRunChar(ch));
+			if (isDigitChar(ch)) mask |= CharClassDigit;
+			if (isRomanNumeral(ch)) mask |= CharClassRomanNumeral;
+			if (isEnglishChar(ch)) mask |= CharClassEnglish;
+			if (isExclusiveEnglishChar(ch)) mask |= CharClassExclusiveEnglish;
+			if (isRussianChar(ch)) mask |= CharClassRussian;
+			if (isExclusiveRussianChar(ch)) mask |= CharClassExclusiveRussian;
+			if (isUkrainianVowel(ch)) mask |= CharClassUkrainianVowel;
+			if (isUkrainianConsonant(ch)) mask |= CharClassUkrainianConsonant;
+			if (ch == L'-' || ch == L'\'') mask |= CharClassHyphen;
+			return mask;
+		}
+
+		std::array<std::uint16_t, CharClassTableSize> buildCharClassTable()
+		{
+			std::array<std::uint16_t, CharClassTableSize> table;
+			for (int i = 0; i < CharClassTableSize; ++i)
+				table[i] = computeCharClassMask((wchar_t)i);
+			return table;
+		}
+
+		const std::array<std::uint16_t, CharClassTableSize> CharClassTable = buildCharClassTable();
+
+		inline std::uint16_t lookupCharClassMask(wchar_t ch)
+		{
+			if ((std::uint32_t)ch < (std::uint32_t)CharClassTableSize)
+				return CharClassTable[ch];
+			return computeCharClassMask(ch);
+		}
+
+		inline TextRunType textRunTypeFromMask(std::uint16_t mask)
+		{
+			if (mask & CharClassPunctuationStopSentence) return TextRunType::PunctuationStopSentence;
+			if (mask & CharClassPunctuation) return TextRunType::Punctuation;
+			if (mask & CharClassWhitespace) return TextRunType::Whitespace;
+			if (mask & CharClassDigit) return TextRunType::Digit;
+			return TextRunType::Alpha;
+		}
+	}
+
+	std::uint16_t charClassMask(wchar_t ch)
+	{
+		return lookupCharClassMask(ch);
+	}
+
+	TextRunType textRunType(wchar_t ch)
+	{
+		return textRunTypeFromMask(lookupCharClassMask(ch));
+	}
+
+	TextRunType textRunTypeNoTable(wchar_t ch)
+	{
+		return classifyTextRunChar(ch);
+	}
+
+	size_t findTextRunEnd(boost::wstring_view text, size_t runStart)
+	{
+		PG_DbgAssert(runStart < text.size());
+		const wchar_t* begin = text.data();
+		const wchar_t* end = begin + text.size();
+		const wchar_t* it = begin + runStart;
+
+		TextRunType runType = textRunType(*it);
+		++it;
+		if (runType == TextRunType::Punctuation || runType == TextRunType::PunctuationStopSentence)
+			return it - begin;
+
+		for (; it != end; ++it)
+		{
+			if (textRunType(*it) != runType)
+				break;
+		}
+		return it - begin;
+	}
+
+	void TextParser::setInputText(boost::wstring_view text)
+	{
+		text_ = text;
+		curCharInd_ = 0;
+	}
+
+	void TextParser::setTextRunDest(std::vector<RawTextRun>* textRunDest)
+	{
+		textRunDest_ = textRunDest;
+	}
+
+	bool TextParser::parseTokensTillDot(std::vector<RawTextRun>& tokens)
+	{
+		PG_Assert2(curCharInd_ != -1, "Text buffer to read was not initialized. Call setInputText");
+		textRunDest_ = &tokens;
+
+		// entire buffer is processed, no sentences left
+		if (curCharInd_ >= text_.size())
+			return false;
+
+		textRunStartInd_ = -1; // start of new word in input stream of characters
+		//outCharInd_ = -1; // the chars are processed without any shifts
+		//gotApostrophe_ = false;
+		//gotHyphen_ = false;
+
+		for (; curCharInd_ < text_.size();)
+		{
+			TextRunType runType = textRunType(text_[curCharInd_]);
+			switch (runType)
+			{
+			case TextRunType::PunctuationStopSentence: // dot is the end of a sentence or the indicator of an abbreviation; the caller must decide
+				finishTextRunIfStarted();
+				createSingleCharRun(runType);
+				return true;
+			case TextRunType::Punctuation:
+				finishTextRunIfStarted();
+				createSingleCharRun(runType);
+				break;
+			default:
+				// the whole run of letters, digits or whitespace is consumed at once
+				continueRun(runType);
+				curCharInd_ = (int)findTextRunEnd(text_, curCharInd_);
+				break;
+			}
+		}
+
 		// finish the last word
 		finishTextRunIfStarted();
 
@@ -669,8 +774,9 @@ namespace PticaGovorun
 
 	boost::optional<CharGroup> classifyUkrainianChar(wchar_t ch)
 	{
-		bool isVowel = isUkrainianVowel(ch);
-		bool isCons = isUkrainianConsonant(ch);
+		std::uint16_t charClass = charClassMask(ch);
+		bool isVowel = (charClass & CharClassUkrainianVowel) != 0;
+		bool isCons = (charClass & CharClassUkrainianConsonant) != 0;
 		if (isVowel && !isCons)
 			return CharGroup::Vowel;
 		else if (!isVowel && isCons)
@@ -691,37 +797,54 @@ namespace PticaGovorun
 		lexemes_ = &lexemes;
 		for (; curLexInd_ < (int)lexemes_->size();)
 		{
-			bool anyRuleWasApplied = false;
-			auto tryRule = [this, &anyRuleWasApplied](decltype(&AbbreviationExpanderUkr::ruleTemplate) ruleFun) -> void
-				{
-					if (anyRuleWasApplied)
-						return;
-					anyRuleWasApplied = (this ->* ruleFun)();
-				};
-
-			// do not require context
-			tryRule(&AbbreviationExpanderUkr::ruleUnifyHyphen);
-			tryRule(&AbbreviationExpanderUkr::ruleUpgradeNumberToWords);
-
-			// require close context (left, right lexeme)
-			tryRule(&AbbreviationExpanderUkr::ruleRepairWordSplitByOptionalHyphen);
-			tryRule(&AbbreviationExpanderUkr::ruleComposeWordWithApostropheInside);
-
-			// require wide context (slower)
-			tryRule(&AbbreviationExpanderUkr::ruleExpandRomanNumber);
-			tryRule(&AbbreviationExpanderUkr::ruleNumberDiapasonAndEnding);
-			tryRule(&AbbreviationExpanderUkr::ruleNumberRokyRoku);
-			tryRule(&AbbreviationExpanderUkr::ruleNumberStolittya);
-			tryRule(&AbbreviationExpanderUkr::ruleSignNAndNumber);
-			tryRule(&AbbreviationExpanderUkr::ruleDayMonthYear);
-
-			if (!anyRuleWasApplied)
+			if (!applyRule())
 				curLexInd_ += 1;
 		}
 		lexemes_ = nullptr;
 		curLexInd_ = -1;
 	}
 
+	bool AbbreviationExpanderUkr::applyRule()
+	{
+		// the rules are tried in the order of priority, but a rule is called only if the current lexeme
+		// may start its pattern; most lexemes are ordinary words and are skipped without calling any rule
+		const RawTextLexeme& lex = curLex();
+		boost::wstring_view str = lex.ValueStr;
+		wchar_t firstChar = str.front();
+		bool isNumeral = lex.Class == PartOfSpeech::Numeral;
+		bool hasNumeralContext = lex.NumeralCardOrd != boost::none && lex.Case != boost::none;
+		TextRunType runType = lex.RunType;
+
+		// do not require context
+		if (firstChar == L'—' && ruleUnifyHyphen())
+			return true;
+		if (hasNumeralContext && ruleUpgradeNumberToWords())
+			return true;
+
+		// require close context (left, right lexeme)
+		if (firstChar == L'¬' && ruleRepairWordSplitByOptionalHyphen())
+			return true;
+		if (isApostrophe(firstChar) && ruleComposeWordWithApostropheInside())
+			return true;
+
+		// require wide context (slower)
+		if (isNumeral && ruleExpandRomanNumber())
+			return true;
+		if (runType == TextRunType::Digit && ruleNumberDiapasonAndEnding())
+			return true;
+		if (str == L"рр" && ruleNumberRokyRoku())
+			return true;
+		if (str == L"р" && ruleNumberRoku())
+			return true;
+		if (str == L"ст" && ruleNumberStolittya())
+			return true;
+		if (str == L"№" && ruleSignNAndNumber())
+			return true;
+		if (isNumeral && ruleDayMonthYear())
+			return true;
+		return false;
+	}
+
 	RawTextLexeme& AbbreviationExpanderUkr::curLex()
 	{
 		return nextLex(0);
@@ -828,9 +951,11 @@ namespace PticaGovorun
 
 	IntegerToUaWordConverter::IntegerToUaWordConverter()
 	{
-		declinedWords_ = std::make_unique<std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>>>();
+		declinedWords_ = std::make_unique<PackedDeclensionDictionary>();
 	}
 
+	IntegerToUaWordConverter::~IntegerToUaWordConverter() = default;
+
 	bool IntegerToUaWordConverter::load(const boost::filesystem::path& declensionDictPath, std::wstring* errMsg)
 	{
 		// base numbers
@@ -887,57 +1012,143 @@ namespace PticaGovorun
 		std::copy(std::begin(zeroWordsArray), std::end(zeroWordsArray), std::back_inserter(zerosWords_));
 
 		//
-		return loadUkrainianWordDeclensionXml(declensionDictPath.wstring(), *declinedWords_, errMsg);
+		std::array<boost::filesystem::path, 1> xmlDictPaths = { declensionDictPath };
+		boost::filesystem::path packedDictPath = declensionDictPath;
+		packedDictPath += ".packed";
+		ErrMsgList loadErrMsg;
+		if (!loadPackedDeclensionDictionary(xmlDictPaths, packedDictPath, *declinedWords_, &loadErrMsg))
+		{
+			*errMsg = combineErrorMessages(loadErrMsg).toStdWString();
+			return false;
+		}
+
+		buildNumeralFormTable(baseNumbers_, baseNumberForms_);
+		buildNumeralFormTable(zerosWords_, zerosWordForms_);
+		return true;
 	}
 
-	//
-	void IntegerToUaWordConverter::convertBaseNumber(gsl::span<const BaseNumToWordMap> numInfos, int baseNum, NumeralCardinality cardOrd, WordCase wordCase, 
-		boost::optional<EntityMultiplicity> mult, boost::optional<WordGender> gender, bool compoundNumeral, std::vector<RawTextLexeme>& lexemes)
+	namespace
 	{
-		auto numInfoIt = std::find_if(std::begin(numInfos), std::end(numInfos), [baseNum](auto& x) { return x.Num == baseNum; });
-		PG_Assert(numInfoIt != std::end(numInfos));
+		const int NumeralCardinalityCount = 2;
+		const int NumeralCaseCount = 7;
+		const int NumeralGenderCount = 4; // none, masculine, feminine, neuter
+		const int NumeralMultiplicityCount = 3; // none, singular, plural
+		const int NumeralFormsPerRow = NumeralCardinalityCount * NumeralCaseCount * NumeralGenderCount * NumeralMultiplicityCount;
 
-		const BaseNumToWordMap& numInfo = *numInfoIt;
-		boost::wstring_view numName = cardOrd == NumeralCardinality::Cardinal ? numInfo.NumCardinal : numInfo.NumOrdinal;
+		/// The index of a declined form in NumeralFormTable. The absent gender or multiplicity has index zero.
+		int numeralFormInd(int row, NumeralCardinality cardOrd, WordCase wordCase, boost::optional<WordGender> gender, boost::optional<EntityMultiplicity> mult)
+		{
+			int genderInd = gender != boost::none ? 1 + static_cast<int>(gender.value()) : 0;
+			int multInd = mult != boost::none ? 1 + static_cast<int>(mult.value()) : 0;
+			int ind = row;
+			ind = ind * NumeralCardinalityCount + static_cast<int>(cardOrd);
+			ind = ind * NumeralCaseCount + static_cast<int>(wordCase);
+			ind = ind * NumeralGenderCount + genderInd;
+			ind = ind * NumeralMultiplicityCount + multInd;
+			return ind;
+		}
+	}
 
-		auto numIt = declinedWords_->find(std::wstring(numName.data()));
-		PG_Assert(numIt != std::end(*declinedWords_));
+	void IntegerToUaWordConverter::buildNumeralFormTable(gsl::span<const BaseNumToWordMap> numInfos, NumeralFormTable& table) const
+	{
+		ptrdiff_t maxNum = 0;
+		for (const BaseNumToWordMap& numInfo : numInfos)
+			maxNum = std::max(maxNum, numInfo.Num);
+		table.NumToRow.assign(maxNum + 1, -1);
+		table.Forms.assign(numInfos.size() * NumeralFormsPerRow, NumeralForm());
 
-		auto matchForm = [=](const WordDeclensionForm& form) -> bool
+		std::vector<boost::optional<WordGender>> genders = { boost::none, WordGender::Masculine, WordGender::Feminine, WordGender::Neuter };
+		std::vector<boost::optional<EntityMultiplicity>> mults = { boost::none, EntityMultiplicity::Singular, EntityMultiplicity::Plural };
+		std::vector<std::pair<const PackedDeclensionForm*, WordDeclensionForm>> groupForms;
+		for (int row = 0; row < (int)numInfos.size(); ++row)
 		{
-			if (form.Case != boost::none && form.Case != wordCase)
-				return false;
-			if (form.Gender != boost::none && form.Gender != gender)
-				return false;
-			if (form.Multiplicity != boost::none && form.Multiplicity != mult)
-				return false;
-			return true;
-		};
+			const BaseNumToWordMap& numInfo = numInfos[row];
+			table.NumToRow[numInfo.Num] = row;
 
-		const std::unique_ptr<WordDeclensionGroup>& group = numIt->second;
-		std::vector<const WordDeclensionForm*> forms;
-		for (const WordDeclensionForm& form : group->Forms)
-		{
-			if (matchForm(form))
-				forms.push_back(&form);
+			for (NumeralCardinality cardOrd : { NumeralCardinality::Cardinal, NumeralCardinality::Ordinal })
+			{
+				boost::wstring_view numName = cardOrd == NumeralCardinality::Cardinal ? numInfo.NumCardinal : numInfo.NumOrdinal;
+				const PackedDeclensionGroup* group = numName.empty() ? nullptr : declinedWords_->findGroup(numName);
+
+				groupForms.clear();
+				if (group != nullptr)
+				{
+					for (const PackedDeclensionForm& packedForm : declinedWords_->forms(*group))
+					{
+						WordDeclensionForm form;
+						unpackFormTags(packedForm.Tags, form);
+						groupForms.push_back(std::make_pair(&packedForm, form));
+					}
+				}
+
+				for (int caseInd = 0; caseInd < NumeralCaseCount; ++caseInd)
+				{
+					WordCase wordCase = static_cast<WordCase>(caseInd);
+					for (const boost::optional<WordGender>& gender : genders)
+					{
+						for (const boost::optional<EntityMultiplicity>& mult : mults)
+						{
+							NumeralForm& numForm = table.Forms[numeralFormInd(row, cardOrd, wordCase, gender, mult)];
+							if (group == nullptr)
+							{
+								numForm.MatchedFormsCount = -1;
+								continue;
+							}
+
+							for (const auto& packedAndForm : groupForms)
+							{
+								const WordDeclensionForm& form = packedAndForm.second;
+								if (form.Case != boost::none && form.Case != wordCase)
+									continue;
+								if (form.Gender != boost::none && form.Gender != gender)
+									continue;
+								if (form.Multiplicity != boost::none && form.Multiplicity != mult)
+									continue;
+
+								numForm.MatchedFormsCount += 1;
+								if (numForm.MatchedFormsCount > 1)
+									continue;
+
+								// trim alternative cases "п'ятдесяти,п'ятдесятьох"
+								boost::wstring_view numStr = declinedWords_->name(*packedAndForm.first);
+								auto commaPos = numStr.find(L',');
+								if (commaPos != boost::wstring_view::npos)
+									numStr = numStr.substr(0, commaPos);
+
+								numForm.Name = numStr;
+								numForm.Case = form.Case;
+								numForm.Gender = form.Gender;
+								numForm.Multiplicity = form.Multiplicity;
+							}
+						}
+					}
+				}
+			}
 		}
+	}
+
+	//
+	void IntegerToUaWordConverter::convertBaseNumber(const NumeralFormTable& numForms, int baseNum, NumeralCardinality cardOrd, WordCase wordCase, 
+		boost::optional<EntityMultiplicity> mult, boost::optional<WordGender> gender, bool compoundNumeral, std::vector<RawTextLexeme>& lexemes)
+	{
+		PG_Assert(baseNum >= 0 && baseNum < (int)numForms.NumToRow.size());
+		int row = numForms.NumToRow[baseNum];
+		PG_Assert(row != -1);
+
+		const NumeralForm& form = numForms.Forms[numeralFormInd(row, cardOrd, wordCase, gender, mult)];
+		PG_Assert(form.MatchedFormsCount != -1);
 
-		bool unique = forms.size() == 1;
+		bool unique = form.MatchedFormsCount == 1;
 		auto errMsg = [=]() { return QString("No form found for num=%1(U=%2) card=%3 case=%4 mult=%5 gender=%6")
 			.arg(baseNum)
-			.arg(numInfos.size())
+			.arg(numForms.Forms.size() / NumeralFormsPerRow)
 			.arg(toQString(toString(cardOrd)))
 			.arg(toQString(toString(wordCase)))
 			.arg(mult != boost::none ? toQString(toString(mult.value())) : QString::fromLatin1("none"))
 			.arg(gender != boost::none ? toQString(toString(gender.value())) : QString::fromLatin1("none")); };
 		PG_Assert2(unique, errMsg().toStdWString().c_str());
-		const WordDeclensionForm& form = *forms.front();
 
-		// trim alternative cases "п'ятдесяти,п'ятдесятьох"
 		boost::wstring_view numStr = form.Name;
-		auto commaPos = numStr.find(L',');
-		if (commaPos != boost::wstring_view::npos)
-			numStr = boost::wstring_view(form.Name.data(), commaPos);
 
 		// rule: одного->одно for composite numerals
 		// числівник один у складних словах набуває форми одно-: одноліток, однолюб, одноколірний; 
@@ -985,8 +1196,8 @@ namespace PticaGovorun
 
 		int nonzOrd = lastNonZeroDecimalInd(triple);
 
-		int magnit = static_cast<int>(std::trunc(std::log10(triple)));
-		int mul10 = static_cast<int>(std::pow(10, magnit)); // ..., 1000, 100, 10, 1
+		int magnit = triple >= 100 ? 2 : (triple >= 10 ? 1 : 0);
+		int mul10 = magnit == 2 ? 100 : (magnit == 1 ? 10 : 1); // 100, 10, 1
 
 		int curDecimInd = magnit;
 
@@ -1039,7 +1250,7 @@ namespace PticaGovorun
 					}
 				}
 
-				convertBaseNumber(baseNumbers_, baseNum, decimCardOrd, decimCase, tripleMult, gender, compoundOrdinal, lexemes);
+				convertBaseNumber(baseNumberForms_, baseNum, decimCardOrd, decimCase, tripleMult, gender, compoundOrdinal, lexemes);
 
 				// every decimal is separated by space, except the single word ordinal numbers ending in 1k, 1mln, 1bln
 				bool avoidSpace = isLastBaseNum || // put the space only in the middle of the tripple
@@ -1081,7 +1292,7 @@ namespace PticaGovorun
 		}
 		if (num == 0)
 		{
-			convertBaseNumber(baseNumbers_, num, cardOrd, numCase, multiplicity, gender, false, lexemes);
+			convertBaseNumber(baseNumberForms_, num, cardOrd, numCase, multiplicity, gender, false, lexemes);
 			return true;
 		}
 
@@ -1182,7 +1393,7 @@ namespace PticaGovorun
 						tripleCaseFix = WordCase::Genitive;
 				}
 
-				convertBaseNumber(zerosWords_, zerosWord.Num, tripleCardOrd, tripleCaseFix, zerosMult, trippleGender, compoundOrdinal, lexemes);
+				convertBaseNumber(zerosWordForms_, zerosWord.Num, tripleCardOrd, tripleCaseFix, zerosMult, trippleGender, compoundOrdinal, lexemes);
 			}
 			else
 			{
@@ -1569,65 +1780,64 @@ namespace PticaGovorun
 		// "У дев'яності ^рр." where ^ marks cur lex
 		if (!hasNextLex(-2) || !hasNextLex(1)) return false;
 
-		RawTextLexeme yearLex;
-		yearLex.RunType = TextRunType::Alpha;
-		yearLex.Class = PartOfSpeech::Noun;
-		bool yearLexValid = false;
-
 		auto& numLex = nextLex(-2);
-		if (numLex.Class == PartOfSpeech::Numeral &&
+		if (!(numLex.Class == PartOfSpeech::Numeral &&
 			numLex.Mulitplicity == EntityMultiplicity::Plural &&
 			nextLex(-1).RunType == TextRunType::Whitespace &&
 			nextLex(0).ValueStr == L"рр" &&
-			nextLex(1).ValueStr == L".")
-		{
+			nextLex(1).ValueStr == L"."))
+			return false;
 
-			boost::wstring_view wordYear;
-			if (numLex.Case == WordCase::Nominative)
-				wordYear = L"роки";
-			else if (numLex.Case == WordCase::Genitive)
-				wordYear = L"років";
-			else if (numLex.Case == WordCase::Locative)
-				wordYear = L"роках";
-			if (wordYear.empty())
-				return false;
+		boost::wstring_view wordYear;
+		if (numLex.Case == WordCase::Nominative)
+			wordYear = L"роки";
+		else if (numLex.Case == WordCase::Genitive)
+			wordYear = L"років";
+		else if (numLex.Case == WordCase::Locative)
+			wordYear = L"роках";
+		if (wordYear.empty())
+			return false;
 
-			yearLex.ValueStr = wordYear;
-			yearLex.Case = numLex.Case;
-			yearLex.Mulitplicity = EntityMultiplicity::Plural;
-			yearLexValid = true;
-		}
+		RawTextLexeme yearLex;
+		yearLex.RunType = TextRunType::Alpha;
+		yearLex.Class = PartOfSpeech::Noun;
+		yearLex.ValueStr = wordYear;
+		yearLex.Case = numLex.Case;
+		yearLex.Mulitplicity = EntityMultiplicity::Plural;
 
-		// "від 11 грудня 2003 ^р."
-		if (numLex.Class == PartOfSpeech::Numeral &&
+		// modify
+		nextLex(0) = yearLex;
+		lexemes_->erase(lexemes_->begin() + curLexInd_ + 1); // dot
+		curLexInd_ += 1;
+		return true;
+	}
+
+	bool AbbreviationExpanderUkr::ruleNumberRoku()
+	{
+		// "від 11 грудня 2003 ^р." where ^ marks cur lex
+		if (!hasNextLex(-2) || !hasNextLex(1)) return false;
+
+		auto& numLex = nextLex(-2);
+		if (!(numLex.Class == PartOfSpeech::Numeral &&
 			numLex.NumeralCardOrd == NumeralCardinality::Ordinal &&
+			numLex.Case == WordCase::Genitive &&
 			nextLex(-1).RunType == TextRunType::Whitespace &&
 			nextLex(0).ValueStr == L"р" &&
-			nextLex(1).ValueStr == L".")
-		{
-
-			boost::wstring_view wordYear;
-			if (numLex.Case == WordCase::Genitive)
-				wordYear = L"року";
-			if (wordYear.empty())
-				return false;
-
-			yearLex.ValueStr = wordYear;
-			yearLex.Case = numLex.Case;
-			yearLex.Mulitplicity = EntityMultiplicity::Singular;
-			yearLexValid = true;
-		}
+			nextLex(1).ValueStr == L"."))
+			return false;
 
-		if (yearLexValid)
-		{
-			// modify
-			nextLex(0) = yearLex;
-			lexemes_->erase(lexemes_->begin() + curLexInd_ + 1); // dot
-			curLexInd_ += 1;
-			return true;
-		}
+		RawTextLexeme yearLex;
+		yearLex.RunType = TextRunType::Alpha;
+		yearLex.Class = PartOfSpeech::Noun;
+		yearLex.ValueStr = L"року";
+		yearLex.Case = numLex.Case;
+		yearLex.Mulitplicity = EntityMultiplicity::Singular;
 
-		return false;
+		// modify
+		nextLex(0) = yearLex;
+		lexemes_->erase(lexemes_->begin() + curLexInd_ + 1); // dot
+		curLexInd_ += 1;
+		return true;
 	}
 
 	bool AbbreviationExpanderUkr::ruleDayMonthYear()
@@ -1847,27 +2057,14 @@ namespace PticaGovorun
 				{
 					for (size_t charInd = 0; charInd < word.size(); ++charInd)
 					{
-						wchar_t ch = word[charInd];
-						bool isDigit = isDigitChar(ch);
-						if (isDigit)
-							digitsCount += 1;
-						bool isRomanCh = isRomanNumeral(ch);
-						if (isRomanCh)
-							romanChCount += 1;
-						bool isEng = isEnglishChar(ch);
-						if (isEng)
-							engCount++;
-						bool isExclEng = isExclusiveEnglishChar(ch);
-						if (isExclEng)
-							exclEngCount++;
-						bool isRus = isRussianChar(ch);
-						if (isRus)
-							rusCount++;
-						bool isExclRus = isExclusiveRussianChar(ch);
-						if (isExclRus)
-							exclRusCount++;
-						if (ch == L'-' || ch == L'\'')
-							hyphenCount++;
+						std::uint16_t charClass = charClassMask(word[charInd]);
+						digitsCount += (charClass & CharClassDigit) != 0;
+						romanChCount += (charClass & CharClassRomanNumeral) != 0;
+						engCount += (charClass & CharClassEnglish) != 0;
+						exclEngCount += (charClass & CharClassExclusiveEnglish) != 0;
+						rusCount += (charClass & CharClassRussian) != 0;
+						exclRusCount += (charClass & CharClassExclusiveRussian) != 0;
+						hyphenCount += (charClass & CharClassHyphen) != 0;
 					}
 				};
 			wordCharUsage(wordSlice);
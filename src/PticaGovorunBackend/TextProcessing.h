@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <cstdint>
 #include <vector>
 #include <unordered_map>
 #include <memory>
@@ -127,6 +128,37 @@ namespace PticaGovorun
 	};
 	PG_EXPORTS inline boost::optional<CharGroup> classifyUkrainianChar(wchar_t ch);
 
+	/// Bits of the character class, returned by charClassMask.
+	enum CharClassBits : std::uint16_t
+	{
+		CharClassDigit = 1 << 0,
+		CharClassRomanNumeral = 1 << 1,
+		CharClassEnglish = 1 << 2,
+		CharClassExclusiveEnglish = 1 << 3,
+		CharClassRussian = 1 << 4,
+		CharClassExclusiveRussian = 1 << 5,
+		CharClassUkrainianVowel = 1 << 6,
+		CharClassUkrainianConsonant = 1 << 7,
+		CharClassHyphen = 1 << 8, // hyphen or apostrophe, which may be inside a word
+		CharClassWhitespace = 1 << 9,
+		CharClassPunctuation = 1 << 10,
+		CharClassPunctuationStopSentence = 1 << 11,
+	};
+
+	/// Returns the combination of CharClassBits, which is equivalent to calling all the char predicates above.
+	/// Latin and Cyrillic chars are looked up in the precomputed table.
+	PG_EXPORTS std::uint16_t charClassMask(wchar_t ch);
+
+	/// The type of the text run, the char belongs to. Chars, which are not digits, whitespace or punctuation, are letters.
+	PG_EXPORTS TextRunType textRunType(wchar_t ch);
+
+	/// The same as textRunType, but the char is classified by the switch over the chars, without the lookup table.
+	PG_EXPORTS TextRunType textRunTypeNoTable(wchar_t ch);
+
+	/// Finds the end (exclusive) of the text run, which starts at the given position. Letters, digits and
+	/// whitespace are grouped in runs; each punctuation char is a separate run.
+	PG_EXPORTS size_t findTextRunEnd(boost::wstring_view text, size_t runStart);
+
 	enum class ActionTense
 	{
 		Future,
@@ -391,6 +423,8 @@ namespace PticaGovorun
 		}
 	};
 
+	class PackedDeclensionDictionary;
+
 	/// Converts integer into the list of words.
 	class PG_EXPORTS IntegerToUaWordConverter
 	{
@@ -416,15 +450,39 @@ namespace PticaGovorun
 			}
 		};
 
+		/// The declined form of a base number for one combination of grammatical tags.
+		struct NumeralForm
+		{
+			boost::wstring_view Name; // the first of alternative names, eg. "п'ятдесяти" of "п'ятдесяти,п'ятдесятьох"
+			boost::optional<WordCase> Case;
+			boost::optional<WordGender> Gender;
+			boost::optional<EntityMultiplicity> Multiplicity;
+			int MatchedFormsCount = 0; // the form is usable only if it is unique; -1 if the numeral is absent in the dictionary
+		};
+
+		/// Declined forms of all base numbers, computed once when the dictionary is loaded.
+		/// The forms are indexed by (base number, cardinality, case, gender, multiplicity), see numeralFormInd.
+		struct NumeralFormTable
+		{
+			std::vector<int> NumToRow; // base number -> row of the table; -1 if there is no such base number
+			std::vector<NumeralForm> Forms;
+		};
+
 		std::vector<BaseNumToWordMap> baseNumbers_;
 		std::vector<BaseNumToWordMap> zerosWords_;
-		std::unique_ptr<
-			std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>>> declinedWords_;
+		NumeralFormTable baseNumberForms_;
+		NumeralFormTable zerosWordForms_;
+		std::unique_ptr<PackedDeclensionDictionary> declinedWords_;
+
+		void buildNumeralFormTable(gsl::span<const BaseNumToWordMap> numInfos, NumeralFormTable& table) const;
 	public:
 		IntegerToUaWordConverter();
+		~IntegerToUaWordConverter();
+
+		/// Loads the numerals declension dictionary. The dictionary is compiled into the packed file next to XML file.
 		bool load(const boost::filesystem::path& declensionDictPath, std::wstring* errMsg);
 
-		void convertBaseNumber(gsl::span<const BaseNumToWordMap> numInfos, int baseNum, NumeralCardinality cardOrd, WordCase wordCase, boost::optional<EntityMultiplicity> singPl,
+		void convertBaseNumber(const NumeralFormTable& numForms, int baseNum, NumeralCardinality cardOrd, WordCase wordCase, boost::optional<EntityMultiplicity> singPl,
 		                        boost::optional<WordGender> gender, bool compoundNumeral, std::vector<RawTextLexeme>& lexemes);
 
 		/// Converts number to a text.
@@ -457,7 +515,9 @@ namespace PticaGovorun
 		inline bool hasNextLex(int stepsCount = 1) const;
 		static bool isWord(const RawTextLexeme& x);
 
-		bool ruleTemplate() { return true; }
+		/// Applies the first matching rule to the current lexeme. Returns false if no rule is applicable.
+		bool applyRule();
+
 		// eg. "пір^'я"
 		bool ruleComposeWordWithApostropheInside();
 		// eg. "в ^XX столітті"
@@ -466,6 +526,8 @@ namespace PticaGovorun
 		bool ruleNumberDiapasonAndEnding();
 		/// eg. "У дев'яності ^рр."
 		bool ruleNumberRokyRoku();
+		/// eg. "від 11 грудня 2003 ^р."
+		bool ruleNumberRoku();
 		/// "на XVI ^ст. припадає"
 		bool ruleNumberStolittya();
 		/// "^№146" or "^№ 146"
@@ -0,0 +1,131 @@
+#include "TrainTestPartition.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <random>
+#include <tuple>
+#include "ComponentsInfrastructure.h"
+#include "ParallelUtils.h"
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	void partitionTrainTestBySpeaker(const std::vector<PartitionItem>& items, double trainRatio, std::uint32_t seed, int threadsCount,
+		std::vector<ResourceUsagePhase>& phases)
+	{
+		phases.assign(items.size(), ResourceUsagePhase::Test);
+
+		// movable items of each speaker
+		std::map<std::string, std::vector<size_t>> speakerToItemInds;
+		for (size_t itemInd = 0; itemInd < items.size(); ++itemInd)
+		{
+			const PartitionItem& item = items[itemInd];
+			if (item.FixedPhase != boost::none)
+			{
+				phases[itemInd] = item.FixedPhase.get();
+				continue;
+			}
+			speakerToItemInds[item.SpeakerBriefId].push_back(itemInd);
+		}
+
+		std::vector<std::pair<std::string, std::vector<size_t>>> speakers(speakerToItemInds.begin(), speakerToItemInds.end());
+
+		// each speaker has its own random generator, hence the result doesn't depend on the order in which speakers are processed
+		parallelFor(speakers.size(), threadsCount, [&](size_t speakerInd, int threadInd)
+		{
+			const std::string& speakerId = speakers[speakerInd].first;
+			std::vector<size_t>& itemInds = speakers[speakerInd].second;
+
+			std::sort(itemInds.begin(), itemInds.end(), [&items](size_t a, size_t b)
+			{
+				return std::tie(items[a].StableKey, a) < std::tie(items[b].StableKey, b);
+			});
+
+			// FNV-1a; unlike std::hash it gives the same value on all platforms
+			std::uint64_t speakerHash = hashFnv1a64(speakerId.data(), speakerId.size());
+			std::seed_seq seedSeq = { seed, (std::uint32_t)speakerHash, (std::uint32_t)(speakerHash >> 32) };
+			std::mt19937 gen(seedSeq);
+
+			// Fisher-Yates shuffle; std::shuffle may produce different permutations in different standard libraries
+			for (size_t i = itemInds.size(); i > 1; --i)
+			{
+				size_t j = gen() % i;
+				std::swap(itemInds[i - 1], itemInds[j]);
+			}
+
+			size_t trainCount = (size_t)std::floor(trainRatio * itemInds.size() + 0.5);
+			for (size_t i = 0; i < trainCount; ++i)
+				phases[itemInds[i]] = ResourceUsagePhase::Train;
+		});
+	}
+
+	int coverTestPhonesInTrain(const std::vector<PartitionItem>& items, std::vector<ResourceUsagePhase>& phases, PhoneSet* uncoveredPhones)
+	{
+		PG_Assert2(items.size() == phases.size(), "Each item must have a phase");
+
+		PhoneSet trainPhones;
+		PhoneSet testPhones;
+		for (size_t itemInd = 0; itemInd < items.size(); ++itemInd)
+		{
+			if (phases[itemInd] == ResourceUsagePhase::Train)
+				trainPhones |= items[itemInd].Phones;
+			else
+				testPhones |= items[itemInd].Phones;
+		}
+		PhoneSet uncovered = testPhones & ~trainPhones;
+
+		// The gain is the number of uncovered phones of an item. The gain only decreases as phones get covered,
+		// so the gain of the popped item is recomputed and the item is pushed back if it is outdated.
+		// The item with the lower index wins a tie, to get the same result on each run.
+		struct Candidate
+		{
+			size_t Gain;
+			size_t ItemInd;
+		};
+		auto lowerPriority = [](const Candidate& a, const Candidate& b)
+		{
+			return a.Gain < b.Gain || (a.Gain == b.Gain && a.ItemInd > b.ItemInd);
+		};
+		std::priority_queue<Candidate, std::vector<Candidate>, decltype(lowerPriority)> candidates(lowerPriority);
+		for (size_t itemInd = 0; itemInd < items.size() && uncovered.any(); ++itemInd)
+		{
+			if (phases[itemInd] != ResourceUsagePhase::Test || items[itemInd].FixedPhase != boost::none)
+				continue;
+			size_t gain = (items[itemInd].Phones & uncovered).count();
+			if (gain > 0)
+			{
+				Candidate cand;
+				cand.Gain = gain;
+				cand.ItemInd = itemInd;
+				candidates.push(cand);
+			}
+		}
+
+		int movedCount = 0;
+		while (uncovered.any() && !candidates.empty())
+		{
+			Candidate cand = candidates.top();
+			candidates.pop();
+
+			const PhoneSet& itemPhones = items[cand.ItemInd].Phones;
+			size_t gain = (itemPhones & uncovered).count();
+			if (gain == 0)
+				continue;
+			if (gain < cand.Gain)
+			{
+				cand.Gain = gain;
+				candidates.push(cand);
+				continue;
+			}
+
+			phases[cand.ItemInd] = ResourceUsagePhase::Train;
+			uncovered &= ~itemPhones;
+			movedCount += 1;
+		}
+
+		if (uncoveredPhones != nullptr)
+			*uncoveredPhones = uncovered;
+		return movedCount;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include <boost/optional.hpp>
+#include "PticaGovorunCore.h"
+#include "PhoneticService.h"
+#include "SpeechProcessing.h"
+
+namespace PticaGovorun
+{
+	/// The set of phones, indexed by PhoneId::Id.
+	typedef std::bitset<std::numeric_limits<PhoneId::id_type>::max() + 1> PhoneSet;
+
+	/// The speech segment as seen by the train/test partitioner.
+	struct PG_EXPORTS PartitionItem
+	{
+		std::string SpeakerBriefId;
+
+		// Identifies the segment between runs (eg annotation file path and marker id).
+		// Defines the order in which segments of a speaker are shuffled, so the partition doesn't depend on the loading order.
+		std::wstring StableKey;
+
+		// The segment can't be moved to the other phase (eg excluded from training).
+		boost::optional<ResourceUsagePhase> FixedPhase;
+
+		PhoneSet Phones;
+	};
+
+	/// Assigns train or test phase to each item. The items of each speaker are shuffled and split separately,
+	/// so that each speaker contributes approximately trainRatio of its segments to the train portion.
+	/// Items with FixedPhase get this phase.
+	/// The result depends only on items and seed, but not on threadsCount (threadsCount<=0 uses all hardware threads).
+	PG_EXPORTS void partitionTrainTestBySpeaker(const std::vector<PartitionItem>& items, double trainRatio, std::uint32_t seed, int threadsCount,
+		std::vector<ResourceUsagePhase>& phases);
+
+	/// Moves test items into the train portion, so that each phone of the test portion exists in the train portion.
+	/// The set is covered greedily: the item, which has the most of uncovered phones, is moved first.
+	/// Items with FixedPhase are not moved.
+	/// Returns the number of moved items. uncoveredPhones receives test phones which no movable item has.
+	PG_EXPORTS int coverTestPhonesInTrain(const std::vector<PartitionItem>& items, std::vector<ResourceUsagePhase>& phases, PhoneSet* uncoveredPhones = nullptr);
+}
@@ -0,0 +1,96 @@
+#include "VocabularySelection.h"
+#include <algorithm>
+#include "ParallelUtils.h"
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	void collectUnigramUsage(const WordsUsageInfo& wordUsage, const std::map<int, ptrdiff_t>* wordPartIdToRecoveredUsage,
+		std::vector<std::int64_t>& wordPartIdToUsage)
+	{
+		std::vector<const WordPart*> wordParts;
+		wordUsage.copyWordParts(wordParts);
+		int maxWordPartId = 0;
+		for (const WordPart* wordPart : wordParts)
+			maxWordPartId = std::max(maxWordPartId, wordPart->id());
+		wordPartIdToUsage.assign(maxWordPartId + 1, 0);
+
+		std::vector<const WordSeqUsage*> wordSeqUsages;
+		wordUsage.copyWordSeq(wordSeqUsages);
+		for (const WordSeqUsage* seqUsage : wordSeqUsages)
+		{
+			if (seqUsage->Key.PartCount != 1) // 1=unigram
+				continue;
+			int wordPartId = seqUsage->Key.PartIds[0];
+			PG_Assert(wordPartId >= 0 && wordPartId <= maxWordPartId);
+			wordPartIdToUsage[wordPartId] = seqUsage->UsedCount;
+		}
+
+		if (wordPartIdToRecoveredUsage != nullptr)
+		{
+			for (const std::pair<int, ptrdiff_t>& recovered : *wordPartIdToRecoveredUsage)
+			{
+				PG_Assert(recovered.first >= 0 && recovered.first <= maxWordPartId);
+				PG_Assert2(wordPartIdToUsage[recovered.first] == 0, "Must be only one source of word's usage statistics");
+				wordPartIdToUsage[recovered.first] = recovered.second;
+			}
+		}
+	}
+
+	void selectTopUsedWordParts(wv::slice<const std::int64_t> wordPartIdToUsage, std::int64_t minUsage, int maxCount, int threadsCount,
+		std::function<bool(int wordPartId, int threadInd)> acceptFun, std::vector<int>& wordPartIds)
+	{
+		wordPartIds.clear();
+
+		std::vector<int> candidates;
+		for (size_t wordPartId = 0; wordPartId < wordPartIdToUsage.size(); ++wordPartId)
+		{
+			if (minUsage == -1 || wordPartIdToUsage[wordPartId] >= minUsage)
+				candidates.push_back((int)wordPartId);
+		}
+
+		// the total order makes the choice independent of the order of candidates
+		auto moreUsed = [&wordPartIdToUsage](int a, int b)
+		{
+			std::int64_t usageA = wordPartIdToUsage[a];
+			std::int64_t usageB = wordPartIdToUsage[b];
+			return usageA > usageB || (usageA == usageB && a < b);
+		};
+
+		static const size_t MinBlockSize = 1024;
+		std::vector<char> blockAccepted;
+		size_t blockStart = 0;
+		while (blockStart < candidates.size())
+		{
+			size_t blockSize = candidates.size() - blockStart;
+			if (maxCount > 0)
+			{
+				// some candidates are rejected, hence the block is slightly larger than the number of words to choose
+				size_t needCount = maxCount - wordPartIds.size();
+				blockSize = std::min(blockSize, std::max(MinBlockSize, needCount + needCount / 4));
+			}
+
+			auto blockBegin = candidates.begin() + blockStart;
+			auto blockEnd = blockBegin + blockSize;
+			if (blockEnd != candidates.end())
+				std::nth_element(blockBegin, blockEnd, candidates.end(), moreUsed);
+			std::sort(blockBegin, blockEnd, moreUsed);
+
+			blockAccepted.assign(blockSize, false);
+			parallelFor(blockSize, threadsCount, [&](size_t i, int threadInd)
+			{
+				blockAccepted[i] = acceptFun(candidates[blockStart + i], threadInd);
+			});
+
+			for (size_t i = 0; i < blockSize; ++i)
+			{
+				if (!blockAccepted[i])
+					continue;
+				wordPartIds.push_back(candidates[blockStart + i]);
+				if (maxCount > 0 && wordPartIds.size() == (size_t)maxCount)
+					return;
+			}
+			blockStart += blockSize;
+		}
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+#include "PticaGovorunCore.h"
+#include "ClnUtils.h"
+#include "LangStat.h"
+
+namespace PticaGovorun
+{
+	/// Gets the usage of each word part as a flat array, indexed by word part id. The usage is taken from unigram statistics
+	/// of text corpus or, if given, from the recovered usage of words not covered by text corpus (see wordUsageOneSource).
+	PG_EXPORTS void collectUnigramUsage(const WordsUsageInfo& wordUsage, const std::map<int, ptrdiff_t>* wordPartIdToRecoveredUsage,
+		std::vector<std::int64_t>& wordPartIdToUsage);
+
+	/// Chooses at most maxCount of the most used word parts, for which acceptFun(wordPartId, threadInd) returns true.
+	/// Only word parts with usage>=minUsage are considered; minUsage=-1 and maxCount<=0 remove the corresponding limit.
+	/// Candidates are ordered by descending usage (ties by ascending id) in blocks: the next block of the most used candidates
+	/// is selected with nth_element and only this block is sorted. acceptFun is called concurrently for candidates of a block,
+	/// hence only a few candidates beyond the last chosen one are checked.
+	/// wordPartIds receives chosen ids in the order of candidates; the result is the same for any threadsCount.
+	PG_EXPORTS void selectTopUsedWordParts(wv::slice<const std::int64_t> wordPartIdToUsage, std::int64_t minUsage, int maxCount, int threadsCount,
+		std::function<bool(int wordPartId, int threadInd)> acceptFun, std::vector<int>& wordPartIds);
+}
@@ -0,0 +1,149 @@
+#include "WordPrefixIndex.h"
+#include <algorithm>
+#include <tuple>
+
+namespace PticaGovorun
+{
+	std::wstring foldWordCase(boost::wstring_view word)
+	{
+		QString wordQ = QString::fromWCharArray(word.data(), (int)word.size());
+		return wordQ.toCaseFolded().toStdWString();
+	}
+
+	bool startsWithinOneEdit(boost::wstring_view text, boost::wstring_view prefix)
+	{
+		if (text.starts_with(prefix))
+			return true;
+
+		// the edit can be made at the first mismatched letter
+		size_t i = 0;
+		while (i < prefix.size() && i < text.size() && text[i] == prefix[i])
+			++i;
+
+		// substitute prefix[i]
+		if (i < text.size() && text.substr(i + 1).starts_with(prefix.substr(i + 1)))
+			return true;
+
+		// remove prefix[i]
+		if (text.substr(i).starts_with(prefix.substr(i + 1)))
+			return true;
+
+		// insert text[i] before prefix[i]
+		if (i < text.size() && text.substr(i + 1).starts_with(prefix.substr(i)))
+			return true;
+		return false;
+	}
+
+	bool WordPrefixIndex::isBuilt() const
+	{
+		return isBuilt_;
+	}
+
+	void WordPrefixIndex::invalidate()
+	{
+		entries_.clear();
+		isBuilt_ = false;
+	}
+
+	void WordPrefixIndex::build(const std::map<boost::wstring_view, PhoneticWord>& phoneticDict)
+	{
+		entries_.clear();
+		for (const auto& pair : phoneticDict)
+		{
+			const PhoneticWord& word = pair.second;
+			entries_.push_back(Entry{ foldWordCase(word.Word), word.Word });
+			for (const PronunciationFlavour& pron : word.Pronunciations)
+				entries_.push_back(Entry{ foldWordCase(pron.PronCode), word.Word });
+		}
+
+		auto entryKey = [](const Entry& e) { return std::tie(e.FoldedKey, e.Word); };
+		std::sort(entries_.begin(), entries_.end(), [&entryKey](const Entry& a, const Entry& b) { return entryKey(a) < entryKey(b); });
+
+		// the word often coincides with its pronCode
+		auto newEnd = std::unique(entries_.begin(), entries_.end(), [&entryKey](const Entry& a, const Entry& b) { return entryKey(a) == entryKey(b); });
+		entries_.erase(newEnd, entries_.end());
+		isBuilt_ = true;
+	}
+
+	void WordPrefixIndex::insertKey(boost::wstring_view key, boost::wstring_view word)
+	{
+		Entry entry{ foldWordCase(key), word };
+		auto it = std::lower_bound(entries_.begin(), entries_.end(), entry, [](const Entry& a, const Entry& b)
+		{
+			return std::tie(a.FoldedKey, a.Word) < std::tie(b.FoldedKey, b.Word);
+		});
+		if (it != entries_.end() && it->FoldedKey == entry.FoldedKey && it->Word == word)
+			return;
+		entries_.insert(it, std::move(entry));
+	}
+
+	void WordPrefixIndex::removeKey(boost::wstring_view key, boost::wstring_view word)
+	{
+		std::wstring foldedKey = foldWordCase(key);
+		auto it = std::lower_bound(entries_.begin(), entries_.end(), foldedKey, [](const Entry& a, const std::wstring& k)
+		{
+			return a.FoldedKey < k;
+		});
+		for (; it != entries_.end() && it->FoldedKey == foldedKey; ++it)
+		{
+			if (it->Word == word)
+			{
+				entries_.erase(it);
+				return;
+			}
+		}
+	}
+
+	void WordPrefixIndex::addWord(const PhoneticWord& word)
+	{
+		insertKey(word.Word, word.Word);
+		for (const PronunciationFlavour& pron : word.Pronunciations)
+			insertKey(pron.PronCode, word.Word);
+	}
+
+	void WordPrefixIndex::removeWord(const PhoneticWord& word)
+	{
+		removeKey(word.Word, word.Word);
+		for (const PronunciationFlavour& pron : word.Pronunciations)
+			removeKey(pron.PronCode, word.Word);
+	}
+
+	void WordPrefixIndex::findWords(boost::wstring_view prefix, size_t maxResults, bool allowTypo, std::vector<boost::wstring_view>& words) const
+	{
+		std::wstring foldedPrefix = foldWordCase(prefix);
+		auto lowerBound = [this](boost::wstring_view key)
+		{
+			return std::lower_bound(entries_.begin(), entries_.end(), key, [](const Entry& a, boost::wstring_view k)
+			{
+				return boost::wstring_view(a.FoldedKey) < k;
+			});
+		};
+		auto pushWord = [&words](boost::wstring_view word)
+		{
+			if (std::find(words.begin(), words.end(), word) == words.end())
+				words.push_back(word);
+		};
+
+		size_t initialSize = words.size();
+		for (auto it = lowerBound(foldedPrefix); it != entries_.end() && words.size() - initialSize < maxResults; ++it)
+		{
+			if (!boost::wstring_view(it->FoldedKey).starts_with(foldedPrefix))
+				break;
+			pushWord(it->Word);
+		}
+
+		if (!allowTypo || foldedPrefix.empty() || words.size() - initialSize >= maxResults)
+			return;
+
+		// keys starting with the same letter as the prefix
+		boost::wstring_view firstLetter(foldedPrefix.data(), 1);
+		for (auto it = lowerBound(firstLetter); it != entries_.end() && words.size() - initialSize < maxResults; ++it)
+		{
+			boost::wstring_view key = it->FoldedKey;
+			if (!key.starts_with(firstLetter))
+				break;
+			if (!key.starts_with(foldedPrefix) && startsWithinOneEdit(key, foldedPrefix))
+				pushWord(it->Word);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <QString>
+#include <boost/utility/string_view.hpp>
+#include "PticaGovorunCore.h"
+#include "PhoneticService.h"
+
+namespace PticaGovorun
+{
+	/// Case insensitive prefix index over words of a phonetic dictionary and their pronCodes.
+	/// The keys are stored case folded in a sorted array, so that the prefix lookup is a binary search.
+	class PG_EXPORTS WordPrefixIndex
+	{
+		struct Entry
+		{
+			std::wstring FoldedKey; // case folded word or pronCode
+			boost::wstring_view Word; // the word the key belongs to
+		};
+		std::vector<Entry> entries_; // ordered by FoldedKey, then by Word
+		bool isBuilt_ = false;
+	public:
+		bool isBuilt() const;
+
+		/// Drops all entries. The index must be built again before querying.
+		void invalidate();
+
+		void build(const std::map<boost::wstring_view, PhoneticWord>& phoneticDict);
+
+		/// Adds keys of the word and all its pronCodes.
+		void addWord(const PhoneticWord& word);
+
+		/// Removes keys of the word and all its pronCodes.
+		void removeWord(const PhoneticWord& word);
+
+		/// Finds up to maxResults distinct words, which or which pronCode starts with given prefix.
+		/// The words are ordered by the matched key, so the exact match goes first.
+		/// allowTypo=true additionally accepts keys which start with the prefix after one edit (insert, remove or
+		/// substitute a letter) if exact matches are not enough; the first letter must match.
+		void findWords(boost::wstring_view prefix, size_t maxResults, bool allowTypo, std::vector<boost::wstring_view>& words) const;
+	private:
+		void insertKey(boost::wstring_view key, boost::wstring_view word);
+		void removeKey(boost::wstring_view key, boost::wstring_view word);
+	};
+
+	/// Converts the word to the representation which is used to compare words case insensitively.
+	PG_EXPORTS std::wstring foldWordCase(boost::wstring_view word);
+
+	/// Whether some prefix of the text can be obtained from the given prefix with at most one edit operation.
+	PG_EXPORTS bool startsWithinOneEdit(boost::wstring_view text, boost::wstring_view prefix);
+}
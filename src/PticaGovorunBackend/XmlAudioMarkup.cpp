@@ -1,6 +1,11 @@
 #include <vector>
 #include <regex>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
 #include <QString>
 #include <QDomDocument>
 #include <QTextStream>
@@ -8,6 +13,8 @@
 
 #include "assertImpl.h"
 #include "XmlAudioMarkup.h"
+#include "CoreUtils.h"
+#include "FileHelpers.h"
 
 namespace PticaGovorun {
 
@@ -246,4 +253,655 @@ PG_EXPORTS std::tuple<bool, const char*> saveAudioMarkupToXml(const SpeechAnnota
 	return std::make_tuple(true, nullptr);
 }
 
+
+namespace
+{
+	inline bool isXmlSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+
+	inline bool isXmlNameChar(char c)
+	{
+		return !isXmlSpace(c) && c != '=' && c != '>' && c != '<' && c != '/' && c != '"' && c != '\'';
+	}
+
+	void appendUtf8(unsigned long codePoint, std::string& buf)
+	{
+		if (codePoint < 0x80)
+			buf.push_back((char)codePoint);
+		else if (codePoint < 0x800)
+		{
+			buf.push_back((char)(0xC0 | (codePoint >> 6)));
+			buf.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+		else if (codePoint < 0x10000)
+		{
+			buf.push_back((char)(0xE0 | (codePoint >> 12)));
+			buf.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+			buf.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+		else
+		{
+			buf.push_back((char)(0xF0 | (codePoint >> 18)));
+			buf.push_back((char)(0x80 | ((codePoint >> 12) & 0x3F)));
+			buf.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+			buf.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+	}
+
+	/// Resolves entity and character references and normalizes white space of the attribute value
+	/// in the same way as xml parser does. The value is returned without copying if it requires no processing.
+	bool decodeXmlAttrValue(boost::string_view rawValue, std::string& buf, boost::string_view& value)
+	{
+		auto needsDecoding = [](char c) { return c == '&' || c == '\t' || c == '\n' || c == '\r'; };
+		if (std::none_of(rawValue.begin(), rawValue.end(), needsDecoding))
+		{
+			value = rawValue;
+			return true;
+		}
+
+		buf.clear();
+		for (size_t i = 0; i < rawValue.size(); ++i)
+		{
+			char c = rawValue[i];
+			if (c == '\r')
+			{
+				buf.push_back(' ');
+				if (i + 1 < rawValue.size() && rawValue[i + 1] == '\n') // CR LF is one line break
+					++i;
+			}
+			else if (c == '\t' || c == '\n')
+				buf.push_back(' ');
+			else if (c == '&')
+			{
+				size_t semicolonInd = rawValue.find(';', i);
+				if (semicolonInd == boost::string_view::npos)
+					return false;
+				boost::string_view ref = rawValue.substr(i + 1, semicolonInd - i - 1);
+				if (ref == "amp") buf.push_back('&');
+				else if (ref == "lt") buf.push_back('<');
+				else if (ref == "gt") buf.push_back('>');
+				else if (ref == "quot") buf.push_back('"');
+				else if (ref == "apos") buf.push_back('\'');
+				else if (ref.size() > 1 && ref[0] == '#')
+				{
+					bool isHex = ref[1] == 'x';
+					size_t digitsStart = isHex ? 2 : 1;
+					if (digitsStart >= ref.size())
+						return false;
+					unsigned long codePoint = 0;
+					for (size_t digitInd = digitsStart; digitInd < ref.size(); ++digitInd)
+					{
+						char d = ref[digitInd];
+						int digit;
+						if (d >= '0' && d <= '9') digit = d - '0';
+						else if (isHex && d >= 'a' && d <= 'f') digit = d - 'a' + 10;
+						else if (isHex && d >= 'A' && d <= 'F') digit = d - 'A' + 10;
+						else return false;
+						codePoint = codePoint * (isHex ? 16 : 10) + digit;
+						if (codePoint > 0x10FFFF)
+							return false;
+					}
+					appendUtf8(codePoint, buf);
+				}
+				else
+					return false; // only predefined entities are supported
+				i = semicolonInd;
+			}
+			else
+				buf.push_back(c);
+		}
+		value = buf;
+		return true;
+	}
+
+	enum class XmlToken
+	{
+		StartElement,
+		EndElement,
+		EndOfText,
+		Error
+	};
+
+	/// Splits xml text into elements. Text, comments, processing instructions and DTD are skipped.
+	/// Empty element <a/> is reported as StartElement followed by EndElement.
+	class AudioMarkupXmlTokenizer
+	{
+		const char* cur_;
+		const char* end_;
+		AudioMarkupXmlBuffers& buffs_;
+		bool pendingEndElement_ = false;
+	public:
+		boost::string_view ElementName;
+		const char* ErrMsg = nullptr;
+	public:
+		AudioMarkupXmlTokenizer(boost::string_view xmlText, AudioMarkupXmlBuffers& buffs)
+			: cur_(xmlText.data()),
+			end_(xmlText.data() + xmlText.size()),
+			buffs_(buffs)
+		{
+			// skip UTF-8 byte order mark
+			if (xmlText.starts_with("\xEF\xBB\xBF"))
+				cur_ += 3;
+		}
+
+		XmlToken next()
+		{
+			if (pendingEndElement_)
+			{
+				pendingEndElement_ = false;
+				return XmlToken::EndElement;
+			}
+			while (true)
+			{
+				cur_ = static_cast<const char*>(std::memchr(cur_, '<', end_ - cur_));
+				if (cur_ == nullptr)
+				{
+					cur_ = end_;
+					return XmlToken::EndOfText;
+				}
+
+				boost::string_view rest(cur_, end_ - cur_);
+				if (rest.starts_with("<?"))
+				{
+					if (!skipPast(rest, "?>")) return error("Unterminated processing instruction");
+				}
+				else if (rest.starts_with("<!--"))
+				{
+					if (!skipPast(rest, "-->")) return error("Unterminated comment");
+				}
+				else if (rest.starts_with("<![CDATA["))
+				{
+					if (!skipPast(rest, "]]>")) return error("Unterminated CDATA section");
+				}
+				else if (rest.starts_with("<!"))
+				{
+					if (!skipPast(rest, ">")) return error("Unterminated document type declaration");
+				}
+				else if (rest.starts_with("</"))
+				{
+					cur_ += 2;
+					if (!readName()) return error("Expected element name");
+					skipSpaces();
+					if (cur_ == end_ || *cur_ != '>') return error("Expected '>' to close end tag");
+					++cur_;
+					return XmlToken::EndElement;
+				}
+				else
+				{
+					cur_ += 1;
+					return readStartElement();
+				}
+			}
+		}
+
+		/// Finds the attribute of the last start element and decodes its value.
+		/// The value is valid until the next call to this method.
+		bool attribute(boost::string_view name, boost::string_view& value, bool& decodeOp)
+		{
+			decodeOp = true;
+			for (const auto& attr : buffs_.Attrs)
+			{
+				if (attr.first == name)
+				{
+					decodeOp = decodeXmlAttrValue(attr.second, buffs_.AttrValue, value);
+					return true;
+				}
+			}
+			return false;
+		}
+	private:
+		XmlToken error(const char* msg)
+		{
+			ErrMsg = msg;
+			return XmlToken::Error;
+		}
+
+		bool skipPast(boost::string_view rest, boost::string_view terminator)
+		{
+			size_t ind = rest.find(terminator);
+			if (ind == boost::string_view::npos)
+				return false;
+			cur_ += ind + terminator.size();
+			return true;
+		}
+
+		void skipSpaces()
+		{
+			while (cur_ < end_ && isXmlSpace(*cur_))
+				++cur_;
+		}
+
+		bool readName()
+		{
+			const char* nameStart = cur_;
+			while (cur_ < end_ && isXmlNameChar(*cur_))
+				++cur_;
+			ElementName = boost::string_view(nameStart, cur_ - nameStart);
+			return !ElementName.empty();
+		}
+
+		XmlToken readStartElement()
+		{
+			if (!readName()) return error("Expected element name");
+			boost::string_view elementName = ElementName;
+
+			buffs_.Attrs.clear();
+			while (true)
+			{
+				skipSpaces();
+				if (cur_ == end_) return error("Unterminated start tag");
+				if (*cur_ == '>')
+				{
+					++cur_;
+					ElementName = elementName;
+					return XmlToken::StartElement;
+				}
+				if (*cur_ == '/')
+				{
+					++cur_;
+					if (cur_ == end_ || *cur_ != '>') return error("Expected '/>' to close empty element");
+					++cur_;
+					ElementName = elementName;
+					pendingEndElement_ = true;
+					return XmlToken::StartElement;
+				}
+
+				if (!readName()) return error("Expected attribute name");
+				boost::string_view attrName = ElementName;
+				skipSpaces();
+				if (cur_ == end_ || *cur_ != '=') return error("Expected '=' after attribute name");
+				++cur_;
+				skipSpaces();
+				if (cur_ == end_ || (*cur_ != '"' && *cur_ != '\'')) return error("Expected quoted attribute value");
+				char quote = *cur_++;
+				const char* valueEnd = static_cast<const char*>(std::memchr(cur_, quote, end_ - cur_));
+				if (valueEnd == nullptr) return error("Unterminated attribute value");
+				buffs_.Attrs.push_back(std::make_pair(attrName, boost::string_view(cur_, valueEnd - cur_)));
+				cur_ = valueEnd + 1;
+			}
+		}
+	};
+
+	/// Parses the number in the same way as QString::toInt, ignoring surrounding white space.
+	bool parseXmlInt(boost::string_view text, std::string& buf, int& result)
+	{
+		buf.assign(text.data(), text.size());
+		const char* start = buf.c_str();
+		char* endPtr = nullptr;
+		errno = 0;
+		long value = std::strtol(start, &endPtr, 10);
+		if (endPtr == start || errno == ERANGE || value < INT_MIN || value > INT_MAX)
+			return false;
+		while (isXmlSpace(*endPtr))
+			++endPtr;
+		if (*endPtr != 0)
+			return false;
+		result = (int)value;
+		return true;
+	}
+
+	// QByteArray parses in C locale, unlike strtof.
+	bool parseXmlFloat(boost::string_view text, float& result)
+	{
+		bool ok = false;
+		float value = QByteArray::fromRawData(text.data(), (int)text.size()).trimmed().toFloat(&ok);
+		if (!ok)
+			return false;
+		result = value;
+		return true;
+	}
+}
+
+bool parseAudioMarkupXml(boost::string_view xmlText, SpeechAnnotation& annot, AudioMarkupXmlBuffers& buffs, ErrMsgList* errMsg)
+{
+	AudioMarkupXmlTokenizer tokenizer(xmlText, buffs);
+	std::vector<boost::string_view>& openElements = buffs.OpenElements;
+	openElements.clear();
+
+	std::string numBuf;
+	bool rootFound = false;
+
+	// gets decoded attribute value or empty string if attribute is missing
+	bool attrDecodeOp = true;
+	auto attr = [&tokenizer, &attrDecodeOp](const char* name) -> boost::string_view
+	{
+		boost::string_view value;
+		bool decodeOp;
+		if (tokenizer.attribute(name, value, decodeOp))
+		{
+			attrDecodeOp = attrDecodeOp && decodeOp;
+			return value;
+		}
+		return boost::string_view();
+	};
+	auto attrQ = [&attr](const char* name) -> QString
+	{
+		boost::string_view value = attr(name);
+		return QString::fromUtf8(value.data(), (int)value.size());
+	};
+
+	while (true)
+	{
+		XmlToken token = tokenizer.next();
+		if (token == XmlToken::Error)
+		{
+			pushErrorMsg(errMsg, tokenizer.ErrMsg);
+			pushErrorMsg(errMsg, "Can't parse audio markup xml");
+			return false;
+		}
+		if (token == XmlToken::EndOfText)
+			break;
+		if (token == XmlToken::EndElement)
+		{
+			if (openElements.empty() || openElements.back() != tokenizer.ElementName)
+			{
+				pushErrorMsg(errMsg, "Xml audio markup error: mismatched end tag");
+				return false;
+			}
+			openElements.pop_back();
+			continue;
+		}
+
+		// StartElement
+		size_t depth = openElements.size();
+		openElements.push_back(tokenizer.ElementName);
+		boost::string_view tagName = tokenizer.ElementName;
+		attrDecodeOp = true;
+
+		if (depth == 0)
+		{
+			if (rootFound)
+			{
+				pushErrorMsg(errMsg, "Xml audio markup error: multiple root elements");
+				return false;
+			}
+			rootFound = true;
+
+			boost::string_view audioFile = attr(AnnotAudioFile);
+			annot.setAudioFileRelPath(utf8s2ws(audioFile));
+
+			float audioSampleRate = 0;
+			if (!parseXmlFloat(attr(AnnotAudioSampleRate), audioSampleRate))
+			{
+				pushErrorMsg(errMsg, "Can't parse audioSampleRate parameter");
+				return false;
+			}
+			annot.setAudioSampleRate(audioSampleRate);
+		}
+		else if (depth == 2 && openElements[1] == AnnotHeaderName)
+		{
+			if (tagName == HeaderSpeakerNodeName)
+			{
+				std::wstring briefId = utf8s2ws(attr(HeaderSpeakerBriefIdName));
+				if (briefId.empty())
+				{
+					pushErrorMsg(errMsg, "Xml audio markup error: expected non empty Speaker.Id");
+					return false;
+				}
+				std::wstring speakerName = utf8s2ws(attr(HeaderSpeakerNameAttrName));
+				annot.addSpeaker(briefId, speakerName);
+			}
+			else if (tagName == HeaderParameterNodeName)
+			{
+				std::string paramName = toStdString(attr(HeaderParameterNameAttrName));
+				if (paramName.empty())
+				{
+					pushErrorMsg(errMsg, "Xml audio markup error: parameter name is empty");
+					return false;
+				}
+				boost::string_view paramValue = attr(HeaderParameterValueAttrName);
+				annot.addParameter(paramName, paramValue);
+			}
+		}
+		else if (depth == 1 && tagName == MarkerName)
+		{
+			int markerId = -1;
+			if (!parseXmlInt(attr(MarkerIdName), numBuf, markerId))
+			{
+				pushErrorMsg(errMsg, "Xml audio markup error: expected syncPoint.id of integer type");
+				return false;
+			}
+
+			int sampleInd = -1;
+			if (!parseXmlInt(attr(MarkerSampleIndName), numBuf, sampleInd))
+			{
+				pushErrorMsg(errMsg, "Xml audio markup error: expected syncPoint.sampleInd of integer type");
+				return false;
+			}
+
+			MarkerLevelOfDetail levelOfDetail = MarkerLevelOfDetail::Word;
+			boost::string_view levelOfDetailStr;
+			bool decodeOp;
+			if (tokenizer.attribute(MarkerLevelOfDetailName, levelOfDetailStr, decodeOp))
+			{
+				attrDecodeOp = attrDecodeOp && decodeOp;
+				if (levelOfDetailStr == MarkerLevelOfDetailPhoneName)
+					levelOfDetail = MarkerLevelOfDetail::Phone;
+			}
+
+			boost::string_view langStr = attr(MarkerLanguageName);
+			SpeechLanguage lang = SpeechLanguage::NotSet;
+			if (langStr == MarkerLangUkrainian)
+				lang = SpeechLanguage::Ukrainian;
+			else if (langStr == MarkerLangRussian)
+				lang = SpeechLanguage::Russian;
+
+			PG_Assert(markerId != -1);
+
+			TimePointMarker syncPoint;
+			syncPoint.Id = markerId;
+			syncPoint.SampleInd = sampleInd;
+			syncPoint.TranscripText = attrQ(MarkerTranscripTextName);
+			syncPoint.LevelOfDetail = levelOfDetail;
+			syncPoint.Language = lang;
+			syncPoint.SpeakerBriefId = utf8s2ws(attr(MarkerSpeakerBriefIdName));
+			syncPoint.ExcludePhase = resourceUsagePhaseFromString(attr(MarkerExcludePhaseName));
+
+			// UI specific
+			syncPoint.IsManual = true;
+			syncPoint.StopsPlayback = getDefaultMarkerStopsPlayback(levelOfDetail);
+
+			annot.attachMarker(syncPoint);
+		}
+
+		if (!attrDecodeOp)
+		{
+			pushErrorMsg(errMsg, "Xml audio markup error: can't decode attribute value");
+			return false;
+		}
+	}
+
+	if (!rootFound)
+	{
+		pushErrorMsg(errMsg, "Xml audio markup error: root element is missing");
+		return false;
+	}
+	if (!openElements.empty())
+	{
+		pushErrorMsg(errMsg, "Xml audio markup error: unclosed element");
+		return false;
+	}
+	return true;
+}
+
+bool loadAudioMarkupXmlFast(const boost::filesystem::path& annotFilePathAbs, SpeechAnnotation& speechAnnot, AudioMarkupXmlBuffers& buffs, ErrMsgList* errMsg)
+{
+	if (!readAllBytes(annotFilePathAbs, buffs.FileContent, errMsg))
+		return false;
+
+	return parseAudioMarkupXml(boost::string_view(buffs.FileContent.data(), buffs.FileContent.size()), speechAnnot, buffs, errMsg);
+}
+
+namespace
+{
+	/// Escapes the attribute value in the same way as QXmlStreamWriter does.
+	void appendXmlAttr(const char* name, boost::string_view valueUtf8, std::string& xmlText)
+	{
+		xmlText.push_back(' ');
+		xmlText.append(name);
+		xmlText.append("=\"");
+		for (char c : valueUtf8)
+		{
+			switch (c)
+			{
+			case '<': xmlText.append("&lt;"); break;
+			case '>': xmlText.append("&gt;"); break;
+			case '&': xmlText.append("&amp;"); break;
+			case '"': xmlText.append("&quot;"); break;
+			case '\n': xmlText.append("&#10;"); break;
+			case '\r': xmlText.append("&#13;"); break;
+			case '\t': xmlText.append("&#9;"); break;
+			default: xmlText.push_back(c);
+			}
+		}
+		xmlText.push_back('"');
+	}
+
+	void appendXmlAttr(const char* name, boost::wstring_view value, std::string& utf8Buf, std::string& xmlText)
+	{
+		utf8Buf.clear();
+		toUtf8StdString(value, utf8Buf);
+		appendXmlAttr(name, utf8Buf, xmlText);
+	}
+
+	void appendXmlAttrInt(const char* name, long value, std::string& xmlText)
+	{
+		char numBuf[32];
+		int len = std::snprintf(numBuf, sizeof(numBuf), "%ld", value);
+		appendXmlAttr(name, boost::string_view(numBuf, len), xmlText);
+	}
+
+	void appendXmlIndent(int depth, std::string& xmlText)
+	{
+		xmlText.push_back('\n');
+		xmlText.append(3 * depth, ' '); // same indent as in saveAudioMarkupToXml
+	}
+}
+
+void writeAudioMarkupXml(const SpeechAnnotation& annot, std::string& xmlText)
+{
+	std::string utf8Buf;
+	xmlText.clear();
+	xmlText.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>");
+
+	appendXmlIndent(0, xmlText);
+	xmlText.append("<");
+	xmlText.append(XmlDocName);
+	appendXmlAttr(AnnotAudioFile, annot.audioFilePathRel(), utf8Buf, xmlText);
+
+	bool isInt = annot.audioSampleRate() == std::truncf(annot.audioSampleRate());
+	int prec = isInt ? 0 : 4; // set 0 for integers to avoid padding zeros after comma
+	QByteArray sampleRateStr = QByteArray::number(annot.audioSampleRate(), 'f', prec); // C locale
+	appendXmlAttr(AnnotAudioSampleRate, boost::string_view(sampleRateStr.constData(), sampleRateStr.size()), xmlText);
+
+	bool hasHeader = !annot.speakers().empty() || !annot.parameters().empty();
+	if (!hasHeader && annot.markers().empty())
+	{
+		xmlText.append("/>\n");
+		return;
+	}
+	xmlText.push_back('>');
+
+	if (hasHeader)
+	{
+		appendXmlIndent(1, xmlText);
+		xmlText.append("<");
+		xmlText.append(AnnotHeaderName);
+		xmlText.append(">");
+		for (const SpeakerFantom& speaker : annot.speakers())
+		{
+			appendXmlIndent(2, xmlText);
+			xmlText.append("<");
+			xmlText.append(HeaderSpeakerNodeName);
+			appendXmlAttr(HeaderSpeakerBriefIdName, speaker.BriefId, utf8Buf, xmlText);
+			appendXmlAttr(HeaderSpeakerNameAttrName, speaker.Name, utf8Buf, xmlText);
+			xmlText.append("/>");
+		}
+		for (const auto& param : annot.parameters())
+		{
+			appendXmlIndent(2, xmlText);
+			xmlText.append("<");
+			xmlText.append(HeaderParameterNodeName);
+			appendXmlAttr(HeaderParameterNameAttrName, param.Name, xmlText);
+			appendXmlAttr(HeaderParameterValueAttrName, param.Value, xmlText);
+			xmlText.append("/>");
+		}
+		appendXmlIndent(1, xmlText);
+		xmlText.append("</");
+		xmlText.append(AnnotHeaderName);
+		xmlText.append(">");
+	}
+
+	for (const TimePointMarker& marker : annot.markers())
+	{
+		appendXmlIndent(1, xmlText);
+		xmlText.append("<");
+		xmlText.append(MarkerName);
+		appendXmlAttrInt(MarkerIdName, marker.Id, xmlText);
+		appendXmlAttrInt(MarkerSampleIndName, marker.SampleInd, xmlText);
+
+		const char* levelOfDetailStr = "error";
+		if (marker.LevelOfDetail == MarkerLevelOfDetail::Word)
+			levelOfDetailStr = MarkerLevelOfDetailWordName;
+		else if (marker.LevelOfDetail == MarkerLevelOfDetail::Phone)
+			levelOfDetailStr = MarkerLevelOfDetailPhoneName;
+		appendXmlAttr(MarkerLevelOfDetailName, levelOfDetailStr, xmlText);
+
+		if (!marker.TranscripText.isEmpty())
+		{
+			QByteArray textUtf8 = marker.TranscripText.toUtf8();
+			appendXmlAttr(MarkerTranscripTextName, boost::string_view(textUtf8.constData(), textUtf8.size()), xmlText);
+		}
+
+		if (marker.Language != SpeechLanguage::NotSet)
+			appendXmlAttr(MarkerLanguageName, speechLanguageToStr(marker.Language), xmlText);
+
+		if (!marker.SpeakerBriefId.empty())
+			appendXmlAttr(MarkerSpeakerBriefIdName, marker.SpeakerBriefId, utf8Buf, xmlText);
+
+		if (marker.ExcludePhase != boost::none)
+			appendXmlAttr(MarkerExcludePhaseName, toString(marker.ExcludePhase.get()), xmlText);
+
+		xmlText.append("/>");
+	}
+
+	appendXmlIndent(0, xmlText);
+	xmlText.append("</");
+	xmlText.append(XmlDocName);
+	xmlText.append(">\n");
+}
+
+bool saveAudioMarkupXmlFast(const SpeechAnnotation& annot, const boost::filesystem::path& annotFilePathAbs, std::string& xmlTextBuff, ErrMsgList* errMsg)
+{
+	writeAudioMarkupXml(annot, xmlTextBuff);
+
+	boost::filesystem::path tmpPath = annotFilePathAbs;
+	tmpPath += ".tmp";
+	{
+		QFile file(toQStringBfs(tmpPath));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+		{
+			pushErrorMsg(errMsg, "Can't open file for writing");
+			return false;
+		}
+		if (file.write(xmlTextBuff.data(), xmlTextBuff.size()) != (qint64)xmlTextBuff.size())
+		{
+			pushErrorMsg(errMsg, "Can't write audio markup xml");
+			return false;
+		}
+	}
+
+	boost::system::error_code ec;
+	boost::filesystem::rename(tmpPath, annotFilePathAbs, ec);
+	if (ec)
+	{
+		pushErrorMsg(errMsg, ec.message());
+		pushErrorMsg(errMsg, "Can't replace audio markup file");
+		return false;
+	}
+	return true;
+}
+
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 #include <tuple>
+#include <vector>
+#include <string>
+#include <boost/utility/string_view.hpp>
 #include <boost/filesystem.hpp>
 #include "PticaGovorunCore.h" // PG_EXPORTS
 #include "SpeechProcessing.h" // TimePointMarker
@@ -11,4 +14,28 @@ namespace PticaGovorun {
 PG_EXPORTS std::tuple<bool, const char*> loadAudioMarkupFromXml(const std::wstring& audioFilePathAbs, SpeechAnnotation& speechAnnot);
 PG_EXPORTS bool loadAudioMarkupXml(const boost::filesystem::path& audioFilePathAbs, SpeechAnnotation& speechAnnot, ErrMsgList* errMsg);
 PG_EXPORTS std::tuple<bool, const char*> saveAudioMarkupToXml(const SpeechAnnotation& annot, const std::wstring& audioFilePathAbs);
+
+/// Buffers which are reused between successive loads of speech annotation files.
+/// Create one instance per thread to avoid reallocations when many files are processed.
+struct PG_EXPORTS AudioMarkupXmlBuffers
+{
+	std::vector<char> FileContent;
+	std::string AttrValue;
+	std::vector<std::pair<boost::string_view, boost::string_view>> Attrs; // name, raw value
+	std::vector<boost::string_view> OpenElements;
+};
+
+/// Parses speech annotation from in-memory xml without building the DOM tree.
+/// Produces the same annotation as loadAudioMarkupFromXml.
+PG_EXPORTS bool parseAudioMarkupXml(boost::string_view xmlText, SpeechAnnotation& speechAnnot, AudioMarkupXmlBuffers& buffs, ErrMsgList* errMsg);
+
+/// Streaming counterpart of loadAudioMarkupXml. The file is read in one call into the reusable buffer.
+PG_EXPORTS bool loadAudioMarkupXmlFast(const boost::filesystem::path& annotFilePathAbs, SpeechAnnotation& speechAnnot, AudioMarkupXmlBuffers& buffs, ErrMsgList* errMsg);
+
+/// Serializes speech annotation into xml text. The output is byte to byte the same as of saveAudioMarkupToXml.
+PG_EXPORTS void writeAudioMarkupXml(const SpeechAnnotation& annot, std::string& xmlText);
+
+/// Streaming counterpart of saveAudioMarkupToXml. The xml is written into temporary file which then replaces
+/// the target file, so the readers never see partially written annotation.
+PG_EXPORTS bool saveAudioMarkupXmlFast(const SpeechAnnotation& annot, const boost::filesystem::path& annotFilePathAbs, std::string& xmlTextBuff, ErrMsgList* errMsg);
 }
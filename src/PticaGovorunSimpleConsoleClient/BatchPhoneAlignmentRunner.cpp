@@ -0,0 +1,120 @@
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include "AppHelpers.h"
+#include "BatchPhoneAlignment.h"
+#include "CoreUtils.h"
+#include "SpeechDataValidation.h"
+
+namespace BatchPhoneAlignmentRunnerNS
+{
+	using namespace PticaGovorun;
+
+	void run()
+	{
+		auto speechProjDir = toBfs(AppHelpers::configParamQString("speechProjDir", ""));
+		auto modelFilePath = toBfs(AppHelpers::configParamQString("phoneGmmModelPath", "phoneGmm.ark"));
+		auto journalFilePath = toBfs(AppHelpers::configParamQString("alignJournalPath", "alignPhones.journal"));
+		int threadsCount = AppHelpers::configParamInt("threadsCount", -1);
+		int gmmComponentsCount = AppHelpers::configParamInt("phoneGmmComponentsCount", 8);
+
+		static const size_t WordsCount = 200000;
+		auto stringArena = std::make_shared<GrowOnlyPinArena<wchar_t>>(WordsCount * 6); // W*C, W words, C chars per word
+
+		bool allowSoftHardConsonant = true;
+		bool allowVowelStress = true;
+		std::shared_ptr<const PhoneRegistry> phoneReg = sharedPhoneRegistryUk(allowSoftHardConsonant, allowVowelStress, PalatalSupport::AsPalatal);
+
+		SpeechData speechData(speechProjDir);
+		speechData.setStringArena(stringArena);
+		speechData.setPhoneReg(phoneReg);
+		ErrMsgList errMsg;
+		if (!speechData.Load(false, &errMsg))
+		{
+			std::wcerr << combineErrorMessages(errMsg).toStdWString() << std::endl;
+			return;
+		}
+
+		// worker threads read the immutable snapshot
+		std::shared_ptr<const PhoneticDictSnapshot> dicts = speechData.phoneticDictSnapshot();
+
+		// the transcription consists of pronCodes; the lookup is done for each word of each segment
+		std::unordered_map<std::wstring, std::vector<std::string>> pronCodeToPhones;
+		std::string phoneStr;
+		for (const auto* dict : { dicts->WellFormed.get(), dicts->Broken.get(), dicts->Filler.get() })
+		{
+			for (const auto& pair : *dict)
+			{
+				for (const PronunciationFlavour& pron : pair.second.Pronunciations)
+				{
+					std::vector<std::string>& phones = pronCodeToPhones[toStdWString(pron.PronCode)];
+					if (!phones.empty())
+						continue;
+					for (PhoneId phoneId : pron.Phones)
+					{
+						phoneStr.clear();
+						phoneToStr(*phoneReg, phoneId, phoneStr);
+						phones.push_back(phoneStr);
+					}
+				}
+			}
+		}
+		auto wordToPhoneListFun = [&pronCodeToPhones](const std::wstring& word, std::vector<std::string>& wordPhones) -> bool
+		{
+			auto it = pronCodeToPhones.find(word);
+			if (it == pronCodeToPhones.end())
+				return false;
+			wordPhones.insert(wordPhones.end(), it->second.begin(), it->second.end());
+			return true;
+		};
+
+		std::vector<AnnotSpeechFileNode> annotFiles;
+		findAnnotationFilesFlat(speechData.speechAnnotDirPath(), annotFiles, threadsCount);
+		std::vector<boost::filesystem::path> annotFilePaths;
+		for (const AnnotSpeechFileNode& fileNode : annotFiles)
+			annotFilePaths.push_back(toBfs(fileNode.SpeechAnnotationAbsPath));
+
+		// the model is trained on manually aligned phones once and reused by subsequent runs
+		PhoneGmmModel model;
+		if (boost::filesystem::exists(modelFilePath))
+		{
+			if (!loadPhoneGmmModel(modelFilePath, model, &errMsg))
+			{
+				std::wcerr << combineErrorMessages(errMsg).toStdWString() << std::endl;
+				return;
+			}
+		}
+		else
+		{
+			std::wcout << L"Training phone GMMs..." << std::endl;
+			if (!trainPhoneGmmModel(annotFilePaths, gmmComponentsCount, threadsCount, model, &errMsg) ||
+				!savePhoneGmmModel(model, modelFilePath, &errMsg))
+			{
+				std::wcerr << combineErrorMessages(errMsg).toStdWString() << std::endl;
+				return;
+			}
+		}
+
+		BatchPhoneAligner aligner(model, wordToPhoneListFun);
+		aligner.setJournalFilePath(journalFilePath);
+		aligner.setThreadsCount(threadsCount);
+		size_t filesCount = annotFilePaths.size();
+		aligner.setProgressFun([filesCount](const boost::filesystem::path& annotFilePath, const ErrMsgList* fileErr, const BatchPhoneAlignmentStats& stats)
+		{
+			int filesProcessed = stats.FilesDone + stats.FilesSkipped + stats.FilesFailed;
+			std::wcout << boost::wformat(L"[%1%/%2%] %3% segs/s %4%") % filesProcessed % filesCount % stats.segmentsPerSec() % annotFilePath.wstring() << std::endl;
+			if (fileErr != nullptr)
+				std::wcerr << combineErrorMessages(*fileErr).toStdWString() << std::endl;
+		});
+
+		BatchPhoneAlignmentStats stats;
+		if (!aligner.run(annotFilePaths, stats, &errMsg))
+		{
+			std::wcerr << combineErrorMessages(errMsg).toStdWString() << std::endl;
+			return;
+		}
+		std::wcout << boost::wformat(L"files: done=%1% skipped=%2% failed=%3%; segments: aligned=%4% failed=%5%; %6% segs/s") %
+			stats.FilesDone % stats.FilesSkipped % stats.FilesFailed % stats.SegmentsAligned % stats.SegmentsFailed % stats.segmentsPerSec() << std::endl;
+	}
+}
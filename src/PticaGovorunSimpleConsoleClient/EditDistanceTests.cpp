@@ -1,7 +1,12 @@
 #include <vector>
 #include <array>
 #include <iostream>
+#include <chrono>
 #include "StringUtils.h"
+#include "SpeechAnnotation.h"
+#include "XmlAudioMarkup.h"
+#include "CoreUtils.h"
+#include "AppHelpers.h"
 #include <TranscriberUI/PhoneticDictionaryViewModel.h>
 
 namespace EditDistanceTestsNS
@@ -115,6 +120,92 @@ namespace EditDistanceTestsNS
 		std::wcout << w2Str << std::endl;
 	}
 
+	// Compares the speed of edit distance algorithms on pairs of real transcripts.
+	void benchmarkEditDistance()
+	{
+		auto speechProjDir = toBfs(AppHelpers::configParamQString("speechProjDir", ""));
+		auto annotRootDir = speechProjDir / "SpeechAnnot";
+
+		std::vector<AnnotSpeechFileNode> annotFiles;
+		findAnnotationFilesFlat(annotRootDir, annotFiles);
+
+		// the transcript of each annotation file is a concatenation of its markers' texts
+		std::vector<std::wstring> transcripts;
+		AudioMarkupXmlBuffers buffs;
+		for (const AnnotSpeechFileNode& node : annotFiles)
+		{
+			SpeechAnnotation annot;
+			ErrMsgList errMsg;
+			if (!loadAudioMarkupXmlFast(toBfs(node.SpeechAnnotationAbsPath), annot, buffs, &errMsg))
+			{
+				std::cerr << str(errMsg) << std::endl;
+				continue;
+			}
+			std::wstring text;
+			for (const TimePointMarker& marker : annot.markers())
+			{
+				if (marker.TranscripText.isEmpty())
+					continue;
+				if (!text.empty())
+					text.push_back(L' ');
+				text.append(marker.TranscripText.toStdWString());
+			}
+			if (!text.empty())
+				transcripts.push_back(std::move(text));
+		}
+		if (transcripts.size() < 2)
+		{
+			std::cerr << "Not enough transcripts in " << annotRootDir << std::endl;
+			return;
+		}
+
+		typedef std::chrono::steady_clock Clock;
+		auto timeIt = [&transcripts](const char* algoName, std::function<float(std::wstring&, std::wstring&)> distFun)
+		{
+			std::chrono::time_point<Clock> now1 = Clock::now();
+			double distSum = 0;
+			for (size_t i = 0; i + 1 < transcripts.size(); ++i)
+				distSum += distFun(transcripts[i], transcripts[i + 1]);
+			std::chrono::time_point<Clock> now2 = Clock::now();
+			auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now2 - now1).count();
+			std::cout << algoName << " elapsedMs=" << elapsedMs << " distSum=" << distSum << std::endl;
+		};
+
+		WordErrorCosts<wchar_t> c;
+		timeIt("fullMatrix", [&c](std::wstring& first, std::wstring& second) -> float
+		{
+			return findEditDistanceNew<wchar_t, WordErrorCosts<wchar_t>>(first, second, c);
+		});
+		timeIt("bitParallel", [](std::wstring& first, std::wstring& second) -> float
+		{
+			return editDistanceBitParallel<wchar_t>(first, second);
+		});
+		timeIt("banded", [&c](std::wstring& first, std::wstring& second) -> float
+		{
+			// the threshold of 30% of the longest transcript; the distant pairs are counted as maxCost
+			float maxCost = 0.3f * std::max(first.size(), second.size());
+			float dist;
+			if (!findEditDistanceBanded<wchar_t, WordErrorCosts<wchar_t>>(first, second, c, maxCost, dist))
+				return maxCost;
+			return dist;
+		});
+
+		EditDistance<wchar_t, WordErrorCosts<wchar_t>> editDist;
+		std::vector<EditStep> editRecipe;
+		timeIt("fullMatrixRecipe", [&c, &editDist, &editRecipe](std::wstring& first, std::wstring& second) -> float
+		{
+			editDist.estimateAllDistances(first, second, c);
+			editRecipe.clear();
+			editDist.minCostRecipe(editRecipe);
+			return editDist.distance();
+		});
+		timeIt("hirschbergRecipe", [&c, &editRecipe](std::wstring& first, std::wstring& second) -> float
+		{
+			editRecipe.clear();
+			return minCostRecipeHirschberg<wchar_t, WordErrorCosts<wchar_t>>(first, second, c, editRecipe);
+		});
+	}
+
 	void run()
 	{
 		//simpleChar();
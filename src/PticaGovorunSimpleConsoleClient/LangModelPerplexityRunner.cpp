@@ -0,0 +1,43 @@
+#include <iostream>
+#include <chrono>
+#include <boost/format.hpp>
+#include "AppHelpers.h"
+#include "ArpaLanguageModelQuery.h"
+#include "CoreUtils.h"
+
+namespace LangModelPerplexityRunnerNS
+{
+	using namespace PticaGovorun;
+	typedef std::chrono::system_clock Clock;
+
+	void run()
+	{
+		auto langModelFilePath = toBfs(AppHelpers::configParamQString("langModelPath", ""));
+		auto textFilesDir = toBfs(AppHelpers::configParamQString("perplexityTextDir", ""));
+		auto numDictPath = AppHelpers::mapPathBfs("pgdata/LM_ua/numsCardOrd.xml");
+		int maxFilesToProcess = AppHelpers::configParamInt("perplexityMaxFilesToProcess", -1);
+		int threadsCount = AppHelpers::configParamInt("threadsCount", -1);
+
+		ErrMsgList errMsg;
+		ArpaLanguageModelQuery langModel;
+		if (!langModel.load(langModelFilePath, &errMsg))
+		{
+			std::wcerr << combineErrorMessages(errMsg).toStdWString() << std::endl;
+			return;
+		}
+
+		std::chrono::time_point<Clock> now1 = Clock::now();
+		PerplexityStat stat;
+		if (!evaluateLangModelPerplexity(langModel, textFilesDir, numDictPath, maxFilesToProcess, threadsCount, stat, &errMsg))
+		{
+			std::wcerr << combineErrorMessages(errMsg).toStdWString() << std::endl;
+			return;
+		}
+		std::chrono::time_point<Clock> now2 = Clock::now();
+		auto elapsedSec = std::chrono::duration_cast<std::chrono::seconds>(now2 - now1).count();
+
+		std::wcout << boost::wformat(L"sentences=%1% words=%2% oov=%3% (%4%%%) zeroProb=%5%") %
+			stat.SentCount % stat.WordCount % stat.OovCount % (stat.oovRate() * 100) % stat.ZeroProbCount << std::endl;
+		std::wcout << boost::wformat(L"perplexity=%1% took=%2%s") % stat.perplexity() % elapsedSec << std::endl;
+	}
+}
@@ -1,9 +1,11 @@
 #include <iostream>
 #include <tuple>
+#include <chrono>
 #include <QFile>
 #include <QTextStream>
 #include "PhoneticService.h"
 #include <CoreUtils.h>
+#include "AppHelpers.h"
 
 namespace PhoneticSpellerTestsNS
 {
@@ -97,7 +99,7 @@ namespace PhoneticSpellerTestsNS
 				bool keepVowelStress = true;
 				updatePhoneModifiers(phoneReg, true, keepVowelStress, phonesAuto);
 
-				std::vector<PhoneId> phonesDict = pron.Phones;
+				std::vector<PhoneId> phonesDict(pron.Phones.begin(), pron.Phones.end());
 				updatePhoneModifiers(phoneReg, true, keepVowelStress, phonesDict);
 
 				bool eqS = phonesAuto == phonesDict;
@@ -126,6 +128,56 @@ namespace PhoneticSpellerTestsNS
 			}
 		}
 	}
+	// Reports the load time and the memory, occupied by phones of the phonetic dictionary.
+	void benchmarkPhoneticDictMemory()
+	{
+		auto speechProjDir = toBfs(AppHelpers::configParamQString("speechProjDir", ""));
+		boost::filesystem::path dictPath = speechProjDir / "PhoneticDict/phoneticDictUkKnown.xml";
+
+		PhoneRegistry phoneReg;
+		initPhoneRegistryUk(phoneReg, true, true);
+
+		typedef std::chrono::steady_clock Clock;
+		std::chrono::time_point<Clock> now1 = Clock::now();
+
+		GrowOnlyPinArena<wchar_t> stringArena(10000);
+		std::vector<PhoneticWord> phoneticDict;
+		ErrMsgList errMsg;
+		if (!loadPhoneticDictionaryXml(dictPath, phoneReg, phoneticDict, stringArena, &errMsg))
+		{
+			std::cerr << str(errMsg) << std::endl;
+			return;
+		}
+		std::chrono::time_point<Clock> now2 = Clock::now();
+		auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now2 - now1).count();
+
+		size_t pronsCount = 0;
+		size_t phonesCount = 0;
+		size_t heapPronsCount = 0; // pronunciations with phones outside the inline storage
+		size_t phonesBytes = 0;
+		for (const PhoneticWord& word : phoneticDict)
+		{
+			for (const PronunciationFlavour& pron : word.Pronunciations)
+			{
+				pronsCount += 1;
+				phonesCount += pron.Phones.size();
+				phonesBytes += sizeof(pron.Phones);
+				if (!pron.Phones.isInline())
+				{
+					heapPronsCount += 1;
+					phonesBytes += pron.Phones.capacity() * sizeof(PhoneId);
+				}
+			}
+		}
+		// the same phones as std::vector<int> of the exact size
+		size_t vectorPhonesBytes = pronsCount * sizeof(std::vector<int>) + phonesCount * sizeof(int);
+
+		std::cout << "words=" << phoneticDict.size() << " prons=" << pronsCount << " phones=" << phonesCount << std::endl;
+		std::cout << "loadMs=" << elapsedMs << std::endl;
+		std::cout << "sizeof(PhoneId)=" << sizeof(PhoneId) << " sizeof(PronunciationFlavour)=" << sizeof(PronunciationFlavour) << std::endl;
+		std::cout << "phonesBytes=" << phonesBytes << " heapProns=" << heapPronsCount << " vectorPhonesBytes=" << vectorPhonesBytes << std::endl;
+	}
+
 	void run()
 	{
 		//simple1();
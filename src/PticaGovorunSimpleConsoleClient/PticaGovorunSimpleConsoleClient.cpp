@@ -14,14 +14,14 @@ namespace ComputeSpeechMfccTesterNS { void run(); }
 namespace ResampleAudioTesterNS { void run(); }
 namespace RecognizeSpeechSphinxTester { void run(); }
 namespace RecognizeSpeechInBatchTester { void runMain(int argc, wchar_t* argv[]); }
-namespace EditDistanceTestsNS { void run(); }
+namespace EditDistanceTestsNS { void run(); void benchmarkEditDistance(); }
 namespace MigrateXmlSpeechAnnotRunnerNS { void run(); }
-namespace PhoneticSpellerTestsNS { void run(); }
+namespace PhoneticSpellerTestsNS { void run(); void benchmarkPhoneticDictMemory(); }
 namespace StressedSyllableRunnerNS { void run(); }
 namespace PronunciationChecksRunnerNS { void run(); }
 namespace RunPrepareTrainModelSphinxNS { void run(); }
 namespace PdfReaderRunnerNS { void run(); }
-namespace RunTextParserNS { void run(); }
+namespace RunTextParserNS { void run(); void benchmarkTextParser(const QString& filePath); }
 namespace UkrainianPhoneticSplitterNS { void run(); }
 namespace RunBuildLanguageModelNS { void runMain(int argc, wchar_t* argv[]); }
 namespace PrepareSphinxTrainDataNS { void run(); }
@@ -29,6 +29,8 @@ namespace DslDictionaryConvertRunnerNS { void run(); }
 namespace SphinxIfRunnerNS { void run(); }
 namespace SegmentsLoaderRunnerNS { void run(); }
 namespace VadRunnerNS { void run(); }
+namespace BatchPhoneAlignmentRunnerNS { void run(); }
+namespace LangModelPerplexityRunnerNS { void run(); }
 
 int mainCore(int argc, char* argv[])
 {
@@ -43,6 +45,31 @@ int mainCore(int argc, char* argv[])
 		RecognizeSpeechSphinxTester::run(); // 2
 		return 0;
 	}
+	if (taskStr == "alignPhones")
+	{
+		BatchPhoneAlignmentRunnerNS::run();
+		return 0;
+	}
+	if (taskStr == "benchmarkEditDistance")
+	{
+		EditDistanceTestsNS::benchmarkEditDistance();
+		return 0;
+	}
+	if (taskStr == "benchmarkTextParser")
+	{
+		RunTextParserNS::benchmarkTextParser(PticaGovorun::AppHelpers::configParamQString("benchmarkTextFilePath", ""));
+		return 0;
+	}
+	if (taskStr == "benchmarkPhoneticDictMemory")
+	{
+		PhoneticSpellerTestsNS::benchmarkPhoneticDictMemory();
+		return 0;
+	}
+	if (taskStr == "langModelPerplexity")
+	{
+		LangModelPerplexityRunnerNS::run();
+		return 0;
+	}
 
 	//SliceTesterNS::run();
 	//MatlabTesterNS::run();
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <locale>
 #include <set>
+#include <memory>
+#include <numeric> // std::iota
 
 #include <windows.h>
 
@@ -26,6 +28,8 @@
 #include "SphinxModel.h"
 #include "assertImpl.h"
 #include "AppHelpers.h"
+#include "ParallelUtils.h"
+#include "DecoderResultCache.h"
 
 namespace RecognizeSpeechSphinxTester
 {
@@ -352,22 +356,130 @@ namespace RecognizeSpeechSphinxTester
 		float DistWords; // edit distance between utterances as a sequence of words
 		float DistChars; // edit distance between utterances as a sequence of chars
 		float DistPhones; // edit distance between utterances as a sequence of phones
-		TranscribedAudioSegment Segment;
+		const TranscribedAudioSegment* Segment; // audio samples are not copied
 		std::wstring TextActual;
-		std::vector<boost::wstring_view> PronIdsExpected; // (2)
-		std::vector<boost::wstring_view> WordsExpected; //  without any braces
+		std::vector<std::wstring> PronIdsExpected; // (2)
+		std::vector<std::wstring> WordsExpected; //  without any braces
 		std::vector<std::wstring> PronIdsActualRaw;
 		std::vector<std::wstring> WordsActual;
 		std::vector<float> WordProbs; // confidence of each recognized word
 		std::vector<float> WordProbsMerged;
 		std::vector<PhoneId> PhonesExpected;
 		std::vector<PhoneId> PhonesActual;
+		std::wstring WordsExpectedAlignedStr;
+		std::wstring WordsActualAlignedStr;
 		std::string PhonesExpectedAlignedStr;
 		std::string PhonesActualAlignedStr;
 		std::wstring PhonesExpectedExpansionErrorMsg; // specify which expected pronCode can't be expanded
 	};
 
-	void updateConfusionMatrix(std::vector<int>& phoneConfusionMat, int phonesCount, std::vector<PhoneId> expectedPhones, std::vector<PhoneId> actualPhones, std::vector<EditStep> phoneEditRecipe)
+	// Output of the decoder for one speech segment.
+	struct DecodedUtterance
+	{
+		std::wstring TextActual;
+		std::vector<std::wstring> PronIdsActualRaw;
+		std::vector<float> WordProbs; // confidence of each recognized word
+	};
+
+	// Expected phones of the utterance, expanded from its reference transcription.
+	struct ReferencePhones
+	{
+		std::wstring Transcription;
+		std::vector<PhoneId> Phones;
+		std::wstring ExpansionErrorMsg; // not empty if some pronCode can't be expanded
+	};
+
+	// Reference phones of utterances for one version of the speech model.
+	// The expansion depends only on the transcription and the phonetic dictionary of the model,
+	// so it is reused between runs of the decoder on the same model.
+	class ReferencePhonesCache
+	{
+		std::map<std::wstring, ReferencePhones> utters_; // key=RelFilePathNoExt
+	public:
+		const ReferencePhones* find(const std::wstring& relFilePathNoExt, const std::wstring& transcription) const
+		{
+			auto it = utters_.find(relFilePathNoExt);
+			if (it == utters_.end() || it->second.Transcription != transcription)
+				return nullptr;
+			return &it->second;
+		}
+
+		void put(const std::wstring& relFilePathNoExt, const ReferencePhones& refPhones)
+		{
+			utters_[relFilePathNoExt] = refPhones;
+		}
+
+		// The absent file is treated as an empty cache. The lines which can't be parsed are skipped.
+		std::tuple<bool, const char*> load(const QString& filePath, const PhoneRegistry& phoneReg)
+		{
+			utters_.clear();
+			QFile file(filePath);
+			if (!file.exists())
+				return std::make_tuple(true, nullptr);
+			if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+				return std::make_tuple(false, "Can't open reference phones cache");
+
+			QTextStream fileStream(&file);
+			fileStream.setCodec("UTF-8");
+			if (fileStream.readLine() != ReferencePhonesCacheHeader)
+				return std::make_tuple(true, nullptr); // unknown format, the cache is rebuilt
+
+			while (!fileStream.atEnd())
+			{
+				QString line = fileStream.readLine();
+				QStringList parts = line.split('\t');
+				if (parts.size() != 4)
+					continue;
+
+				ReferencePhones refPhones;
+				refPhones.Transcription = parts[1].toStdWString();
+				if (parts[2] == "1")
+				{
+					std::string phonesStr = parts[3].toStdString();
+					if (!parsePhoneList(phoneReg, phonesStr, refPhones.Phones))
+						continue;
+				}
+				else
+					refPhones.ExpansionErrorMsg = parts[3].toStdWString();
+				utters_[parts[0].toStdWString()] = std::move(refPhones);
+			}
+			return std::make_tuple(true, nullptr);
+		}
+
+		std::tuple<bool, const char*> save(const QString& filePath, const PhoneRegistry& phoneReg) const
+		{
+			QFile file(filePath);
+			if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+				return std::make_tuple(false, "Can't open reference phones cache for writing");
+
+			QTextStream fileStream(&file);
+			fileStream.setCodec("UTF-8");
+			fileStream << ReferencePhonesCacheHeader << "\n";
+
+			std::string phonesStr;
+			for (const auto& pair : utters_)
+			{
+				const ReferencePhones& refPhones = pair.second;
+				fileStream << QString::fromStdWString(pair.first) << "\t" << QString::fromStdWString(refPhones.Transcription) << "\t";
+				if (refPhones.ExpansionErrorMsg.empty())
+				{
+					phonesStr.clear();
+					if (!phoneListToStr(phoneReg, refPhones.Phones, phonesStr))
+						return std::make_tuple(false, "Can't convert phones to string");
+					fileStream << "1\t" << QString::fromStdString(phonesStr);
+				}
+				else
+					fileStream << "0\t" << QString::fromStdWString(refPhones.ExpansionErrorMsg);
+				fileStream << "\n";
+			}
+			return std::make_tuple(true, nullptr);
+		}
+	private:
+		static const char* ReferencePhonesCacheHeader;
+	};
+	const char* ReferencePhonesCache::ReferencePhonesCacheHeader = "#referencePhones v1";
+
+	void updateConfusionMatrix(std::vector<int>& phoneConfusionMat, int phonesCount, const std::vector<PhoneId>& expectedPhones, const std::vector<PhoneId>& actualPhones, const std::vector<EditStep>& phoneEditRecipe)
 	{
 		for (const EditStep& step : phoneEditRecipe)
 		{
@@ -396,25 +508,39 @@ namespace RecognizeSpeechSphinxTester
 		}
 	}
 
+	// Runs the decoder on each segment. The decoder is not thread safe, so segments are processed sequentially.
+	// The segments, decoded earlier with the same model and config, are taken from the cache.
 	void decodeSpeechSegments(const std::vector<TranscribedAudioSegment>& segs,
-
-	                          ps_decoder_t* ps, float targetSampleRate, std::vector<TwoUtterances>& recogUtterances,
-	                          std::vector<int>& phoneConfusionMat, int phonesCount,
-	                          int& sentErrorTotalCount,
-	                          int& wordErrorTotalCount, int& wordTotalCount,
-	                          int& phoneErrorTotalCount, int& phoneTotalCount,
-	                          EditDistance<PhoneId, PhoneProximityCosts>& phonesEditDist,
-	                          const PhoneProximityCosts& editCost,
-	                          const std::map<boost::wstring_view, PronunciationFlavour>& pronCodeToPronTest,
-	                          const std::map<boost::wstring_view, PronunciationFlavour>& pronCodeToPronFiller,
-	                          const PhoneRegistry& phoneReg, bool excludeSilFromDecOutput)
+	                          ps_decoder_t* ps, float targetSampleRate,
+	                          DecoderResultCache& decoderCache, boost::wstring_view speechModelVerStr, boost::string_view decoderConfig,
+	                          std::vector<DecodedUtterance>& decodedUtterances)
 	{
 		QTextCodec* textCodec = QTextCodec::codecForName("utf8");
+		fe_t* pFeatInfo = ps->acmod->fe; // feature extraction info
+		int frameSize = pFeatInfo->frame_size;
+		int frameShift = pFeatInfo->frame_shift;
+		int cachedCount = 0;
 
 		for (int i = 0; i < segs.size(); ++i)
 		{
 			const TranscribedAudioSegment& seg = segs[i];
 
+			DecoderCacheKey cacheKey = makeDecoderCacheKey(seg.Samples, seg.SampleRate, speechModelVerStr, decoderConfig);
+			DecodedResult cachedResult;
+			if (decoderCache.find(cacheKey, cachedResult))
+			{
+				DecodedUtterance decoded;
+				decoded.TextActual = std::move(cachedResult.Hypothesis);
+				for (DecodedWord& word : cachedResult.Words)
+				{
+					decoded.PronIdsActualRaw.push_back(std::move(word.Word));
+					decoded.WordProbs.push_back(word.Prob);
+				}
+				decodedUtterances.push_back(std::move(decoded));
+				cachedCount++;
+				continue;
+			}
+
 			// decode
 
 			const std::vector<short>* speechFramesActual = &seg.Samples;
@@ -478,16 +604,18 @@ namespace RecognizeSpeechSphinxTester
 				hyp = "";
 			}
 
-			std::wstring hypWStr = textCodec->toUnicode(hyp).toStdWString();
+			DecodedUtterance decoded;
+			decoded.TextActual = textCodec->toUnicode(hyp).toStdWString();
+
+			DecodedResult decodedResult;
+			decodedResult.Hypothesis = decoded.TextActual;
 
 			// find words and word probabilities
-			std::vector<std::wstring> pronIdsActualRaw;
-			std::vector<float> wordsActualProbs;
 			for (ps_seg_t* recogSeg = ps_seg_iter(ps); recogSeg; recogSeg = ps_seg_next(recogSeg))
 			{
 				const char* word = ps_seg_word(recogSeg);
 				std::wstring wordWStr = textCodec->toUnicode(word).toStdWString();
-				pronIdsActualRaw.push_back(wordWStr);
+				decoded.PronIdsActualRaw.push_back(wordWStr);
 
 				int startFrame, endFrame;
 				ps_seg_frames(recogSeg, &startFrame, &endFrame);
@@ -496,30 +624,140 @@ namespace RecognizeSpeechSphinxTester
 				int32 post = ps_seg_prob(recogSeg, &ascr, &lscr, &lback); // posterior probability?
 
 				float64 prob = logmath_exp(ps_get_logmath(ps), post);
-				wordsActualProbs.push_back((float)prob);
+				decoded.WordProbs.push_back((float)prob);
+
+				// sample range in the original sample rate of the segment
+				DecodedWord decodedWord;
+				decodedWord.Word = wordWStr;
+				frameRangeToSampleRange(startFrame, endFrame, FrameToSamplePicker, frameSize, frameShift, decodedWord.BegSample, decodedWord.EndSample);
+				decodedWord.BegSample = (long)(decodedWord.BegSample * seg.SampleRate / targetSampleRate);
+				decodedWord.EndSample = (long)(decodedWord.EndSample * seg.SampleRate / targetSampleRate);
+				decodedWord.Prob = (float)prob;
+				decodedResult.Words.push_back(std::move(decodedWord));
 			}
+			decodedUtterances.push_back(std::move(decoded));
+
+			ErrMsgList errMsg;
+			if (!decoderCache.put(cacheKey, decodedResult, &errMsg))
+				std::cerr << str(errMsg) << std::endl; // proceed without the cache
+		}
+		std::wcout << L"Decoded segments taken from cache: " << cachedCount << L"/" << segs.size() << std::endl;
+	}
+
+	// The state of the thread which evaluates decoded utterances.
+	struct EvaluationThreadState
+	{
+		EditDistance<PhoneId, PhoneProximityCosts> PhonesEditDist;
+		EditDistance<wchar_t, CharPhonationGroupCosts> CharsEditDist;
+		GrowOnlyPinArena<wchar_t> Arena;
+		std::vector<int> PhoneConfusionMat;
+		std::vector<EditStep> EditRecipe;
+
+		EvaluationThreadState() : Arena(1024) {}
+	};
+
+	// Compares decoded utterances with expected ones on multiple threads.
+	// Each thread accumulates its own phone confusion matrix, which are summed at the end.
+	// The reference phones are taken from the cache; the missing ones are expanded and put into the cache.
+	void evaluateDecodedUtterances(const std::vector<TranscribedAudioSegment>& segs, const std::vector<DecodedUtterance>& decodedUtterances,
+	                               int threadsCount, std::vector<TwoUtterances>& recogUtterances,
+	                               std::vector<int>& phoneConfusionMat, int phonesCount,
+	                               int& sentErrorTotalCount,
+	                               int& wordErrorTotalCount, int& wordTotalCount,
+	                               int& phoneErrorTotalCount, int& phoneTotalCount,
+	                               const PhoneProximityCosts& editCost,
+	                               const std::map<boost::wstring_view, PronunciationFlavour>& pronCodeToPronTest,
+	                               const std::map<boost::wstring_view, PronunciationFlavour>& pronCodeToPronFiller,
+	                               const PhoneRegistry& phoneReg, bool excludeSilFromDecOutput,
+	                               ReferencePhonesCache& refPhonesCache)
+	{
+		size_t uttersCount = decodedUtterances.size();
+		PG_Assert(uttersCount <= segs.size());
+
+		threadsCount = parallelThreadsCount(uttersCount, threadsCount);
+		std::vector<std::unique_ptr<EvaluationThreadState>> threadStates;
+		for (int i = 0; i < threadsCount; ++i)
+		{
+			threadStates.push_back(std::make_unique<EvaluationThreadState>());
+			threadStates.back()->PhoneConfusionMat.resize(phoneConfusionMat.size(), 0);
+		}
+
+		recogUtterances.resize(uttersCount);
+		std::vector<char> isRefPhonesNew(uttersCount, false); // char, because vector<bool> can't be written concurrently
+		CharPhonationGroupCosts charCosts;
+
+		auto isFillerFun = [&pronCodeToPronFiller](boost::wstring_view pronCode)
+		{
+			return pronCodeToPronFiller.find(pronCode) != pronCodeToPronFiller.end();
+		};
+
+		auto trimNumberInParenthesisFun = [](const std::vector<boost::wstring_view>& words, std::vector<boost::wstring_view>& outWords)
+			{
+				for (boost::wstring_view pronId : words)
+				{
+					boost::wstring_view baseWord;
+					parsePronId(pronId, baseWord);
+					outWords.push_back(baseWord);
+				}
+			};
+
+		auto expandPronCodeFun = [&](boost::wstring_view pronCode) -> const PronunciationFlavour*
+			{
+				auto fillerIt = pronCodeToPronFiller.find(pronCode);
+				if (fillerIt != pronCodeToPronFiller.end())
+					return &fillerIt->second;
+
+				auto testIt = pronCodeToPronTest.find(pronCode);
+				if (testIt != pronCodeToPronTest.end())
+					return &testIt->second;
+
+				return nullptr;
+			};
+
+		auto expandPronCodesFun = [&](const std::vector<boost::wstring_view>& pronCodes, std::vector<PhoneId>& phones, std::wstring* errMsg) -> bool
+			{
+				for (boost::wstring_view pronCode : pronCodes)
+				{
+					const PronunciationFlavour* pron = expandPronCodeFun(pronCode);
+					if (pron == nullptr)
+					{
+						*errMsg = QString("Phonetic dictionary has no pronCode=%1").arg(toQString(pronCode)).toStdWString();
+						return false;
+					}
+
+					std::copy(pron->Phones.begin(), pron->Phones.end(), std::back_inserter(phones));
+				}
+				return true;
+			};
+
+		parallelFor(uttersCount, threadsCount, [&](size_t i, int threadInd)
+		{
+			const TranscribedAudioSegment& seg = segs[i];
+			const DecodedUtterance& decoded = decodedUtterances[i];
+			EvaluationThreadState& state = *threadStates[threadInd];
+			state.Arena.clear(); // the words of the previous utterance were copied
 
 			// split expected text into words
 
 			std::vector<boost::wstring_view> pronCodesExpected;
-			GrowOnlyPinArena<wchar_t> arena(1024);
-			splitUtteranceIntoPronuncList(seg.Transcription, arena, pronCodesExpected);
+			splitUtteranceIntoPronuncList(seg.Transcription, state.Arena, pronCodesExpected);
 
 			// merge actual pronCodes (word parts)
 
+			const std::vector<std::wstring>& pronIdsActualRaw = decoded.PronIdsActualRaw;
 			std::vector<std::wstring> pronCodesActualMergedStr;
 			std::vector<float> pronCodesActualProbsMerged;
 			if (!pronIdsActualRaw.empty())
 			{
 				pronCodesActualMergedStr.push_back(pronIdsActualRaw.front());
-				pronCodesActualProbsMerged.push_back(wordsActualProbs.front());
+				pronCodesActualProbsMerged.push_back(decoded.WordProbs.front());
 			}
 			for (size_t wordInd = 1; wordInd < pronIdsActualRaw.size(); ++wordInd)
 			{
 				const std::wstring& prev = pronCodesActualMergedStr.back();
 				const std::wstring& cur = pronIdsActualRaw[wordInd];
 				float prevProb = pronCodesActualProbsMerged.back();
-				float curProb = wordsActualProbs[wordInd];
+				float curProb = decoded.WordProbs[wordInd];
 				if (prev.back() == L'~' && cur.front() == L'~')
 				{
 					std::wstring merged = prev;
@@ -536,37 +774,15 @@ namespace RecognizeSpeechSphinxTester
 				}
 			}
 
-			std::vector<boost::wstring_view> pronCodesActualMerged;
-			std::transform(pronCodesActualMergedStr.begin(), pronCodesActualMergedStr.end(), std::back_inserter(pronCodesActualMerged), [](std::wstring& w)
-			               {
-				               return boost::wstring_view(w);
-			               });
+			std::vector<boost::wstring_view> pronCodesActualMerged(pronCodesActualMergedStr.begin(), pronCodesActualMergedStr.end());
 
-			// expected no sil
+			// expected and actual without sil
 
 			std::vector<boost::wstring_view> pronCodesExpectedNoSil;
-			std::remove_copy_if(std::begin(pronCodesExpected), std::end(pronCodesExpected), std::back_inserter(pronCodesExpectedNoSil), [&](boost::wstring_view pronCode)
-			                    {
-				                    return pronCodeToPronFiller.find(pronCode) != pronCodeToPronFiller.end();
-			                    });
-
-			// actual no sil
+			std::remove_copy_if(std::begin(pronCodesExpected), std::end(pronCodesExpected), std::back_inserter(pronCodesExpectedNoSil), isFillerFun);
 
 			std::vector<boost::wstring_view> pronCodesActualNoSil;
-			std::remove_copy_if(std::begin(pronCodesActualMerged), std::end(pronCodesActualMerged), std::back_inserter(pronCodesActualNoSil), [&](boost::wstring_view pronCode)
-			                    {
-				                    return pronCodeToPronFiller.find(pronCode) != pronCodeToPronFiller.end();
-			                    });
-
-			auto trimNumberInParenthesisFun = [](const std::vector<boost::wstring_view>& words, std::vector<boost::wstring_view>& outWords)
-				{
-					for (boost::wstring_view pronId : words)
-					{
-						boost::wstring_view baseWord;
-						parsePronId(pronId, baseWord);
-						outWords.push_back(baseWord);
-					}
-				};
+			std::remove_copy_if(std::begin(pronCodesActualMerged), std::end(pronCodesActualMerged), std::back_inserter(pronCodesActualNoSil), isFillerFun);
 
 			// expected words
 
@@ -578,14 +794,14 @@ namespace RecognizeSpeechSphinxTester
 
 			// actual words
 			// decoder will never return 'slova(2)' and will always return the base word 'slova'
-			std::vector<boost::wstring_view>& pronCodesActualSrc = excludeSilFromDecOutput ? pronCodesActualNoSil : pronCodesActualMerged;
+			const auto& pronCodesActualSrc = excludeSilFromDecOutput ? pronCodesActualNoSil : pronCodesActualMerged;
 			std::vector<boost::wstring_view> wordsActual;
 			trimNumberInParenthesisFun(pronCodesActualSrc, wordsActual);
 
 			// compute word error
 
-			WordErrorCosts<boost::wstring_view> c;
-			float distWord = findEditDistance(wordsExpected.begin(), wordsExpected.end(), wordsActual.begin(), wordsActual.end(), c);
+			// unit costs, so the bit-parallel Levenshtein distance is used
+			float distWord = editDistanceBitParallel<boost::wstring_view>(wordsExpected, wordsActual);
 
 			// compute edit distances between whole utterances (char distance)
 			std::wostringstream strBuff;
@@ -595,64 +811,57 @@ namespace RecognizeSpeechSphinxTester
 			PticaGovorun::join(wordsActual.begin(), wordsActual.end(), boost::wstring_view(L" "), strBuff);
 			std::wstring wordsActualStr = strBuff.str();
 
-			WordErrorCosts<wchar_t> charCost;
-			float distChar = findEditDistance(std::cbegin(wordsExpectedStr), std::cend(wordsExpectedStr), std::cbegin(wordsActualStr), std::cend(wordsActualStr), charCost);
+			float distChar = editDistanceBitParallel<wchar_t>(wordsExpectedStr, wordsActualStr);
 
-			// do phonetic expansion
-
-			auto expandPronCodeFun = [&](boost::wstring_view pronCode) -> const PronunciationFlavour*
-			
-				{
-					auto fillerIt = pronCodeToPronFiller.find(pronCode);
-					if (fillerIt != pronCodeToPronFiller.end())
-						return &fillerIt->second;
+			TwoUtterances& utter = recogUtterances[i];
 
-					auto testIt = pronCodeToPronTest.find(pronCode);
-					if (testIt != pronCodeToPronTest.end())
-						return &testIt->second;
-
-					return nullptr;
-				};
-
-			auto expandPronCodesFun = [&](const std::vector<boost::wstring_view>& pronCodes, std::vector<PhoneId>& phones, std::wstring* errMsg) -> bool
-				{
-					for (boost::wstring_view pronCode : pronCodes)
-					{
-						const PronunciationFlavour* pron = expandPronCodeFun(pronCode);
-						if (pron == nullptr)
-						{
-							*errMsg = QString("Phonetic dictionary has no pronCode=%1").arg(toQString(pronCode)).toStdWString();
-							return false;
-						}
-
-						std::copy(pron->Phones.begin(), pron->Phones.end(), std::back_inserter(phones));
-					}
-					return true;
-				};
+			// align words char by char for reports
+			state.CharsEditDist.estimateAllDistances(wordsExpectedStr, wordsActualStr, charCosts);
+			state.EditRecipe.clear();
+			state.CharsEditDist.minCostRecipe(state.EditRecipe);
+			std::vector<wchar_t> alignWord1;
+			std::vector<wchar_t> alignWord2;
+			alignWords(wv::make_view(wordsExpectedStr), wv::make_view(wordsActualStr), state.EditRecipe, L'_', alignWord1, alignWord2);
+			utter.WordsExpectedAlignedStr.assign(alignWord1.begin(), alignWord1.end());
+			utter.WordsActualAlignedStr.assign(alignWord2.begin(), alignWord2.end());
 
+			// do phonetic expansion
 			// Transcript may contain words outside arpa and phonetic dictionary.
 			// In this case the phonetic expansion is not performed.
-			std::wstring phoneExpansionErrMsg;
+
+			const ReferencePhones* refPhones = refPhonesCache.find(seg.RelFilePathNoExt, seg.Transcription);
 			std::vector<PhoneId> expectedPhones;
+			std::wstring phoneExpansionErrMsg;
+			if (refPhones != nullptr)
+			{
+				expectedPhones = refPhones->Phones;
+				phoneExpansionErrMsg = refPhones->ExpansionErrorMsg;
+			}
+			else
+			{
+				expandPronCodesFun(pronCodesExpectedSrc, expectedPhones, &phoneExpansionErrMsg);
+				isRefPhonesNew[i] = true;
+			}
+			bool expectedPhoneExpansion = phoneExpansionErrMsg.empty();
+
 			std::vector<PhoneId> actualPhones;
 			std::string expectedPhonesStr;
 			std::string actualPhonesStr;
 			float distPhones = -1;
-
-			bool expectedPhoneExpansion = expandPronCodesFun(pronCodesExpectedSrc, expectedPhones, &phoneExpansionErrMsg);
 			if (expectedPhoneExpansion)
 			{
-				bool actualPhoneExpansion = expandPronCodesFun(pronCodesActualSrc, actualPhones, &phoneExpansionErrMsg);
+				std::wstring actualExpansionErrMsg;
+				bool actualPhoneExpansion = expandPronCodesFun(pronCodesActualSrc, actualPhones, &actualExpansionErrMsg);
 				PG_Assert2(actualPhoneExpansion, QString("Actual words must be in phonetic dictionary. %1")
-					.arg(QString::fromStdWString(phoneExpansionErrMsg)).toStdWString().c_str());
+					.arg(QString::fromStdWString(actualExpansionErrMsg)).toStdWString().c_str());
 
-				phonesEditDist.estimateAllDistances(expectedPhones, actualPhones, editCost);
-				distPhones = phonesEditDist.distance();
+				state.PhonesEditDist.estimateAllDistances(expectedPhones, actualPhones, editCost);
+				distPhones = state.PhonesEditDist.distance();
 
-				std::vector<EditStep> phoneEditRecipe;
-				phonesEditDist.minCostRecipe(phoneEditRecipe);
+				state.EditRecipe.clear();
+				state.PhonesEditDist.minCostRecipe(state.EditRecipe);
 
-				updateConfusionMatrix(phoneConfusionMat, phonesCount, expectedPhones, actualPhones, phoneEditRecipe);
+				updateConfusionMatrix(state.PhoneConfusionMat, phonesCount, expectedPhones, actualPhones, state.EditRecipe);
 
 				std::function<void(PhoneId, std::vector<char>&)> ph2StrFun = [&phoneReg](PhoneId ph, std::vector<char>& phVec)
 					{
@@ -665,41 +874,59 @@ namespace RecognizeSpeechSphinxTester
 				std::vector<char> align1;
 				std::vector<char> align2;
 				char padChar = '_';
-				alignWords(wv::make_view(expectedPhones), wv::make_view(actualPhones), ph2StrFun, phoneEditRecipe, padChar, align1, align2, boost::make_optional(padChar));
+				alignWords(wv::make_view(expectedPhones), wv::make_view(actualPhones), ph2StrFun, state.EditRecipe, padChar, align1, align2, boost::make_optional(padChar));
 				expectedPhonesStr = std::string(align1.begin(), align1.end());
 				actualPhonesStr = std::string(align2.begin(), align2.end());
 			}
 
 			//
-			TwoUtterances utter;
 			utter.RelFilePathNoExt = seg.RelFilePathNoExt;
 			utter.DistWords = distWord;
 			utter.DistChars = distChar;
 			utter.DistPhones = distPhones;
-			utter.Segment = seg;
-			utter.TextActual = hypWStr;
-			utter.PronIdsExpected = pronCodesExpected;
+			utter.Segment = &seg;
+			utter.TextActual = decoded.TextActual;
+			utter.PronIdsExpected = toStdWStringVec(pronCodesExpected);
 			utter.PronIdsActualRaw = pronIdsActualRaw;
-			utter.WordsExpected = wordsExpected;
+			utter.WordsExpected = toStdWStringVec(wordsExpected);
 			utter.WordsActual = toStdWStringVec(wordsActual);
-			utter.WordProbs = wordsActualProbs;
+			utter.WordProbs = decoded.WordProbs;
 			utter.WordProbsMerged = pronCodesActualProbsMerged;
-			utter.PhonesExpected = expectedPhones;
-			utter.PhonesActual = actualPhones;
+			utter.PhonesExpected = std::move(expectedPhones);
+			utter.PhonesActual = std::move(actualPhones);
 			utter.PhonesExpectedAlignedStr = expectedPhonesStr;
 			utter.PhonesActualAlignedStr = actualPhonesStr;
 			utter.PhonesExpectedExpansionErrorMsg = phoneExpansionErrMsg;
-			recogUtterances.push_back(utter);
+		});
 
-			wordErrorTotalCount += std::trunc<int>(distWord);
-			wordTotalCount += (int)wordsExpected.size();
-			if (expectedPhoneExpansion)
+		// reduce per thread results
+		for (const std::unique_ptr<EvaluationThreadState>& state : threadStates)
+		{
+			for (size_t cellInd = 0; cellInd < phoneConfusionMat.size(); ++cellInd)
+				phoneConfusionMat[cellInd] += state->PhoneConfusionMat[cellInd];
+		}
+
+		for (size_t i = 0; i < uttersCount; ++i)
+		{
+			const TwoUtterances& utter = recogUtterances[i];
+			if (isRefPhonesNew[i])
 			{
-				PG_DbgAssert(distPhones >= 0);
-				phoneErrorTotalCount += std::trunc<int>(distPhones);
-				phoneTotalCount += (int)expectedPhones.size();
+				ReferencePhones refPhones;
+				refPhones.Transcription = segs[i].Transcription;
+				refPhones.Phones = utter.PhonesExpected;
+				refPhones.ExpansionErrorMsg = utter.PhonesExpectedExpansionErrorMsg;
+				refPhonesCache.put(utter.RelFilePathNoExt, refPhones);
 			}
-			if (distWord > 0) sentErrorTotalCount += 1;
+
+			wordErrorTotalCount += std::trunc<int>(utter.DistWords);
+			wordTotalCount += (int)utter.WordsExpected.size();
+			if (utter.PhonesExpectedExpansionErrorMsg.empty())
+			{
+				PG_DbgAssert(utter.DistPhones >= 0);
+				phoneErrorTotalCount += std::trunc<int>(utter.DistPhones);
+				phoneTotalCount += (int)utter.PhonesExpected.size();
+			}
+			if (utter.DistWords > 0) sentErrorTotalCount += 1;
 		}
 	}
 
@@ -840,7 +1067,8 @@ namespace RecognizeSpeechSphinxTester
 		return true;
 	}
 
-	std::tuple<bool, const char*> dumpDecoderExpectActualResults(boost::wstring_view filePath, const std::vector<TwoUtterances>& recogUtterances)
+	// Writes utterances in given order; order[i] is the index of the utterance.
+	std::tuple<bool, const char*> dumpDecoderExpectActualResults(boost::wstring_view filePath, const std::vector<TwoUtterances>& recogUtterances, const std::vector<size_t>& order)
 	{
 		QFile dumpFile(toQString(filePath));
 		if (!dumpFile.open(QIODevice::WriteOnly | QIODevice::Text))
@@ -851,19 +1079,17 @@ namespace RecognizeSpeechSphinxTester
 
 		boost::wstring_view separ(L" ");
 		std::wostringstream buff;
-		CharPhonationGroupCosts c;
-		EditDistance<wchar_t, CharPhonationGroupCosts> editDist;
-		for (int i = 0; i < recogUtterances.size(); ++i)
+		for (size_t utterInd : order)
 		{
-			const TwoUtterances& utter = recogUtterances[i];
+			const TwoUtterances& utter = recogUtterances[utterInd];
 			if (utter.DistWords == 0) // skip correct utterances
 				continue;
 			dumpFileStream << "WordError=" << utter.DistWords << "/" << utter.WordsExpected.size()
 				<< " CharError=" << utter.DistChars
 				<< " PhoneError=" << utter.DistPhones
-				<< " RelWavPath=" << QString::fromStdWString(utter.Segment.RelFilePathNoExt) << "\n";
+				<< " RelWavPath=" << QString::fromStdWString(utter.Segment->RelFilePathNoExt) << "\n";
 
-			dumpFileStream << "ExpectProns=" << QString::fromStdWString(utter.Segment.Transcription) << "\n";
+			dumpFileStream << "ExpectProns=" << QString::fromStdWString(utter.Segment->Transcription) << "\n";
 
 			buff.str(L"");
 			PticaGovorun::join(utter.PronIdsActualRaw.cbegin(), utter.PronIdsActualRaw.cend(), separ, buff);
@@ -877,25 +1103,9 @@ namespace RecognizeSpeechSphinxTester
 			}
 			dumpFileStream << "\n"; // end after last prob
 
-			buff.str(L"");
-			PticaGovorun::join(utter.WordsExpected.cbegin(), utter.WordsExpected.cend(), separ, buff);
-			std::wstring expectWords = buff.str();
-			//dumpFileStream << "ExpectWords=" << QString::fromStdWString(expectWords) << "\n";
-
-			buff.str(L"");
-			PticaGovorun::join(utter.WordsActual.cbegin(), utter.WordsActual.cend(), separ, buff);
-			std::wstring actualWords = buff.str();
-			//dumpFileStream << "ActualWords=" << QString::fromStdWString(actualWords) << "\n";
-
-			//
-			editDist.estimateAllDistances(expectWords, actualWords, c);
-			std::vector<EditStep> editRecipe;
-			editDist.minCostRecipe(editRecipe);
-			std::vector<wchar_t> alignWord1;
-			std::vector<wchar_t> alignWord2;
-			alignWords(wv::make_view(expectWords), wv::make_view(actualWords), editRecipe, L'_', alignWord1, alignWord2);
-			dumpFileStream << "ExpectWords=" << QString::fromStdWString(std::wstring(alignWord1.begin(), alignWord1.end())) << "\n";
-			dumpFileStream << "ActualWords=" << QString::fromStdWString(std::wstring(alignWord2.begin(), alignWord2.end())) << "\n";
+			// words are aligned when evaluating the utterance
+			dumpFileStream << "ExpectWords=" << QString::fromStdWString(utter.WordsExpectedAlignedStr) << "\n";
+			dumpFileStream << "ActualWords=" << QString::fromStdWString(utter.WordsActualAlignedStr) << "\n";
 
 			// expected-actual phones
 			bool hasPhoneticExpansion = utter.PhonesExpectedExpansionErrorMsg.empty();
@@ -912,7 +1122,8 @@ namespace RecognizeSpeechSphinxTester
 		return std::make_tuple(true, nullptr);
 	}
 
-	std::tuple<bool, const char*> dumpDecoderExpectActualResultsXml(boost::wstring_view filePath, const std::vector<TwoUtterances>& recogUtterances, const std::wstring& speechModelVerStr)
+	// Writes utterances in given order; order[i] is the index of the utterance.
+	std::tuple<bool, const char*> dumpDecoderExpectActualResultsXml(boost::wstring_view filePath, const std::vector<TwoUtterances>& recogUtterances, const std::vector<size_t>& order, const std::wstring& speechModelVerStr)
 	{
 		QFile file(toQString(filePath));
 		if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
@@ -928,24 +1139,22 @@ namespace RecognizeSpeechSphinxTester
 
 		boost::wstring_view separ(L" ");
 		std::wostringstream buff;
-		CharPhonationGroupCosts c;
-		EditDistance<wchar_t, CharPhonationGroupCosts> editDist;
-		for (int i = 0; i < recogUtterances.size(); ++i)
+		for (size_t utterInd : order)
 		{
-			const TwoUtterances& utter = recogUtterances[i];
+			const TwoUtterances& utter = recogUtterances[utterInd];
 
 			// note, dump utterances with utter.ErrorWord == 0 too
 
 			xmlWriter.writeStartElement("utter");
 
-			xmlWriter.writeAttribute("relWavPath", QString::fromStdWString(utter.Segment.RelFilePathNoExt));
+			xmlWriter.writeAttribute("relWavPath", QString::fromStdWString(utter.Segment->RelFilePathNoExt));
 
 			xmlWriter.writeAttribute("speechVer", QString::fromStdWString(speechModelVerStr));
 			xmlWriter.writeAttribute("wordDist", QString::number(utter.DistWords));
 			xmlWriter.writeAttribute("charDist", QString::number(utter.DistChars));
 			xmlWriter.writeAttribute("expWordsNum", QString::number(utter.WordsExpected.size()));
 
-			xmlWriter.writeTextElement("pronsExpect", QString::fromStdWString(utter.Segment.Transcription));
+			xmlWriter.writeTextElement("pronsExpect", QString::fromStdWString(utter.Segment->Transcription));
 
 			buff.str(L"");
 			PticaGovorun::join(utter.PronIdsActualRaw.cbegin(), utter.PronIdsActualRaw.cend(), separ, buff);
@@ -969,15 +1178,8 @@ namespace RecognizeSpeechSphinxTester
 			std::wstring actualWords = buff.str();
 			xmlWriter.writeTextElement("wordsActual", QString::fromStdWString(actualWords));
 
-			//
-			editDist.estimateAllDistances(expectWords, actualWords, c);
-			std::vector<EditStep> editRecipe;
-			editDist.minCostRecipe(editRecipe);
-			std::vector<wchar_t> alignWord1;
-			std::vector<wchar_t> alignWord2;
-			alignWords(wv::make_view(expectWords), wv::make_view(actualWords), editRecipe, L'_', alignWord1, alignWord2);
-			xmlWriter.writeTextElement("alignWordsExpect", QString::fromStdWString(std::wstring(alignWord1.begin(), alignWord1.end())));
-			xmlWriter.writeTextElement("alignWordsActual", QString::fromStdWString(std::wstring(alignWord2.begin(), alignWord2.end())));
+			xmlWriter.writeTextElement("alignWordsExpect", QString::fromStdWString(utter.WordsExpectedAlignedStr));
+			xmlWriter.writeTextElement("alignWordsActual", QString::fromStdWString(utter.WordsActualAlignedStr));
 
 			// expected-actual phones
 			xmlWriter.writeTextElement("alignPhonesExpect", QString::fromStdString(utter.PhonesExpectedAlignedStr));
@@ -1102,9 +1304,24 @@ namespace RecognizeSpeechSphinxTester
 		if (ps == nullptr)
 			return;
 
+		// the decoder results are reused between runs while the model, dictionary and language model are the same
+		std::string decoderConfig;
+		appendFileFingerprint(toBfs(langModelPath), decoderConfig);
+		appendFileFingerprint(toBfs(dictPath), decoderConfig);
+		appendFileFingerprint(toBfs(dictPathFiller), decoderConfig);
+		DecoderResultCache decoderCache;
+		{
+			QString decoderCachePath = AppHelpers::configParamQString("decode.resultCachePath", "decoderResults.cache");
+			ErrMsgList cacheErrMsg;
+			if (!decoderCache.open(toBfs(decoderCachePath), &cacheErrMsg))
+			{
+				std::cerr << str(cacheErrMsg) << std::endl;
+				return;
+			}
+		}
+
 		//
 		PhoneProximityCosts phoneCosts(phoneReg);
-		EditDistance<PhoneId, PhoneProximityCosts> phonesEditDist;
 		int regPhonesCount = phoneReg.phonesCount() + 1; // +1 to keep NIL phone in the first row/column
 		phoneReg.assumeSequentialPhoneIdsWithoutGaps();
 		std::vector<int> phoneConfusionMat(regPhonesCount * regPhonesCount, 0);
@@ -1115,17 +1332,34 @@ namespace RecognizeSpeechSphinxTester
 		int phoneErrorTotalCount = 0;
 		int phoneTotalCount = 0;
 		float targetSampleRate = CmuSphinxSampleRate;
-		std::vector<TwoUtterances> recogUtterances;
-		decodeSpeechSegments(segments, ps, targetSampleRate, recogUtterances,
-		                     phoneConfusionMat, regPhonesCount,
-		                     sentErrorTotalCount, wordErrorTotalCount, wordTotalCount, phoneErrorTotalCount, phoneTotalCount,
-		                     phonesEditDist, phoneCosts,
-		                     pronCodeToObjTest, pronCodeToPronObjFiller,
-		                     phoneReg, excludeSilFromDecOutput);
+		std::vector<DecodedUtterance> decodedUtterances;
+		decodeSpeechSegments(segments, ps, targetSampleRate, decoderCache, speechModelVerStr, decoderConfig, decodedUtterances);
 
 		// the call may crash if phonetic dictionary was not correctly initialized (eg .dict file is empty)
 		ps_free(ps);
 
+		// reference phones depend on the phonetic dictionary, which is the part of the speech model
+		dumpFileName.str(L"");
+		dumpFileName << L"referencePhones_" << speechModelVerStr << (excludeSilFromDecOutput ? L"_noSil" : L"") << L".txt";
+		QString refPhonesCachePath = toQString(dumpFileName.str());
+		ReferencePhonesCache refPhonesCache;
+		std::tie(op, errMsg) = refPhonesCache.load(refPhonesCachePath, phoneReg);
+		if (!op)
+			std::cerr << errMsg << std::endl; // proceed without the cache
+
+		int evalThreadsCount = AppHelpers::configParamInt("decode.evalThreadsCount", -1);
+		std::vector<TwoUtterances> recogUtterances;
+		evaluateDecodedUtterances(segments, decodedUtterances, evalThreadsCount, recogUtterances,
+		                          phoneConfusionMat, regPhonesCount,
+		                          sentErrorTotalCount, wordErrorTotalCount, wordTotalCount, phoneErrorTotalCount, phoneTotalCount,
+		                          phoneCosts,
+		                          pronCodeToObjTest, pronCodeToPronObjFiller,
+		                          phoneReg, excludeSilFromDecOutput, refPhonesCache);
+
+		std::tie(op, errMsg) = refPhonesCache.save(refPhonesCachePath, phoneReg);
+		if (!op)
+			std::cerr << errMsg << std::endl;
+
 		// output brief statistics
 		double sentErrAvg = sentErrorTotalCount / (double)segments.size();
 		double wordErrAvg = wordErrorTotalCount / (double)wordTotalCount;
@@ -1155,15 +1389,18 @@ namespace RecognizeSpeechSphinxTester
 		}
 
 		// order by word error large to small
+		// the indices are sorted, so that utterances are not moved around
 
-		std::sort(std::begin(recogUtterances), std::end(recogUtterances), [](TwoUtterances& a, TwoUtterances& b)
+		std::vector<size_t> order(recogUtterances.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(std::begin(order), std::end(order), [&recogUtterances](size_t a, size_t b)
 		          {
-			          return a.DistWords > b.DistWords;
+			          return recogUtterances[a].DistWords > recogUtterances[b].DistWords;
 		          });
 
 		dumpFileName.str(L"");
 		dumpFileName << L"wordErrorDump_" << speechModelVerStr << "_" << timeStampStr << L"_byWordErr.txt";
-		std::tie(op, errMsg) = dumpDecoderExpectActualResults(dumpFileName.str(), recogUtterances);
+		std::tie(op, errMsg) = dumpDecoderExpectActualResults(dumpFileName.str(), recogUtterances, order);
 		if (!op)
 		{
 			std::cerr << errMsg << std::endl;
@@ -1172,7 +1409,7 @@ namespace RecognizeSpeechSphinxTester
 
 		dumpFileName.str(L"");
 		dumpFileName << L"wordErrorDump_" << speechModelVerStr << "_" << timeStampStr << L"_byWordErr.xml";
-		std::tie(op, errMsg) = dumpDecoderExpectActualResultsXml(dumpFileName.str(), recogUtterances, speechModelVerStr);
+		std::tie(op, errMsg) = dumpDecoderExpectActualResultsXml(dumpFileName.str(), recogUtterances, order, speechModelVerStr);
 		if (!op)
 		{
 			std::cerr << errMsg << std::endl;
@@ -1181,14 +1418,14 @@ namespace RecognizeSpeechSphinxTester
 
 		// order by file path
 
-		std::sort(std::begin(recogUtterances), std::end(recogUtterances), [](TwoUtterances& a, TwoUtterances& b)
+		std::sort(std::begin(order), std::end(order), [&recogUtterances](size_t a, size_t b)
 		          {
-			          return a.RelFilePathNoExt < b.RelFilePathNoExt;
+			          return recogUtterances[a].RelFilePathNoExt < recogUtterances[b].RelFilePathNoExt;
 		          });
 
 		dumpFileName.str(L"");
 		dumpFileName << L"wordErrorDump_" << speechModelVerStr << "_" << timeStampStr << L"_byFile.txt";
-		std::tie(op, errMsg) = dumpDecoderExpectActualResults(dumpFileName.str(), recogUtterances);
+		std::tie(op, errMsg) = dumpDecoderExpectActualResults(dumpFileName.str(), recogUtterances, order);
 		if (!op)
 		{
 			std::cerr << errMsg << std::endl;
@@ -1197,7 +1434,7 @@ namespace RecognizeSpeechSphinxTester
 
 		dumpFileName.str(L"");
 		dumpFileName << L"wordErrorDump_" << speechModelVerStr << "_" << timeStampStr << L"_byFile.xml";
-		std::tie(op, errMsg) = dumpDecoderExpectActualResultsXml(dumpFileName.str(), recogUtterances, speechModelVerStr);
+		std::tie(op, errMsg) = dumpDecoderExpectActualResultsXml(dumpFileName.str(), recogUtterances, order, speechModelVerStr);
 		if (!op)
 		{
 			std::cerr << errMsg << std::endl;
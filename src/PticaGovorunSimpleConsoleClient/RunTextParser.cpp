@@ -1,5 +1,7 @@
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <functional>
 #include <QDebug>
 #include <QFile>
 #include <QString>
@@ -94,6 +96,127 @@ namespace RunTextParserNS
 		std::wcout << "File parsed successfully" << std::endl;
 	}
 
+	// Compares the speed of char classification and text run splitting on the text of the file.
+	void benchmarkTextParser(const QString& filePath)
+	{
+		QFile file(filePath);
+		if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+		{
+			std::wcerr << "Can't open file " << filePath.toStdWString();
+			return;
+		}
+
+		// all paragraphs of the file are concatenated
+		std::wstring text;
+		QXmlStreamReader xml(&file);
+		while (!xml.atEnd())
+		{
+			xml.readNext();
+			if (xml.isCharacters())
+			{
+				text.append(xml.text().toString().toStdWString());
+				text.push_back(L'\n');
+			}
+		}
+		if (text.empty())
+			return;
+
+		const int repeatCount = 10;
+		typedef std::chrono::steady_clock Clock;
+		auto timeIt = [&text, repeatCount](const char* algoName, std::function<size_t(boost::wstring_view)> fun)
+		{
+			std::chrono::time_point<Clock> now1 = Clock::now();
+			size_t checkSum = 0;
+			for (int i = 0; i < repeatCount; ++i)
+				checkSum += fun(text);
+			std::chrono::time_point<Clock> now2 = Clock::now();
+			auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now2 - now1).count();
+			double charsPerMs = elapsedMs > 0 ? repeatCount * (double)text.size() / elapsedMs : 0;
+			std::cout << algoName << " elapsedMs=" << elapsedMs << " charsPerMs=" << charsPerMs << " checkSum=" << checkSum << std::endl;
+		};
+
+		// char classification, as used to detect the language of a word
+		timeIt("predicateChain", [](boost::wstring_view str) -> size_t
+		{
+			size_t count = 0;
+			for (wchar_t ch : str)
+			{
+				count += isDigitChar(ch);
+				count += isRomanNumeral(ch);
+				count += isEnglishChar(ch);
+				count += isExclusiveEnglishChar(ch);
+				count += isRussianChar(ch);
+				count += isExclusiveRussianChar(ch);
+			}
+			return count;
+		});
+		timeIt("charClassTable", [](boost::wstring_view str) -> size_t
+		{
+			const std::uint16_t bits = CharClassDigit | CharClassRomanNumeral | CharClassEnglish | CharClassExclusiveEnglish | CharClassRussian | CharClassExclusiveRussian;
+			size_t count = 0;
+			for (wchar_t ch : str)
+			{
+				std::uint16_t charClass = charClassMask(ch) & bits;
+				for (; charClass != 0; charClass &= charClass - 1)
+					count++;
+			}
+			return count;
+		});
+
+		// splitting into text runs
+		timeIt("runTypeSwitch", [](boost::wstring_view str) -> size_t
+		{
+			size_t runsCount = 0;
+			boost::optional<TextRunType> prevRunType;
+			for (wchar_t ch : str)
+			{
+				TextRunType runType = textRunTypeNoTable(ch);
+				bool singleCharRun = runType == TextRunType::Punctuation || runType == TextRunType::PunctuationStopSentence;
+				if (singleCharRun || runType != prevRunType)
+					runsCount++;
+				prevRunType = runType;
+			}
+			return runsCount;
+		});
+		timeIt("runTypePerChar", [](boost::wstring_view str) -> size_t
+		{
+			size_t runsCount = 0;
+			boost::optional<TextRunType> prevRunType;
+			for (wchar_t ch : str)
+			{
+				TextRunType runType = textRunType(ch);
+				bool singleCharRun = runType == TextRunType::Punctuation || runType == TextRunType::PunctuationStopSentence;
+				if (singleCharRun || runType != prevRunType)
+					runsCount++;
+				prevRunType = runType;
+			}
+			return runsCount;
+		});
+		timeIt("findTextRunEnd", [](boost::wstring_view str) -> size_t
+		{
+			size_t runsCount = 0;
+			for (size_t i = 0; i < str.size(); i = findTextRunEnd(str, i))
+				runsCount++;
+			return runsCount;
+		});
+		timeIt("textParser", [](boost::wstring_view str) -> size_t
+		{
+			TextParser wordsReader;
+			wordsReader.setInputText(str);
+			std::vector<RawTextRun> words;
+			size_t runsCount = 0;
+			while (true)
+			{
+				words.clear();
+				bool hasMore = wordsReader.parseTokensTillDot(words);
+				runsCount += words.size();
+				if (!hasMore)
+					break;
+			}
+			return runsCount;
+		});
+	}
+
 	void run()
 	{
 		QString filePath = QString::fromWCharArray(LR"path(C:\devb\PticaGovorunProj\data\textWorld\fiction\ .  .fb2)path");
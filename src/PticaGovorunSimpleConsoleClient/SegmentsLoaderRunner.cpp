@@ -33,7 +33,7 @@ namespace SegmentsLoaderRunnerNS
 		for (const auto& seg : segments)
 		{
 			if (seg.ContentMarker.Id == targId && 
-				!writeAllSamplesWav(seg.Samples, 22050, "tmp_audioRegion.wav", &errMsg))
+				!writeAllSamplesWav(seg.samples(), 22050, "tmp_audioRegion.wav", &errMsg))
 			{
 				std::cerr << str(errMsg) << "\n";
 				return;
@@ -39,7 +39,7 @@ namespace StressedSyllableRunnerNS
 		}
 	}
 	
-	bool populateStressedVowels(const PhoneRegistry& phoneReg, const std::vector<PhoneId>& phoneDict,
+	bool populateStressedVowels(const PhoneRegistry& phoneReg, wv::slice<PhoneId> phoneDict,
 		const std::vector<PhoneId>& phoneAuto, const WordPhoneticTranscriber& phoneticTranscriber,
 		std::vector<int>& charInds)
 	{
@@ -49,7 +49,7 @@ namespace StressedSyllableRunnerNS
 			const BasicPhone* basicPhone;
 			int phoneOriginalInd;
 		};
-		auto collectVowels = [phoneReg](const std::vector<PhoneId>& phoneIds, std::vector<PhoneAndBasic>& outBasicPhones)
+		auto collectVowels = [phoneReg](wv::slice<PhoneId> phoneIds, std::vector<PhoneAndBasic>& outBasicPhones)
 		{
 			for (int phoneInd = 0; phoneInd < (int)phoneIds.size(); ++phoneInd)
 			{
@@ -102,7 +102,7 @@ namespace StressedSyllableRunnerNS
 		void extractStressedSyllables();
 	private:
 		bool inferSpelling(const PhoneticWord& phWord, std::vector<int>& firstStressedVowelInds, boost::wstring_view& firstWord);
-		void printPron(const std::vector<PhoneId>& phonesDict, boost::wstring_view pronAsWord, boost::wstring_view word, const std::vector<PhoneId>* phonesAuto);
+		void printPron(wv::slice<PhoneId> phonesDict, boost::wstring_view pronAsWord, boost::wstring_view word, const std::vector<PhoneId>* phonesAuto);
 	};
 
 	bool PronuncStressedSyllableExtractor::inferSpelling(const PhoneticWord& phWord, std::vector<int>& firstStressedVowelInds, boost::wstring_view& firstWord)
@@ -148,7 +148,7 @@ namespace StressedSyllableRunnerNS
 		return !firstStressedVowelInds.empty();
 	}
 	
-	void PronuncStressedSyllableExtractor::printPron(const std::vector<PhoneId>& phonesDict, boost::wstring_view pronAsWord, boost::wstring_view word,
+	void PronuncStressedSyllableExtractor::printPron(wv::slice<PhoneId> phonesDict, boost::wstring_view pronAsWord, boost::wstring_view word,
 		const std::vector<PhoneId>* phonesAuto)
 	{
 		std::string pronDictStr;
@@ -0,0 +1,108 @@
+#include <cmath>
+#include <fstream>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "ArpaLanguageModelQuery.h"
+#include "TempPathTest.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	struct ArpaLanguageModelQueryTest : public TempPathTest
+	{
+		ArpaLanguageModelQueryTest() : TempPathTest("langModel-%%%%-%%%%.arpa")
+		{
+		}
+
+		void writeLangModel(const char* text)
+		{
+			std::ofstream lmFile(tempPath_.string(), std::ios::binary);
+			lmFile << text;
+		}
+
+		void writeBigramModel()
+		{
+			writeLangModel(
+				"\\data\\\n"
+				"ngram 1=4\n"
+				"ngram 2=3\n"
+				"\n"
+				"\\1-grams:\n"
+				"  -1.0 <s> -0.5 \n"
+				"  -0.5 </s> \n"
+				"  -0.6 mama -0.3 \n"
+				"  -0.9 myla -0.2 \n"
+				"\n"
+				"\\2-grams:\n"
+				"  -0.1 mama myla \n"
+				"  -0.2 <s> mama \n"
+				"  -0.3 myla </s> \n"
+				"\n"
+				"\\end\\\n");
+		}
+	};
+
+	TEST_F(ArpaLanguageModelQueryTest, backOffLookup)
+	{
+		writeBigramModel();
+		ArpaLanguageModelQuery langModel;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(langModel.load(tempPath_, &errMsg)) << str(errMsg);
+		EXPECT_EQ(2, langModel.order());
+		EXPECT_EQ(4, langModel.ngramCount(1));
+		EXPECT_EQ(3, langModel.ngramCount(2));
+
+		std::int32_t mama = langModel.wordId(L"mama");
+		std::int32_t myla = langModel.wordId(L"myla");
+		ASSERT_NE(-1, mama);
+		EXPECT_EQ(-1, langModel.wordId(L"ramu"));
+
+		EXPECT_NEAR(-0.2, langModel.logProb(langModel.sentStartId(), mama), 1e-6);
+		EXPECT_NEAR(-0.8, langModel.logProb(mama, langModel.sentEndId()), 1e-6); // back off
+		EXPECT_NEAR(-0.9, langModel.logProb(-1, myla), 1e-6);
+	}
+
+	TEST_F(ArpaLanguageModelQueryTest, perplexityWithOov)
+	{
+		writeBigramModel();
+		ArpaLanguageModelQuery langModel;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(langModel.load(tempPath_, &errMsg)) << str(errMsg);
+
+		std::int32_t mama = langModel.wordId(L"mama");
+		std::int32_t myla = langModel.wordId(L"myla");
+		PerplexityStat stat;
+		scoreSentence(langModel, { mama, myla }, stat);
+		EXPECT_NEAR(-0.6, stat.LogProbSum, 1e-6);
+		EXPECT_EQ(3, stat.scoredCount());
+
+		// the word after OOV is scored as unigram
+		scoreSentence(langModel, { mama, -1, myla }, stat);
+		EXPECT_EQ(2, stat.SentCount);
+		EXPECT_EQ(5, stat.WordCount);
+		EXPECT_EQ(1, stat.OovCount);
+		EXPECT_EQ(6, stat.scoredCount());
+		EXPECT_NEAR(-2.0, stat.LogProbSum, 1e-6);
+		EXPECT_NEAR(std::pow(10.0, 2.0 / 6), stat.perplexity(), 1e-5);
+		EXPECT_NEAR(0.2, stat.oovRate(), 1e-12);
+	}
+
+	TEST_F(ArpaLanguageModelQueryTest, bigramOfUnknownWordIsError)
+	{
+		writeLangModel(
+			"\\data\\\n"
+			"ngram 1=2\n"
+			"ngram 2=1\n"
+			"\\1-grams:\n"
+			"-0.3 <s> -0.1\n"
+			"-0.3 </s>\n"
+			"\\2-grams:\n"
+			"-0.1 <s> mama\n"
+			"\\end\\\n");
+		ArpaLanguageModelQuery langModel;
+		ErrMsgList errMsg;
+		EXPECT_FALSE(langModel.load(tempPath_, &errMsg));
+	}
+}
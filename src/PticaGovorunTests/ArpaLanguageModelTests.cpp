@@ -0,0 +1,56 @@
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include "ArpaLanguageModel.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	ArpaBigramCount bigramCount(int historyUnigramInd, int nextUnigramInd, std::int64_t usage)
+	{
+		ArpaBigramCount count;
+		count.HistoryUnigramInd = historyUnigramInd;
+		count.NextUnigramInd = nextUnigramInd;
+		count.UsageCounter = usage;
+		return count;
+	}
+
+	TEST(ArpaLanguageModelTest, bigramsAreGroupedByHistory)
+	{
+		std::vector<ArpaBigramCount> counts = { bigramCount(2, 1, 5), bigramCount(0, 2, 1), bigramCount(2, 0, 3), bigramCount(0, 1, 0) };
+		ArpaBigramTable bigrams;
+		buildArpaBigramTable(3, counts, 2, bigrams);
+
+		EXPECT_EQ((std::vector<std::uint32_t>{ 0, 2, 2, 4 }), bigrams.HistoryOffset);
+		EXPECT_EQ((std::vector<std::int32_t>{ 1, 2, 0, 1 }), bigrams.NextUnigramInd);
+		EXPECT_EQ((std::vector<std::int64_t>{ 0, 1, 3, 5 }), bigrams.UsageCounter);
+	}
+
+	TEST(ArpaLanguageModelTest, normalizeBigramsPerHistory)
+	{
+		std::vector<ArpaBigramCount> counts = { bigramCount(0, 0, 1), bigramCount(0, 1, 3), bigramCount(1, 0, 0), bigramCount(1, 1, 2) };
+		ArpaUnigramTable unigrams;
+		unigrams.WordParts.resize(2);
+		ArpaBigramTable bigrams;
+		buildArpaBigramTable(2, counts, 1, bigrams);
+
+		std::vector<double> historyLogScale = { std::log10(0.8), 0 };
+		normalizeArpaBigrams(historyLogScale, 2, unigrams, bigrams);
+
+		EXPECT_EQ((std::vector<std::int64_t>{ 4, 2 }), unigrams.HistoryCounter);
+		EXPECT_NEAR(std::log10(0.2), bigrams.LogProb[0], 1e-12);
+		EXPECT_NEAR(std::log10(0.6), bigrams.LogProb[1], 1e-12);
+		EXPECT_EQ(ArpaLogProbMinusInf, bigrams.LogProb[2]); // prohibited
+		EXPECT_NEAR(0, bigrams.LogProb[3], 1e-12);
+	}
+
+	TEST(ArpaLanguageModelTest, totalProbOfManySmallProbs)
+	{
+		const int count = 4000000;
+		std::vector<double> logProbs(count, -std::log10((double)count));
+		logProbs.push_back(ArpaLogProbMinusInf);
+		EXPECT_NEAR(0, log10SumPow10(logProbs), 1e-9);
+		EXPECT_EQ(ArpaLogProbMinusInf, log10SumPow10({ ArpaLogProbMinusInf }));
+	}
+}
@@ -0,0 +1,51 @@
+#include <vector>
+#include <gtest/gtest.h>
+#include "BatchPhoneAlignment.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	TEST(BatchPhoneAlignmentTest, gmmSeparatesTwoClusters)
+	{
+		// 1-dimensional frames around -5 and +5
+		std::vector<float> frames;
+		for (int i = 0; i < 50; ++i)
+		{
+			frames.push_back(-5 + (i % 5) * 0.1f);
+			frames.push_back(5 + (i % 5) * 0.1f);
+		}
+
+		DiagGaussianMixture gmm;
+		trainDiagGaussianMixture(frames, 1, 2, 10, gmm);
+		ASSERT_EQ(2, gmm.componentsCount());
+
+		float nearCluster = 5.1f;
+		float farAway = 0;
+		EXPECT_GT(gmm.logProb(&nearCluster), gmm.logProb(&farAway));
+		EXPECT_NEAR(0.5, gmm.Weights[0], 0.05);
+	}
+
+	TEST(BatchPhoneAlignmentTest, alignTwoPhonesGmm)
+	{
+		PhoneGmmModel model;
+		model.FeatVecLen = 1;
+		std::vector<float> aFrames = { -1.1f, -1, -0.9f };
+		std::vector<float> bFrames = { 0.9f, 1, 1.1f };
+		trainDiagGaussianMixture(aFrames, 1, 1, 1, model.PhoneNameToGmm["a"]);
+		trainDiagGaussianMixture(bFrames, 1, 1, 1, model.PhoneNameToGmm["b"]);
+
+		// 3 frames of 'a' then 5 frames of 'b'
+		std::vector<float> features = { -1, -1, -1, 1, 1, 1, 1, 1 };
+		std::vector<std::string> phones = { "a", "b" };
+		std::vector<std::pair<size_t, size_t>> phoneFrames;
+		double score = 0;
+		ASSERT_TRUE(alignPhonesGmm(model, features, phones, phoneFrames, score, nullptr));
+		ASSERT_EQ(2, phoneFrames.size());
+		EXPECT_EQ(std::make_pair<size_t, size_t>(0, 2), phoneFrames[0]);
+		EXPECT_EQ(std::make_pair<size_t, size_t>(3, 7), phoneFrames[1]);
+
+		phones.push_back("c");
+		EXPECT_FALSE(alignPhonesGmm(model, features, phones, phoneFrames, score, nullptr));
+	}
+}
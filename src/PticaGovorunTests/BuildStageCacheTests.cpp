@@ -0,0 +1,78 @@
+#include <fstream>
+#include <map>
+#include <string>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "BuildPipeline.h"
+#include "TempPathTest.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	struct BuildStageCacheTest : public TempPathTest
+	{
+		boost::filesystem::path outDir_;
+		boost::filesystem::path cacheDir_;
+
+		BuildStageCacheTest() : TempPathTest("stageCache-%%%%-%%%%")
+		{
+		}
+
+		void SetUp() override
+		{
+			outDir_ = tempPath_ / "out";
+			cacheDir_ = tempPath_ / "cache";
+			boost::filesystem::create_directories(outDir_);
+		}
+
+		/// Runs the stage, which writes one file and the given values.
+		bool runStage(BuildStageCache& cache, std::uint64_t key, const std::map<std::string, std::string>& builtValues,
+			std::map<std::string, std::string>& values, bool& built)
+		{
+			built = false;
+			auto buildFun = [&](std::map<std::string, std::string>& vals, ErrMsgList* errMsg) -> bool
+			{
+				std::ofstream file((outDir_ / "artifact.txt").string(), std::ios::binary);
+				file << "artifact";
+				vals = builtValues;
+				built = true;
+				return true;
+			};
+			ErrMsgList errMsg;
+			return cache.runCached("stage1", key, { "artifact.txt" }, outDir_, values, buildFun, &errMsg);
+		}
+	};
+
+	TEST_F(BuildStageCacheTest, valuesWithSeparatorsRoundTrip)
+	{
+		std::map<std::string, std::string> builtValues;
+		builtValues["speakerDur.a=b"] = "1.5";
+		builtValues["multi\nline\\name"] = "x=y\r\\";
+		builtValues["#key"] = "data value named like the key";
+
+		BuildStageCache cache(cacheDir_);
+		std::map<std::string, std::string> values;
+		bool built = false;
+		ASSERT_TRUE(runStage(cache, 7, builtValues, values, built));
+		EXPECT_TRUE(built);
+
+		boost::filesystem::remove(outDir_ / "artifact.txt");
+		values.clear();
+		ASSERT_TRUE(runStage(cache, 7, builtValues, values, built));
+		EXPECT_FALSE(built);
+		EXPECT_TRUE(builtValues == values);
+		EXPECT_TRUE(boost::filesystem::exists(outDir_ / "artifact.txt"));
+	}
+
+	TEST_F(BuildStageCacheTest, changedKeyRebuilds)
+	{
+		BuildStageCache cache(cacheDir_);
+		std::map<std::string, std::string> values;
+		bool built = false;
+		ASSERT_TRUE(runStage(cache, 7, { { "a", "1" } }, values, built));
+		ASSERT_TRUE(runStage(cache, 8, { { "a", "2" } }, values, built));
+		EXPECT_TRUE(built);
+		EXPECT_EQ("2", values["a"]);
+	}
+}
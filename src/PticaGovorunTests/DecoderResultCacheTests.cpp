@@ -0,0 +1,70 @@
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "DecoderResultCache.h"
+#include "FileHelpers.h"
+#include "TempPathTest.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	struct DecoderResultCacheTest : public TempPathTest
+	{
+		DecoderResultCacheTest() : TempPathTest("decCache-%%%%-%%%%.bin")
+		{
+		}
+	};
+
+	TEST_F(DecoderResultCacheTest, resultsSurviveReopen)
+	{
+		std::vector<short> samples = { 1, 2, 3, 4 };
+		DecoderCacheKey key1 = makeDecoderCacheKey(samples, 16000, L"persian.v39", "lm.DMP");
+		DecoderCacheKey key2 = makeDecoderCacheKey(samples, 16000, L"persian.v40", "lm.DMP");
+		EXPECT_FALSE(key1 == key2);
+
+		DecodedResult result;
+		result.Hypothesis = L"\x0442\x0430\x043A";
+		DecodedWord word;
+		word.Word = result.Hypothesis;
+		word.BegSample = 10;
+		word.EndSample = 20;
+		word.Prob = 0.5f;
+		result.Words.push_back(word);
+		{
+			DecoderResultCache cache;
+			ErrMsgList errMsg;
+			ASSERT_TRUE(cache.open(tempPath_, &errMsg)) << str(errMsg);
+			ASSERT_TRUE(cache.put(key1, result, &errMsg)) << str(errMsg);
+		}
+
+		// simulate the record, torn by the interrupted process
+		std::vector<char> bytes;
+		ASSERT_TRUE(readAllBytes(tempPath_, bytes, nullptr));
+		bytes.insert(bytes.end(), { 100, 0, 0, 0, 1, 2 });
+		ASSERT_TRUE(writeAllBytes(tempPath_, boost::string_view(bytes.data(), bytes.size()), nullptr));
+
+		DecoderResultCache cache;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(cache.open(tempPath_, &errMsg)) << str(errMsg);
+		EXPECT_EQ(1, cache.size());
+
+		DecodedResult cached;
+		EXPECT_FALSE(cache.find(key2, cached));
+		ASSERT_TRUE(cache.find(key1, cached));
+		EXPECT_EQ(result.Hypothesis, cached.Hypothesis);
+		ASSERT_EQ(1, cached.Words.size());
+		EXPECT_EQ(result.Words[0].Word, cached.Words[0].Word);
+		EXPECT_EQ(10, cached.Words[0].BegSample);
+		EXPECT_EQ(20, cached.Words[0].EndSample);
+		EXPECT_FLOAT_EQ(0.5f, cached.Words[0].Prob);
+
+		// the new record is appended after the last valid one
+		ASSERT_TRUE(cache.put(key2, DecodedResult(), &errMsg)) << str(errMsg);
+		DecoderResultCache cache2;
+		ASSERT_TRUE(cache2.open(tempPath_, &errMsg)) << str(errMsg);
+		EXPECT_EQ(2, cache2.size());
+		EXPECT_TRUE(cache2.find(key2, cached));
+		EXPECT_TRUE(cached.Words.empty());
+	}
+}
@@ -0,0 +1,169 @@
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "CoreUtils.h"
+#include "KaldiFeatureArchive.h"
+#include "KaldiModel.h"
+#include "TempPathTest.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	struct KaldiFeatureArchiveTest : public TempPathTest
+	{
+		KaldiFeatureArchiveTest() : TempPathTest("kaldiArk-%%%%-%%%%")
+		{
+		}
+
+		void SetUp() override
+		{
+			boost::filesystem::create_directories(tempPath_);
+		}
+
+		void writeTwoMatrices()
+		{
+			KaldiArchiveWriter writer;
+			ErrMsgList errMsg;
+			ASSERT_TRUE(writer.open(tempPath_ / "feats.ark", tempPath_ / "feats.scp", &errMsg)) << str(errMsg);
+			writer.setScpArkPath("feats.ark");
+			std::vector<float> mat1 = { 1, 2, 3, 4, 5, 6 };
+			ASSERT_TRUE(writer.writeMatrix("spk1_utt2", mat1, 3, &errMsg)) << str(errMsg);
+			std::vector<float> mat2 = { -1.5f, 0.25f };
+			ASSERT_TRUE(writer.writeMatrix("spk1_utt1", mat2, 1, &errMsg)) << str(errMsg);
+			ASSERT_TRUE(writer.close(&errMsg)) << str(errMsg);
+		}
+
+		void checkTwoMatrices(const KaldiArchiveReader& reader)
+		{
+			ASSERT_EQ(2, reader.keys().size());
+			EXPECT_EQ("spk1_utt2", reader.keys()[0]);
+			EXPECT_EQ("spk1_utt1", reader.keys()[1]);
+			EXPECT_FALSE(reader.contains("spk1_utt3"));
+
+			ErrMsgList errMsg;
+			std::vector<float> data;
+			int rows = -1;
+			int cols = -1;
+			ASSERT_TRUE(reader.readMatrix("spk1_utt1", data, rows, cols, &errMsg)) << str(errMsg);
+			EXPECT_EQ(2, rows);
+			EXPECT_EQ(1, cols);
+			EXPECT_EQ(std::vector<float>({ -1.5f, 0.25f }), data);
+
+			ASSERT_TRUE(reader.readMatrix("spk1_utt2", data, rows, cols, &errMsg)) << str(errMsg);
+			EXPECT_EQ(2, rows);
+			EXPECT_EQ(3, cols);
+			EXPECT_EQ(std::vector<float>({ 1, 2, 3, 4, 5, 6 }), data);
+		}
+	};
+
+	TEST_F(KaldiFeatureArchiveTest, readByScp)
+	{
+		writeTwoMatrices();
+
+		KaldiArchiveReader reader;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(reader.openScp(tempPath_ / "feats.scp", &errMsg)) << str(errMsg);
+		checkTwoMatrices(reader);
+	}
+
+	TEST_F(KaldiFeatureArchiveTest, readByScanningArk)
+	{
+		writeTwoMatrices();
+
+		KaldiArchiveReader reader;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(reader.openArk(tempPath_ / "feats.ark", &errMsg)) << str(errMsg);
+		checkTwoMatrices(reader);
+	}
+
+	TEST_F(KaldiFeatureArchiveTest, missingKeyFails)
+	{
+		writeTwoMatrices();
+
+		KaldiArchiveReader reader;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(reader.openScp(tempPath_ / "feats.scp", &errMsg)) << str(errMsg);
+		std::vector<float> data;
+		int rows = -1;
+		int cols = -1;
+		EXPECT_FALSE(reader.readMatrix("absent", data, rows, cols, &errMsg));
+	}
+
+	TEST_F(KaldiFeatureArchiveTest, keyWithSpaceFails)
+	{
+		KaldiArchiveWriter writer;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(writer.open(tempPath_ / "feats.ark", tempPath_ / "feats.scp", &errMsg)) << str(errMsg);
+		std::vector<float> mat = { 1, 2 };
+		EXPECT_FALSE(writer.writeMatrix("spk1 utt1", mat, 1, &errMsg));
+		ASSERT_TRUE(writer.close(&errMsg)) << str(errMsg);
+	}
+
+	TEST_F(KaldiFeatureArchiveTest, kaldiFeatsScpRefersToSegmentArchive)
+	{
+		// segments' archives are keyed by file id, as they are written along with wav segments
+		auto writeSegArchive = [this](const char* featsName, std::vector<std::pair<std::string, std::vector<float>>> mats, int cols)
+		{
+			KaldiArchiveWriter writer;
+			ErrMsgList errMsg;
+			ASSERT_TRUE(writer.open(tempPath_ / (std::string(featsName) + ".ark"), tempPath_ / (std::string(featsName) + ".scp"), &errMsg)) << str(errMsg);
+			writer.setScpArkPath(std::string(featsName) + ".ark");
+			for (const auto& mat : mats)
+				ASSERT_TRUE(writer.writeMatrix(mat.first, mat.second, cols, &errMsg)) << str(errMsg);
+			ASSERT_TRUE(writer.close(&errMsg)) << str(errMsg);
+		};
+		writeSegArchive("db_train_feats", { { "train/spk1/utt1", { 1, 2, 3, 4 } }, { "train/spk2/utt2", { 5, 6 } } }, 2);
+		writeSegArchive("db_test_feats", { { "test/spk1/utt3", { 7, 8, 9 } } }, 3);
+
+		AnnotatedSpeechSegment seg1;
+		seg1.SpeakerBriefId = "spk1";
+		seg1.TranscriptText = L"one";
+		AnnotatedSpeechSegment seg2;
+		seg2.SpeakerBriefId = "spk2";
+		seg2.TranscriptText = L"two";
+		AnnotatedSpeechSegment seg3;
+		seg3.SpeakerBriefId = "spk1";
+		seg3.TranscriptText = L"three";
+		auto segPaths = [this](const char* segName, const char* relPath)
+		{
+			AudioFileRelativePathComponents paths;
+			paths.SegFileNameNoExt = segName;
+			paths.AudioSegFilePathNoExt = toQStringBfs(tempPath_ / relPath);
+			paths.WavOutRelFilePathNoExt = relPath;
+			return paths;
+		};
+		std::vector<AssignedPhaseAudioSegment> segRefs = {
+			{ &seg2, ResourceUsagePhase::Train, segPaths("utt2", "train/spk2/utt2") },
+			{ &seg3, ResourceUsagePhase::Test, segPaths("utt3", "test/spk1/utt3") },
+			{ &seg1, ResourceUsagePhase::Train, segPaths("utt1", "train/spk1/utt1") },
+		};
+
+		auto noDisplay = [](boost::wstring_view) { return boost::wstring_view(); };
+		KaldiModelBuilder kaldiModel(tempPath_ / "Kaldi", noDisplay, noDisplay);
+		kaldiModel.setSegmentFeatures(tempPath_ / "db_train_feats.scp", tempPath_ / "db_test_feats.scp");
+		ErrMsgList errMsg;
+		ASSERT_TRUE(kaldiModel.generate(segRefs, &errMsg)) << str(errMsg);
+		EXPECT_FALSE(boost::filesystem::exists(tempPath_ / "Kaldi" / "train_feats.ark"));
+
+		// Kaldi's feats.scp is keyed by utterance id, sorted
+		KaldiArchiveReader trainFeats;
+		ASSERT_TRUE(trainFeats.openScp(tempPath_ / "Kaldi" / "train_feats.scp", &errMsg)) << str(errMsg);
+		ASSERT_EQ(std::vector<std::string>({ "spk1_utt1", "spk2_utt2" }), trainFeats.keys());
+		std::vector<float> data;
+		int rows = -1;
+		int cols = -1;
+		ASSERT_TRUE(trainFeats.readMatrix("spk2_utt2", data, rows, cols, &errMsg)) << str(errMsg);
+		EXPECT_EQ(1, rows);
+		EXPECT_EQ(2, cols);
+		EXPECT_EQ(std::vector<float>({ 5, 6 }), data);
+
+		KaldiArchiveReader testFeats;
+		ASSERT_TRUE(testFeats.openScp(tempPath_ / "Kaldi" / "test_feats.scp", &errMsg)) << str(errMsg);
+		ASSERT_EQ(std::vector<std::string>({ "spk1_utt3" }), testFeats.keys());
+		ASSERT_TRUE(testFeats.readMatrix("spk1_utt3", data, rows, cols, &errMsg)) << str(errMsg);
+		EXPECT_EQ(1, rows);
+		EXPECT_EQ(3, cols);
+		EXPECT_EQ(std::vector<float>({ 7, 8, 9 }), data);
+	}
+}
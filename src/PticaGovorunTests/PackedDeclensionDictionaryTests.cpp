@@ -0,0 +1,109 @@
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "PackedDeclensionDictionary.h"
+#include "TempPathTest.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	struct PackedDeclensionDictionaryTest : public TempPathTest
+	{
+		std::unordered_map<std::wstring, std::unique_ptr<WordDeclensionGroup>> declinedWords_;
+
+		PackedDeclensionDictionaryTest() : TempPathTest("declDict-%%%%-%%%%.packed")
+		{
+		}
+
+		void SetUp() override
+		{
+			auto addForm = [](WordDeclensionGroup& group, const wchar_t* name, WordCase wordCase, EntityMultiplicity multiplicity)
+			{
+				WordDeclensionForm form;
+				form.Name = name;
+				form.Case = wordCase;
+				form.Multiplicity = multiplicity;
+				form.OwningWordGroup = &group;
+				group.Forms.push_back(form);
+			};
+
+			// кіт: кіт, кота, коти
+			auto cat = std::make_unique<WordDeclensionGroup>();
+			cat->Name = L"\x043A\x0456\x0442";
+			cat->WordClass = PartOfSpeech::Noun;
+			cat->IsBeing = true;
+			cat->Gender = WordGender::Masculine;
+			addForm(*cat, L"\x043A\x0456\x0442", WordCase::Nominative, EntityMultiplicity::Singular);
+			addForm(*cat, L"\x043A\x043E\x0442\x0430", WordCase::Genitive, EntityMultiplicity::Singular);
+			addForm(*cat, L"\x043A\x043E\x0442\x0438", WordCase::Nominative, EntityMultiplicity::Plural);
+
+			// кота (the form of another word in the same spelling)
+			auto other = std::make_unique<WordDeclensionGroup>();
+			other->Name = L"\x043A\x043E\x0442\x0430\x0431";
+			other->WordClass = PartOfSpeech::Noun;
+			addForm(*other, L"\x043A\x043E\x0442\x0430", WordCase::Acusative, EntityMultiplicity::Plural);
+
+			declinedWords_[cat->Name] = std::move(cat);
+			declinedWords_[other->Name] = std::move(other);
+		}
+	};
+
+	TEST_F(PackedDeclensionDictionaryTest, findGroupAndForms)
+	{
+		ErrMsgList errMsg;
+		ASSERT_TRUE(writePackedDeclensionDictionary(declinedWords_, tempPath_, &errMsg)) << str(errMsg);
+
+		PackedDeclensionDictionary dict;
+		ASSERT_TRUE(dict.open(tempPath_, &errMsg)) << str(errMsg);
+		EXPECT_EQ(2, dict.groups().size());
+		EXPECT_EQ(3, dict.uniqueFormsCount());
+		EXPECT_EQ(nullptr, dict.findGroup(L"\x043A\x0456\x0442\x0438"));
+
+		const PackedDeclensionGroup* packedCat = dict.findGroup(L"\x043A\x0456\x0442");
+		ASSERT_NE(nullptr, packedCat);
+		EXPECT_EQ(3, dict.forms(*packedCat).size());
+
+		WordDeclensionGroup cat;
+		dict.unpackGroup(*packedCat, cat);
+		const WordDeclensionGroup& expectCat = *declinedWords_[cat.Name];
+		EXPECT_TRUE(cat.WordClass == expectCat.WordClass);
+		EXPECT_TRUE(cat.IsBeing == expectCat.IsBeing);
+		EXPECT_TRUE(cat.Gender == expectCat.Gender);
+		EXPECT_TRUE(cat.NumberCategory == boost::none);
+		ASSERT_EQ(expectCat.Forms.size(), cat.Forms.size());
+		for (size_t i = 0; i < cat.Forms.size(); ++i)
+		{
+			EXPECT_EQ(expectCat.Forms[i].Name, cat.Forms[i].Name);
+			EXPECT_TRUE(expectCat.Forms[i].Case == cat.Forms[i].Case);
+			EXPECT_TRUE(expectCat.Forms[i].Multiplicity == cat.Forms[i].Multiplicity);
+			EXPECT_TRUE(cat.Forms[i].Gender == boost::none);
+			EXPECT_EQ(&cat, cat.Forms[i].OwningWordGroup);
+		}
+
+		std::vector<const PackedDeclensionGroup*> groups;
+		dict.findFormGroups(L"\x043A\x043E\x0442\x0430", groups);
+		ASSERT_EQ(2, groups.size());
+		EXPECT_NE(groups[0], groups[1]);
+	}
+
+	TEST_F(PackedDeclensionDictionaryTest, packFormTagsRoundtrip)
+	{
+		WordDeclensionForm form;
+		form.WordClass = PartOfSpeech::Verb;
+		form.Tense = ActionTense::Future;
+		form.Person = WordPerson::They;
+		form.IsInfinitive = false;
+		form.ActiveOrPassive = WordActiveOrPassive::Passive;
+
+		WordDeclensionForm actual;
+		unpackFormTags(packFormTags(form), actual);
+		EXPECT_TRUE(form.WordClass == actual.WordClass);
+		EXPECT_TRUE(form.Tense == actual.Tense);
+		EXPECT_TRUE(form.Person == actual.Person);
+		EXPECT_TRUE(form.IsInfinitive == actual.IsInfinitive);
+		EXPECT_TRUE(form.ActiveOrPassive == actual.ActiveOrPassive);
+		EXPECT_TRUE(actual.Case == boost::none);
+		EXPECT_TRUE(actual.Mandative == boost::none);
+	}
+}
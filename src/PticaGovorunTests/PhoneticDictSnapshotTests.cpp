@@ -0,0 +1,84 @@
+#include <map>
+#include <memory>
+#include <gtest/gtest.h>
+#include "PhoneticDictSnapshot.h"
+#include "SpeechDataValidation.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	TEST(PhoneticDictSnapshotTest, phoneRegistryIsSharedForSameSettings)
+	{
+		std::shared_ptr<const PhoneRegistry> phoneReg1 = sharedPhoneRegistryUk(true, true, PalatalSupport::AsPalatal);
+		std::shared_ptr<const PhoneRegistry> phoneReg2 = sharedPhoneRegistryUk(true, true, PalatalSupport::AsPalatal);
+		std::shared_ptr<const PhoneRegistry> phoneReg3 = sharedPhoneRegistryUk(true, false, PalatalSupport::AsPalatal);
+		EXPECT_EQ(phoneReg1.get(), phoneReg2.get());
+		EXPECT_NE(phoneReg1.get(), phoneReg3.get());
+		EXPECT_EQ(PalatalSupport::AsPalatal, phoneReg1->palatalSupport());
+		EXPECT_GT(phoneReg1->phonesCount(), phoneReg3->phonesCount());
+	}
+
+	TEST(PhoneticDictSnapshotTest, editCopiesOnlyEditedDictionary)
+	{
+		typedef std::map<boost::wstring_view, PhoneticWord> PhoneticDict;
+		auto snapshot = std::make_shared<PhoneticDictSnapshot>();
+		snapshot->PhoneReg = sharedPhoneRegistryUk(true, true, PalatalSupport::AsHard);
+		snapshot->WellFormed = std::make_shared<PhoneticDict>();
+		snapshot->Broken = std::make_shared<PhoneticDict>();
+		snapshot->Filler = std::make_shared<PhoneticDict>();
+		snapshot->Shrekky = std::make_shared<PhoneticDict>();
+
+		SharedPhoneticDicts dicts(snapshot);
+		QString errMsg;
+		ASSERT_TRUE(dicts.createUpdateDeletePhoneticWord("persian", "mama", "mama\tM A M A", &errMsg)) << errMsg.toStdString();
+
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot1 = dicts.snapshot();
+		EXPECT_EQ(1, snapshot1->Version);
+		EXPECT_EQ(nullptr, snapshot->findPhoneticWord("persian", L"mama")); // old snapshot is not changed
+		const PhoneticWord* word = snapshot1->findPhoneticWord("persian", L"mama");
+		ASSERT_NE(nullptr, word);
+		ASSERT_EQ(1, word->Pronunciations.size());
+		EXPECT_EQ(L"mama", word->Pronunciations[0].PronCode);
+		EXPECT_EQ(4, word->Pronunciations[0].Phones.size());
+		EXPECT_EQ(snapshot->Broken, snapshot1->Broken); // not edited dictionaries are shared
+		EXPECT_EQ(snapshot->Shrekky, snapshot1->Shrekky);
+
+		// empty pronunciations delete the word
+		ASSERT_TRUE(dicts.createUpdateDeletePhoneticWord("persian", "mama", "", &errMsg)) << errMsg.toStdString();
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot2 = dicts.snapshot();
+		EXPECT_EQ(nullptr, snapshot2->findPhoneticWord("persian", L"mama"));
+		EXPECT_NE(nullptr, snapshot1->findPhoneticWord("persian", L"mama"));
+
+		EXPECT_FALSE(dicts.createUpdateDeletePhoneticWord("filler", "mama", "mama\tM A M A", &errMsg));
+	}
+
+	TEST(PhoneticDictSnapshotTest, speechDataEditIsPublished)
+	{
+		SpeechData speechData("");
+		speechData.setPhoneReg(sharedPhoneRegistryUk(true, true, PalatalSupport::AsHard));
+		speechData.setStringArena(std::make_shared<GrowOnlyPinArena<wchar_t>>(1024));
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot = speechData.phoneticDictSnapshot();
+		ASSERT_NE(nullptr, snapshot);
+
+		// the suggestion index is built before the edit and is updated by it
+		QStringList suggested;
+		speechData.suggesedWordsUserInput("persian", "ma", suggested);
+		EXPECT_TRUE(suggested.isEmpty());
+
+		QString errMsg;
+		ASSERT_TRUE(speechData.createUpdateDeletePhoneticWord("persian", "mama", "mama\tM A M A", &errMsg)) << errMsg.toStdString();
+		std::shared_ptr<const PhoneticDictSnapshot> snapshot1 = speechData.phoneticDictSnapshot();
+		EXPECT_EQ(nullptr, snapshot->findPhoneticWord("persian", L"mama"));
+		EXPECT_NE(nullptr, snapshot1->findPhoneticWord("persian", L"mama"));
+		EXPECT_EQ(snapshot1->WellFormed.get(), &speechData.phoneticDictWellFormed()); // the snapshot is the storage
+		EXPECT_EQ(snapshot->Broken, snapshot1->Broken);
+
+		speechData.suggesedWordsUserInput("persian", "ma", suggested);
+		EXPECT_EQ(QStringList({ "mama" }), suggested);
+
+		// the failed edit doesn't publish anything
+		EXPECT_FALSE(speechData.createUpdateDeletePhoneticWord("persian", "mama", "mama\tNOT_A_PHONE", &errMsg));
+		EXPECT_EQ(snapshot1, speechData.phoneticDictSnapshot());
+	}
+}
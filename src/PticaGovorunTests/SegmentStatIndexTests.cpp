@@ -0,0 +1,123 @@
+#include <functional>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "SegmentStatIndex.h"
+#include "TempPathTest.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	struct SegmentStatIndexTest : public TempPathTest
+	{
+		std::vector<SegmentStatRow> rows_;
+
+		SegmentStatIndexTest() : TempPathTest("segmentStats-%%%%-%%%%.bin")
+		{
+		}
+
+		void SetUp() override
+		{
+			auto addRow = [this](const char* speakerId, ResourceUsagePhase phase, float durSec, std::vector<std::wstring> words, std::vector<int> phoneIds)
+			{
+				SegmentStatRow row;
+				row.SpeakerId = speakerId;
+				row.Phase = phase;
+				row.DurationSec = durSec;
+				row.Words = words;
+				for (int phoneIdInt : phoneIds)
+				{
+					PhoneId phoneId;
+					phoneId.Id = (PhoneId::id_type)phoneIdInt;
+					row.Phones.push_back(phoneId);
+				}
+				rows_.push_back(row);
+			};
+			addRow("bear", ResourceUsagePhase::Train, 2, { L"mama", L"myla" }, { 1, 2, 1, 3 });
+			addRow("fox", ResourceUsagePhase::Test, 1.5f, { L"ramu" }, { 3, 1, 4 });
+			addRow("bear", ResourceUsagePhase::Test, 0.5f, { L"mama" }, { 1, 2, 1 });
+		}
+
+		bool build(int threadsCount, SegmentStatIndex& index, ErrMsgList* errMsg)
+		{
+			return buildSegmentStatIndex(rows_.size(), 5, threadsCount, [this](size_t segInd, int threadInd, SegmentStatRow& row, ErrMsgList* errMsg) -> bool
+			{
+				row = rows_[segInd];
+				return true;
+			}, index, errMsg);
+		}
+	};
+
+	TEST_F(SegmentStatIndexTest, columnsAndTotals)
+	{
+		SegmentStatIndex index;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(build(2, index, &errMsg)) << str(errMsg);
+		ASSERT_EQ(3, index.segmentsCount());
+		EXPECT_EQ((std::vector<std::string>{ "bear", "fox" }), index.SpeakerIds);
+		EXPECT_EQ((std::vector<std::wstring>{ L"mama", L"myla", L"ramu" }), index.Words);
+		EXPECT_EQ(0, index.wordIds(2)[0]);
+		EXPECT_EQ(2, index.phoneCounts(0)[1]);
+		EXPECT_TRUE(index.phase(1) == ResourceUsagePhase::Test);
+
+		SegmentPhaseStat trainStat;
+		SegmentPhaseStat testStat;
+		computePhaseStat(index, 4, trainStat, testStat);
+		EXPECT_EQ(1, trainStat.UtterCount);
+		EXPECT_EQ(2, testStat.UtterCount);
+		EXPECT_EQ(2, trainStat.WordCount);
+		EXPECT_EQ(2, testStat.WordCount);
+		EXPECT_DOUBLE_EQ(2.0, testStat.DurationSec);
+		EXPECT_DOUBLE_EQ(0.5, testStat.SpeakerDurSec[0]);
+		EXPECT_EQ(3, testStat.PhoneCounts[1]);
+
+		std::vector<int> testOnlyPhoneIds;
+		findTestOnlyPhones(trainStat, testStat, testOnlyPhoneIds);
+		EXPECT_EQ((std::vector<int>{ 4 }), testOnlyPhoneIds);
+	}
+
+	TEST_F(SegmentStatIndexTest, saveLoadRoundtrip)
+	{
+		SegmentStatIndex index;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(build(1, index, &errMsg)) << str(errMsg);
+
+		ASSERT_TRUE(saveSegmentStatIndex(index, tempPath_, &errMsg)) << str(errMsg);
+
+		SegmentStatIndex loaded;
+		ASSERT_TRUE(loadSegmentStatIndex(tempPath_, loaded, &errMsg)) << str(errMsg);
+
+		EXPECT_EQ(index.PhonesDim, loaded.PhonesDim);
+		EXPECT_EQ(index.DurationSec, loaded.DurationSec);
+		EXPECT_EQ(index.SpeakerInd, loaded.SpeakerInd);
+		EXPECT_EQ(index.Phase, loaded.Phase);
+		EXPECT_EQ(index.PhoneCounts, loaded.PhoneCounts);
+		EXPECT_EQ(index.WordIdsOffset, loaded.WordIdsOffset);
+		EXPECT_EQ(index.WordIds, loaded.WordIds);
+		EXPECT_EQ(index.SpeakerIds, loaded.SpeakerIds);
+		EXPECT_EQ(index.Words, loaded.Words);
+	}
+
+	TEST_F(SegmentStatIndexTest, loadRejectsOutOfRangeReferences)
+	{
+		SegmentStatIndex index;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(build(1, index, &errMsg)) << str(errMsg);
+
+		// the index is saved as is, so the corrupted columns get into the file
+		auto checkLoadFails = [&](std::function<void(SegmentStatIndex&)> corrupt)
+		{
+			SegmentStatIndex corrupted = index;
+			corrupt(corrupted);
+			ASSERT_TRUE(saveSegmentStatIndex(corrupted, tempPath_, &errMsg)) << str(errMsg);
+
+			SegmentStatIndex loaded;
+			EXPECT_FALSE(loadSegmentStatIndex(tempPath_, loaded, &errMsg));
+		};
+		checkLoadFails([](SegmentStatIndex& x) { x.SpeakerInd[1] = 2; });
+		checkLoadFails([](SegmentStatIndex& x) { x.SpeakerInd[1] = -1; });
+		checkLoadFails([](SegmentStatIndex& x) { std::swap(x.WordIdsOffset[1], x.WordIdsOffset[2]); });
+		checkLoadFails([](SegmentStatIndex& x) { x.WordIds[0] = 3; });
+	}
+}
@@ -0,0 +1,61 @@
+#include <vector>
+#include <gtest/gtest.h>
+#include "SmallVector.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	TEST(SmallVectorTest, keepsShortSequenceInline)
+	{
+		SmallVector<int, 4> xs = { 1, 2, 3 };
+		EXPECT_TRUE(xs.isInline());
+		EXPECT_EQ(3, xs.size());
+		EXPECT_EQ(1, xs.front());
+		EXPECT_EQ(3, xs.back());
+
+		xs.push_back(4);
+		EXPECT_TRUE(xs.isInline());
+		xs.push_back(5);
+		EXPECT_FALSE(xs.isInline());
+		EXPECT_EQ((std::vector<int>{ 1, 2, 3, 4, 5 }), std::vector<int>(xs.begin(), xs.end()));
+
+		xs.pop_back();
+		xs.shrink_to_fit();
+		EXPECT_TRUE(xs.isInline());
+		EXPECT_EQ((std::vector<int>{ 1, 2, 3, 4 }), std::vector<int>(xs.begin(), xs.end()));
+	}
+
+	TEST(SmallVectorTest, copyAndMove)
+	{
+		std::vector<int> items = { 1, 2, 3, 4, 5, 6 };
+		SmallVector<int, 4> longXs(items.begin(), items.end());
+		SmallVector<int, 4> shortXs = { 7 };
+
+		SmallVector<int, 4> longCopy = longXs;
+		EXPECT_TRUE(longCopy == longXs);
+		EXPECT_NE(longCopy.data(), longXs.data());
+
+		SmallVector<int, 4> longMoved = std::move(longCopy);
+		EXPECT_TRUE(longMoved == longXs);
+		EXPECT_TRUE(longCopy.empty());
+
+		SmallVector<int, 4> shortMoved = std::move(shortXs);
+		EXPECT_EQ(1, shortMoved.size());
+		EXPECT_EQ(7, shortMoved[0]);
+
+		shortMoved = longMoved;
+		EXPECT_TRUE(shortMoved == longXs);
+		longMoved = SmallVector<int, 4>{ 8, 9 };
+		EXPECT_TRUE(longMoved.isInline());
+		EXPECT_FALSE(longMoved < shortMoved);
+		EXPECT_TRUE(shortMoved < longMoved);
+	}
+
+	TEST(SmallVectorTest, pushBackOwnElementOnGrowth)
+	{
+		SmallVector<int, 2> xs = { 1, 2 };
+		xs.push_back(xs[0]);
+		EXPECT_EQ((std::vector<int>{ 1, 2, 1 }), std::vector<int>(xs.begin(), xs.end()));
+	}
+}
@@ -0,0 +1,36 @@
+#include <vector>
+#include <algorithm>
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <gtest/gtest.h>
+#include "SpeechProcessing.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	TEST(SpectrumLogPowerTest, sinePeaksAtItsFrequency)
+	{
+		const float sampleRate = 16000;
+		const int fftNum = 512;
+		const int toneBin = 64; // 64*16000/512=2000Hz
+		std::vector<short> frame(400);
+		for (size_t i = 0; i < frame.size(); ++i)
+			frame[i] = (short)(10000 * std::sin(2 * M_PI * toneBin * i / fftNum));
+
+		std::vector<float> wavePointsRe;
+		std::vector<float> wavePointsIm;
+		std::vector<float> powers(fftNum / 2);
+		computeSpectrumLogPower(frame, fftNum, nullptr, wavePointsRe, wavePointsIm, powers);
+		auto peakInd = std::max_element(powers.begin(), powers.end()) - powers.begin();
+		EXPECT_EQ(toneBin, peakInd);
+
+		TriangularFilterBank filterBank;
+		buildTriangularFilterBank(sampleRate, 24, fftNum, filterBank);
+		std::vector<float> melPowers(filterBank.BinCount);
+		computeSpectrumLogPower(frame, fftNum, &filterBank, wavePointsRe, wavePointsIm, melPowers);
+		auto melPeakInd = std::max_element(melPowers.begin(), melPowers.end()) - melPowers.begin();
+		EXPECT_GT(melPeakInd, 0);
+		EXPECT_LT(melPeakInd, filterBank.BinCount - 1);
+	}
+}
@@ -0,0 +1,129 @@
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "SpeechDataValidationCache.h"
+#include "TempPathTest.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	struct SpeechDataValidationCacheTest : public TempPathTest
+	{
+		boost::filesystem::path annotPath_;
+		boost::filesystem::path cachePath_;
+
+		SpeechDataValidationCacheTest() : TempPathTest("validationCache-%%%%-%%%%")
+		{
+		}
+
+		void SetUp() override
+		{
+			boost::filesystem::create_directories(tempPath_);
+			annotPath_ = tempPath_ / "story1.xml";
+			cachePath_ = tempPath_ / "validationCache.txt";
+			writeFile(annotPath_, "<xml/>", std::ios::trunc);
+		}
+
+		static void writeFile(const boost::filesystem::path& filePath, const char* text, std::ios::openmode mode)
+		{
+			std::ofstream file(filePath.string(), std::ios::binary | mode);
+			file << text;
+		}
+
+		/// Saves the validation result of the annotation file into the cache.
+		void saveValidatedAnnot()
+		{
+			AnnotValidationEntry entry;
+			readFileStamp(annotPath_, entry.FileSize, entry.ModifTime);
+			entry.ContentHash = 0x1234abcd;
+			entry.Msgs.append("Marker\twith tab");
+			entry.PronUsage[L"мама"] = 2;
+
+			SpeechDataValidationCache cache;
+			cache.setFiles({ annotPathQ() }, { entry });
+			cache.setDictEntries({ { L"persian мама", L"мама мама(2)" } });
+			ErrMsgList errMsg;
+			ASSERT_TRUE(cache.save(cachePath_, &errMsg)) << str(errMsg);
+		}
+
+		QString annotPathQ() const
+		{
+			return QString::fromStdWString(annotPath_.wstring());
+		}
+
+		/// Loads the cache and checks whether the entry of the annotation file can be reused.
+		bool isCacheHit()
+		{
+			SpeechDataValidationCache cache;
+			ErrMsgList errMsg;
+			if (!cache.load(cachePath_, &errMsg))
+				return false;
+			const AnnotValidationEntry* cached = cache.findFile(annotPathQ());
+			if (cached == nullptr)
+				return false;
+
+			std::int64_t fileSize = -1;
+			std::int64_t modifTime = 0;
+			readFileStamp(annotPath_, fileSize, modifTime);
+			return cached->hasFileStamp(fileSize, modifTime);
+		}
+	};
+
+	TEST_F(SpeechDataValidationCacheTest, unchangedFileIsHit)
+	{
+		saveValidatedAnnot();
+		ASSERT_TRUE(isCacheHit());
+
+		SpeechDataValidationCache cache;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(cache.load(cachePath_, &errMsg)) << str(errMsg);
+		const AnnotValidationEntry* cached = cache.findFile(annotPathQ());
+		ASSERT_TRUE(cached != nullptr);
+		EXPECT_EQ((std::uint64_t)0x1234abcd, cached->ContentHash);
+		EXPECT_EQ(QStringList({ "Marker\twith tab" }), cached->Msgs);
+		EXPECT_EQ(2, cached->PronUsage.at(L"мама"));
+		EXPECT_EQ(std::wstring(L"мама мама(2)"), cache.dictEntries().at(L"persian мама"));
+	}
+
+	TEST_F(SpeechDataValidationCacheTest, sizeChangeIsMiss)
+	{
+		saveValidatedAnnot();
+		std::time_t modifTime = boost::filesystem::last_write_time(annotPath_);
+		writeFile(annotPath_, "<!-- edited -->", std::ios::app);
+		boost::filesystem::last_write_time(annotPath_, modifTime);
+		EXPECT_FALSE(isCacheHit());
+	}
+
+	TEST_F(SpeechDataValidationCacheTest, modifTimeChangeIsMiss)
+	{
+		saveValidatedAnnot();
+		boost::filesystem::last_write_time(annotPath_, boost::filesystem::last_write_time(annotPath_) + 10);
+		EXPECT_FALSE(isCacheHit());
+	}
+
+	TEST_F(SpeechDataValidationCacheTest, corruptedCacheIsEmptyAndRewritten)
+	{
+		saveValidatedAnnot();
+		writeFile(cachePath_, "F\tbroken line without fields\n", std::ios::app);
+
+		SpeechDataValidationCache cache;
+		ErrMsgList errMsg;
+		EXPECT_FALSE(cache.load(cachePath_, &errMsg));
+		EXPECT_TRUE(cache.findFile(annotPathQ()) == nullptr);
+		EXPECT_TRUE(cache.dictEntries().empty());
+
+		// the next validation overwrites the corrupted cache
+		saveValidatedAnnot();
+		EXPECT_TRUE(isCacheHit());
+	}
+
+	TEST_F(SpeechDataValidationCacheTest, unknownHeaderIsMiss)
+	{
+		saveValidatedAnnot();
+		writeFile(cachePath_, "#other cache v2\n", std::ios::trunc);
+		EXPECT_FALSE(isCacheHit());
+	}
+}
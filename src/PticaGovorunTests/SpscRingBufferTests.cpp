@@ -0,0 +1,79 @@
+#include <vector>
+#include <thread>
+#include <gtest/gtest.h>
+#include "SpscRingBuffer.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	TEST(SpscRingBufferTest, writeReadWrapsAround)
+	{
+		SpscRingBuffer<short> ring(4);
+		std::vector<short> in = { 1, 2, 3 };
+		EXPECT_EQ(3, ring.write(in));
+		EXPECT_EQ(1, ring.writeAvailable());
+
+		std::vector<short> out(2);
+		EXPECT_EQ(2, ring.read(out));
+		EXPECT_EQ(std::vector<short>({ 1, 2 }), out);
+
+		std::vector<short> in2 = { 4, 5, 6, 7 };
+		EXPECT_EQ(3, ring.write(in2)); // only 3 free slots
+		EXPECT_EQ(4, ring.readAvailable());
+
+		out.resize(8);
+		ASSERT_EQ(4, ring.read(out));
+		EXPECT_EQ(std::vector<short>({ 3, 4, 5, 6 }), std::vector<short>(out.begin(), out.begin() + 4));
+		EXPECT_EQ(0, ring.readAvailable());
+	}
+
+	TEST(SpscRingBufferTest, skipToDiscardsOldItems)
+	{
+		SpscRingBuffer<short> ring(8);
+		std::vector<short> in = { 1, 2, 3, 4, 5 };
+		ring.write(in);
+		ring.skipTo(3);
+		ring.skipTo(1); // never goes back
+
+		std::vector<short> out(8);
+		ASSERT_EQ(2, ring.read(out));
+		EXPECT_EQ(4, out[0]);
+		EXPECT_EQ(5, out[1]);
+	}
+
+	TEST(SpscRingBufferTest, producerConsumerThreadsKeepOrder)
+	{
+		SpscRingBuffer<int> ring(64);
+		const int count = 100000;
+		std::thread producer([&ring]()
+		{
+			std::vector<int> chunk(7);
+			int next = 0;
+			while (next < count)
+			{
+				size_t chunkSize = std::min<size_t>(chunk.size(), count - next);
+				for (size_t i = 0; i < chunkSize; ++i)
+					chunk[i] = next + (int)i;
+				size_t written = ring.write(gsl::span<const int>(chunk.data(), chunkSize));
+				next += (int)written;
+				if (written == 0)
+					std::this_thread::yield();
+			}
+		});
+
+		std::vector<int> out(5);
+		int expected = 0;
+		bool ordered = true;
+		while (expected < count)
+		{
+			size_t readCount = ring.read(out);
+			for (size_t i = 0; i < readCount; ++i)
+				ordered &= out[i] == expected++;
+			if (readCount == 0)
+				std::this_thread::yield();
+		}
+		producer.join();
+		EXPECT_TRUE(ordered);
+	}
+}
@@ -1,5 +1,6 @@
 #include <vector>
 #include <string>
+#include <random>
 #include <gtest/gtest.h>
 #include "StringUtils.h"
 #include <TranscriberUI/PhoneticDictionaryViewModel.h>
@@ -68,4 +69,55 @@ namespace PticaGovorunTests
 		// removed
 		ASSERT_EQ(1, wordDist({ L"a", L"1" }, { L"1" }));
 	}
+	TEST_F(StringEditDistanceTest, bitParallelEqualsFullMatrix)
+	{
+		std::string rests("rests");
+		std::string stress("stress");
+		std::string empty;
+		ASSERT_EQ(3, editDistanceBitParallel<char>(rests, stress));
+		ASSERT_EQ(6, editDistanceBitParallel<char>(empty, stress));
+
+		// the pattern spans multiple 64-bit blocks
+		std::mt19937 gen(17);
+		WordErrorCosts<int> c;
+		for (int i = 0; i < 200; ++i)
+		{
+			std::vector<int> first(gen() % 200);
+			std::vector<int> second(gen() % 200);
+			for (int& x : first) x = gen() % 4;
+			for (int& x : second) x = gen() % 4;
+			float expected = findEditDistanceNew<int, WordErrorCosts<int>>(first, second, c);
+			ASSERT_EQ(expected, editDistanceBitParallel<int>(first, second));
+		}
+	}
+	TEST_F(StringEditDistanceTest, bandedStopsAboveMaxCost)
+	{
+		WordErrorCosts<char> c;
+		std::string first("rests");
+		std::string second("stress");
+		float dist = -1;
+		ASSERT_TRUE((findEditDistanceBanded<char, WordErrorCosts<char>>(first, second, c, 3, dist)));
+		ASSERT_EQ(3, dist);
+		ASSERT_FALSE((findEditDistanceBanded<char, WordErrorCosts<char>>(first, second, c, 2, dist)));
+
+		std::string longStr(100, 'a');
+		ASSERT_FALSE((findEditDistanceBanded<char, WordErrorCosts<char>>(first, longStr, c, 10, dist)));
+	}
+	TEST_F(StringEditDistanceTest, hirschbergRecipeIsOptimal)
+	{
+		std::mt19937 gen(29);
+		WordErrorCosts<int> c;
+		for (int i = 0; i < 50; ++i)
+		{
+			std::vector<int> first(gen() % 300);
+			std::vector<int> second(gen() % 300);
+			for (int& x : first) x = gen() % 5;
+			for (int& x : second) x = gen() % 5;
+
+			std::vector<EditStep> recipe;
+			float cost = minCostRecipeHirschberg<int, WordErrorCosts<int>>(first, second, c, recipe);
+			ASSERT_EQ((findEditDistanceNew<int, WordErrorCosts<int>>(first, second, c)), cost);
+			ASSERT_TRUE(validateRecipe<int>(recipe, first, second));
+		}
+	}
 }
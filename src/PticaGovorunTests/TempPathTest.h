@@ -0,0 +1,25 @@
+#pragma once
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+namespace PticaGovorunTests
+{
+	/// The fixture of tests which write files. Provides the unique path in the temporary directory;
+	/// the file or directory at this path is removed after the test.
+	struct TempPathTest : public testing::Test
+	{
+		boost::filesystem::path tempPath_;
+
+		/// pathModel=the name of the path, where each '%' is replaced with a random hex digit, eg "cache-%%%%-%%%%.bin".
+		explicit TempPathTest(const char* pathModel)
+			: tempPath_(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path(pathModel))
+		{
+		}
+
+		void TearDown() override
+		{
+			boost::system::error_code ec;
+			boost::filesystem::remove_all(tempPath_, ec);
+		}
+	};
+}
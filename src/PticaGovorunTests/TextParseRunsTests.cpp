@@ -189,4 +189,39 @@ namespace PticaGovorunTests
 		EXPECT_EQ(L",", str(words[6]));
 		EXPECT_EQ(L"Kiev", str(words[7]));
 	}
+
+	TEST_F(TextParseRunsTest, longRunsOfMixedScripts)
+	{
+		// long runs mix Latin and Cyrillic letters, ASCII and non-breaking whitespace
+		std::wstring s1 = std::wstring(21, L'a') + std::wstring(3, L'\x0456') + L"1234567890123 \t\n\x00A0\x0454\x0491" + L"x\x2014y";
+		wordsReader.setInputText(s1);
+		EXPECT_FALSE(wordsReader.parseTokensTillDot(words));
+		ASSERT_EQ(6, words.size());
+		EXPECT_EQ(std::wstring(21, L'a') + std::wstring(3, L'\x0456'), str(words[0]));
+		EXPECT_EQ(L"1234567890123", str(words[1]));
+		EXPECT_EQ(L" \t\n\x00A0", str(words[2]));
+		EXPECT_TRUE(words[2].Type == TextRunType::Whitespace);
+		EXPECT_EQ(L"\x0454\x0491x", str(words[3]));
+		EXPECT_EQ(L"\x2014", str(words[4]));
+		EXPECT_TRUE(words[4].Type == TextRunType::Punctuation);
+		EXPECT_EQ(L"y", str(words[5]));
+	}
+
+	TEST(CharClassTest, maskMatchesPredicates)
+	{
+		for (int code = 0; code < 0x3000; ++code)
+		{
+			wchar_t ch = (wchar_t)code;
+			std::uint16_t charClass = charClassMask(ch);
+			EXPECT_EQ(isDigitChar(ch), (charClass & CharClassDigit) != 0) << code;
+			EXPECT_EQ(isRomanNumeral(ch), (charClass & CharClassRomanNumeral) != 0) << code;
+			EXPECT_EQ(isEnglishChar(ch), (charClass & CharClassEnglish) != 0) << code;
+			EXPECT_EQ(isExclusiveEnglishChar(ch), (charClass & CharClassExclusiveEnglish) != 0) << code;
+			EXPECT_EQ(isRussianChar(ch), (charClass & CharClassRussian) != 0) << code;
+			EXPECT_EQ(isExclusiveRussianChar(ch), (charClass & CharClassExclusiveRussian) != 0) << code;
+			EXPECT_EQ(isUkrainianVowel(ch), (charClass & CharClassUkrainianVowel) != 0) << code;
+			EXPECT_EQ(isUkrainianConsonant(ch), (charClass & CharClassUkrainianConsonant) != 0) << code;
+			EXPECT_TRUE(textRunType(ch) == textRunTypeNoTable(ch)) << code;
+		}
+	}
 }
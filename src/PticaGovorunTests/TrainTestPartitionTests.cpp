@@ -0,0 +1,81 @@
+#include <vector>
+#include <gtest/gtest.h>
+#include "TrainTestPartition.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	std::vector<PartitionItem> makeItems(int speakersCount, int segsPerSpeaker)
+	{
+		std::vector<PartitionItem> items;
+		for (int speakerInd = 0; speakerInd < speakersCount; ++speakerInd)
+			for (int segInd = 0; segInd < segsPerSpeaker; ++segInd)
+			{
+				PartitionItem item;
+				item.SpeakerBriefId = "speaker" + std::to_string(speakerInd);
+				item.StableKey = std::to_wstring(segInd);
+				item.Phones.set(1 + segInd % 3);
+				items.push_back(item);
+			}
+		return items;
+	}
+
+	TEST(TrainTestPartitionTest, sameResultForAnyThreadsCount)
+	{
+		std::vector<PartitionItem> items = makeItems(7, 20);
+		std::vector<ResourceUsagePhase> phases1;
+		std::vector<ResourceUsagePhase> phases4;
+		partitionTrainTestBySpeaker(items, 0.7, 1932, 1, phases1);
+		partitionTrainTestBySpeaker(items, 0.7, 1932, 4, phases4);
+		EXPECT_TRUE(phases1 == phases4);
+
+		// the order of input items doesn't matter
+		std::vector<PartitionItem> itemsRev(items.rbegin(), items.rend());
+		std::vector<ResourceUsagePhase> phasesRev;
+		partitionTrainTestBySpeaker(itemsRev, 0.7, 1932, 3, phasesRev);
+		EXPECT_TRUE(std::vector<ResourceUsagePhase>(phasesRev.rbegin(), phasesRev.rend()) == phases1);
+	}
+
+	TEST(TrainTestPartitionTest, eachSpeakerIsSplitByRatio)
+	{
+		std::vector<PartitionItem> items = makeItems(3, 10);
+		items[0].FixedPhase = ResourceUsagePhase::Test;
+
+		std::vector<ResourceUsagePhase> phases;
+		partitionTrainTestBySpeaker(items, 0.7, 5, 2, phases);
+		ASSERT_EQ(items.size(), phases.size());
+		EXPECT_TRUE(phases[0] == ResourceUsagePhase::Test);
+
+		for (int speakerInd = 0; speakerInd < 3; ++speakerInd)
+		{
+			int trainCount = 0;
+			for (int segInd = 0; segInd < 10; ++segInd)
+				if (phases[speakerInd * 10 + segInd] == ResourceUsagePhase::Train)
+					trainCount += 1;
+			EXPECT_EQ(speakerInd == 0 ? 6 : 7, trainCount) << "speaker" << speakerInd; // 70% of 9 movable segments is 6
+		}
+	}
+
+	TEST(TrainTestPartitionTest, coverTestPhonesGreedily)
+	{
+		std::vector<PartitionItem> items(5);
+		items[0].Phones.set(1);
+		items[1].Phones.set(2); // rare phone 2 is in test only
+		items[2].Phones.set(2);
+		items[2].Phones.set(3); // covers both rare phones
+		items[3].Phones.set(3);
+		items[4].Phones.set(4);
+		items[4].FixedPhase = ResourceUsagePhase::Test; // rare phone 4 can't be covered
+		std::vector<ResourceUsagePhase> phases = { ResourceUsagePhase::Train, ResourceUsagePhase::Test, ResourceUsagePhase::Test, ResourceUsagePhase::Test, ResourceUsagePhase::Test };
+
+		PhoneSet uncovered;
+		int movedCount = coverTestPhonesInTrain(items, phases, &uncovered);
+		EXPECT_EQ(1, movedCount);
+		EXPECT_TRUE(phases[2] == ResourceUsagePhase::Train);
+		EXPECT_TRUE(phases[1] == ResourceUsagePhase::Test);
+		EXPECT_TRUE(phases[3] == ResourceUsagePhase::Test);
+		EXPECT_EQ(1, uncovered.count());
+		EXPECT_TRUE(uncovered.test(4));
+	}
+}
@@ -0,0 +1,40 @@
+#include <vector>
+#include <gtest/gtest.h>
+#include "VocabularySelection.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	TEST(VocabularySelectionTest, topUsedAcceptedWordParts)
+	{
+		std::vector<std::int64_t> usage = { 0, 5, 9, 5, 1, 7, 3 };
+		auto rejectId5 = [](int wordPartId, int threadInd) { return wordPartId != 5; };
+
+		std::vector<int> wordPartIds;
+		selectTopUsedWordParts(usage, 2, 3, 2, rejectId5, wordPartIds);
+		EXPECT_EQ((std::vector<int>{ 2, 1, 3 }), wordPartIds); // equal usage is ordered by id
+
+		selectTopUsedWordParts(usage, 4, -1, 2, rejectId5, wordPartIds);
+		EXPECT_EQ((std::vector<int>{ 2, 1, 3 }), wordPartIds);
+
+		selectTopUsedWordParts(usage, -1, -1, 1, rejectId5, wordPartIds);
+		EXPECT_EQ((std::vector<int>{ 2, 1, 3, 6, 4, 0 }), wordPartIds);
+	}
+
+	TEST(VocabularySelectionTest, manyBlocksGiveFullSortPrefix)
+	{
+		std::vector<std::int64_t> usage;
+		for (int i = 0; i < 10000; ++i)
+			usage.push_back((i * 7919) % 1000);
+		auto acceptOdd = [](int wordPartId, int threadInd) { return wordPartId % 2 == 1; };
+
+		std::vector<int> expected;
+		selectTopUsedWordParts(usage, -1, -1, 1, acceptOdd, expected);
+		expected.resize(3000);
+
+		std::vector<int> wordPartIds;
+		selectTopUsedWordParts(usage, -1, 3000, 4, acceptOdd, wordPartIds);
+		EXPECT_EQ(expected, wordPartIds);
+	}
+}
@@ -0,0 +1,121 @@
+#include <vector>
+#include <gtest/gtest.h>
+#include "WordPrefixIndex.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	struct WordPrefixIndexTest : public testing::Test
+	{
+		static PhoneticWord word(const wchar_t* w, std::vector<const wchar_t*> pronCodes)
+		{
+			PhoneticWord result;
+			result.Word = w;
+			for (const wchar_t* pronCode : pronCodes)
+			{
+				PronunciationFlavour pron;
+				pron.PronCode = pronCode;
+				result.Pronunciations.push_back(pron);
+			}
+			return result;
+		}
+	};
+
+	TEST_F(WordPrefixIndexTest, prefixIsCaseInsensitive)
+	{
+		std::map<boost::wstring_view, PhoneticWord> dict;
+		dict[L"Київ"] = word(L"Київ", { L"Київ" });
+		dict[L"кит"] = word(L"кит", { L"кит" });
+		dict[L"сон"] = word(L"сон", { L"сон" });
+
+		WordPrefixIndex index;
+		index.build(dict);
+
+		std::vector<boost::wstring_view> words;
+		index.findWords(L"кИ", 10, false, words);
+		ASSERT_EQ(2, words.size());
+		ASSERT_EQ(boost::wstring_view(L"кит"), words[0]);
+		ASSERT_EQ(boost::wstring_view(L"Київ"), words[1]);
+	}
+
+	TEST_F(WordPrefixIndexTest, matchPronCodeReturnsWord)
+	{
+		std::map<boost::wstring_view, PhoneticWord> dict;
+		dict[L"setup"] = word(L"setup", { L"setup(1)", L"cetap(2)" });
+
+		WordPrefixIndex index;
+		index.build(dict);
+
+		std::vector<boost::wstring_view> words;
+		index.findWords(L"ceta", 10, false, words);
+		ASSERT_EQ(1, words.size());
+		ASSERT_EQ(boost::wstring_view(L"setup"), words[0]);
+	}
+
+	TEST_F(WordPrefixIndexTest, limitResults)
+	{
+		std::map<boost::wstring_view, PhoneticWord> dict;
+		dict[L"ab"] = word(L"ab", { L"ab" });
+		dict[L"abc"] = word(L"abc", { L"abc" });
+		dict[L"abd"] = word(L"abd", { L"abd" });
+
+		WordPrefixIndex index;
+		index.build(dict);
+
+		std::vector<boost::wstring_view> words;
+		index.findWords(L"ab", 2, false, words);
+		ASSERT_EQ(2, words.size());
+		ASSERT_EQ(boost::wstring_view(L"ab"), words[0]); // exact match goes first
+	}
+
+	TEST_F(WordPrefixIndexTest, addRemoveWord)
+	{
+		std::map<boost::wstring_view, PhoneticWord> dict;
+		dict[L"кот"] = word(L"кот", { L"кот" });
+
+		WordPrefixIndex index;
+		index.build(dict);
+
+		PhoneticWord newWord = word(L"кора", { L"кора", L"кора(2)" });
+		index.addWord(newWord);
+
+		std::vector<boost::wstring_view> words;
+		index.findWords(L"ко", 10, false, words);
+		ASSERT_EQ(2, words.size());
+
+		index.removeWord(newWord);
+		words.clear();
+		index.findWords(L"ко", 10, false, words);
+		ASSERT_EQ(1, words.size());
+		ASSERT_EQ(boost::wstring_view(L"кот"), words[0]);
+	}
+
+	TEST_F(WordPrefixIndexTest, typoLookup)
+	{
+		std::map<boost::wstring_view, PhoneticWord> dict;
+		dict[L"молоко"] = word(L"молоко", { L"молоко" });
+		dict[L"мир"] = word(L"мир", { L"мир" });
+
+		WordPrefixIndex index;
+		index.build(dict);
+
+		std::vector<boost::wstring_view> words;
+		index.findWords(L"малок", 10, false, words);
+		ASSERT_TRUE(words.empty());
+
+		index.findWords(L"малок", 10, true, words);
+		ASSERT_EQ(1, words.size());
+		ASSERT_EQ(boost::wstring_view(L"молоко"), words[0]);
+	}
+
+	TEST_F(WordPrefixIndexTest, startsWithinOneEdit)
+	{
+		ASSERT_TRUE(startsWithinOneEdit(L"молоко", L"молоко"));
+		ASSERT_TRUE(startsWithinOneEdit(L"молоко", L"малоко")); // substitute
+		ASSERT_TRUE(startsWithinOneEdit(L"молоко", L"моллок")); // remove
+		ASSERT_TRUE(startsWithinOneEdit(L"молоко", L"мооко")); // insert
+		ASSERT_TRUE(startsWithinOneEdit(L"мол", L"молт")); // remove the last letter
+		ASSERT_FALSE(startsWithinOneEdit(L"молоко", L"малако"));
+	}
+}
@@ -0,0 +1,133 @@
+#include <cstdint>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "PhoneticService.h"
+#include "TempPathTest.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	struct WordUsageSnapshotTest : public TempPathTest
+	{
+		WordUsageSnapshotTest() : TempPathTest("wordUsage-%%%%-%%%%.bin")
+		{
+		}
+
+		void saveSnapshot()
+		{
+			UkrainianPhoneticSplitter splitter;
+			WordPart* kit = splitter.wordUsage().getOrAddWordPart(L"кіт", WordPartSide::WholeWord);
+			splitter.wordUsage().getOrAddWordSequence(WordSeqKey({ kit->id() }))->UsedCount = 7;
+
+			ErrMsgList errMsg;
+			ASSERT_TRUE(splitter.saveWordUsageSnapshot(tempPath_, 42, &errMsg)) << str(errMsg);
+		}
+
+		std::int32_t readSnapshotInt(std::streamoff offset)
+		{
+			std::ifstream file(tempPath_.string(), std::ios::binary);
+			file.seekg(offset);
+			std::int32_t value = 0;
+			file.read(reinterpret_cast<char*>(&value), sizeof(value));
+			return value;
+		}
+
+		void writeSnapshotInt(std::streamoff offset, std::int32_t value)
+		{
+			std::fstream file(tempPath_.string(), std::ios::in | std::ios::out | std::ios::binary);
+			file.seekp(offset);
+			file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		void checkCorruptedIsNotLoaded()
+		{
+			UkrainianPhoneticSplitter loadedSplitter;
+			bool loaded = true;
+			ErrMsgList errMsg;
+			EXPECT_FALSE(loadedSplitter.loadWordUsageSnapshot(tempPath_, 42, loaded, &errMsg));
+			EXPECT_FALSE(loaded);
+			EXPECT_FALSE(errMsg.utf8Msg.empty());
+
+			// the usage is left untouched for rebuilding
+			EXPECT_TRUE(loadedSplitter.wordUsage().wordPartByValue(L"кіт", WordPartSide::WholeWord) == nullptr);
+			EXPECT_TRUE(loadedSplitter.sentStartWordPart() != nullptr);
+		}
+	};
+
+	// the snapshot starts with the 56 bytes header, followed by 16 bytes word part records: Id, TextOffset, TextSize, ...
+	const std::streamoff SnapshotFirstPartOffset = 56;
+	const std::streamoff SnapshotPartSize = 16;
+
+	TEST_F(WordUsageSnapshotTest, saveLoadRoundTrip)
+	{
+		UkrainianPhoneticSplitter splitter;
+		WordsUsageInfo& wordUsage = splitter.wordUsage();
+		WordPart* kit = wordUsage.getOrAddWordPart(L"кіт", WordPartSide::WholeWord);
+		WordPart* suffix = wordUsage.getOrAddWordPart(L"ом", WordPartSide::RightPart);
+		suffix->setRemoved(true);
+		wordUsage.getOrAddWordSequence(WordSeqKey({ kit->id() }))->UsedCount = 7;
+		wordUsage.getOrAddWordSequence(WordSeqKey({ kit->id(), suffix->id() }))->UsedCount = 3;
+
+		ErrMsgList errMsg;
+		ASSERT_TRUE(splitter.saveWordUsageSnapshot(tempPath_, 42, &errMsg)) << str(errMsg);
+
+		UkrainianPhoneticSplitter loadedSplitter;
+		bool loaded = false;
+		ASSERT_TRUE(loadedSplitter.loadWordUsageSnapshot(tempPath_, 42, loaded, &errMsg)) << str(errMsg);
+		ASSERT_TRUE(loaded);
+
+		const WordsUsageInfo& loadedUsage = loadedSplitter.wordUsage();
+		ASSERT_EQ(wordUsage.wordPartsCount(), loadedUsage.wordPartsCount());
+		ASSERT_EQ(2, loadedUsage.wordSeqCount());
+
+		const WordPart* loadedKit = loadedUsage.wordPartByValue(L"кіт", WordPartSide::WholeWord);
+		ASSERT_TRUE(loadedKit != nullptr);
+		ASSERT_EQ(kit->id(), loadedKit->id());
+		ASSERT_FALSE(loadedKit->removed());
+
+		const WordPart* loadedSuffix = loadedUsage.wordPartById(suffix->id());
+		ASSERT_TRUE(loadedSuffix != nullptr);
+		ASSERT_EQ(std::wstring(L"ом"), loadedSuffix->partText());
+		ASSERT_EQ(WordPartSide::RightPart, loadedSuffix->partSide());
+		ASSERT_TRUE(loadedSuffix->removed());
+
+		ASSERT_EQ(7, loadedUsage.getWordSequenceUsage(WordSeqKey({ kit->id() })));
+		ASSERT_EQ(3, loadedUsage.getWordSequenceUsage(WordSeqKey({ kit->id(), suffix->id() })));
+		ASSERT_EQ(splitter.sentStartWordPart()->id(), loadedSplitter.sentStartWordPart()->id());
+
+		// new word parts do not reuse the restored ids
+		const WordPart* newPart = loadedSplitter.wordUsage().getOrAddWordPart(L"пес", WordPartSide::WholeWord);
+		ASSERT_GT(newPart->id(), suffix->id());
+	}
+
+	TEST_F(WordUsageSnapshotTest, keyMismatchIsNotLoaded)
+	{
+		UkrainianPhoneticSplitter splitter;
+		splitter.wordUsage().getOrAddWordPart(L"кіт", WordPartSide::WholeWord);
+
+		ErrMsgList errMsg;
+		ASSERT_TRUE(splitter.saveWordUsageSnapshot(tempPath_, 1, &errMsg)) << str(errMsg);
+
+		UkrainianPhoneticSplitter loadedSplitter;
+		bool loaded = true;
+		ASSERT_TRUE(loadedSplitter.loadWordUsageSnapshot(tempPath_, 2, loaded, &errMsg)) << str(errMsg);
+		ASSERT_FALSE(loaded);
+		ASSERT_TRUE(loadedSplitter.wordUsage().wordPartByValue(L"кіт", WordPartSide::WholeWord) == nullptr);
+	}
+
+	TEST_F(WordUsageSnapshotTest, textOutOfRangeIsCorrupted)
+	{
+		saveSnapshot();
+		writeSnapshotInt(SnapshotFirstPartOffset + 4, 0x7FFFFFF0); // TextOffset
+		checkCorruptedIsNotLoaded();
+	}
+
+	TEST_F(WordUsageSnapshotTest, duplicatePartIdIsCorrupted)
+	{
+		saveSnapshot();
+		writeSnapshotInt(SnapshotFirstPartOffset + SnapshotPartSize, readSnapshotInt(SnapshotFirstPartOffset));
+		checkCorruptedIsNotLoaded();
+	}
+}
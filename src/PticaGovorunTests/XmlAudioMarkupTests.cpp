@@ -0,0 +1,72 @@
+#include <string>
+#include <gtest/gtest.h>
+#include "XmlAudioMarkup.h"
+
+namespace PticaGovorunTests
+{
+	using namespace PticaGovorun;
+
+	TEST(XmlAudioMarkupTest, writeParseRoundTrip)
+	{
+		SpeechAnnotation annot;
+		annot.setAudioFileRelPath(L"bear/story1.wav");
+		annot.setAudioSampleRate(22050);
+		annot.addSpeaker(L"bear", L"Ведмідь");
+		annot.addParameter("noise", "low");
+
+		TimePointMarker wordMarker;
+		wordMarker.Id = 1;
+		wordMarker.SampleInd = 100;
+		wordMarker.LevelOfDetail = MarkerLevelOfDetail::Word;
+		wordMarker.TranscripText = QString::fromStdWString(L"мама мила \"раму\" & <sil>");
+		wordMarker.Language = SpeechLanguage::Ukrainian;
+		wordMarker.SpeakerBriefId = L"bear";
+		annot.attachMarker(wordMarker);
+
+		TimePointMarker phoneMarker;
+		phoneMarker.Id = 2;
+		phoneMarker.SampleInd = 250;
+		phoneMarker.LevelOfDetail = MarkerLevelOfDetail::Phone;
+		phoneMarker.ExcludePhase = ResourceUsagePhase::Train;
+		annot.attachMarker(phoneMarker);
+
+		std::string xmlText;
+		writeAudioMarkupXml(annot, xmlText);
+
+		SpeechAnnotation parsed;
+		AudioMarkupXmlBuffers buffs;
+		ErrMsgList errMsg;
+		ASSERT_TRUE(parseAudioMarkupXml(xmlText, parsed, buffs, &errMsg)) << str(errMsg);
+
+		EXPECT_EQ(annot.audioFilePathRel(), parsed.audioFilePathRel());
+		EXPECT_EQ(annot.audioSampleRate(), parsed.audioSampleRate());
+		ASSERT_EQ(1, parsed.speakers().size());
+		EXPECT_EQ(std::wstring(L"bear"), parsed.speakers()[0].BriefId);
+		EXPECT_EQ(std::wstring(L"Ведмідь"), parsed.speakers()[0].Name);
+		ASSERT_EQ(1, parsed.parameters().size());
+		EXPECT_EQ("noise", parsed.parameters()[0].Name);
+		EXPECT_EQ("low", parsed.parameters()[0].Value);
+
+		ASSERT_EQ(2, parsed.markersSize());
+		const TimePointMarker& word = parsed.marker(0);
+		EXPECT_EQ(1, word.Id);
+		EXPECT_EQ(100, word.SampleInd);
+		EXPECT_TRUE(word.LevelOfDetail == MarkerLevelOfDetail::Word);
+		EXPECT_EQ(wordMarker.TranscripText, word.TranscripText);
+		EXPECT_TRUE(word.Language == SpeechLanguage::Ukrainian);
+		EXPECT_EQ(std::wstring(L"bear"), word.SpeakerBriefId);
+		EXPECT_TRUE(word.ExcludePhase == boost::none);
+
+		const TimePointMarker& phone = parsed.marker(1);
+		EXPECT_EQ(2, phone.Id);
+		EXPECT_EQ(250, phone.SampleInd);
+		EXPECT_TRUE(phone.LevelOfDetail == MarkerLevelOfDetail::Phone);
+		EXPECT_TRUE(phone.TranscripText.isEmpty());
+		EXPECT_TRUE(phone.ExcludePhase == ResourceUsagePhase::Train);
+
+		// the parsed annotation is serialized into the same bytes
+		std::string xmlText2;
+		writeAudioMarkupXml(parsed, xmlText2);
+		EXPECT_EQ(xmlText, xmlText2);
+	}
+}
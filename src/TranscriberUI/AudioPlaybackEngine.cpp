@@ -0,0 +1,279 @@
+#include "AudioPlaybackEngine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <QDebug>
+
+namespace PticaGovorun
+{
+	SampleRangesPlaybackSource::SampleRangesPlaybackSource(gsl::span<const short> samples, std::vector<std::pair<long, long>> ranges)
+		: samples_(samples),
+		ranges_(std::move(ranges))
+	{
+		if (!ranges_.empty())
+			curSampleInd_ = ranges_.front().first;
+	}
+
+	size_t SampleRangesPlaybackSource::read(gsl::span<short> buffer)
+	{
+		size_t outInd = 0;
+		while (outInd < (size_t)buffer.size() && rangeInd_ < ranges_.size())
+		{
+			long rangeEnd = std::min<long>(ranges_[rangeInd_].second, (long)samples_.size());
+			size_t count = (size_t)std::max<long>(0, std::min<long>(rangeEnd - curSampleInd_, (long)(buffer.size() - outInd)));
+			std::copy_n(samples_.begin() + curSampleInd_, count, buffer.begin() + outInd);
+			outInd += count;
+			curSampleInd_ += (long)count;
+			if (curSampleInd_ >= rangeEnd)
+			{
+				++rangeInd_;
+				if (rangeInd_ < ranges_.size())
+					curSampleInd_ = ranges_[rangeInd_].first;
+			}
+		}
+		return outInd;
+	}
+
+	long SampleRangesPlaybackSource::sampleIndAt(size_t playedCount) const
+	{
+		long lastSampleInd = NullSampleInd;
+		for (const auto& range : ranges_)
+		{
+			size_t rangeLen = (size_t)(range.second - range.first);
+			if (playedCount < rangeLen)
+				return range.first + (long)playedCount;
+			playedCount -= rangeLen;
+			lastSampleInd = range.second;
+		}
+		return lastSampleInd;
+	}
+
+#if PG_HAS_PORTAUDIO
+	namespace
+	{
+		const size_t RingCapacity = 1 << 15; // samples, ~1.5sec at 22050Hz
+		const size_t FeedChunkSize = 2048; // samples, which feeder reads from a source at once
+		const unsigned long FramesPerBuffer = 256;
+		const int NumChannels = 2; // Stereo=2, Mono=1
+		const auto FeederIdleWait = std::chrono::milliseconds(5); // the pause of feeder when the ring is full
+	}
+
+	AudioPlaybackEngine::AudioPlaybackEngine()
+		: ring_(RingCapacity),
+		callbackBuffer_(FramesPerBuffer)
+	{
+		feeder_ = std::thread([this]() { feederLoop(); });
+	}
+
+	AudioPlaybackEngine::~AudioPlaybackEngine()
+	{
+		{
+			std::lock_guard<std::mutex> lock(feederMutex_);
+			quit_ = true;
+		}
+		feederCond_.notify_one();
+		feeder_.join();
+		closeStream();
+	}
+
+	bool AudioPlaybackEngine::ensureStream(float sampleRate, ErrMsgList* errMsg)
+	{
+		if (stream_ != nullptr && streamSampleRate_ == sampleRate)
+			return true;
+		closeStream();
+
+		PaDeviceIndex deviceIndex = Pa_GetDefaultOutputDevice();
+		if (deviceIndex == paNoDevice)
+		{
+			pushErrorMsg(errMsg, "No default output device");
+			return false;
+		}
+
+		PaStreamParameters outputParameters;
+		outputParameters.device = deviceIndex;
+		outputParameters.channelCount = NumChannels;
+		outputParameters.sampleFormat = paInt16;
+		outputParameters.suggestedLatency = Pa_GetDeviceInfo(deviceIndex)->defaultLowOutputLatency;
+		outputParameters.hostApiSpecificStreamInfo = nullptr;
+
+		auto callback = [](const void *inputBuffer, void *outputBuffer,
+			unsigned long framesPerBuffer,
+			const PaStreamCallbackTimeInfo* timeInfo,
+			PaStreamCallbackFlags statusFlags,
+			void *userData) -> int
+		{
+			AudioPlaybackEngine& engine = *(AudioPlaybackEngine*)userData;
+			return engine.streamCallback((short*)outputBuffer, framesPerBuffer);
+		};
+
+		PaStream* stream;
+		PaError err = Pa_OpenStream(&stream, nullptr, &outputParameters, sampleRate, FramesPerBuffer, paClipOff, callback, this);
+		if (err != paNoError)
+		{
+			pushErrorMsg(errMsg, Pa_GetErrorText(err));
+			return false;
+		}
+		err = Pa_StartStream(stream);
+		if (err != paNoError)
+		{
+			pushErrorMsg(errMsg, Pa_GetErrorText(err));
+			Pa_CloseStream(stream);
+			return false;
+		}
+		stream_ = stream;
+		streamSampleRate_ = sampleRate;
+		return true;
+	}
+
+	void AudioPlaybackEngine::closeStream()
+	{
+		if (stream_ == nullptr)
+			return;
+		PaError err = Pa_StopStream(stream_);
+		if (err != paNoError)
+			qDebug() << "Error in Pa_StopStream: " << Pa_GetErrorText(err);
+		err = Pa_CloseStream(stream_);
+		if (err != paNoError)
+			qDebug() << "Error in Pa_CloseStream: " << Pa_GetErrorText(err);
+		stream_ = nullptr;
+		streamSampleRate_ = -1;
+	}
+
+	bool AudioPlaybackEngine::play(std::shared_ptr<PlaybackSource> source, float sampleRate, ErrMsgList* errMsg)
+	{
+		if (!ensureStream(sampleRate, errMsg))
+			return false;
+		activeSource_ = source;
+		activeEpoch_ = postRequest(std::move(source));
+		return true;
+	}
+
+	void AudioPlaybackEngine::stop()
+	{
+		uint64_t epoch = postRequest(nullptr);
+		activeSource_ = nullptr;
+		activeEpoch_ = 0;
+
+		// the feeder reads the source by small chunks, so it switches to the request quickly
+		std::unique_lock<std::mutex> lock(feederMutex_);
+		acceptedCond_.wait(lock, [&]() { return acceptedEpoch_ >= epoch; });
+	}
+
+	uint64_t AudioPlaybackEngine::postRequest(std::shared_ptr<PlaybackSource> source)
+	{
+		uint64_t epoch;
+		{
+			std::lock_guard<std::mutex> lock(feederMutex_);
+			pendingSource_ = std::move(source);
+			epoch = pendingEpoch_.fetch_add(1) + 1;
+		}
+		feederCond_.notify_one();
+		return epoch;
+	}
+
+	bool AudioPlaybackEngine::isPlaying() const
+	{
+		return activeEpoch_ != 0 && finishedEpoch_.load(std::memory_order_acquire) < activeEpoch_;
+	}
+
+	long AudioPlaybackEngine::playingSampleInd() const
+	{
+		if (!isPlaying())
+			return NullSampleInd;
+
+		// the callback may not have reached the requested epoch yet
+		uint64_t epoch = playedEpoch_.load(std::memory_order_acquire);
+		size_t playedCount = playedCount_.load(std::memory_order_acquire);
+		if (epoch != activeEpoch_ || playedEpoch_.load(std::memory_order_acquire) != epoch)
+			return activeSource_->sampleIndAt(0);
+		return activeSource_->sampleIndAt(playedCount);
+	}
+
+	void AudioPlaybackEngine::feederLoop()
+	{
+		std::vector<short> chunk(FeedChunkSize);
+		uint64_t feederEpoch = 0;
+		while (true)
+		{
+			std::shared_ptr<PlaybackSource> source;
+			{
+				std::unique_lock<std::mutex> lock(feederMutex_);
+				feederCond_.wait(lock, [&]() { return quit_ || pendingEpoch_.load() != feederEpoch; });
+				if (quit_)
+					return;
+				source = std::move(pendingSource_); // releases the previous source
+				feederEpoch = pendingEpoch_.load();
+				acceptedEpoch_ = feederEpoch;
+			}
+			acceptedCond_.notify_all();
+
+			// the callback skips the samples of previous epochs
+			epochEndPos_.store(NotFinishedPos, std::memory_order_relaxed);
+			epochStartPos_.store(ring_.writePosition(), std::memory_order_relaxed);
+			publishedEpoch_.store(feederEpoch, std::memory_order_release);
+
+			while (source != nullptr && pendingEpoch_.load() == feederEpoch)
+			{
+				size_t space = ring_.writeAvailable();
+				if (space == 0)
+				{
+					std::unique_lock<std::mutex> lock(feederMutex_);
+					feederCond_.wait_for(lock, FeederIdleWait, [&]() { return quit_ || pendingEpoch_.load() != feederEpoch; });
+					if (quit_)
+						return;
+					continue;
+				}
+
+				size_t count = std::min(space, chunk.size());
+				size_t readCount = source->read(gsl::span<short>(chunk.data(), count));
+				ring_.write(gsl::span<const short>(chunk.data(), readCount));
+				if (readCount < count)
+					source = nullptr;
+			}
+			if (pendingEpoch_.load() == feederEpoch)
+				epochEndPos_.store(ring_.writePosition(), std::memory_order_release);
+		}
+	}
+
+	int AudioPlaybackEngine::streamCallback(short* out, unsigned long framesCount)
+	{
+		// switch to the new epoch; check the epoch again to not get the start of later epoch
+		uint64_t epoch = publishedEpoch_.load(std::memory_order_acquire);
+		if (epoch != consumerEpoch_)
+		{
+			size_t startPos = epochStartPos_.load(std::memory_order_relaxed);
+			if (publishedEpoch_.load(std::memory_order_acquire) == epoch)
+			{
+				ring_.skipTo(startPos);
+				consumerEpoch_ = epoch;
+				consumerStartPos_ = startPos;
+			}
+		}
+
+		unsigned long outFrameInd = 0;
+		while (outFrameInd < framesCount)
+		{
+			size_t count = std::min<size_t>(framesCount - outFrameInd, callbackBuffer_.size());
+			size_t readCount = ring_.read(gsl::span<short>(callbackBuffer_.data(), count));
+			for (size_t i = 0; i < readCount; ++i)
+			{
+				*out++ = callbackBuffer_[i]; // left
+				*out++ = callbackBuffer_[i]; // right
+			}
+			outFrameInd += (unsigned long)readCount;
+			if (readCount < count)
+				break;
+		}
+
+		// silence when there is no data
+		std::memset(out, 0, sizeof(short) * NumChannels * (framesCount - outFrameInd));
+
+		playedCount_.store(ring_.readPosition() - consumerStartPos_, std::memory_order_release);
+		playedEpoch_.store(consumerEpoch_, std::memory_order_release);
+
+		if (consumerEpoch_ == epoch && ring_.readPosition() >= epochEndPos_.load(std::memory_order_acquire))
+			finishedEpoch_.store(consumerEpoch_, std::memory_order_release);
+		return paContinue;
+	}
+#endif
+}
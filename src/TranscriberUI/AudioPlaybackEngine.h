@@ -0,0 +1,111 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <utility>
+#include <gsl/span>
+
+#if PG_HAS_PORTAUDIO
+#include <portaudio.h>
+#endif
+
+#include "ComponentsInfrastructure.h"
+#include "SpscRingBuffer.h"
+#include "AppHelpers.h" // NullSampleInd
+
+namespace PticaGovorun
+{
+	/// The source of samples to play. The samples are read on the feeder thread of the player.
+	class PlaybackSource
+	{
+	public:
+		virtual ~PlaybackSource() = default;
+
+		/// Reads next samples into the buffer. Returns the number of read samples.
+		/// The source is exhausted when the result is less than buffer's size.
+		virtual size_t read(gsl::span<short> buffer) = 0;
+
+		/// Maps the number of played samples to the index of the sample in the audio.
+		virtual long sampleIndAt(size_t playedCount) const = 0;
+	};
+
+	/// Plays ranges [start;end) of samples, kept in memory, one after another.
+	/// The samples must exist during the process of playing.
+	class SampleRangesPlaybackSource : public PlaybackSource
+	{
+		gsl::span<const short> samples_;
+		std::vector<std::pair<long, long>> ranges_;
+		size_t rangeInd_ = 0;
+		long curSampleInd_ = -1;
+	public:
+		SampleRangesPlaybackSource(gsl::span<const short> samples, std::vector<std::pair<long, long>> ranges);
+		size_t read(gsl::span<short> buffer) override;
+		long sampleIndAt(size_t playedCount) const override;
+	};
+
+#if PG_HAS_PORTAUDIO
+	/// Plays audio through one PortAudio stream, which is opened once and then kept running.
+	/// The feeder thread moves samples from the source into the lock-free ring buffer, from which
+	/// the audio callback takes them. The callback doesn't lock or allocate; it only publishes the
+	/// number of played samples, which the UI polls to show the playing sample.
+	class AudioPlaybackEngine
+	{
+		static const size_t NotFinishedPos = (size_t)-1;
+
+		SpscRingBuffer<short> ring_;
+		PaStream* stream_ = nullptr;
+		float streamSampleRate_ = -1;
+		std::vector<short> callbackBuffer_; // mono samples for one callback
+
+		// feeder thread
+		std::thread feeder_;
+		std::mutex feederMutex_;
+		std::condition_variable feederCond_;
+		bool quit_ = false;
+		std::shared_ptr<PlaybackSource> pendingSource_;
+		std::atomic<uint64_t> pendingEpoch_{ 0 }; // each play or stop request starts a new epoch
+		uint64_t acceptedEpoch_ = 0; // the last request taken by the feeder
+		std::condition_variable acceptedCond_;
+
+		// published by the feeder for the callback
+		std::atomic<uint64_t> publishedEpoch_{ 0 };
+		std::atomic<size_t> epochStartPos_{ 0 }; // ring position of the first sample of the epoch
+		std::atomic<size_t> epochEndPos_{ 0 }; // ring position after the last sample of the epoch, or NotFinishedPos
+
+		// published by the callback for the UI
+		uint64_t consumerEpoch_ = 0;
+		size_t consumerStartPos_ = 0;
+		std::atomic<uint64_t> playedEpoch_{ 0 };
+		std::atomic<size_t> playedCount_{ 0 };
+		std::atomic<uint64_t> finishedEpoch_{ 0 };
+
+		// UI thread
+		std::shared_ptr<PlaybackSource> activeSource_;
+		uint64_t activeEpoch_ = 0; // the epoch of the last play request or 0 when stopped
+	public:
+		AudioPlaybackEngine();
+		~AudioPlaybackEngine();
+		AudioPlaybackEngine(const AudioPlaybackEngine&) = delete;
+		AudioPlaybackEngine& operator=(const AudioPlaybackEngine&) = delete;
+
+		/// Starts playing the source, interrupting current playback.
+		bool play(std::shared_ptr<PlaybackSource> source, float sampleRate, ErrMsgList* errMsg);
+		/// Stops playing. On return the feeder doesn't use the previous source, so its samples may be released.
+		void stop();
+
+		bool isPlaying() const;
+
+		/// Gets the index of the sample being played or NullSampleInd.
+		long playingSampleInd() const;
+	private:
+		bool ensureStream(float sampleRate, ErrMsgList* errMsg);
+		void closeStream();
+		uint64_t postRequest(std::shared_ptr<PlaybackSource> source);
+		void feederLoop();
+		int streamCallback(short* out, unsigned long framesCount);
+	};
+#endif
+}
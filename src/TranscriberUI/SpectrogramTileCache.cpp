@@ -0,0 +1,159 @@
+#include "SpectrogramTileCache.h"
+#include <algorithm>
+#include <vector>
+#include "assertImpl.h"
+
+namespace PticaGovorun
+{
+	namespace
+	{
+		const float FrameDurSec = 0.025f;
+		const int MelBinCount = 64;
+
+		// the powers in dB are mapped into grayscale in this range; less is white, greater is black
+		const float DbFloor = 50;
+		const float DbCeil = 130;
+	}
+
+	SpectrogramTileCache::SpectrogramTileCache(size_t maxTilesCount)
+		: maxTilesCount_(maxTilesCount)
+	{
+		worker_ = std::thread([this]() { workerLoop(); });
+	}
+
+	SpectrogramTileCache::~SpectrogramTileCache()
+	{
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			stopRequested_ = true;
+		}
+		requestsChanged_.notify_one();
+		worker_.join();
+	}
+
+	void SpectrogramTileCache::setAudio(gsl::span<const short> samples, float sampleRate)
+	{
+		std::unique_lock<std::mutex> lk(mutex_);
+		requests_.clear();
+		renderDone_.wait(lk, [this]() { return !isRendering_; });
+		tiles_.clear();
+
+		samples_ = samples;
+		sampleRate_ = sampleRate;
+		if (sampleRate > 0)
+		{
+			frameSize_ = (int)(sampleRate * FrameDurSec);
+			fftNum_ = getMinDftPointsCount(frameSize_);
+			buildTriangularFilterBank(sampleRate, MelBinCount, fftNum_, melFilterBank_);
+		}
+	}
+
+	bool SpectrogramTileCache::melScale() const
+	{
+		return melScale_;
+	}
+
+	void SpectrogramTileCache::setMelScale(bool melScale)
+	{
+		melScale_ = melScale;
+
+		// tiles of the other scale are not needed anymore, they leave the cache as least recently used
+		std::lock_guard<std::mutex> lk(mutex_);
+		requests_.clear();
+	}
+
+	QImage SpectrogramTileCache::tile(float pixelsPerSample, int tileInd, int heightPix)
+	{
+		TileKey key{ pixelsPerSample, tileInd, heightPix, melScale_ };
+
+		std::unique_lock<std::mutex> lk(mutex_);
+		if (samples_.empty() || heightPix <= 0)
+			return QImage();
+
+		auto tileIt = std::find_if(tiles_.begin(), tiles_.end(), [&key](const CachedTile& t) { return t.Key == key; });
+		if (tileIt != tiles_.end())
+		{
+			tiles_.splice(tiles_.begin(), tiles_, tileIt);
+			return tiles_.front().Image;
+		}
+
+		if (isRendering_ && renderingKey_ == key)
+			return QImage();
+
+		// the visible tiles are requested last, so render them first
+		auto reqIt = std::find(requests_.begin(), requests_.end(), key);
+		if (reqIt != requests_.end())
+			requests_.erase(reqIt);
+		requests_.push_front(key);
+		if (requests_.size() > maxTilesCount_)
+			requests_.pop_back();
+
+		lk.unlock();
+		requestsChanged_.notify_one();
+		return QImage();
+	}
+
+	void SpectrogramTileCache::workerLoop()
+	{
+		std::unique_lock<std::mutex> lk(mutex_);
+		while (true)
+		{
+			requestsChanged_.wait(lk, [this]() { return stopRequested_ || !requests_.empty(); });
+			if (stopRequested_)
+				break;
+
+			renderingKey_ = requests_.front();
+			requests_.pop_front();
+			isRendering_ = true;
+			lk.unlock();
+
+			// the samples are not changed while rendering, because setAudio waits for it
+			QImage image = renderTile(renderingKey_);
+
+			lk.lock();
+			tiles_.push_front(CachedTile{ renderingKey_, std::move(image) });
+			if (tiles_.size() > maxTilesCount_)
+				tiles_.pop_back();
+			isRendering_ = false;
+			renderDone_.notify_all();
+
+			lk.unlock();
+			emit tileReady();
+			lk.lock();
+		}
+	}
+
+	QImage SpectrogramTileCache::renderTile(const TileKey& key)
+	{
+		QImage image(TileWidthPix, key.HeightPix, QImage::Format_RGB32);
+		image.fill(Qt::white);
+
+		const TriangularFilterBank* filterBank = key.MelScale ? &melFilterBank_ : nullptr;
+		int binCount = key.MelScale ? melFilterBank_.BinCount : fftNum_ / 2;
+		std::vector<float> powers(binCount);
+
+		// one DFT frame per column, centered on the sample under the center of the column
+		for (int col = 0; col < TileWidthPix; ++col)
+		{
+			float docX = key.TileInd * TileWidthPix + col + 0.5f;
+			ptrdiff_t centerSampleInd = (ptrdiff_t)(docX / key.PixelsPerSample);
+			if (centerSampleInd < 0 || centerSampleInd >= (ptrdiff_t)samples_.size())
+				continue;
+
+			ptrdiff_t frameBeg = std::max<ptrdiff_t>(0, centerSampleInd - frameSize_ / 2);
+			ptrdiff_t frameEnd = std::min<ptrdiff_t>(samples_.size(), frameBeg + frameSize_);
+			computeSpectrumLogPower(samples_.subspan(frameBeg, frameEnd - frameBeg), fftNum_, filterBank, wavePointsRe_, wavePointsIm_, powers);
+
+			// low frequencies go at the bottom
+			for (int y = 0; y < key.HeightPix; ++y)
+			{
+				int binInd = (key.HeightPix - 1 - y) * binCount / key.HeightPix;
+				float level = (powers[binInd] - DbFloor) / (DbCeil - DbFloor);
+				level = std::min(1.0f, std::max(0.0f, level));
+				int gray = 255 - (int)(level * 255);
+				reinterpret_cast<QRgb*>(image.scanLine(y))[col] = qRgb(gray, gray, gray);
+			}
+		}
+		return image;
+	}
+}
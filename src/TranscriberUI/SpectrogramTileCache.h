@@ -0,0 +1,86 @@
+#pragma once
+#include <deque>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <gsl/span>
+#include <QObject>
+#include <QImage>
+
+#include "SpeechProcessing.h"
+
+namespace PticaGovorun
+{
+	/// Renders the spectrogram of audio in tiles of TileWidthPix columns on a background thread.
+	/// The rendered tiles are kept in LRU cache, keyed by the zoom (pixels per sample), the index of the tile,
+	/// the height of the tile and the frequency scale, so scrolling only blits the cached images.
+	/// The tile with index t covers document columns [t*TileWidthPix; (t+1)*TileWidthPix) of the samples graph.
+	class SpectrogramTileCache : public QObject
+	{
+		Q_OBJECT
+	public:
+		static const int TileWidthPix = 256;
+	signals:
+		// Occurs on the background thread when a requested tile is rendered.
+		void tileReady();
+	private:
+		struct TileKey
+		{
+			float PixelsPerSample;
+			int TileInd;
+			int HeightPix;
+			bool MelScale;
+
+			bool operator==(const TileKey& other) const
+			{
+				return PixelsPerSample == other.PixelsPerSample && TileInd == other.TileInd &&
+					HeightPix == other.HeightPix && MelScale == other.MelScale;
+			}
+		};
+		struct CachedTile
+		{
+			TileKey Key;
+			QImage Image;
+		};
+
+		std::mutex mutex_;
+		std::condition_variable requestsChanged_;
+		std::condition_variable renderDone_;
+		std::list<CachedTile> tiles_; // most recently used go first
+		size_t maxTilesCount_;
+		std::deque<TileKey> requests_; // the recent request goes first
+		bool isRendering_ = false;
+		TileKey renderingKey_;
+		bool stopRequested_ = false;
+		std::thread worker_;
+
+		gsl::span<const short> samples_;
+		float sampleRate_ = 0;
+		int frameSize_ = 0;
+		int fftNum_ = 0;
+		TriangularFilterBank melFilterBank_;
+		bool melScale_ = false;
+
+		// DFT buffers of the worker thread
+		std::vector<float> wavePointsRe_;
+		std::vector<float> wavePointsIm_;
+	public:
+		explicit SpectrogramTileCache(size_t maxTilesCount = 64);
+		~SpectrogramTileCache();
+
+		/// Replaces the audio and drops all tiles. Waits for the tile which is rendered at the moment.
+		/// The samples must exist until the next call to setAudio.
+		void setAudio(gsl::span<const short> samples, float sampleRate);
+
+		bool melScale() const;
+		void setMelScale(bool melScale);
+
+		/// Returns the cached tile or the null image if the tile is not rendered yet; then the tile is queued for rendering.
+		QImage tile(float pixelsPerSample, int tileInd, int heightPix);
+	private:
+		void workerLoop();
+		QImage renderTile(const TileKey& key);
+	};
+}
@@ -21,6 +21,9 @@ SpeechTranscriptionPaintWidget::SpeechTranscriptionPaintWidget(QWidget *parent)
 void SpeechTranscriptionPaintWidget::setModel(std::shared_ptr<PticaGovorun::SpeechTranscriptionViewModel> transcriberModel)
 {
 	transcriberModel_ = transcriberModel;
+
+	// tiles are rendered on the background thread; the connection is queued to the UI thread
+	QObject::connect(&transcriberModel_->spectrogramTiles(), &PticaGovorun::SpectrogramTileCache::tileReady, this, [this]() { update(); });
 }
 
 void SpeechTranscriptionPaintWidget::paintEvent(QPaintEvent* pe)
@@ -91,7 +94,16 @@ void SpeechTranscriptionPaintWidget::drawModel(QPainter& painter, const QRect& v
 		// draw in 'background' to avoid covering the content
 		drawCursorRange(painter, laneRect, docLeft, docRight);
 
-		drawWaveform(painter, laneRect, docLeft, docRight);
+		QRect waveformRect = laneRect;
+		if (transcriberModel_->spectrogramVisible())
+		{
+			QRect spectrogramRect = laneRect;
+			spectrogramRect.setTop(laneRect.top() + laneRect.height() / 2);
+			waveformRect.setBottom(spectrogramRect.top());
+			drawSpectrogram(painter, spectrogramRect, docLeft, docRight);
+		}
+
+		drawWaveform(painter, waveformRect, docLeft, docRight);
 		
 		auto diagItemDrawFun = [=, &painter](const PticaGovorun::DiagramSegment& diagItem)
 		{
@@ -155,6 +167,37 @@ void SpeechTranscriptionPaintWidget::drawWaveform(QPainter& painter, const QRect
 	}
 }
 
+void SpeechTranscriptionPaintWidget::drawSpectrogram(QPainter& painter, const QRect& viewportRect, float visibleDocLeft, float visibleDocRight)
+{
+	PticaGovorun::SpectrogramTileCache& tiles = transcriberModel_->spectrogramTiles();
+	const int tileWidth = PticaGovorun::SpectrogramTileCache::TileWidthPix;
+	float pixelsPerSample = transcriberModel_->pixelsPerSample();
+
+	// tiles are counted from the first sample, not from the document's origin
+	float graphLeft = visibleDocLeft - transcriberModel_->docPaddingX();
+	float graphRight = visibleDocRight - transcriberModel_->docPaddingX();
+	float graphWidth = transcriberModel_->audioSamples().size() * pixelsPerSample;
+	graphLeft = std::max(0.0f, graphLeft);
+	graphRight = std::min(graphWidth, graphRight);
+	if (graphLeft >= graphRight)
+		return;
+
+	int firstTileInd = (int)(graphLeft / tileWidth);
+	int lastTileInd = (int)(graphRight / tileWidth);
+	for (int tileInd = firstTileInd; tileInd <= lastTileInd; ++tileInd)
+	{
+		QImage tile = tiles.tile(pixelsPerSample, tileInd, viewportRect.height());
+		if (tile.isNull())
+			continue;
+
+		float tileDocX = transcriberModel_->docPaddingX() + tileInd * tileWidth;
+		painter.drawImage(QPointF(tileDocX - visibleDocLeft, viewportRect.top()), tile);
+	}
+
+	// prefetch the next tile, as usually the document is scrolled forward
+	tiles.tile(pixelsPerSample, lastTileInd + 1, viewportRect.height());
+}
+
 void SpeechTranscriptionPaintWidget::drawCursorSingle(QPainter& painter, const QRect& viewportRect, float docLeft)
 {
 	std::pair<long,long> cursor =  transcriberModel_->cursor();
@@ -33,6 +33,9 @@ private:
 	// Draw amplitudes of samples. Horizontal axis is time.
 	void drawWaveform(QPainter& painter, const QRect& viewportRect, float docLeft, float docRight);
 
+	// Blits cached tiles of the spectrogram; missing tiles are requested and drawn when they are ready.
+	void drawSpectrogram(QPainter& painter, const QRect& viewportRect, float docLeft, float docRight);
+
 	void drawCursorSingle(QPainter& painter, const QRect& viewportRect, float docLeft);
 	void drawCursorRange(QPainter& painter, const QRect& viewportRect, float docLeft, float docRight);
 	void drawMarkers(QPainter& painter, const QRect& viewportRect, float docLeft, float docRight);
@@ -46,6 +46,17 @@ namespace PticaGovorun
 	{
 	}
 
+	SpeechTranscriptionViewModel::~SpeechTranscriptionViewModel()
+	{
+		// the feeder thread reads audioSamples_, which are destroyed before the player
+#if PG_HAS_PORTAUDIO
+		if (audioPlayer_ != nullptr)
+			audioPlayer_->stop();
+#endif
+		// waits for the tile, which is rendered from audioSamples_
+		spectrogramTiles_.setAudio(gsl::span<const short>(), 0);
+	}
+
 	void SpeechTranscriptionViewModel::init(std::shared_ptr<SharedServiceProvider> serviceProvider)
 	{
 		notificationService_ = serviceProvider->notificationService();
@@ -71,6 +82,13 @@ namespace PticaGovorun
 
 		auto audioFilePath = audioFilePathAbs();
 
+		// the player must not read the samples which are reloaded
+#if PG_HAS_PORTAUDIO
+		if (audioPlayer_ != nullptr)
+			audioPlayer_->stop();
+#endif
+		spectrogramTiles_.setAudio(gsl::span<const short>(), 0);
+
 		//
 		audioSamples_.clear();
 		diagramSegments_.clear();
@@ -84,6 +102,7 @@ namespace PticaGovorun
 		}
 		if (audioSampleRate_ != SampleRate)
 			nextNotification("WARN: SampleRate != 22050 Hz. Perhaps other parameters (FrameSize, FrameShift) should be changed");
+		spectrogramTiles_.setAudio(audioSamples_, audioSampleRate_);
 
 		//
 		docOffsetX_ = 0;
@@ -126,223 +145,49 @@ namespace PticaGovorun
 	}
 
 #if PG_HAS_PORTAUDIO
-	static const decltype(paComplete) SoundPlayerCompleteOrAbortTechnique = paComplete; // paComplete or paAbort
-	
-	void SpeechTranscriptionViewModel::soundPlayerPlay(const short* audioSouce, long startPlayingFrameInd, long finishPlayingFrameInd, bool restoreCurFrameInd)
-	{
-		using namespace PticaGovorun;
-		PG_DbgAssert2(startPlayingFrameInd <= finishPlayingFrameInd, "Must play start <= end");
-
-		if (soundPlayerIsPlaying())
-			return;
-
-		SoundPlayerData& data = soundPlayerData_;
-		data.transcriberViewModel = this;
-		data.AudioSouce = audioSouce;
-#if PG_DEBUG
-		data.StartPlayingFrameInd = startPlayingFrameInd;
-#endif
-		data.FinishPlayingFrameInd = finishPlayingFrameInd;
-		data.CurPlayingFrameInd = startPlayingFrameInd;
-		data.MoveCursorToLastPlayingPosition = !restoreCurFrameInd;
+	static const int PlayingSamplePollIntervalMs = 15; // the interval to redraw the playing sample
 
-		auto logPaError = [](PaError err)
+	void SpeechTranscriptionViewModel::soundPlayerPlay(std::shared_ptr<PlaybackSource> source, bool restoreCurFrameInd)
+	{
+		if (audioPlayer_ == nullptr)
 		{
-			auto msg = Pa_GetErrorText(err);
-			qDebug() << msg;
-		};
-
-		//
-		PaDeviceIndex deviceIndex = Pa_GetDefaultOutputDevice(); /* default output device */
-		if (deviceIndex == paNoDevice) {
-			qDebug() << "Error: No default output device";
-			return;
+			audioPlayer_ = std::make_unique<AudioPlaybackEngine>();
+			playingSampleTimer_.setInterval(PlayingSamplePollIntervalMs);
+			QObject::connect(&playingSampleTimer_, &QTimer::timeout, this, [this]() { pollPlayingSampleInd(); });
 		}
 
-		PaStreamParameters outputParameters;
-		outputParameters.device = deviceIndex;
-		outputParameters.channelCount = 2;       /* stereo output */
-		outputParameters.sampleFormat = paInt16; /* 32 bit floating point output */
-		outputParameters.suggestedLatency = Pa_GetDeviceInfo(deviceIndex)->defaultLowOutputLatency;
-		outputParameters.hostApiSpecificStreamInfo = nullptr;
-
-		auto patestCallbackAbort = [](const void *inputBuffer, void *outputBuffer,
-			unsigned long framesPerBuffer,
-			const PaStreamCallbackTimeInfo* timeInfo,
-			PaStreamCallbackFlags statusFlags,
-			void *userData) -> int
-		{
-			//qDebug() << "patestCallback";
-			SoundPlayerData& data = *(SoundPlayerData*)userData;
-			if (!data.allowPlaying)
-				return paAbort;
-
-			SpeechTranscriptionViewModel& transcriberViewModel = *data.transcriberViewModel;
-
-			long sampleInd = data.CurPlayingFrameInd;
-			long sampleEnd = std::min((long)data.FinishPlayingFrameInd, sampleInd + (long)framesPerBuffer);
-			int availableFramesCount = sampleEnd - sampleInd;
-			if (availableFramesCount < framesPerBuffer) // the last buffer
-				return paAbort;
-
-			// updates current frame
-			transcriberViewModel.setCursorInternal(sampleInd, false, false);
-
-			// populate samples buffer
-
-			short *out = (short*)outputBuffer;
-			for (unsigned long i = 0; i < availableFramesCount; i++)
-			{
-				short sampleValue = data.AudioSouce[sampleInd + i];
-				*out++ = sampleValue;  // left
-				*out++ = sampleValue;  // right
-			}
-
-			// set the frame to play on the next request of audio samples
-			data.CurPlayingFrameInd = sampleEnd;
-			return paContinue;
-		};
-
-		auto patestCallbackComplete = [](const void *inputBuffer, void *outputBuffer,
-			unsigned long framesPerBuffer,
-			const PaStreamCallbackTimeInfo* timeInfo,
-			PaStreamCallbackFlags statusFlags,
-			void *userData) -> int
+		ErrMsgList errMsg;
+		if (!audioPlayer_->play(source, audioSampleRate_, &errMsg))
 		{
-			//qDebug() << "patestCallback";
-
-			short *out = (short*)outputBuffer;
-
-			SoundPlayerData& data = *(SoundPlayerData*)userData;
-			if (!data.allowPlaying)
-			{
-				// reset the buffer
-				static const int NumChannels = 2; // Stereo=2, Mono=1
-				static const int FrameSize = sizeof(decltype(*out)) * NumChannels;
-				std::memset(out, 0, FrameSize * framesPerBuffer);
-				return paComplete;
-			}
-
-			SpeechTranscriptionViewModel& transcriberViewModel = *data.transcriberViewModel;
-
-			long sampleInd = data.CurPlayingFrameInd;
-			long sampleEnd = std::min(data.FinishPlayingFrameInd, sampleInd + (long)framesPerBuffer);
-			int availableFramesCount = sampleEnd - sampleInd;
-
-			// updates playing sample in UI
-			transcriberViewModel.setPlayingSampleInd(sampleInd, true);
-
-			// populate samples buffer
-
-			for (unsigned long i = 0; i < availableFramesCount; i++)
-			{
-				short sampleValue = data.AudioSouce[sampleInd + i];
-				*out++ = sampleValue;  // left
-				*out++ = sampleValue;  // right
-			}
-
-			// trailing bytes are zero
-			for (unsigned long i = availableFramesCount; i < framesPerBuffer; i++)
-			{
-				*out++ = 0;  // left
-				*out++ = 0;  // right
-			}
-
-			// set the frame to play on the next request of audio samples
-			data.CurPlayingFrameInd = sampleEnd;
-
-			if (availableFramesCount < framesPerBuffer) // the last buffer
-				return paComplete;
-
-			return paContinue;
-		};
-
-		typedef int(*PaStreamCallbackFun)(
-			const void *input, void *output,
-			unsigned long frameCount,
-			const PaStreamCallbackTimeInfo* timeInfo,
-			PaStreamCallbackFlags statusFlags,
-			void *userData);
-
-		auto patestCallback = (SoundPlayerCompleteOrAbortTechnique == paComplete) ? (PaStreamCallbackFun)patestCallbackComplete : (PaStreamCallbackFun)patestCallbackAbort;
-
-		// choose the buffer so the current frame is redrawn each N pixels
-		//int FRAMES_PER_BUFFER = 8;
-		static const int CurSampleJumpLatencyPix = 2; // N pixels
-		int FRAMES_PER_BUFFER = int(CurSampleJumpLatencyPix / scale_);
-		PaStream *stream;
-		PaError err = Pa_OpenStream(
-			&stream,
-			nullptr, /* no input */
-			&outputParameters,
-			audioSampleRate_,
-			FRAMES_PER_BUFFER,
-			paClipOff,      /* we won't output out of range samples so don't bother clipping them */
-			patestCallback,
-			&data);
-		if (err != paNoError)
-		{
-			logPaError(err);
+			pushErrorMsg(&errMsg, "Can't play audio");
+			nextNotification(combineErrorMessages(errMsg));
 			return;
 		}
+		moveCursorToLastPlayingPosition_ = !restoreCurFrameInd;
+		playingSampleTimer_.start();
+	}
 
-		data.stream = stream;
-
-		auto StreamFinished = [](void* userData) -> void
-		{
-			qDebug() << "StreamFinished";
-			SoundPlayerData& data = *(SoundPlayerData*)userData;
-
-			// stream is closed when the client stops the stream
-			// when data finishes and paAbort    is used, the client must close the stream
-			// when data finishes and paComplete is used, the stream is closed automatically
-
-			if (SoundPlayerCompleteOrAbortTechnique == paAbort)
-			{
-				qDebug() << "Closing stream";
-				PaStream* stream = data.stream;
-				PaError err = Pa_CloseStream(stream);
-				if (err != paNoError)
-				{
-					qDebug() << "Error in Pa_CloseStream: " << Pa_GetErrorText(err);
-					return;
-				}
-			}
-
-			if (data.MoveCursorToLastPlayingPosition)
-			{
-				long cursor = data.CurPlayingFrameInd;
-				data.transcriberViewModel->setCursorInternal(cursor, true, false);
-			}
-
-			// hides current playing sample in UI
-			data.transcriberViewModel->setPlayingSampleInd(PticaGovorun::NullSampleInd, false);
-
-			// parts of UI are not painted when cursor moves
-			// redraw entire UI when playing completes
-			emit data.transcriberViewModel->audioSamplesChanged();
-
-			data.transcriberViewModel->isPlaying_ = false;
-		};
-
-		err = Pa_SetStreamFinishedCallback(stream, StreamFinished);
-		if (err != paNoError)
+	void SpeechTranscriptionViewModel::pollPlayingSampleInd()
+	{
+		if (audioPlayer_->isPlaying())
 		{
-			logPaError(err);
+			long sampleInd = audioPlayer_->playingSampleInd();
+			if (sampleInd != PticaGovorun::NullSampleInd)
+				setPlayingSampleInd(sampleInd, true);
 			return;
 		}
 
-		// play
+		// playing finished
+		playingSampleTimer_.stop();
+		if (moveCursorToLastPlayingPosition_ && playingSampleInd_ != PticaGovorun::NullSampleInd)
+			setCursorInternal(playingSampleInd_, true, false);
 
-		soundPlayerData_.allowPlaying = true;
-		isPlaying_ = true;
+		// hides current playing sample in UI
+		setPlayingSampleInd(PticaGovorun::NullSampleInd, false);
 
-		err = Pa_StartStream(stream);
-		if (err != paNoError)
-		{
-			logPaError(err);
-			return;
-		}
+		// parts of UI are not painted when cursor moves
+		// redraw entire UI when playing completes
+		emit audioSamplesChanged();
 	}
 
 	void SpeechTranscriptionViewModel::soundPlayerPlayCurrentSegment(SegmentStartFrameToPlayChoice startFrameChoice)
@@ -360,20 +205,16 @@ namespace PticaGovorun
 		int leftMarkerind = -1;
 		std::tie(curSegBeg, curSegEnd) = getSampleRangeToPlay(curFrameInd, startFrameChoice, &leftMarkerind);
 
-		soundPlayerPlay(audioSamples_.data(), curSegBeg, curSegEnd, true);
+		auto source = std::make_shared<SampleRangesPlaybackSource>(audioSamples_, std::vector<std::pair<long, long>>{ { curSegBeg, curSegEnd } });
+		soundPlayerPlay(source, true);
 	}
 
 	void SpeechTranscriptionViewModel::soundPlayerPause()
 	{
-		qDebug() << "Pause. Stopping stream";
-		soundPlayerData_.allowPlaying = false;
+		if (audioPlayer_ != nullptr)
+			audioPlayer_->stop();
 
-		PaStream *stream = soundPlayerData_.stream;
-		PaError err = Pa_StopStream(stream);
-		if (err != paNoError)
-			return;
-
-		// note, stream is closed in the Pa_SetStreamFinishedCallback
+		// the timer finishes playing on next tick
 	}
 
 	void SpeechTranscriptionViewModel::soundPlayerPlay()
@@ -385,22 +226,23 @@ namespace PticaGovorun
 		if (curFrameInd == PticaGovorun::NullSampleInd)
 			return;
 
-		soundPlayerPlay(audioSamples_.data(), curFrameInd, audioSamples_.size() - 1, false);
+		auto source = std::make_shared<SampleRangesPlaybackSource>(audioSamples_, std::vector<std::pair<long, long>>{ { curFrameInd, (long)audioSamples_.size() } });
+		soundPlayerPlay(source, false);
 	}
 
 	void SpeechTranscriptionViewModel::soundPlayerTogglePlayPause()
 	{
-		qDebug() << "soundPlayerTogglePlayPause{ isPlaying=" << isPlaying_;
-		if (isPlaying_)
+		bool isPlaying = soundPlayerIsPlaying();
+		qDebug() << "soundPlayerTogglePlayPause{ isPlaying=" << isPlaying;
+		if (isPlaying)
 			soundPlayerPause();
 		else
 			soundPlayerPlay();
-		qDebug() << "soundPlayerTogglePlayPause} isPlaying=" << isPlaying_;
 	}
 
 	bool SpeechTranscriptionViewModel::soundPlayerIsPlaying() const
 	{
-		return isPlaying_;
+		return audioPlayer_ != nullptr && audioPlayer_->isPlaying();
 	}
 
 	long SpeechTranscriptionViewModel::playingSampleInd() const
@@ -611,6 +453,30 @@ namespace PticaGovorun
 		return phoneRulerVisible_;
 	}
 
+	bool SpeechTranscriptionViewModel::spectrogramVisible() const
+	{
+		return spectrogramVisible_;
+	}
+
+	void SpeechTranscriptionViewModel::toggleSpectrogramRequest()
+	{
+		spectrogramVisible_ = !spectrogramVisible_;
+		emit audioSamplesChanged();
+	}
+
+	void SpeechTranscriptionViewModel::toggleSpectrogramMelScaleRequest()
+	{
+		spectrogramTiles_.setMelScale(!spectrogramTiles_.melScale());
+		nextNotification(spectrogramTiles_.melScale() ? "Spectrogram: mel scale" : "Spectrogram: linear scale");
+		if (spectrogramVisible_)
+			emit audioSamplesChanged();
+	}
+
+	SpectrogramTileCache& SpeechTranscriptionViewModel::spectrogramTiles()
+	{
+		return spectrogramTiles_;
+	}
+
 	void SpeechTranscriptionViewModel::scrollDocumentEndRequest()
 	{
 		float maxDocWidth = docWidthPix();\
@@ -1621,6 +1487,48 @@ namespace PticaGovorun
 		std::string hmmPath = AppHelpers::mapPathStdString(QString("data/TrainSphinx/%1/model_parameters/persian.cd_cont_200").arg(sphinxModelDirName));
 		std::string langModelPath = AppHelpers::mapPathStdString(QString("data/TrainSphinx/%1/etc/persian_test.lm.DMP").arg(sphinxModelDirName));
 		std::string dictPath = AppHelpers::mapPathStdString(QString("data/TrainSphinx/%1/etc/persian_test.dic").arg(sphinxModelDirName));
+
+		auto showRecognizedSegment = [this, curSegBeg, curSegEnd](const QString& hypQStr, std::vector<AlignedWord> wordBoundaries)
+		{
+			DiagramSegment diagSeg;
+			diagSeg.SampleIndBegin = curSegBeg;
+			diagSeg.SampleIndEnd = curSegEnd;
+			diagSeg.RecogAlignedPhonemeSeqPadded = true;
+			diagSeg.RecogSegmentText = hypQStr;
+			diagSeg.WordBoundaries = std::move(wordBoundaries);
+			diagramSegments_.push_back(diagSeg);
+
+			// push the text to log so a user can copy it
+			nextNotification(hypQStr);
+
+			// redraw current segment
+			emit audioSamplesChanged();
+		};
+
+		// the segment, recognized earlier with the same model, is shown without running the decoder
+		std::wstring speechModelVerStr = sphinxModelVersionStr(AppHelpers::mapPath(QString("data/TrainSphinx/%1").arg(sphinxModelDirName)).toStdWString());
+		std::string decoderConfig;
+		appendFileFingerprint(langModelPath, decoderConfig);
+		appendFileFingerprint(dictPath, decoderConfig);
+		DecoderResultCache* decoderCache = decoderResultCache();
+		DecoderCacheKey cacheKey = makeDecoderCacheKey(audioSegmentBuffer_, audioSampleRate_, speechModelVerStr, decoderConfig);
+		DecodedResult decodedResult;
+		if (decoderCache != nullptr && !speechModelVerStr.empty() && decoderCache->find(cacheKey, decodedResult))
+		{
+			std::vector<AlignedWord> wordBoundaries;
+			for (const DecodedWord& word : decodedResult.Words)
+			{
+				AlignedWord wordBnds;
+				wordBnds.Name = QString::fromStdWString(word.Word);
+				wordBnds.BegSample = word.BegSample;
+				wordBnds.EndSample = word.EndSample;
+				wordBnds.Prob = word.Prob;
+				wordBoundaries.push_back(wordBnds);
+			}
+			showRecognizedSegment(QString::fromStdWString(decodedResult.Hypothesis), std::move(wordBoundaries));
+			return;
+		}
+
 		cmd_ln_t *config = SphinxConfig::pg_init_cmd_ln_t(hmmPath, langModelPath, dictPath, true, false, true, boost::string_view());
 		if (config == nullptr)
 			return;
@@ -1712,20 +1620,41 @@ namespace PticaGovorun
 
 		ps_free(ps);
 
-		//
-		DiagramSegment diagSeg;
-		diagSeg.SampleIndBegin = curSegBeg;
-		diagSeg.SampleIndEnd = curSegEnd;
-		diagSeg.RecogAlignedPhonemeSeqPadded = true;
-		diagSeg.RecogSegmentText = hypQStr;
-		diagSeg.WordBoundaries = std::move(wordBoundaries);
-		diagramSegments_.push_back(diagSeg);
+		if (decoderCache != nullptr && !speechModelVerStr.empty())
+		{
+			decodedResult.Hypothesis = hypWStr;
+			for (const AlignedWord& wordBnds : wordBoundaries)
+			{
+				DecodedWord word;
+				word.Word = wordBnds.Name.toStdWString();
+				word.BegSample = wordBnds.BegSample;
+				word.EndSample = wordBnds.EndSample;
+				word.Prob = wordBnds.Prob;
+				decodedResult.Words.push_back(word);
+			}
+			if (!decoderCache->put(cacheKey, decodedResult, &errMsg))
+				nextNotification(combineErrorMessages(errMsg));
+		}
 
-		// push the text to log so a user can copy it
-		nextNotification(hypQStr);
+		showRecognizedSegment(hypQStr, std::move(wordBoundaries));
+	}
 
-		// redraw current segment
-		emit audioSamplesChanged();
+	PticaGovorun::DecoderResultCache* SpeechTranscriptionViewModel::decoderResultCache()
+	{
+		using namespace PticaGovorun;
+		if (decoderResultCache_ == nullptr)
+		{
+			QString cachePath = AppHelpers::configParamQString("SphinxDecoderCachePath", AppHelpers::mapPath("decoderResults.cache"));
+			auto cache = std::make_unique<DecoderResultCache>();
+			ErrMsgList errMsg;
+			if (!cache->open(toBfs(cachePath), &errMsg))
+			{
+				nextNotification(combineErrorMessages(errMsg));
+				return nullptr;
+			}
+			decoderResultCache_ = std::move(cache);
+		}
+		return decoderResultCache_.get();
 	}
 #endif
 
@@ -1999,7 +1928,7 @@ namespace PticaGovorun
 		return silencePadAudioSamplesCount_;
 	}
 
-	void SpeechTranscriptionViewModel::chooseSpeechSegments(const QString& recipe, std::vector<short>& composedAudio)
+	void SpeechTranscriptionViewModel::chooseSpeechSegments(const QString& recipe, std::vector<std::pair<long, long>>& segRanges)
 	{
 		// Composition recipe format:
 		// characters after # signs are comments
@@ -2077,19 +2006,18 @@ namespace PticaGovorun
 
 			//
 			for (int i = 0; i < repeatTimes; ++i)
-				std::copy(std::begin(audioSamples_) + fromFrameInd, std::begin(audioSamples_) + toFrameInd,
-					std::back_inserter(composedAudio));
+				segRanges.push_back(std::make_pair(fromFrameInd, toFrameInd));
 		}
 	}
 
 	void SpeechTranscriptionViewModel::playComposingRecipeRequest(const QString& recipe)
 	{
-		composedAudio_.clear();
-		chooseSpeechSegments(recipe, composedAudio_);
+		std::vector<std::pair<long, long>> segRanges;
+		chooseSpeechSegments(recipe, segRanges);
 
 #if PG_HAS_PORTAUDIO
-		// play composed audio
-		soundPlayerPlay(composedAudio_.data(), 0, composedAudio_.size(), false);
+		// play composed audio; the segments are streamed from audio samples without copying
+		soundPlayerPlay(std::make_shared<SampleRangesPlaybackSource>(audioSamples_, std::move(segRanges)), false);
 #endif
 	}
 
@@ -7,10 +7,8 @@
 
 #include <QPoint>
 #include <QSize>
+#include <QTimer>
 #include <qevent.h>
-#if PG_HAS_PORTAUDIO
-#include <portaudio.h>
-#endif
 
 #include "XmlAudioMarkup.h"
 #include "JuliusToolNativeWrapper.h"
@@ -22,6 +20,9 @@
 #include "JuliusRecognizerProvider.h"
 #include "AppHelpers.h"
 #include "SphinxIf.h" // Sphinx impl of VAD
+#include "AudioPlaybackEngine.h"
+#include "SpectrogramTileCache.h"
+#include "DecoderResultCache.h"
 
 namespace PticaGovorun
 {
@@ -120,6 +121,7 @@ public:
 			void playingSampleIndChanged(long oldPlayingSampleInd);
 public:
 	SpeechTranscriptionViewModel();
+	~SpeechTranscriptionViewModel();
 	void init(std::shared_ptr<SharedServiceProvider> serviceProvider);
 
 	void loadAnnotAndAudioFileRequest();
@@ -130,10 +132,9 @@ public:
 
 #if PG_HAS_PORTAUDIO
 public:
-	// Plays the current segment of audio.
+	// Plays the source of samples.
 	// restoreCurFrameInd=true, if current frame must be restored when playing finishes.
-	// The audio samples to play must exist during the process of playing.
-	void soundPlayerPlay(const short* audioSouce, long startPlayingFrameInd, long finishPlayingFrameInd, bool restoreCurFrameInd);
+	void soundPlayerPlay(std::shared_ptr<PlaybackSource> source, bool restoreCurFrameInd);
 
 	void soundPlayerPlayCurrentSegment(SegmentStartFrameToPlayChoice startFrameChoice);
 	void soundPlayerPause();
@@ -149,30 +150,12 @@ public:
 	// updateViewportOffset is true to keep viewport above the playing caret.
 	void setPlayingSampleInd(long value, bool updateViewportOffset);
 private:
-	// Represents internal audio player's data.
-	// The range (StartPlayingFrameInd;FinishPlayingFrameInd) of frames is played.
-	struct SoundPlayerData
-	{
-		SpeechTranscriptionViewModel* transcriberViewModel;
-		const short* AudioSouce;
-		long CurPlayingFrameInd;
-
-#if PG_DEBUG
-		// used to restore cursor to initial position
-		long StartPlayingFrameInd; // is not changed when playing
-#endif
+	// Updates the playing sample from the player; called on timer while audio is playing.
+	void pollPlayingSampleInd();
 
-								   // used to determine when to stop playing
-		long FinishPlayingFrameInd; // is not changed when playing
-
-									// True to move the cursor to the last playing sample index when playing stops.
-		bool MoveCursorToLastPlayingPosition = false;
-
-		PaStream *stream;
-		std::atomic<bool> allowPlaying;
-	};
-	SoundPlayerData soundPlayerData_;
-	std::atomic<bool> isPlaying_ = false;
+	std::unique_ptr<AudioPlaybackEngine> audioPlayer_; // created on first play
+	QTimer playingSampleTimer_;
+	bool moveCursorToLastPlayingPosition_ = false; // true to move the cursor to the last playing sample index when playing stops
 	long playingSampleInd_ = PticaGovorun::NullSampleInd; // the plyaing sample or -1 if audio is not playing
 #else
 	bool soundPlayerIsPlaying() const { return false; }
@@ -206,6 +189,12 @@ public:
 
 	bool phoneRulerVisible() const;
 
+	// The spectrogram is drawn in the bottom half of each lane.
+	bool spectrogramVisible() const;
+	void toggleSpectrogramRequest();
+	void toggleSpectrogramMelScaleRequest();
+	SpectrogramTileCache& spectrogramTiles();
+
 	void scrollPageForwardRequest();
 	void scrollPageBackwardRequest();
 	void scrollDocumentStartRequest();
@@ -231,6 +220,8 @@ private:
 	// together with the samples graph is treated as the document
 	float docPaddingPix_ = 100;
 	bool phoneRulerVisible_ = false;
+	bool spectrogramVisible_ = false;
+	SpectrogramTileCache spectrogramTiles_;
 	QSizeF viewportSize_;
 
 public:
@@ -360,6 +351,9 @@ public:	// recongizer
 #endif
 #if PG_HAS_SPHINX
 	void recognizeCurrentSegmentSphinxRequest();
+	// Opens the cache on first request. Returns null if the cache can't be opened.
+	PticaGovorun::DecoderResultCache* decoderResultCache();
+	std::unique_ptr<PticaGovorun::DecoderResultCache> decoderResultCache_;
 #endif
 	/// Poerforms VAD (Voice Activity Detection) (speech/silence) on the current segment.
 	void uiToolVoiceActivityControlPanel(QKeyEvent* ke);
@@ -376,9 +370,10 @@ private:
 
 public: // segment composer
 	void playComposingRecipeRequest(const QString& recipe);
-	void chooseSpeechSegments(const QString& recipe, std::vector<short>& composedAudio);
+
+	// Collects the ranges [start;end) of samples to play according to the recipe.
+	void chooseSpeechSegments(const QString& recipe, std::vector<std::pair<long, long>>& segRanges);
 private:
-	std::vector<short> composedAudio_;
 
 	// string assiciated with the range of samples (cursor)
 	QString cursorTextToAlign_;
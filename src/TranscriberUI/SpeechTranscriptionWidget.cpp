@@ -1,6 +1,7 @@
 #include "SpeechTranscriptionWidget.h"
 #include "ui_SpeechTranscriptionWidget.h"
 #include <QDebug>
+#include <algorithm>
 #include "AppHelpers.h"
 #include "assertImpl.h"
 
@@ -297,10 +298,9 @@ namespace PticaGovorun
 		auto playingSampleInd = transcriberModel_->playingSampleInd();
 		if (oldPlayingSampleInd != PticaGovorun::NullSampleInd && playingSampleInd != PticaGovorun::NullSampleInd)
 		{
-			PG_DbgAssert2(oldPlayingSampleInd <= playingSampleInd, "Audio must be played forward?");
-
-			auto minSampleInd = oldPlayingSampleInd;
-			auto maxSampleInd = playingSampleInd;
+			// composed audio may jump backward
+			auto minSampleInd = std::min(oldPlayingSampleInd, playingSampleInd);
+			auto maxSampleInd = std::max(oldPlayingSampleInd, playingSampleInd);
 
 			auto leftX = transcriberModel_->sampleIndToDocPosX(minSampleInd);
 			auto rightX = transcriberModel_->sampleIndToDocPosX(maxSampleInd);
@@ -389,6 +389,13 @@ namespace PticaGovorun
 			transcriberModel_->deleteRequest(ke->modifiers().testFlag(Qt::ControlModifier));
 		else if (ke->key() == Qt::Key_T && ke->modifiers().testFlag(Qt::ControlModifier))
 			transcriberModel_->selectMarkerClosestToCurrentCursorRequest();
+		else if (ke->key() == Qt::Key_F7)
+		{
+			if (ke->modifiers().testFlag(Qt::ShiftModifier))
+				transcriberModel_->toggleSpectrogramMelScaleRequest();
+			else
+				transcriberModel_->toggleSpectrogramRequest();
+		}
 
 		// navigation
 		else if (ke->key() == Qt::Key_End && ke->modifiers().testFlag(Qt::ControlModifier))
@@ -50,10 +50,14 @@ int main(int argc, char *argv[])
 	}
 #endif
 	
-    PticaGovorun::AnnotationToolMainWindow w;
-    w.show();
+	int appExecOp;
+	{
+		// the window owns the audio player, which must be closed before PortAudio terminates
+		PticaGovorun::AnnotationToolMainWindow w;
+		w.show();
 
-	int appExecOp = a.exec();
+		appExecOp = a.exec();
+	}
 
 	//
 #if HAS_MATLAB